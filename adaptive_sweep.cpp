@@ -0,0 +1,197 @@
+#include "adaptive_sweep.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+SweepPoint::SweepPoint(const ExperimentSpec &spec, unsigned long batch_size, unsigned long seed)
+        : spec(spec), batch_size(batch_size) {
+    if (batch_size == 0) {
+        throw std::invalid_argument("A batch needs at least one collision");
+    }
+    ExperimentSpec uncapped = spec;
+    uncapped.event_budget = 0;
+    try {
+        simulation.reset(new Simulation(uncapped.make_simulation()));
+    } catch (const std::invalid_argument &ex) {
+        printf("Not running for bridge width %.2f and radius %.2f\n", spec.channel_width, spec.urn_radius);
+        return;
+    }
+    simulation->seed(seed);
+    simulation->start(spec.left_ratio);
+}
+
+void SweepPoint::advance(unsigned long num_batches) {
+    if (not simulation) {
+        return;
+    }
+    if (not transient_done) {
+        while (simulation->num_collisions < spec.M_t) {
+            simulation->update(0.0);
+        }
+        count_offset = simulation->current_counters;
+        time_offset = simulation->time;
+        transient_done = true;
+    }
+    const double weight = 1. / (double) batch_size;
+    for (unsigned long batch = 0; batch < num_batches; batch++) {
+        double mean = 0;
+        for (unsigned long collision = 0; collision < batch_size; collision++) {
+            simulation->update(0.0);
+            mean += weight * simulation->get_mass_spread();
+        }
+        batch_means.add(mean);
+    }
+}
+
+bool SweepPoint::is_valid() const {
+    return simulation != nullptr;
+}
+
+unsigned long SweepPoint::get_num_batches() const {
+    return batch_means.count();
+}
+
+unsigned long SweepPoint::get_num_collisions() const {
+    return simulation ? simulation->num_collisions : 0;
+}
+
+double SweepPoint::get_batch_variance() const {
+    return batch_means.variance();
+}
+
+double SweepPoint::get_standard_error() const {
+    return batch_means.standard_error();
+}
+
+ExperimentResult SweepPoint::get_result() const {
+    ExperimentResult result;
+    if (not simulation) {
+        result.valid = false;
+        return result;
+    }
+    result.mass_spread = batch_means.mean();
+    const double duration = simulation->time - time_offset;
+    for (unsigned int i = 0; i < 4 and transient_done; i++) {
+        result.currents.at(i) = duration > 0 ? (simulation->current_counters.at(i) - count_offset.at(i)) / duration : 0;
+    }
+    result.num_collisions = simulation->num_collisions;
+    result.time = simulation->time;
+    return result;
+}
+
+AdaptiveSweep::AdaptiveSweep(const std::vector<ExperimentSpec> &specs, unsigned long total_budget,
+                             unsigned long batch_size, unsigned long seed) : total_budget(total_budget) {
+    points.reserve(specs.size());
+    for (const ExperimentSpec &spec: specs) {
+        points.emplace_back(spec, batch_size, seed + points.size());
+    }
+}
+
+std::vector<unsigned long> AdaptiveSweep::allocate(const std::vector<double> &variances,
+                                                   const std::vector<unsigned long> &num_batches,
+                                                   unsigned long budget) {
+    if (variances.size() != num_batches.size()) {
+        throw std::invalid_argument("Every point needs a variance and a number of batches");
+    }
+    std::vector<unsigned long> allocation(variances.size(), 0);
+    auto gain = [&](unsigned long index) {
+        const double n = std::max(1., (double) (num_batches.at(index) + allocation.at(index)));
+        return variances.at(index) / n - variances.at(index) / (n + 1);
+    };
+    std::priority_queue<std::pair<double, unsigned long>> queue;
+    for (unsigned long index = 0; index < variances.size(); index++) {
+        if (variances.at(index) > 0) {
+            queue.emplace(gain(index), index);
+        }
+    }
+    for (unsigned long batch = 0; batch < budget and not queue.empty(); batch++) {
+        const unsigned long index = queue.top().second;
+        queue.pop();
+        allocation.at(index)++;
+        queue.emplace(gain(index), index);
+    }
+    return allocation;
+}
+
+void AdaptiveSweep::run(const std::function<void(unsigned long)> &progress) {
+    unsigned long pilot_cost = 0;
+    for (const SweepPoint &point: points) {
+        if (point.is_valid()) {
+            pilot_cost += point.spec.M_t + pilot_batches * point.batch_size;
+        }
+    }
+    if (pilot_cost > total_budget) {
+        throw std::invalid_argument("The budget of " + std::to_string(total_budget) +
+                                    " collisions does not cover the transients and pilot batches (" +
+                                    std::to_string(pilot_cost) + " collisions)");
+    }
+    std::vector<unsigned long> pilot(points.size());
+    for (unsigned long index = 0; index < points.size(); index++) {
+        pilot.at(index) = points.at(index).is_valid() ? pilot_batches : 0;
+    }
+    advance(pilot);
+    for (unsigned long round = 0; round < num_rounds; round++) {
+        const unsigned long batch_size = points.empty() ? 1 : points.front().batch_size;
+        const unsigned long spent = get_num_collisions();
+        const unsigned long left = spent < total_budget ? (total_budget - spent) / batch_size : 0;
+        std::vector<double> variances;
+        std::vector<unsigned long> num_batches;
+        for (const SweepPoint &point: points) {
+            variances.push_back(point.is_valid() ? point.get_batch_variance() : 0);
+            num_batches.push_back(point.get_num_batches());
+        }
+        advance(allocate(variances, num_batches, left / (num_rounds - round)));
+        if (progress) {
+            progress(round);
+        }
+    }
+}
+
+const std::vector<SweepPoint> &AdaptiveSweep::get_points() const {
+    return points;
+}
+
+unsigned long AdaptiveSweep::get_num_collisions() const {
+    unsigned long collisions = 0;
+    for (const SweepPoint &point: points) {
+        collisions += point.get_num_collisions();
+    }
+    return collisions;
+}
+
+std::string AdaptiveSweep::to_line(unsigned long index) const {
+    const SweepPoint &point = points.at(index);
+    std::ostringstream s;
+    s << point.get_result().to_line(point.spec) << "," << point.get_standard_error() << ","
+      << point.get_num_collisions();
+    return s.str();
+}
+
+void AdaptiveSweep::advance(const std::vector<unsigned long> &num_batches) {
+    std::atomic<unsigned long> next(0);
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    auto work = [&]() {
+        for (unsigned long index = next++; index < points.size(); index = next++) {
+            try {
+                points.at(index).advance(num_batches.at(index));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failure_mutex);
+                failure = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned thread = 0; thread < std::max(1u, num_threads); thread++) {
+        threads.emplace_back(work);
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef TERRIER_ADAPTIVE_SWEEP_H
+#define TERRIER_ADAPTIVE_SWEEP_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "experiment.h"
+#include "replicas.h"
+
+/**
+ * A sweep point that can be continued: it keeps its simulation between calls to `advance`
+ * and measures the mass spread in batches of `batch_size` collisions.
+ * The batch means are nearly independent if a batch is much longer than the correlation time of the mass spread,
+ * so their spread gives the standard error of the average.
+ */
+class SweepPoint {
+public:
+    /**
+     * @param spec Specification of the point. Its final time, event budget and deadline are not used.
+     * @param batch_size Number of collisions in a batch
+     * @param seed Seed of the simulation
+     */
+    SweepPoint(const ExperimentSpec &spec, unsigned long batch_size, unsigned long seed);
+
+    const ExperimentSpec spec;
+    const unsigned long batch_size;
+
+    /**
+     * Run the transient phase if that has not happened yet, then measure `num_batches` more batches.
+     * Does nothing for an invalid point.
+     */
+    void advance(unsigned long num_batches);
+
+    // False if the geometry of the spec is not valid
+    bool is_valid() const;
+
+    unsigned long get_num_batches() const;
+
+    // Collisions so far, including the transient phase
+    unsigned long get_num_collisions() const;
+
+    /**
+     * @return Sample variance of the batch means
+     */
+    double get_batch_variance() const;
+
+    /**
+     * @return Standard error of the mean mass spread, infinite for less than two batches
+     */
+    double get_standard_error() const;
+
+    /**
+     * @return Averages over all measured batches
+     */
+    ExperimentResult get_result() const;
+
+private:
+    std::unique_ptr<Simulation> simulation;
+    bool transient_done = false;
+    RunningStatistics batch_means;
+    std::vector<int> count_offset;
+    double time_offset = 0;
+};
+
+/**
+ * Spends a fixed budget of collisions on the points of a sweep, where it reduces the error most.
+ * After a pilot of `pilot_batches` batches per point, the rest of the budget is spent in `num_rounds` rounds.
+ * Each round hands out batches one by one to the point whose squared standard error drops most by it,
+ * which spends more events near the transition, where the mass spread fluctuates, than in the plateaus.
+ * The points continue from where they stopped, so no collisions are spent twice on a transient.
+ */
+class AdaptiveSweep {
+public:
+    /**
+     * @param specs Points of the sweep
+     * @param total_budget Collisions over all points, including the transients
+     * @param batch_size Number of collisions in a batch
+     * @param seed Point i is seeded with `seed + i`
+     */
+    AdaptiveSweep(const std::vector<ExperimentSpec> &specs, unsigned long total_budget,
+                  unsigned long batch_size = 10000, unsigned long seed = 0);
+
+    unsigned long pilot_batches = 4;
+    unsigned long num_rounds = 10;
+    unsigned num_threads = 1;
+
+    /**
+     * Hand out batches one by one to the point with the largest decrease in squared standard error,
+     * `variance / n - variance / (n + 1)` for a point with `n` batches.
+     * @param variances Variance of the batch means of every point
+     * @param num_batches Batches every point already has
+     * @param budget Number of batches to hand out
+     * @return Batches for every point
+     */
+    static std::vector<unsigned long> allocate(const std::vector<double> &variances,
+                                               const std::vector<unsigned long> &num_batches, unsigned long budget);
+
+    /**
+     * Run the pilot and all rounds. Throws `std::invalid_argument` if the budget does not cover the pilot.
+     * @param progress Optional callback, called after every round with the round number
+     */
+    void run(const std::function<void(unsigned long)> &progress = nullptr);
+
+    const std::vector<SweepPoint> &get_points() const;
+
+    // Collisions spent so far
+    unsigned long get_num_collisions() const;
+
+    /**
+     * Format the result of a point as in `ExperimentResult::to_line`,
+     * followed by the standard error of the mass spread and the number of collisions.
+     */
+    std::string to_line(unsigned long index) const;
+
+private:
+    void advance(const std::vector<unsigned long> &num_batches);
+
+    const unsigned long total_budget;
+    std::vector<SweepPoint> points;
+};
+
+#endif //TERRIER_ADAPTIVE_SWEEP_H
@@ -0,0 +1,205 @@
+#include "checkpoint.h"
+
+static const char MAGIC[4] = {'P', 'C', 'H', 'K'};
+static const uint32_t VERSION = 6;
+
+template<typename T>
+static void write_value(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+static void read_value(std::ifstream &file, T &value) {
+    if (not file.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+        throw std::invalid_argument("Checkpoint file ends prematurely");
+    }
+}
+
+template<typename T>
+static void write_vector(std::ofstream &file, const std::vector<T> &values) {
+    write_value(file, (uint64_t) values.size());
+    file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+template<typename T>
+static void read_vector(std::ifstream &file, std::vector<T> &values) {
+    uint64_t size;
+    read_value(file, size);
+    values.resize(size);
+    if (not file.read(reinterpret_cast<char *>(values.data()), size * sizeof(T))) {
+        throw std::invalid_argument("Checkpoint file ends prematurely");
+    }
+}
+
+CheckpointRing::CheckpointRing(unsigned long capacity, double interval) : capacity(capacity), interval(interval) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Checkpoint ring needs room for at least one checkpoint");
+    }
+    slots.resize(capacity);
+}
+
+CheckpointRing::CheckpointRing(const std::string &filename) : capacity(0), interval(0) {
+    std::ifstream file(filename, std::ios::binary);
+    if (not file) {
+        throw std::invalid_argument("Can not open checkpoint file " + filename);
+    }
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    uint32_t version = 0;
+    if (file) {
+        read_value(file, version);
+    }
+    if (not std::equal(magic, magic + 4, MAGIC) or version != VERSION) {
+        throw std::invalid_argument("Not a checkpoint file: " + filename);
+    }
+    read_value(file, parameters);
+    has_parameters = true;
+    read_value(file, interval);
+    uint64_t num_checkpoints;
+    read_value(file, num_checkpoints);
+    capacity = std::max((unsigned long) num_checkpoints, 1ul);
+    slots.resize(capacity);
+    for (count = 0; count < num_checkpoints; count++) {
+        SimulationState &state = slots[count];
+        read_value(file, state.time);
+        read_value(file, state.num_collisions);
+        read_value(file, state.in_left);
+        read_vector(file, state.current_counters);
+        read_vector(file, state.gate_capacities);
+        state.gate_contents.resize(2);
+        read_vector(file, state.gate_contents[0]);
+        read_vector(file, state.gate_contents[1]);
+        for (std::vector<double> *values: {&state.x_pos, &state.y_pos, &state.directions, &state.impact_times,
+                                           &state.next_x_pos, &state.next_y_pos, &state.next_directions,
+                                           &state.next_impact_times, &state.orbit_chords, &state.orbit_rotations}) {
+            read_vector(file, *values);
+        }
+        read_value(file, state.num_parked);
+        read_value(file, state.parked_collision_rate);
+        read_value(file, state.parked_collision_credit);
+        std::vector<char> rng_state;
+        read_vector(file, rng_state);
+        state.rng_state.assign(rng_state.begin(), rng_state.end());
+        read_value(file, state.common_random_numbers);
+        read_value(file, state.common_seed);
+        read_vector(file, state.common_draws);
+        read_vector(file, state.particle_ids);
+        read_vector(file, state.species);
+        state.species_gate_capacities.resize(2);
+        read_vector(file, state.species_gate_capacities[0]);
+        read_vector(file, state.species_gate_capacities[1]);
+        read_vector(file, state.species_in_left);
+        read_vector(file, state.species_current_counters);
+        read_vector(file, state.wall_segments);
+        read_vector(file, state.free_slots);
+        read_value(file, state.num_lost_injections);
+    }
+    next_slot = count % capacity;
+    if (count > 0) {
+        next_checkpoint_time = slots[count - 1].time + interval;
+    }
+}
+
+void CheckpointRing::take(const Simulation &simulation) {
+    simulation.save_state(slots[next_slot]);
+    next_slot = (next_slot + 1) % capacity;
+    count = std::min(count + 1, capacity);
+    next_checkpoint_time = simulation.time + interval;
+}
+
+const SimulationState *CheckpointRing::find(double t) const {
+    // Walk from the newest checkpoint back
+    for (unsigned long i = 1; i <= count; i++) {
+        const SimulationState &state = slots[(next_slot + capacity - i) % capacity];
+        if (state.time <= t) {
+            return &state;
+        }
+    }
+    return nullptr;
+}
+
+unsigned long CheckpointRing::size() const {
+    return count;
+}
+
+void CheckpointRing::write(const std::string &filename, const Simulation &simulation) const {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (not file) {
+        throw std::invalid_argument("Can not open checkpoint file " + filename);
+    }
+    Parameters run;
+    run.num_particles = simulation.num_particles;
+    run.bridge_width = simulation.bridge_width;
+    run.circle_radius = simulation.circle_radius;
+    // `setup` turns a channel length into a chamber distance; store what it started from
+    run.circle_distance = simulation.distance_as_channel_length ? simulation.bridge_length
+                                                                : simulation.circle_distance;
+    run.left_gate_capacity = simulation.left_gate_capacity;
+    run.right_gate_capacity = simulation.right_gate_capacity;
+    run.second_width = simulation.second_width;
+    run.second_length = simulation.second_length;
+    run.random_dir = simulation.explosion_direction_is_random;
+    run.flat_gate = simulation.gate_is_flat;
+    run.distance_as_channel_length = simulation.distance_as_channel_length;
+    run.park_trapped_orbits = simulation.park_trapped_orbits;
+    run.selective_explosions = simulation.selective_explosions;
+    run.trap_horizon = simulation.trap_horizon;
+    run.queue_type = simulation.queue_type;
+    run.renumber_interval = simulation.renumber_interval;
+    file.write(MAGIC, sizeof(MAGIC));
+    write_value(file, VERSION);
+    write_value(file, run);
+    write_value(file, interval);
+    write_value(file, (uint64_t) count);
+    for (unsigned long i = count; i > 0; i--) {
+        const SimulationState &state = slots[(next_slot + capacity - i) % capacity];
+        write_value(file, state.time);
+        write_value(file, state.num_collisions);
+        write_value(file, state.in_left);
+        write_vector(file, state.current_counters);
+        write_vector(file, state.gate_capacities);
+        write_vector(file, state.gate_contents[0]);
+        write_vector(file, state.gate_contents[1]);
+        for (const std::vector<double> *values: {&state.x_pos, &state.y_pos, &state.directions, &state.impact_times,
+                                                 &state.next_x_pos, &state.next_y_pos, &state.next_directions,
+                                                 &state.next_impact_times, &state.orbit_chords,
+                                                 &state.orbit_rotations}) {
+            write_vector(file, *values);
+        }
+        write_value(file, state.num_parked);
+        write_value(file, state.parked_collision_rate);
+        write_value(file, state.parked_collision_credit);
+        write_vector(file, std::vector<char>(state.rng_state.begin(), state.rng_state.end()));
+        write_value(file, state.common_random_numbers);
+        write_value(file, state.common_seed);
+        write_vector(file, state.common_draws);
+        write_vector(file, state.particle_ids);
+        write_vector(file, state.species);
+        write_vector(file, state.species_gate_capacities[0]);
+        write_vector(file, state.species_gate_capacities[1]);
+        write_vector(file, state.species_in_left);
+        write_vector(file, state.species_current_counters);
+        write_vector(file, state.wall_segments);
+        write_vector(file, state.free_slots);
+        write_value(file, state.num_lost_injections);
+    }
+}
+
+Simulation CheckpointRing::make_simulation() const {
+    if (not has_parameters) {
+        throw std::logic_error("Only checkpoint rings read from a file know their simulation parameters");
+    }
+    Simulation simulation(parameters.num_particles, parameters.bridge_width, parameters.circle_radius,
+                          parameters.circle_distance, parameters.left_gate_capacity, parameters.right_gate_capacity,
+                          parameters.random_dir, parameters.flat_gate);
+    simulation.second_width = parameters.second_width;
+    simulation.second_length = parameters.second_length;
+    simulation.distance_as_channel_length = parameters.distance_as_channel_length;
+    simulation.park_trapped_orbits = parameters.park_trapped_orbits;
+    simulation.selective_explosions = parameters.selective_explosions;
+    simulation.trap_horizon = parameters.trap_horizon;
+    simulation.queue_type = (EventQueue::Type) parameters.queue_type;
+    simulation.renumber_interval = parameters.renumber_interval;
+    simulation.setup();
+    return simulation;
+}
@@ -0,0 +1,156 @@
+#ifndef TERRIER_CHECKPOINT_H
+#define TERRIER_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+/**
+ * Dynamic state of a simulation between two events: everything `Simulation::update` needs to continue from there,
+ * including the state of the random number generator. Parameters and geometry are not part of it.
+ * Continuing from a restored state gives exactly the same events as the original run.
+ */
+struct SimulationState {
+    double time = 0;
+    unsigned long num_collisions = 0;
+    unsigned long in_left = 0;
+    std::vector<int> current_counters;
+    std::vector<int> gate_capacities;
+    std::vector<std::vector<unsigned long>> gate_contents;
+    std::vector<double> x_pos;
+    std::vector<double> y_pos;
+    std::vector<double> directions;
+    std::vector<double> impact_times;
+    std::vector<double> next_x_pos;
+    std::vector<double> next_y_pos;
+    std::vector<double> next_directions;
+    std::vector<double> next_impact_times;
+    std::vector<double> orbit_chords;
+    std::vector<double> orbit_rotations;
+    unsigned long num_parked = 0;
+    double parked_collision_rate = 0;
+    double parked_collision_credit = 0;
+    // Textual state of the Mersenne twister, as written by its stream operator
+    std::string rng_state;
+    // Streams of `Simulation::use_common_random_numbers`
+    bool common_random_numbers = false;
+    unsigned long common_seed = 0;
+    std::vector<unsigned long> common_draws;
+    // Id of every particle index, see `Simulation::renumber`
+    std::vector<unsigned long> particle_ids;
+    // Species, see `Simulation::set_species`
+    std::vector<uint8_t> species;
+    std::vector<std::vector<int>> species_gate_capacities;
+    std::vector<unsigned long> species_in_left;
+    std::vector<int> species_current_counters;
+    // Sources and sinks of an open system and its free slots, see `Simulation::add_source`
+    std::vector<WallSegment> wall_segments;
+    std::vector<unsigned long> free_slots;
+    unsigned long num_lost_injections = 0;
+};
+
+/**
+ * Ring of periodic checkpoints of a running simulation, so that an interesting window of a fast run
+ * (e.g. a polarisation switch) can be re-simulated afterwards with full trajectory output.
+ * Once the ring is full, the oldest checkpoint is overwritten. The slots are reused, so after the first round
+ * taking a checkpoint only copies the particle data.
+ *
+ *     CheckpointRing checkpoints(64, 10);
+ *     while (...) {
+ *         simulation.update(0);
+ *         checkpoints.record(simulation);
+ *     }
+ *     checkpoints.write("checkpoints.chk", simulation);
+ *
+ * The `replay` executable restores the latest checkpoint before a time window and re-simulates that window.
+ */
+class CheckpointRing {
+public:
+    /**
+     * @param capacity Maximum number of checkpoints kept
+     * @param interval Simulated time between two checkpoints
+     */
+    CheckpointRing(unsigned long capacity, double interval);
+
+    /**
+     * Read the parameters and checkpoints written by `write`.
+     * @param filename Name of the checkpoint file
+     */
+    explicit CheckpointRing(const std::string &filename);
+
+    /**
+     * Take a checkpoint if at least `interval` has passed since the last one. Cheap otherwise,
+     * so it can be called after every event.
+     * @param simulation Running simulation
+     */
+    void record(const Simulation &simulation) {
+        if (simulation.time >= next_checkpoint_time) {
+            take(simulation);
+        }
+    }
+
+    /**
+     * Take a checkpoint now.
+     * @param simulation Running simulation
+     */
+    void take(const Simulation &simulation);
+
+    /**
+     * @param t Time
+     * @return Latest checkpoint at or before `t`, `nullptr` if there is none
+     */
+    const SimulationState *find(double t) const;
+
+    /**
+     * @return Number of checkpoints in the ring
+     */
+    unsigned long size() const;
+
+    /**
+     * Write the parameters of the simulation and all checkpoints in the ring, oldest first.
+     * @param filename Name of the checkpoint file, overwritten if it exists
+     * @param simulation Simulation the checkpoints were taken from
+     */
+    void write(const std::string &filename, const Simulation &simulation) const;
+
+    /**
+     * Create a simulation with the parameters of the checkpointed run, set up but not started.
+     * Only available for rings that were read from a file.
+     * @return Simulation to restore a checkpoint in
+     */
+    Simulation make_simulation() const;
+
+private:
+    struct Parameters {
+        int num_particles = 0;
+        double bridge_width = 0;
+        double circle_radius = 0;
+        // Distance between the chambers as passed to the constructor, or the channel length
+        // if `distance_as_channel_length` is set
+        double circle_distance = 0;
+        int left_gate_capacity = 0;
+        int right_gate_capacity = 0;
+        double second_width = 0;
+        double second_length = 0;
+        bool random_dir = false;
+        bool flat_gate = false;
+        bool distance_as_channel_length = false;
+        bool park_trapped_orbits = false;
+        bool selective_explosions = false;
+        unsigned long trap_horizon = 0;
+        int queue_type = 0;
+        unsigned long renumber_interval = 0;
+    };
+
+    unsigned long capacity;
+    double interval;
+    double next_checkpoint_time = 0;
+    // Slot of the next checkpoint; the oldest checkpoint once the ring is full
+    unsigned long next_slot = 0;
+    unsigned long count = 0;
+    std::vector<SimulationState> slots;
+    Parameters parameters;
+    bool has_parameters = false;
+};
+
+#endif //TERRIER_CHECKPOINT_H
@@ -0,0 +1,7 @@
+#ifndef TERRIER_CONSTANTS_H
+#define TERRIER_CONSTANTS_H
+
+// Shared by the two- and three-dimensional simulations and the models built on their geometry
+const double PI = 3.14159265358979324;
+
+#endif //TERRIER_CONSTANTS_H
@@ -0,0 +1,42 @@
+#include <iostream>
+#include "correlator.h"
+#include "experiment.h"
+#include <string>
+
+/**
+ * This file contains an executable that measures the autocorrelation functions of `in_left` and the currents of a
+ * sweep point (see `TimeCorrelations`). After a transient of `M_t` collisions, it samples the simulation every `dt`
+ * time units up to `M_f` collisions and writes the correlation functions. It prints the integrated autocorrelation
+ * times and the mass spread with an error that accounts for the correlation between the samples.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) output file, (2) a sweep line, and optionally (3) the time between"
+                " two samples");
+    }
+    const ExperimentSpec spec = ExperimentSpec::from_line(argv[2]);
+    Simulation simulation = spec.make_simulation();
+    simulation.start(spec.left_ratio);
+    while (simulation.num_collisions < spec.M_t) {
+        simulation.update(0.0);
+    }
+    TimeCorrelations correlations(argc > 3 ? std::stod(argv[3]) : 0.1);
+    correlations.record(simulation);
+    while (simulation.num_collisions < spec.M_f) {
+        simulation.update(0.0);
+        correlations.record(simulation);
+    }
+    correlations.write(argv[1]);
+    printf("integrated times: in_left %.4f, currents %.4f %.4f %.4f %.4f\n",
+           correlations.get_integrated_time(TimeCorrelations::IN_LEFT),
+           correlations.get_integrated_time(TimeCorrelations::CURRENT),
+           correlations.get_integrated_time(TimeCorrelations::CURRENT + 1),
+           correlations.get_integrated_time(TimeCorrelations::CURRENT + 2),
+           correlations.get_integrated_time(TimeCorrelations::CURRENT + 3));
+    printf("mass spread %.4f +/- %.4f over %lu samples\n", correlations.get_mass_spread(),
+           correlations.get_mass_spread_error(),
+           correlations.get_correlator(TimeCorrelations::IN_LEFT).get_num_samples());
+    return 0;
+}
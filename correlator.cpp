@@ -0,0 +1,169 @@
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include "correlator.h"
+
+MultiTauCorrelator::MultiTauCorrelator(unsigned long points_per_level) : points_per_level(points_per_level) {
+    if (points_per_level < 2 or points_per_level % 2) {
+        throw std::invalid_argument("A multi-tau correlator needs an even number of points per level");
+    }
+}
+
+void MultiTauCorrelator::add(double value) {
+    if (num_samples == 0) {
+        offset = value;
+    }
+    num_samples++;
+    value -= offset;
+    sum += value;
+    sum_of_squares += value * value;
+    add_to_level(0, value);
+}
+
+void MultiTauCorrelator::add_to_level(unsigned long level, double value) {
+    if (level == levels.size()) {
+        levels.emplace_back();
+        levels.back().values.assign(points_per_level, 0);
+        levels.back().products.assign(points_per_level, 0);
+        levels.back().counts.assign(points_per_level, 0);
+    }
+    Level &current = levels[level];
+    current.head = (current.head + points_per_level - 1) % points_per_level;
+    current.values[current.head] = value;
+    current.num_values = std::min(current.num_values + 1, points_per_level);
+    // Lags below half the points of this level are covered by the level below
+    for (unsigned long lag = level == 0 ? 0 : points_per_level / 2; lag < current.num_values; lag++) {
+        current.products[lag] += value * current.values[(current.head + lag) % points_per_level];
+        current.counts[lag]++;
+    }
+    current.accumulator += value;
+    if (++current.num_accumulated == 2) {
+        const double average = current.accumulator / 2;
+        current.accumulator = 0;
+        current.num_accumulated = 0;
+        add_to_level(level + 1, average);
+    }
+}
+
+unsigned long MultiTauCorrelator::get_num_samples() const {
+    return num_samples;
+}
+
+double MultiTauCorrelator::mean() const {
+    return num_samples > 0 ? offset + sum / num_samples : 0;
+}
+
+double MultiTauCorrelator::variance() const {
+    if (num_samples == 0) {
+        return 0;
+    }
+    const double relative_mean = sum / num_samples;
+    return std::max(0., sum_of_squares / num_samples - relative_mean * relative_mean);
+}
+
+std::vector<unsigned long> MultiTauCorrelator::get_lags() const {
+    std::vector<unsigned long> lags;
+    for (unsigned long level = 0; level < levels.size(); level++) {
+        for (unsigned long lag = level == 0 ? 0 : points_per_level / 2; lag < points_per_level; lag++) {
+            if (levels[level].counts[lag] > 0) {
+                lags.push_back(lag << level);
+            }
+        }
+    }
+    return lags;
+}
+
+std::vector<double> MultiTauCorrelator::get_correlation() const {
+    std::vector<double> correlation;
+    const double relative_mean = num_samples > 0 ? sum / num_samples : 0;
+    const double var = variance();
+    for (unsigned long level = 0; level < levels.size(); level++) {
+        for (unsigned long lag = level == 0 ? 0 : points_per_level / 2; lag < points_per_level; lag++) {
+            const unsigned long count = levels[level].counts[lag];
+            if (count > 0) {
+                const double covariance = levels[level].products[lag] / count - relative_mean * relative_mean;
+                correlation.push_back(var > 0 ? covariance / var : 0);
+            }
+        }
+    }
+    return correlation;
+}
+
+double MultiTauCorrelator::get_integrated_time(double window) const {
+    const std::vector<unsigned long> lags = get_lags();
+    const std::vector<double> correlation = get_correlation();
+    // Trapezoidal rule, which is 1/2 + the sum of the correlations for lags one sample apart
+    double integral = 0;
+    for (unsigned long i = 1; i < lags.size(); i++) {
+        integral += (correlation[i - 1] + correlation[i]) / 2 * (lags[i] - lags[i - 1]);
+        if (lags[i] >= window * integral) {
+            break;
+        }
+    }
+    return std::max(integral, 0.5);
+}
+
+double MultiTauCorrelator::get_standard_error() const {
+    return num_samples > 0 ? std::sqrt(variance() * 2 * get_integrated_time() / num_samples) : 0;
+}
+
+TimeCorrelations::TimeCorrelations(double dt, unsigned long points_per_level)
+        : dt(dt), correlators(NUM_SIGNALS, MultiTauCorrelator(points_per_level)) {
+    if (dt <= 0) {
+        throw std::invalid_argument("The time between two samples should be positive");
+    }
+}
+
+void TimeCorrelations::take_samples(const Simulation &simulation) {
+    if (not started) {
+        started = true;
+        num_particles = simulation.num_particles;
+        next_sample = simulation.time + dt;
+        std::copy(simulation.current_counters.begin(), simulation.current_counters.end(), sampled_counters);
+        return;
+    }
+    // Until the latest event, the simulation was in the state of the previous one
+    while (next_sample <= simulation.time) {
+        correlators[IN_LEFT].add(in_left);
+        for (unsigned i = 0; i < 4; i++) {
+            correlators[CURRENT + i].add((counters[i] - sampled_counters[i]) / dt);
+            sampled_counters[i] = counters[i];
+        }
+        next_sample += dt;
+    }
+}
+
+const MultiTauCorrelator &TimeCorrelations::get_correlator(unsigned signal) const {
+    return correlators.at(signal);
+}
+
+double TimeCorrelations::get_integrated_time(unsigned signal) const {
+    return get_correlator(signal).get_integrated_time() * dt;
+}
+
+double TimeCorrelations::get_mass_spread() const {
+    return num_particles > 0 ? (num_particles - 2 * correlators[IN_LEFT].mean()) / num_particles : 0;
+}
+
+double TimeCorrelations::get_mass_spread_error() const {
+    return num_particles > 0 ? 2 * correlators[IN_LEFT].get_standard_error() / num_particles : 0;
+}
+
+void TimeCorrelations::write(const std::string &filename) const {
+    std::ofstream file(filename);
+    if (not file) {
+        throw std::invalid_argument("Can not open correlation file " + filename);
+    }
+    const std::vector<unsigned long> lags = correlators[IN_LEFT].get_lags();
+    std::vector<std::vector<double>> correlations;
+    for (const MultiTauCorrelator &correlator: correlators) {
+        correlations.push_back(correlator.get_correlation());
+    }
+    for (unsigned long i = 0; i < lags.size(); i++) {
+        file << lags[i] * dt;
+        for (const std::vector<double> &correlation: correlations) {
+            file << " " << correlation[i];
+        }
+        file << "\n";
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef TERRIER_CORRELATOR_H
+#define TERRIER_CORRELATOR_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+/**
+ * Online autocorrelation of an evenly sampled series over lags that span many decades, in O(log T) memory:
+ * the multi-tau scheme. Level 0 correlates the last `points_per_level` samples; every next level does the same
+ * with averages of two values of the level below, so its lags are twice as long and twice as coarse.
+ * The lags of level l > 0 are j 2^l for j from `points_per_level` / 2 to `points_per_level` - 1.
+ */
+class MultiTauCorrelator {
+public:
+    /**
+     * @param points_per_level Number of lags per level, even
+     */
+    explicit MultiTauCorrelator(unsigned long points_per_level = 16);
+
+    void add(double value);
+
+    unsigned long get_num_samples() const;
+
+    double mean() const;
+
+    double variance() const;
+
+    /**
+     * @return Lags with a correlation estimate, in samples, increasing
+     */
+    std::vector<unsigned long> get_lags() const;
+
+    /**
+     * @return Normalised autocorrelation at each lag of `get_lags`, 1 at lag 0
+     */
+    std::vector<double> get_correlation() const;
+
+    /**
+     * Integrated autocorrelation time: the integral of the autocorrelation over the lags, up to Sokal's window,
+     * the first lag that exceeds `window` times the integral so far. Half a sample for an uncorrelated series.
+     * @param window Length of the window in units of the integrated time
+     * @return Integrated autocorrelation time, in samples
+     */
+    double get_integrated_time(double window = 6) const;
+
+    /**
+     * @return Standard error of the mean, from the variance and the integrated autocorrelation time
+     */
+    double get_standard_error() const;
+
+private:
+    struct Level {
+        // Last values of the level, newest at `head`
+        std::vector<double> values;
+        unsigned long head = 0;
+        unsigned long num_values = 0;
+        std::vector<double> products;
+        std::vector<unsigned long> counts;
+        double accumulator = 0;
+        unsigned long num_accumulated = 0;
+    };
+
+    void add_to_level(unsigned long level, double value);
+
+    const unsigned long points_per_level;
+    std::vector<Level> levels;
+    unsigned long num_samples = 0;
+    // Values are correlated relative to the first one, which keeps the products small for series with a large mean
+    double offset = 0;
+    double sum = 0;
+    double sum_of_squares = 0;
+};
+
+/**
+ * Autocorrelation of `in_left` and of the currents of a simulation (see `Simulation::current_counters`),
+ * sampled every `dt` time units. `in_left` is sampled as it is at the sample time; a current as the number of
+ * crossings since the previous sample divided by `dt`. Feed it after every event:
+ *
+ *     TimeCorrelations correlations(0.1);
+ *     while (...) {
+ *         simulation.update(0);
+ *         correlations.record(simulation);
+ *     }
+ *     correlations.write("correlations.dat");
+ */
+class TimeCorrelations {
+public:
+    enum Signal {
+        IN_LEFT = 0,
+        // The currents, in the order of `Simulation::current_counters`
+        CURRENT = 1
+    };
+    static const unsigned NUM_SIGNALS = 5;
+
+    /**
+     * @param dt Time between two samples
+     * @param points_per_level See `MultiTauCorrelator`
+     */
+    explicit TimeCorrelations(double dt, unsigned long points_per_level = 16);
+
+    /**
+     * Take the samples up to the time of the latest event. The first call only starts the sampling.
+     * Cheap if no sample is due, so it can be called after every event.
+     * @param simulation Running simulation
+     */
+    void record(const Simulation &simulation) {
+        if (simulation.time >= next_sample) {
+            take_samples(simulation);
+        }
+        in_left = simulation.in_left;
+        std::copy(simulation.current_counters.begin(), simulation.current_counters.end(), counters);
+    }
+
+    /**
+     * @param signal IN_LEFT, or CURRENT + the index of a current counter
+     */
+    const MultiTauCorrelator &get_correlator(unsigned signal) const;
+
+    /**
+     * @param signal IN_LEFT, or CURRENT + the index of a current counter
+     * @return Integrated autocorrelation time, in time units
+     */
+    double get_integrated_time(unsigned signal) const;
+
+    /**
+     * @return Time average of the mass spread over the samples (see `Simulation::get_mass_spread`)
+     */
+    double get_mass_spread() const;
+
+    /**
+     * @return Standard error of `get_mass_spread`, which accounts for the correlation between the samples
+     */
+    double get_mass_spread_error() const;
+
+    /**
+     * Write the correlation functions: a line per lag, with the lag in time units and the autocorrelation of
+     * `in_left` and the four currents.
+     * @param filename Name of the file, overwritten if it exists
+     */
+    void write(const std::string &filename) const;
+
+    const double dt;
+
+private:
+    void take_samples(const Simulation &simulation);
+
+    std::vector<MultiTauCorrelator> correlators;
+    bool started = false;
+    double next_sample = 0;
+    unsigned long num_particles = 0;
+    // State after the previous event, which holds up to the time of the latest event
+    unsigned long in_left = 0;
+    int counters[4] = {0, 0, 0, 0};
+    int sampled_counters[4] = {0, 0, 0, 0};
+};
+
+#endif //TERRIER_CORRELATOR_H
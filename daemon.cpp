@@ -0,0 +1,356 @@
+#include "daemon.h"
+#include <cstring>
+#include <iomanip>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Milliseconds between checks whether the daemon is stopping
+static const int POLL_INTERVAL = 50;
+
+DaemonJob DaemonJob::from_line(const std::string &line) {
+    DaemonJob job;
+    std::istringstream stream(line);
+    stream >> job.id >> job.num_particles >> job.bridge_width >> job.circle_radius >> job.circle_distance
+           >> job.left_gate_capacity >> job.right_gate_capacity >> job.random_dir >> job.flat_gate
+           >> job.distance_as_channel_length >> job.left_ratio >> job.max_collisions >> job.max_time >> job.seed;
+    std::string rest;
+    if (stream.fail() or stream >> rest) {
+        throw std::invalid_argument("Malformed job: " + line);
+    }
+    return job;
+}
+
+std::string DaemonJob::to_line() const {
+    std::ostringstream s;
+    s << std::setprecision(17) << id << " " << num_particles << " " << bridge_width << " " << circle_radius << " "
+      << circle_distance << " " << left_gate_capacity << " " << right_gate_capacity << " " << random_dir << " "
+      << flat_gate << " " << distance_as_channel_length << " " << left_ratio << " " << max_collisions << " "
+      << max_time << " " << seed;
+    return s.str();
+}
+
+bool DaemonJob::has_same_geometry(const DaemonJob &other) const {
+    return num_particles == other.num_particles and bridge_width == other.bridge_width and
+           circle_radius == other.circle_radius and circle_distance == other.circle_distance and
+           left_gate_capacity == other.left_gate_capacity and right_gate_capacity == other.right_gate_capacity and
+           random_dir == other.random_dir and flat_gate == other.flat_gate and
+           distance_as_channel_length == other.distance_as_channel_length;
+}
+
+DaemonResult DaemonResult::from_line(const std::string &line) {
+    DaemonResult result;
+    std::istringstream stream(line);
+    std::string status;
+    stream >> result.id >> status;
+    if (status == "ok") {
+        stream >> result.time >> result.num_collisions >> result.in_left >> result.mass_spread;
+    } else if (status == "error") {
+        std::getline(stream >> std::ws, result.error);
+    }
+    if (stream.fail() or (status != "ok" and status != "error")) {
+        throw std::invalid_argument("Malformed result: " + line);
+    }
+    return result;
+}
+
+std::string DaemonResult::to_line() const {
+    std::ostringstream s;
+    s << std::setprecision(17) << id;
+    if (error.empty()) {
+        s << " ok " << time << " " << num_collisions << " " << in_left << " " << mass_spread;
+    } else {
+        std::string message = error;
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        s << " error " << message;
+    }
+    return s.str();
+}
+
+DaemonResult run_daemon_job(const DaemonJob &job, std::unique_ptr<Simulation> &simulation, DaemonJob &last_job) {
+    DaemonResult result;
+    result.id = job.id;
+    if (job.max_collisions == 0 and job.max_time <= 0) {
+        result.error = "Job needs a collision or time limit";
+        return result;
+    }
+    try {
+        if (not simulation or not job.has_same_geometry(last_job)) {
+            simulation.reset();
+            std::unique_ptr<Simulation> created(
+                    new Simulation(job.num_particles, job.bridge_width, job.circle_radius, job.circle_distance,
+                                   job.left_gate_capacity, job.right_gate_capacity, job.random_dir, job.flat_gate));
+            created->distance_as_channel_length = job.distance_as_channel_length;
+            created->setup();
+            simulation = std::move(created);
+            last_job = job;
+        }
+        if (job.seed != 0) {
+            simulation->seed(job.seed);
+        }
+        simulation->start(job.left_ratio);
+        while ((job.max_collisions == 0 or simulation->num_collisions < job.max_collisions) and
+               (job.max_time <= 0 or simulation->time < job.max_time)) {
+            simulation->update(0);
+        }
+        result.time = simulation->time;
+        result.num_collisions = simulation->num_collisions;
+        result.in_left = simulation->in_left;
+        result.mass_spread = simulation->get_mass_spread();
+    } catch (const std::exception &e) {
+        // The simulation may be in any state
+        simulation.reset();
+        result.error = e.what();
+    }
+    return result;
+}
+
+SimulationDaemon::Connection::Connection(int fd) : fd(fd) {
+}
+
+SimulationDaemon::Connection::~Connection() {
+    close(fd);
+}
+
+void SimulationDaemon::Connection::send_line(const std::string &line) {
+    const std::string text = line + "\n";
+    std::lock_guard<std::mutex> lock(write_mutex);
+    std::size_t sent = 0;
+    while (sent < text.size()) {
+        const ssize_t count = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return; // The client is gone
+        }
+        sent += count;
+    }
+}
+
+SimulationDaemon::SimulationDaemon(const std::string &socket_path, unsigned num_workers)
+        : socket_path(socket_path),
+          num_workers(num_workers > 0 ? num_workers : std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+SimulationDaemon::~SimulationDaemon() {
+    stop();
+}
+
+void SimulationDaemon::start() {
+    if (running) {
+        return;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path too long: " + socket_path);
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        throw std::runtime_error("Can not create daemon socket");
+    }
+    unlink(socket_path.c_str());
+    if (bind(server, (sockaddr *) &address, sizeof(address)) != 0 or listen(server, 64) != 0) {
+        close(server);
+        throw std::runtime_error("Can not listen on " + socket_path);
+    }
+    running = true;
+    for (unsigned worker = 0; worker < num_workers; worker++) {
+        workers.emplace_back(&SimulationDaemon::work_loop, this);
+    }
+    acceptor = std::thread(&SimulationDaemon::accept_loop, this, server);
+}
+
+void SimulationDaemon::stop() {
+    if (not running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        running = false;
+    }
+    queue_condition.notify_all();
+    acceptor.join();
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+    workers.clear();
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        for (Reader &reader: readers) {
+            reader.thread.join();
+        }
+        readers.clear();
+    }
+    queue.clear();
+    unlink(socket_path.c_str());
+}
+
+unsigned long SimulationDaemon::get_jobs_done() const {
+    return jobs_done;
+}
+
+unsigned long SimulationDaemon::get_simulations_created() const {
+    return simulations_created;
+}
+
+unsigned long SimulationDaemon::get_num_readers() {
+    std::lock_guard<std::mutex> lock(readers_mutex);
+    return readers.size();
+}
+
+void SimulationDaemon::accept_loop(int server) {
+    while (running) {
+        pollfd listener{server, POLLIN, 0};
+        if (poll(&listener, 1, POLL_INTERVAL) <= 0) {
+            continue;
+        }
+        const int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        // Join the readers of closed connections, so a long-running daemon does not pile them up
+        for (auto reader = readers.begin(); reader != readers.end();) {
+            if (*reader->done) {
+                reader->thread.join();
+                reader = readers.erase(reader);
+            } else {
+                reader++;
+            }
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        readers.push_back({std::thread(&SimulationDaemon::read_loop, this, std::make_shared<Connection>(client), done),
+                           done});
+    }
+    close(server);
+}
+
+void SimulationDaemon::read_loop(std::shared_ptr<Connection> connection, std::shared_ptr<std::atomic<bool>> done) {
+    std::string buffer;
+    char chunk[4096];
+    while (running) {
+        pollfd request{connection->fd, POLLIN, 0};
+        if (poll(&request, 1, POLL_INTERVAL) <= 0) {
+            continue;
+        }
+        const ssize_t count = recv(connection->fd, chunk, sizeof(chunk), 0);
+        if (count <= 0) {
+            break; // The client has closed its side; results still go out over the connection
+        }
+        buffer.append(chunk, count);
+        std::size_t begin = 0;
+        std::size_t end;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            while ((end = buffer.find('\n', begin)) != std::string::npos) {
+                if (end > begin) {
+                    queue.push_back({buffer.substr(begin, end - begin), connection});
+                }
+                begin = end + 1;
+            }
+        }
+        queue_condition.notify_all();
+        buffer.erase(0, begin);
+    }
+    *done = true;
+}
+
+void SimulationDaemon::work_loop() {
+    std::unique_ptr<Simulation> simulation;
+    DaemonJob last_job;
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this]() {
+                return not running or not queue.empty();
+            });
+            if (not running) {
+                return;
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        DaemonResult result;
+        try {
+            const DaemonJob job = DaemonJob::from_line(task.line);
+            if (not simulation or not job.has_same_geometry(last_job)) {
+                simulations_created++;
+            }
+            result = run_daemon_job(job, simulation, last_job);
+        } catch (const std::invalid_argument &e) {
+            std::istringstream(task.line) >> result.id;
+            result.error = e.what();
+        }
+        task.connection->send_line(result.to_line());
+        jobs_done++;
+    }
+}
+
+DaemonClient::DaemonClient(const std::string &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path too long: " + socket_path);
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 or connect(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Can not connect to the daemon at " + socket_path);
+    }
+}
+
+DaemonClient::~DaemonClient() {
+    close(fd);
+}
+
+void DaemonClient::submit(const DaemonJob &job) {
+    const std::string text = job.to_line() + "\n";
+    std::size_t sent = 0;
+    while (sent < text.size()) {
+        const ssize_t count = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            throw std::runtime_error("Connection to the daemon closed");
+        }
+        sent += count;
+    }
+}
+
+DaemonResult DaemonClient::receive() {
+    std::size_t end;
+    while ((end = buffer.find('\n')) == std::string::npos) {
+        char chunk[4096];
+        const ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+        if (count <= 0) {
+            throw std::runtime_error("Connection to the daemon closed");
+        }
+        buffer.append(chunk, count);
+    }
+    const std::string line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return DaemonResult::from_line(line);
+}
+
+std::vector<DaemonResult> DaemonClient::run(const std::vector<DaemonJob> &jobs) {
+    std::unordered_map<unsigned long, std::size_t> positions;
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+        positions[jobs[i].id] = i;
+    }
+    if (positions.size() != jobs.size()) {
+        throw std::invalid_argument("Job ids should be unique");
+    }
+    for (const DaemonJob &job: jobs) {
+        submit(job);
+    }
+    std::vector<DaemonResult> results(jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+        DaemonResult result = receive();
+        results.at(positions.at(result.id)) = result;
+    }
+    return results;
+}
@@ -0,0 +1,199 @@
+#ifndef TERRIER_DAEMON_H
+#define TERRIER_DAEMON_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "simulation.h"
+
+/**
+ * A short run of the two-chamber model, as sent to the simulation daemon.
+ * On the wire, a job is one line of whitespace separated values in the order of the fields below.
+ */
+struct DaemonJob {
+    // Chosen by the client, returned with the result
+    unsigned long id = 0;
+    int num_particles = 100;
+    double bridge_width = 0.3;
+    double circle_radius = 1;
+    double circle_distance = 0.5;
+    int left_gate_capacity = 3;
+    int right_gate_capacity = 3;
+    bool random_dir = false;
+    bool flat_gate = false;
+    bool distance_as_channel_length = false;
+    double left_ratio = 0.5;
+    // The run stops at whichever limit comes first; zero means no limit, but at least one is required
+    unsigned long max_collisions = 0;
+    double max_time = 0;
+    // Seed of the random number generator, zero for a random seed
+    unsigned long seed = 0;
+
+    /**
+     * Parse a job line. Throws `std::invalid_argument` if the line is malformed.
+     * @param line Line without trailing newline
+     * @return Job
+     */
+    static DaemonJob from_line(const std::string &line);
+
+    std::string to_line() const;
+
+    /**
+     * @param other Another job
+     * @return true if both jobs run in the same geometry, so that they can share a simulation
+     */
+    bool has_same_geometry(const DaemonJob &other) const;
+};
+
+/**
+ * State of the simulation at the end of a job, or the reason it could not run.
+ * On the wire: `<id> ok <time> <num_collisions> <in_left> <mass_spread>` or `<id> error <message>`.
+ */
+struct DaemonResult {
+    unsigned long id = 0;
+    double time = 0;
+    unsigned long num_collisions = 0;
+    unsigned long in_left = 0;
+    double mass_spread = 0;
+    // Empty if the job ran
+    std::string error;
+
+    static DaemonResult from_line(const std::string &line);
+
+    std::string to_line() const;
+};
+
+/**
+ * Run a job, reusing `simulation` if it has been set up for a job with the same geometry.
+ * Otherwise, a new simulation is created in its place and `last_job` is updated.
+ * Errors in the job are reported in the result.
+ * @param job Job
+ * @param simulation Simulation of the previous job on this thread, may be empty
+ * @param last_job Job the simulation was created for
+ * @return Result
+ */
+DaemonResult run_daemon_job(const DaemonJob &job, std::unique_ptr<Simulation> &simulation, DaemonJob &last_job);
+
+/**
+ * Long-lived server for many short runs. Listens on a Unix domain socket; every line a client sends is a job,
+ * which is run on a pool of warm worker threads. Each worker keeps its last simulation and reuses it for the next
+ * job with the same geometry. Results are streamed back on the connection of the job as soon as they are done,
+ * so they may arrive in a different order than the jobs were sent.
+ */
+class SimulationDaemon {
+public:
+    /**
+     * @param socket_path Path of the socket. An existing file at this path is replaced.
+     * @param num_workers Number of worker threads, zero for one per hardware thread
+     */
+    explicit SimulationDaemon(const std::string &socket_path, unsigned num_workers = 0);
+
+    ~SimulationDaemon();
+
+    /**
+     * Start listening and start the workers.
+     */
+    void start();
+
+    /**
+     * Stop accepting jobs, drop the jobs that have not started, finish the running ones and remove the socket.
+     */
+    void stop();
+
+    unsigned long get_jobs_done() const;
+
+    /**
+     * @return Number of simulations that had to be created, because no warm one with the same geometry was available
+     */
+    unsigned long get_simulations_created() const;
+
+    /**
+     * @return Number of reader threads not joined yet. Readers of closed connections are joined on the next accept.
+     */
+    unsigned long get_num_readers();
+
+    const std::string socket_path;
+    const unsigned num_workers;
+
+private:
+    struct Connection {
+        explicit Connection(int fd);
+
+        ~Connection();
+
+        void send_line(const std::string &line);
+
+        const int fd;
+        std::mutex write_mutex;
+    };
+
+    struct Task {
+        std::string line;
+        std::shared_ptr<Connection> connection;
+    };
+
+    struct Reader {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void accept_loop(int server);
+
+    void read_loop(std::shared_ptr<Connection> connection, std::shared_ptr<std::atomic<bool>> done);
+
+    void work_loop();
+
+    std::atomic<bool> running{false};
+    std::thread acceptor;
+    std::vector<std::thread> workers;
+    std::mutex readers_mutex;
+    std::vector<Reader> readers;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    std::deque<Task> queue;
+    std::atomic<unsigned long> jobs_done{0};
+    std::atomic<unsigned long> simulations_created{0};
+};
+
+/**
+ * Connection to a simulation daemon.
+ *
+ *     DaemonClient client("particular.sock");
+ *     std::vector<DaemonResult> results = client.run(jobs);
+ */
+class DaemonClient {
+public:
+    explicit DaemonClient(const std::string &socket_path);
+
+    ~DaemonClient();
+
+    DaemonClient(const DaemonClient &) = delete;
+
+    DaemonClient &operator=(const DaemonClient &) = delete;
+
+    void submit(const DaemonJob &job);
+
+    /**
+     * Wait for the next result of any submitted job.
+     * @return Result
+     */
+    DaemonResult receive();
+
+    /**
+     * Submit all jobs and wait for their results. The ids of the jobs should be unique.
+     * @param jobs Jobs
+     * @return Results, in the order of the jobs
+     */
+    std::vector<DaemonResult> run(const std::vector<DaemonJob> &jobs);
+
+private:
+    int fd;
+    std::string buffer;
+};
+
+#endif //TERRIER_DAEMON_H
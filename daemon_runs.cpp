@@ -0,0 +1,32 @@
+#include <iostream>
+#include <csignal>
+#include "daemon.h"
+#include <string>
+
+/**
+ * This file contains an executable that serves short runs over a Unix domain socket, see `SimulationDaemon`.
+ * It runs until it is interrupted. Clients connect with `DaemonClient`, or write job lines to the socket directly,
+ * e.g. with `socat - UNIX-CONNECT:particular.sock`.
+ */
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void interrupt(int) {
+    interrupted = 1;
+}
+
+int main(int argc, char *argv[]) {
+    const std::string socket_path = argc > 1 ? argv[1] : "particular.sock";
+    const unsigned num_threads = argc > 2 ? std::stoi(argv[2]) : 0;
+    std::signal(SIGINT, interrupt);
+    std::signal(SIGTERM, interrupt);
+    SimulationDaemon daemon(socket_path, num_threads);
+    daemon.start();
+    printf("Listening on %s with %u workers\n", socket_path.c_str(), daemon.num_workers);
+    while (not interrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    daemon.stop();
+    printf("Stopped after %lu jobs\n", daemon.get_jobs_done());
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <memory>
 #include "simulation.h"
+#include "experiment.h"
 #include <string>
 
 /**
@@ -26,39 +27,27 @@
  * @param M_f Final time, measured in number of collisions
  * @param av_chi Average mass spread, return value
  * @param currents Average currents counted per instance, return value
+ * @param backend Name of the backend the run selected, see `select_backend`, return value
  */
 void get_mass_spread(double channel_length, double channel_width, int threshold, double radius, double second_length,
              double second_width, int num_particles, double left_ratio, unsigned long M_t, unsigned long M_f,
-             double &av_chi, std::vector<double> &currents) {
-    Simulation sim = Simulation(num_particles, channel_width, radius, channel_length, threshold, threshold);
-    sim.gate_is_flat = true;
-    sim.distance_as_channel_length = true;
-    sim.expected_collisions = M_f;
-    sim.second_length = second_length;
-    sim.second_width = second_width;
-    sim.setup();
-    std::ostringstream s;
-    av_chi = 0;
-    try {
-        sim.start(left_ratio);
-    } catch (const std::invalid_argument &ex) {
-        printf("Not running for bridge width %.2f and radius %.2f, returning 0\n", channel_width, radius);
-    }
-
-    while (sim.num_collisions < M_t) {
-        sim.update(0.0);
-    }
-    const double weight = 1. / (double) (M_f - M_t);
-    const std::vector<int> count_offset = sim.current_counters;
-    const double time_offset = sim.time;
-    while (sim.num_collisions < M_f) {
-        sim.update(0.0);
-        av_chi += weight * sim.get_mass_spread();
-    }
-    currents.resize(4);
-    for (unsigned int i = 0; i < 4; i++) {
-        currents.at(i) = (sim.current_counters.at(i) - count_offset.at(i)) / (sim.time - time_offset);
-    }
+             double &av_chi, std::vector<double> &currents, std::string &backend) {
+    ExperimentSpec spec;
+    spec.channel_length = channel_length;
+    spec.channel_width = channel_width;
+    spec.threshold = threshold;
+    spec.urn_radius = radius;
+    spec.second_length = second_length;
+    spec.second_width = second_width;
+    spec.num_particles = num_particles;
+    spec.left_ratio = left_ratio;
+    spec.M_t = M_t;
+    spec.M_f = M_f;
+    spec.auto_backend = true;
+    const ExperimentResult result = run_experiment(spec);
+    av_chi = result.mass_spread;
+    currents = result.currents;
+    backend = result.backend.name();
 }
 
 /**
@@ -156,14 +145,15 @@ void mass_spread_and_current_for(int argc, char *argv[]) {
     const std::string sim_id = argv[12];
     double av_chi = 0;
     std::vector<double> currents;
+    std::string backend;
     get_mass_spread(channel_length, channel_width, threshold, radius, second_length, second_width, num_particles,
-            initial_ratio, M_t, M_f, av_chi, currents);
+            initial_ratio, M_t, M_f, av_chi, currents, backend);
     std::ostringstream s;
     s << sim_id << "," << av_chi;
     for (unsigned int i = 0; i < 4; i++) {
         s << ", " << currents.at(i);
     }
-    s << std::endl;
+    s << ", " << backend << std::endl;
     std::ofstream result_file(file_id + ".out", std::ios::app);
     result_file << s.str();
     result_file.close();
@@ -0,0 +1,185 @@
+#include "event_queue.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+
+EventQueue::EventQueue(Type type) : type(type) {
+}
+
+void EventQueue::build(const std::vector<double> &times) {
+    order.resize(times.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&times](unsigned long i1, unsigned long i2) {
+        return times[i1] < times[i2];
+    });
+    if (type == BINARY_HEAP) {
+        // A sorted array is a valid heap
+        position.resize(times.size());
+        for (unsigned long index = 0; index < order.size(); index++) {
+            position[order[index]] = index;
+        }
+    }
+}
+
+unsigned long EventQueue::top() const {
+    return order[0];
+}
+
+void EventQueue::relabel(const std::vector<unsigned long> &new_indices) {
+    for (unsigned long &particle: order) {
+        particle = new_indices[particle];
+    }
+    if (type == BINARY_HEAP) {
+        for (unsigned long index = 0; index < order.size(); index++) {
+            position[order[index]] = index;
+        }
+    }
+}
+
+unsigned long EventQueue::size() const {
+    return order.size();
+}
+
+EventQueue::Type EventQueue::get_type() const {
+    return type;
+}
+
+void EventQueue::update(unsigned long particle, const std::vector<double> &times, bool was_top) {
+    if (type == SORTED_VECTOR) {
+        if (was_top) {
+            order.erase(order.begin());
+        } else {
+            order.erase(order.begin() + find_index(particle, times));
+        }
+        insert_sorted(particle, times);
+    } else {
+        const unsigned long index = position[particle];
+        if (index > 0 and times[particle] < times[order[(index - 1) / 2]]) {
+            sift_up(index, times);
+        } else {
+            sift_down(index, times);
+        }
+    }
+}
+
+void EventQueue::update_front(const unsigned long *particles, const double *new_times, unsigned long count,
+                              std::vector<double> &times) {
+    if (type == SORTED_VECTOR) {
+        for (unsigned long i = 0; i < count; i++) {
+            times[particles[i]] = new_times[i];
+        }
+        // Inserting one by one puts a particle before all equal times, so with ties the last one goes first
+        batch.assign(particles, particles + count);
+        std::reverse(batch.begin(), batch.end());
+        std::stable_sort(batch.begin(), batch.end(), [&times](unsigned long i1, unsigned long i2) {
+            return times[i1] < times[i2];
+        });
+        merged.resize(order.size());
+        std::merge(batch.begin(), batch.end(), order.begin() + count, order.end(), merged.begin(),
+                   [&times](unsigned long i1, unsigned long i2) {
+                       return times[i1] < times[i2];
+                   });
+        order.swap(merged);
+    } else {
+        // The heap needs the old times of the rest of the batch while sifting
+        for (unsigned long i = 0; i < count; i++) {
+            times[particles[i]] = new_times[i];
+            update(particles[i], times, true);
+        }
+    }
+}
+
+void EventQueue::get_front(unsigned long count, const std::vector<double> &times,
+                           std::vector<unsigned long> &particles) const {
+    count = std::min(count, (unsigned long) order.size());
+    particles.clear();
+    if (type == SORTED_VECTOR) {
+        particles.assign(order.begin(), order.begin() + count);
+    } else {
+        // Best-first walk through the heap
+        typedef std::pair<double, unsigned long> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> frontier;
+        if (count > 0) {
+            frontier.emplace(times[order[0]], 0);
+        }
+        while (particles.size() < count) {
+            const unsigned long index = frontier.top().second;
+            frontier.pop();
+            particles.push_back(order[index]);
+            for (unsigned long child = 2 * index + 1; child <= 2 * index + 2 and child < order.size(); child++) {
+                frontier.emplace(times[order[child]], child);
+            }
+        }
+    }
+}
+
+unsigned long EventQueue::find_index(unsigned long particle, const std::vector<double> &times) const {
+    auto it = std::find(order.begin(), order.end(), particle);
+    if (it != order.end()) {
+        return std::distance(order.begin(), it);
+    } else {
+        // Throw error if sorting goes wrong. Sorting does not go wrong.
+        printf("Lost particle %lu running on time %.2f, %lu sorts present\n", particle, times[particle], order.size());
+        std::ofstream file;
+        file.open("sorted_indices.txt");
+        for (unsigned long index:order) {
+            file << index << std::endl;
+        }
+        file.close();
+        throw std::invalid_argument("Particle not found. Sorting mechanism fails");
+    }
+}
+
+void EventQueue::insert_sorted(unsigned long particle, const std::vector<double> &times) {
+    const double &impact_time = times[particle];
+    unsigned long l = 0;
+    unsigned long r = order.size();
+    while (l < r) {
+        unsigned long m = (l + r) / 2;
+        if (times[order[m]] < impact_time) {
+            l = m + 1;
+        } else {
+            r = m;
+        }
+    }
+    order.insert(order.begin() + l, particle);
+}
+
+void EventQueue::swap_entries(unsigned long a, unsigned long b) {
+    std::swap(order[a], order[b]);
+    position[order[a]] = a;
+    position[order[b]] = b;
+}
+
+void EventQueue::sift_up(unsigned long index, const std::vector<double> &times) {
+    while (index > 0) {
+        const unsigned long parent = (index - 1) / 2;
+        if (not(times[order[index]] < times[order[parent]])) {
+            break;
+        }
+        swap_entries(index, parent);
+        index = parent;
+    }
+}
+
+void EventQueue::sift_down(unsigned long index, const std::vector<double> &times) {
+    const unsigned long n = order.size();
+    while (true) {
+        const unsigned long left = 2 * index + 1;
+        if (left >= n) {
+            break;
+        }
+        unsigned long smallest = left;
+        if (left + 1 < n and times[order[left + 1]] < times[order[left]]) {
+            smallest = left + 1;
+        }
+        if (not(times[order[smallest]] < times[order[index]])) {
+            break;
+        }
+        swap_entries(index, smallest);
+        index = smallest;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef TERRIER_EVENT_QUEUE_H
+#define TERRIER_EVENT_QUEUE_H
+
+#include <vector>
+
+/**
+ * Priority queue of particle indices, ordered by their next impact time.
+ * The times themselves are owned by the engine and passed in on every call,
+ * so the queue stays valid when the engine is copied.
+ *
+ * Two implementations are available:
+ *  - `SORTED_VECTOR` keeps all indices sorted. Popping the minimum and reinserting it is a binary search and a
+ *    memmove, which is very fast for up to a few thousand particles. Updating an arbitrary particle needs a linear
+ *    search.
+ *  - `BINARY_HEAP` is an indexed binary heap. Every update is logarithmic, which pays off for large systems and
+ *    for frequent updates of arbitrary particles (gate explosions).
+ * Particles with equal times may come out in a different order in the two implementations.
+ */
+class EventQueue {
+public:
+    enum Type {
+        SORTED_VECTOR, BINARY_HEAP
+    };
+
+    explicit EventQueue(Type type = SORTED_VECTOR);
+
+    /**
+     * (Re)build the queue with all indices of `times`.
+     * @param times Next impact time of each particle
+     */
+    void build(const std::vector<double> &times);
+
+    /**
+     * @return Index of the particle with the earliest time
+     */
+    unsigned long top() const;
+
+    /**
+     * Restore the order after the time of a particle has changed.
+     * @param particle Particle index
+     * @param times Next impact time of each particle, with the new time for `particle`
+     * @param was_top Whether the particle was at the top of the queue before its time changed
+     */
+    void update(unsigned long particle, const std::vector<double> &times, bool was_top = false);
+
+    /**
+     * Give the earliest particles new, later times and restore the order.
+     * Equivalent to setting the new time and calling `update(particle, times, true)` for each of them in turn,
+     * provided every new time is later than all old times in the batch. The sorted vector merges the batch in one pass.
+     * @param particles The earliest particles, in queue order
+     * @param new_times New time of each of these particles
+     * @param count Number of particles
+     * @param times Next impact time of each particle, to be updated with the new times
+     */
+    void update_front(const unsigned long *particles, const double *new_times, unsigned long count,
+                      std::vector<double> &times);
+
+    /**
+     * Collect the particles with the earliest times, in order.
+     * @param count Maximum number of particles
+     * @param times Next impact time of each particle
+     * @param particles Output
+     */
+    void get_front(unsigned long count, const std::vector<double> &times, std::vector<unsigned long> &particles) const;
+
+    /**
+     * Follow a renumbering of the particles. The order of the queue, including that of equal times, is kept.
+     * @param new_indices New index of every particle, by old index
+     */
+    void relabel(const std::vector<unsigned long> &new_indices);
+
+    unsigned long size() const;
+
+    Type get_type() const;
+
+private:
+    unsigned long find_index(unsigned long particle, const std::vector<double> &times) const;
+
+    void insert_sorted(unsigned long particle, const std::vector<double> &times);
+
+    void sift_up(unsigned long index, const std::vector<double> &times);
+
+    void sift_down(unsigned long index, const std::vector<double> &times);
+
+    void swap_entries(unsigned long a, unsigned long b);
+
+    Type type;
+    // Sorted indices, or the heap array
+    std::vector<unsigned long> order;
+    // Position of each particle in the heap array (heap only)
+    std::vector<unsigned long> position;
+    // Buffers for batch updates of the sorted vector
+    std::vector<unsigned long> batch;
+    std::vector<unsigned long> merged;
+};
+
+#endif //TERRIER_EVENT_QUEUE_H
@@ -1,5 +1,6 @@
 #include <iostream>
 #include "simulation.h"
+#include "replicas.h"
 #include <string>
 
 /*
@@ -8,6 +9,9 @@
  * Of note is mostly the unicorn() target, which clearly displays the polarisation effect of the gate.
  */
 
+// Relative standard error of the mean at which the replicated examinations stop early
+const double REPLICA_PRECISION = 0.005;
+
 void write_results(std::string &id, std::vector<double> &data) {
     std::ofstream results_file;
     results_file.open(id + ".txt");
@@ -32,10 +36,13 @@ void many_particle_animation() {
     }
 }
 
-double get_cool_down_time(int number_of_particles, int gate_capacity) {
+double get_cool_down_time(int number_of_particles, int gate_capacity, unsigned long seed = 0) {
     Simulation simulation = Simulation(number_of_particles, 0.3);
     simulation.left_gate_capacity = gate_capacity;
     simulation.right_gate_capacity = 0;
+    if (seed != 0) {
+        simulation.seed(seed);
+    }
     simulation.setup();
     simulation.start(0);
     // simulation.write_positions_to_file(0);
@@ -45,25 +52,31 @@ double get_cool_down_time(int number_of_particles, int gate_capacity) {
     return simulation.time;
 }
 
+/**
+ * Average cool-down time over independent replicas, run in parallel until the mean is precise enough.
+ */
+ReplicaResult get_cool_down_times(int number_of_particles, int gate_capacity, unsigned long max_repeats) {
+    ReplicaRunner runner;
+    runner.max_replicas = max_repeats;
+    runner.relative_precision = REPLICA_PRECISION;
+    return runner.run([=](unsigned long replica, std::vector<double> &observables) {
+        observables[0] = get_cool_down_time(number_of_particles, gate_capacity, replica + 1);
+    });
+}
+
 double test_parameters(int number_of_particles, int gate_capacity) {
     int repeats = 10000;
-    double total_time = 0;
-    for (int i = 0; i < repeats; i++) {
-        total_time += get_cool_down_time(number_of_particles, gate_capacity);
-    }
-    return total_time / repeats;
+    return get_cool_down_times(number_of_particles, gate_capacity, repeats).statistics[0].mean();
 }
 
 void get_exit_range_times(int max_num_particles, int gate_capacity) {
     int repeats = 50000;
     for (int i = 0; i < 39; i++) {
-        double total_time = 0;
         int number_of_particles = max_num_particles - i * 10;
-        for (int r = 0; r < repeats; r++) {
-            total_time += get_cool_down_time(number_of_particles, gate_capacity);
-        }
-        total_time /= repeats;
-        printf("Number of particles: %d\tCooldown time %.5f\n", number_of_particles, total_time);
+        const ReplicaResult result = get_cool_down_times(number_of_particles, gate_capacity, repeats);
+        printf("Number of particles: %d\tCooldown time %.5f\t(+- %.5f, median %.5f, 90%% %.5f, %lu runs)\n",
+               number_of_particles, result.statistics[0].mean(), result.statistics[0].standard_error(),
+               result.sketches[0].quantile(0.5), result.sketches[0].quantile(0.9), result.num_replicas);
     }
 }
 
@@ -108,21 +121,24 @@ void find_gate(int start_particles, int end_particle) {
     for (int i = 0; i < (end_particle - start_particles) / step; i++) {
         int number_of_particles = start_particles + i * step;
         int num_repeats = 100;
-        double total_time = 0;
-        for (int rep = 0; rep < num_repeats; rep++) {
+        ReplicaRunner runner;
+        runner.max_replicas = num_repeats;
+        runner.relative_precision = REPLICA_PRECISION;
+        const ReplicaResult result = runner.run([=](unsigned long replica, std::vector<double> &observables) {
             Simulation simulation = Simulation(number_of_particles, bridge_width);
             simulation.left_gate_capacity = gate_capacity;
             simulation.right_gate_capacity = gate_capacity;
+            simulation.seed(replica + 1);
             simulation.setup();
             simulation.start(0.5);
-            int diff = 0;
-            while (diff < number_of_particles * 0.95 and simulation.time < 10000) {
+            while (std::fabs(simulation.get_mass_spread()) < 0.95 and simulation.time < 10000) {
                 simulation.update(0.0);
             }
-            total_time += simulation.time;
-        }
-        total_time /= num_repeats;
-        printf("Number of particles: %d therm_time %.2f\n", number_of_particles, total_time);
+            observables[0] = simulation.time;
+        });
+        printf("Number of particles: %d therm_time %.2f (+- %.2f, median %.2f, %lu runs)\n", number_of_particles,
+               result.statistics[0].mean(), result.statistics[0].standard_error(), result.sketches[0].quantile(0.5),
+               result.num_replicas);
     }
 
 }
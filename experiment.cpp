@@ -0,0 +1,258 @@
+#include <chrono>
+#include "experiment.h"
+
+// Smallest system in which `select_backend` tries renumbering
+static const unsigned long MIN_RENUMBERED_PARTICLES = 10000;
+
+std::string Backend::name() const {
+    std::ostringstream s;
+    s << (queue_type == EventQueue::BINARY_HEAP ? "binary_heap" : "sorted_vector") << "/";
+    if (window_size > 0) {
+        s << "window" << window_size;
+    } else {
+        s << "serial";
+    }
+    if (renumber_interval > 0) {
+        s << "/renumber" << renumber_interval;
+    }
+    return s.str();
+}
+
+Backend Backend::from_name(const std::string &name) {
+    std::vector<std::string> parts;
+    std::istringstream stream(name);
+    std::string part;
+    while (std::getline(stream, part, '/')) {
+        parts.push_back(part);
+    }
+    Backend backend;
+    const auto is_number = [](const std::string &digits) {
+        return not digits.empty() and digits.find_first_not_of("0123456789") == std::string::npos;
+    };
+    if (parts.size() < 2 or parts.size() > 3 or (parts[0] != "sorted_vector" and parts[0] != "binary_heap")) {
+        throw std::invalid_argument("Not a backend: " + name);
+    }
+    backend.queue_type = parts[0] == "binary_heap" ? EventQueue::BINARY_HEAP : EventQueue::SORTED_VECTOR;
+    if (parts[1].compare(0, 6, "window") == 0 and is_number(parts[1].substr(6))) {
+        backend.window_size = std::stoul(parts[1].substr(6));
+    } else if (parts[1] != "serial") {
+        throw std::invalid_argument("Not a backend: " + name);
+    }
+    if (parts.size() == 3) {
+        if (parts[2].compare(0, 8, "renumber") != 0 or not is_number(parts[2].substr(8))) {
+            throw std::invalid_argument("Not a backend: " + name);
+        }
+        backend.renumber_interval = std::stoul(parts[2].substr(8));
+    }
+    return backend;
+}
+
+void Backend::apply(Simulation &simulation) const {
+    simulation.queue_type = queue_type;
+    if (window_size > 0) {
+        simulation.window_size = window_size;
+    }
+    simulation.renumber_interval = renumber_interval;
+}
+
+ExperimentSpec ExperimentSpec::from_line(const std::string &line) {
+    std::istringstream stream(line);
+    std::vector<std::string> words;
+    std::string word;
+    while (stream >> word) {
+        words.push_back(word);
+    }
+    ExperimentSpec spec;
+    if (words.size() == 8) {
+        spec.single_channel = true;
+        spec.channel_length = std::stod(words[0]);
+        spec.channel_width = std::stod(words[1]);
+        spec.urn_radius = std::stod(words[2]);
+        spec.threshold = (int) std::stod(words[3]);
+        spec.num_particles = (int) std::stod(words[4]);
+        spec.M_t = (unsigned long) std::stod(words[5]);
+        spec.M_f = (unsigned long) std::stod(words[6]);
+    } else if (words.size() == 11) {
+        spec.channel_length = std::stod(words[0]);
+        spec.channel_width = std::stod(words[1]);
+        spec.threshold = (int) std::stod(words[2]);
+        spec.urn_radius = std::stod(words[3]);
+        spec.second_length = std::stod(words[4]);
+        spec.second_width = std::stod(words[5]);
+        spec.num_particles = (int) std::stod(words[6]);
+        spec.left_ratio = std::stod(words[7]);
+        spec.M_t = (unsigned long) std::stod(words[8]);
+        spec.M_f = (unsigned long) std::stod(words[9]);
+    } else {
+        throw std::invalid_argument("Sweep line should have 8 (single channel) or 11 (double channel) values: " + line);
+    }
+    spec.identifier = words.back();
+    spec.tokens.assign(words.begin(), words.end() - 1);
+    return spec;
+}
+
+std::vector<ExperimentSpec> ExperimentSpec::read_sweep(std::istream &stream) {
+    std::vector<ExperimentSpec> specs;
+    std::string line;
+    while (std::getline(stream, line)) {
+        const std::size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos or line[first] == '#') {
+            continue;
+        }
+        specs.push_back(from_line(line));
+    }
+    return specs;
+}
+
+std::vector<ExperimentSpec> ExperimentSpec::read_sweep_file(const std::string &filename) {
+    std::ifstream file(filename);
+    if (not file) {
+        throw std::invalid_argument("Can not open sweep file " + filename);
+    }
+    return read_sweep(file);
+}
+
+Simulation ExperimentSpec::make_simulation() const {
+    Simulation sim = Simulation(num_particles, channel_width, urn_radius, channel_length, threshold, threshold);
+    sim.gate_is_flat = true;
+    sim.distance_as_channel_length = true;
+    sim.expected_collisions = M_f;
+    sim.second_length = second_length;
+    sim.second_width = second_width;
+    sim.event_budget = event_budget;
+    backend.apply(sim);
+    sim.setup();
+    if (seed > 0) {
+        sim.seed(seed);
+    }
+    return sim;
+}
+
+std::string ExperimentResult::to_line(const ExperimentSpec &spec) const {
+    std::ostringstream s;
+    for (const std::string &token: spec.tokens) {
+        s << token << ",";
+    }
+    if (spec.single_channel) {
+        s << std::fabs(mass_spread);
+    } else {
+        s << mass_spread;
+        for (double current: currents) {
+            s << "," << current;
+        }
+    }
+    s << "," << backend.name() << "," << truncated;
+    return s.str();
+}
+
+/**
+ * Process the events of a started simulation up to `end` collisions with a backend, or until its budget runs out.
+ * If `mass_spread` is given, `weight` times the mass spread after every event is added to it, in the same order
+ * with every backend.
+ */
+static void run_until(Simulation &sim, const Backend &backend, unsigned long end, double weight, double *mass_spread,
+                      const std::function<void(unsigned long)> &progress) {
+    std::vector<unsigned long> in_left_trace;
+    while (sim.num_collisions < end and sim.has_budget_left()) {
+        const unsigned long start = sim.num_collisions;
+        if (backend.window_size == 0) {
+            sim.update(0.0);
+            if (mass_spread) {
+                *mass_spread += weight * sim.get_mass_spread();
+            }
+        } else {
+            // One window per budget check, without passing the event budget
+            unsigned long max_events = std::min(backend.window_size, end - start);
+            if (sim.event_budget > 0) {
+                max_events = std::min(max_events, sim.event_budget - start);
+            }
+            in_left_trace.clear();
+            sim.update_window(max_events, mass_spread ? &in_left_trace : nullptr);
+            const auto num_active = (double) sim.get_num_active();
+            for (unsigned long in_left: in_left_trace) {
+                *mass_spread += weight * (num_active > 0 ? (num_active - 2. * in_left) / num_active : 0);
+            }
+        }
+        if (progress and start / PROGRESS_INTERVAL != sim.num_collisions / PROGRESS_INTERVAL) {
+            progress(sim.num_collisions);
+        }
+    }
+}
+
+Backend select_backend(const ExperimentSpec &spec) {
+    const auto num_particles = (unsigned long) spec.num_particles;
+    std::vector<Backend> candidates;
+    for (EventQueue::Type queue_type: {EventQueue::SORTED_VECTOR, EventQueue::BINARY_HEAP}) {
+        for (unsigned long window_size: {0ul, 64ul, 256ul}) {
+            for (unsigned long renumber_interval: {0ul, 4 * num_particles}) {
+                if (window_size > num_particles or
+                    (renumber_interval > 0 and num_particles < MIN_RENUMBERED_PARTICLES)) {
+                    continue;
+                }
+                Backend candidate;
+                candidate.queue_type = queue_type;
+                candidate.window_size = window_size;
+                candidate.renumber_interval = renumber_interval;
+                candidates.push_back(candidate);
+            }
+        }
+    }
+    // Every backend warms up for a quarter of the events it is timed for
+    const unsigned long num_events = std::max(BACKEND_CALIBRATION_EVENTS, 4 * num_particles);
+    if (num_events / 4 * 5 * candidates.size() > spec.M_f / 10) {
+        return spec.backend;
+    }
+    Backend fastest;
+    for (Backend &candidate: candidates) {
+        ExperimentSpec trial = spec;
+        trial.backend = candidate;
+        trial.event_budget = 0;
+        Simulation sim = trial.make_simulation();
+        sim.start(spec.left_ratio);
+        run_until(sim, candidate, num_events / 4, 0, nullptr, nullptr);
+        const auto clock_start = std::chrono::steady_clock::now();
+        run_until(sim, candidate, num_events / 4 + num_events, 0, nullptr, nullptr);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+        candidate.events_per_second = num_events / std::max(seconds, 1E-9);
+        if (candidate.events_per_second > fastest.events_per_second) {
+            fastest = candidate;
+        }
+    }
+    return fastest;
+}
+
+ExperimentResult run_experiment(const ExperimentSpec &spec, const std::function<void(unsigned long)> &progress) {
+    ExperimentResult result;
+    std::unique_ptr<Simulation> sim;
+    try {
+        sim.reset(new Simulation(spec.make_simulation()));
+        result.backend = spec.auto_backend ? select_backend(spec) : spec.backend;
+        result.backend.apply(*sim);
+        sim->start(spec.left_ratio);
+    } catch (const std::invalid_argument &ex) {
+        printf("Not running for bridge width %.2f and radius %.2f, returning 0\n", spec.channel_width,
+               spec.urn_radius);
+        result.valid = false;
+        return result;
+    }
+    sim->set_deadline(spec.time_limit);
+    run_until(*sim, result.backend, spec.M_t, 0, nullptr, progress);
+    const double weight = 1. / (double) (spec.M_f - spec.M_t);
+    const std::vector<int> count_offset = sim->current_counters;
+    const double time_offset = sim->time;
+    const unsigned long measure_offset = sim->num_collisions;
+    run_until(*sim, result.backend, spec.M_f, weight, &result.mass_spread, progress);
+    result.truncated = sim->truncated;
+    if (result.truncated) {
+        // Renormalise the average to the collisions that were actually measured
+        const unsigned long measured = sim->num_collisions - measure_offset;
+        result.mass_spread = measured > 0 ? result.mass_spread * (double) (spec.M_f - spec.M_t) / measured : 0;
+    }
+    for (unsigned int i = 0; i < 4; i++) {
+        const double duration = sim->time - time_offset;
+        result.currents.at(i) = duration > 0 ? (sim->current_counters.at(i) - count_offset.at(i)) / duration : 0;
+    }
+    result.num_collisions = sim->num_collisions;
+    result.time = sim->time;
+    return result;
+}
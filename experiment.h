@@ -0,0 +1,162 @@
+#ifndef TERRIER_EXPERIMENT_H
+#define TERRIER_EXPERIMENT_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+/**
+ * How a run processes its events: the event queue, serial `Simulation::update` or batched
+ * `Simulation::update_window`, and periodic renumbering. All backends process exactly the same events in the same
+ * order and give the same results; they only differ in speed, see `select_backend`.
+ */
+struct Backend {
+    EventQueue::Type queue_type = EventQueue::SORTED_VECTOR;
+    // Events inspected at once by `Simulation::update_window`, zero to process them one by one with `update`
+    unsigned long window_size = 0;
+    // See `Simulation::renumber_interval`
+    unsigned long renumber_interval = 0;
+    // Events per second of wall-clock time measured by `select_backend`, zero if not measured
+    double events_per_second = 0;
+
+    /**
+     * @return Name such as `sorted_vector/serial` or `binary_heap/window64/renumber4000`, without commas
+     */
+    std::string name() const;
+
+    /**
+     * Parse a name returned by `name`, to rerun a point with the backend recorded in its output.
+     * Throws `std::invalid_argument` if the name is not valid.
+     * @param name Name of a backend
+     * @return Backend
+     */
+    static Backend from_name(const std::string &name);
+
+    /**
+     * Set up a simulation to use this backend; the queue takes effect on the next call to `start`.
+     */
+    void apply(Simulation &simulation) const;
+};
+
+/**
+ * A single point in a parameter sweep: the parameters of one mass spread/current measurement,
+ * as they appear on a line of the `.in` files created by `create_single_channel_batch.py`
+ * and `create_double_channel_batch.py`.
+ */
+struct ExperimentSpec {
+    double channel_length = 1;
+    double channel_width = 0.3;
+    double urn_radius = 1;
+    int threshold = 3;
+    double second_length = 0;
+    double second_width = 0;
+    int num_particles = 1000;
+    double left_ratio = 0.75;
+    unsigned long M_t = 0;
+    unsigned long M_f = 0;
+    // Limits of the run, zero means unlimited. See `Simulation::event_budget` and `Simulation::set_deadline`.
+    unsigned long event_budget = 0;
+    double time_limit = 0;
+    // Seed of the run, zero to draw one from the random device
+    unsigned long seed = 0;
+    // Backend of the run. With `auto_backend`, `run_experiment` replaces it by the fastest one, see `select_backend`
+    Backend backend;
+    bool auto_backend = false;
+    // Whether the spec comes from a single channel sweep (reports the absolute mass spread only)
+    bool single_channel = false;
+    // File identifier, last token of the line
+    std::string identifier;
+    // The parameter tokens as they were read, for reporting
+    std::vector<std::string> tokens;
+
+    /**
+     * Parse a line of a sweep file. Lines with 8 tokens are single channel points:
+     * (1) channel length, (2) width, (3) urn radius, (4) threshold, (5) number of particles,
+     * (6) transient time, (7) final time, (8) identifier.
+     * Lines with 11 tokens are double channel points:
+     * (1) channel length, (2) channel width, (3) threshold, (4) urn radius, (5) second channel length,
+     * (6) second channel width, (7) number of particles, (8) initial ratio, (9) transient time, (10) final time,
+     * (11) identifier
+     * @param line Line of a sweep file
+     * @return Parsed specification
+     */
+    static ExperimentSpec from_line(const std::string &line);
+
+    /**
+     * Read all points of a sweep, skipping empty lines and lines starting with `#`.
+     * @param stream Contents of one or more `.in` files
+     * @return Specifications in order
+     */
+    static std::vector<ExperimentSpec> read_sweep(std::istream &stream);
+
+    /**
+     * Read all points of a sweep file.
+     * @param filename Name of the `.in` file
+     * @return Specifications in file order
+     */
+    static std::vector<ExperimentSpec> read_sweep_file(const std::string &filename);
+
+    /**
+     * Create a simulation for this point that has been set up, but not started, with `backend` applied.
+     * Throws `std::invalid_argument` if the geometry is not valid.
+     * @return Simulation
+     */
+    Simulation make_simulation() const;
+};
+
+/**
+ * Measured quantities of a single point.
+ */
+struct ExperimentResult {
+    // Average mass spread between the transient and the final time
+    double mass_spread = 0;
+    // Average currents, see `Simulation::current_counters`
+    std::vector<double> currents = std::vector<double>(4, 0);
+    unsigned long num_collisions = 0;
+    double time = 0;
+    // False if the geometry was invalid and the point was not run
+    bool valid = true;
+    // True if the run hit its event budget or deadline before `M_f`. The averages then cover the part that did run.
+    bool truncated = false;
+    // Backend the point ran with, so that it can be rerun in the same way
+    Backend backend;
+
+    /**
+     * Format the result as a line of comma separated values, preceded by the parameter tokens
+     * and followed by the name of the backend and the truncation flag.
+     * @param spec Specification the result belongs to
+     * @return Line without trailing newline
+     */
+    std::string to_line(const ExperimentSpec &spec) const;
+};
+
+/**
+ * Time every applicable backend on a point: each runs a fresh simulation of the point for a short while, and the
+ * one with the most events per second of wall-clock time wins. Window sizes are only tried when they fit in the
+ * system, renumbering only for systems large enough for it to pay off. The calibration takes at most a tenth of
+ * the events of the point; for points too short to calibrate, the backend of the spec is returned unmeasured.
+ * Timings are noisy, but since all backends give the same results, a poor choice only costs time.
+ * @param spec Specification of the point
+ * @return Fastest backend, with its measured speed
+ */
+Backend select_backend(const ExperimentSpec &spec);
+
+/**
+ * Run a single point: a transient phase of `M_t` collisions, then average the mass spread over the collisions
+ * up to `M_f` and measure the currents over that interval.
+ * With `auto_backend` set, the backend is selected first, see `select_backend`.
+ * If the event budget or deadline of the spec is hit first, the partial averages are returned, flagged as truncated.
+ * @param spec Specification of the point
+ * @param progress Optional callback, called with the number of collisions every `PROGRESS_INTERVAL` collisions
+ * @return Measured quantities
+ */
+ExperimentResult run_experiment(const ExperimentSpec &spec,
+                                const std::function<void(unsigned long)> &progress = nullptr);
+
+// Number of collisions between two progress reports, a power of two so the check is cheap
+const unsigned long PROGRESS_INTERVAL = 1ul << 16;
+// Minimum number of events `select_backend` times each backend for; larger systems get four events per particle
+const unsigned long BACKEND_CALIBRATION_EVENTS = 20000;
+
+#endif //TERRIER_EXPERIMENT_H
@@ -1,5 +1,8 @@
 #include <iostream>
 #include "simulation.h"
+#include "renderer.h"
+#include "observers.h"
+#include "checkpoint.h"
 #include <string>
 #include <chrono>
 
@@ -27,6 +30,43 @@ void polarisation_demo() {
     printf("Polarised in %.2f seconds, mass spread of %.2f\n", simulation.time, simulation.get_mass_spread());
 }
 
+void checkpointed_polarisation_run() {
+    printf("Running a polarising system without output, keeping checkpoints for a replay\n");
+    Simulation simulation = Simulation(300, 0.2);
+    simulation.left_gate_capacity = 2;
+    simulation.gate_is_flat = true;
+    simulation.right_gate_capacity = 2;
+    simulation.circle_distance = 0.5;
+    simulation.circle_radius = 0.5;
+    simulation.distance_as_channel_length = true;
+    simulation.setup();
+    simulation.start(0.5);
+    CheckpointRing checkpoints(100, 10);
+    // A switch is a change of the polarised side, with a mass spread beyond one half
+    int side = 0;
+    double last_switch = 0;
+    while (simulation.time < 1000) {
+        simulation.update(0);
+        checkpoints.record(simulation);
+        const double mass_spread = simulation.get_mass_spread();
+        if (std::fabs(mass_spread) > 0.5 and (mass_spread > 0) != (side > 0)) {
+            if (side != 0) {
+                last_switch = simulation.time;
+            }
+            side = mass_spread > 0 ? 1 : -1;
+        }
+    }
+    checkpoints.write("checkpoints.chk", simulation);
+    if (last_switch > 0) {
+        printf("Last polarisation switch at %.2f. Replay it with e.g.\n"
+               "./replay checkpoints.chk %.2f %.2f 0.025\n", last_switch, std::max(0., last_switch - 5),
+               last_switch + 5);
+    } else {
+        printf("No polarisation switch before %.2f. Replay any window with e.g.\n"
+               "./replay checkpoints.chk 500 510 0.025\n", simulation.time);
+    }
+}
+
 void double_channel_demo() {
     printf("Creating the animation for 1000 particles\n");
     Simulation simulation = Simulation(1000, 0.5);
@@ -67,6 +107,32 @@ void many_particle_animation() {
     }
 }
 
+void large_system_animation() {
+    printf("Rendering the animation for 100000 particles\n");
+    Simulation simulation = Simulation(100000, 0.5);
+    simulation.left_gate_capacity = 300;
+    simulation.gate_is_flat = true;
+    simulation.right_gate_capacity = 300;
+    simulation.circle_distance = 0.5;
+    simulation.circle_radius = 1;
+    simulation.distance_as_channel_length = true;
+    simulation.setup();
+    simulation.start(0.75);
+    Renderer renderer(TrajectoryHeader::from_simulation(simulation), 1000, 500);
+    double dt = 0.025;
+    unsigned long frame_number = 0;
+    while (simulation.time < 10) {
+        // Render every frame that passes before the next impact, straight from the engine
+        while (simulation.get_next_event_time() > simulation.last_written_time + dt) {
+            simulation.last_written_time += dt;
+            char filename[32];
+            snprintf(filename, sizeof(filename), "frame-%05lu.png", frame_number++);
+            renderer.render(simulation, simulation.last_written_time).write_png(filename);
+        }
+        simulation.update(0);
+    }
+}
+
 void time_test(const int num_times = 5) { // Starting point: 7 seconds, after keeping track of particle pos: 2.3
     printf("Running the animation for 10000 particles, timing\n");
     double average_time = 0;
@@ -106,12 +172,20 @@ void mass_spread_demo(const int &num_res) {
         simulation.setup();
         simulation.start(0.7);
         simulation.write_positions_to_file(0);
+        // Record the series on an observer thread, away from the event loop
+        auto series = std::make_shared<MassSpreadObserver>(simulation.num_particles, 100);
+        ObserverPipeline pipeline;
+        pipeline.add(series);
+        pipeline.start();
+        simulation.observers = &pipeline;
+        pipeline.publish_state(simulation);
         while (simulation.num_collisions < (unsigned long) 1E6) {
-            if (simulation.num_collisions % 100 == 0) {
-                s << simulation.get_mass_spread() << ",";
-            }
             simulation.update(0);
         }
+        pipeline.stop();
+        for (double mass_spread: series->get_series()) {
+            s << mass_spread << ",";
+        }
         s << simulation.get_mass_spread();
         s << std::endl;
     }
@@ -134,6 +208,14 @@ int main(int argc, char *argv[]) {
             many_particle_animation();
             break;
         }
+        case 3: {
+            large_system_animation();
+            break;
+        }
+        case 4: {
+            checkpointed_polarisation_run();
+            break;
+        }
         default: {
             polarisation_demo();
             break;
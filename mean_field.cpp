@@ -0,0 +1,114 @@
+#include "mean_field.h"
+
+MeanFieldModel MeanFieldModel::from_simulation(const Simulation &simulation) {
+    MeanFieldModel model;
+    model.num_particles = simulation.num_particles;
+    model.bridge_width = simulation.bridge_width;
+    model.bridge_length = simulation.bridge_length;
+    model.circle_radius = simulation.circle_radius;
+    model.left_gate_capacity = simulation.left_gate_capacity;
+    model.right_gate_capacity = simulation.right_gate_capacity;
+    model.second_width = simulation.second_width;
+    return model;
+}
+
+double MeanFieldModel::get_chamber_area() const {
+    double area = PI * circle_radius * circle_radius;
+    for (double width: {bridge_width, second_width}) {
+        if (width > 0) {
+            area -= circle_radius * circle_radius * std::asin(width / (2 * circle_radius)) -
+                    width * std::sqrt(4 * circle_radius * circle_radius - width * width) / 4;
+        }
+    }
+    return area;
+}
+
+double MeanFieldModel::get_pass_probability(double n, int capacity) const {
+    // P(K < capacity) for a Poisson occupancy K; the first term is taken in log space to stay finite for large means
+    const double lambda = n * bridge_width * bridge_length / (4 * get_chamber_area());
+    if (lambda <= 0) {
+        return capacity > 0 ? 1 : 0;
+    }
+    // Only the terms within a few dozen standard deviations of the mean contribute
+    const double spread = 40 * std::sqrt(lambda) + 40;
+    const int first = (int) std::max(0., std::floor(lambda - spread));
+    const int last = (int) std::min((double) capacity, std::ceil(lambda + spread));
+    double probability = 0;
+    double term = std::exp(first * std::log(lambda) - lambda - std::lgamma(first + 1.));
+    for (int k = first; k < last; k++) {
+        probability += term;
+        term *= lambda / (k + 1);
+    }
+    return std::min(probability, 1.);
+}
+
+std::vector<double> MeanFieldModel::get_rates(double mass_spread) const {
+    const double n_left = num_particles * (1 - mass_spread) / 2;
+    const double n_right = num_particles * (1 + mass_spread) / 2;
+    const double effusion = 1 / (PI * get_chamber_area());
+    std::vector<double> rates(4);
+    rates[0] = n_left * bridge_width * effusion * get_pass_probability(n_left, left_gate_capacity);
+    rates[1] = n_left * second_width * effusion;
+    rates[2] = n_right * bridge_width * effusion * get_pass_probability(n_right, right_gate_capacity);
+    rates[3] = n_right * second_width * effusion;
+    return rates;
+}
+
+double MeanFieldModel::get_derivative(double mass_spread) const {
+    const std::vector<double> rates = get_rates(mass_spread);
+    return 2 * (rates[0] + rates[1] - rates[2] - rates[3]) / num_particles;
+}
+
+MeanFieldResult solve_mean_field(const MeanFieldModel &model, double initial_mass_spread, double max_time,
+                                 double tolerance, bool stop_when_stationary) {
+    // Dormand-Prince tableau; the last stage is the fifth order solution, so its derivative is reused
+    static const double a[6][6] = {
+            {1. / 5},
+            {3. / 40, 9. / 40},
+            {44. / 45, -56. / 15, 32. / 9},
+            {19372. / 6561, -25360. / 2187, 64448. / 6561, -212. / 729},
+            {9017. / 3168, -355. / 33, 46732. / 5247, 49. / 176, -5103. / 18656},
+            {35. / 384, 0, 500. / 1113, 125. / 192, -2187. / 6784, 11. / 84}};
+    // Difference between the fifth and fourth order weights
+    static const double e[7] = {71. / 57600, 0, -71. / 16695, 71. / 1920, -17253. / 339200, 22. / 525, -1. / 40};
+    MeanFieldResult result;
+    double y = std::min(std::max(initial_mass_spread, -1.), 1.);
+    double t = 0;
+    double h = 1E-2;
+    double k[7];
+    k[0] = model.get_derivative(y);
+    while (t < max_time) {
+        if (stop_when_stationary and std::fabs(k[0]) < tolerance) {
+            result.stationary = true;
+            break;
+        }
+        h = std::min(h, max_time - t);
+        for (int stage = 1; stage < 7; stage++) {
+            double y_stage = y;
+            for (int j = 0; j < stage; j++) {
+                y_stage += h * a[stage - 1][j] * k[j];
+            }
+            k[stage] = model.get_derivative(std::min(std::max(y_stage, -1.), 1.));
+        }
+        double error = 0;
+        for (int stage = 0; stage < 7; stage++) {
+            error += h * e[stage] * k[stage];
+        }
+        error = std::fabs(error);
+        if (error <= tolerance) {
+            t += h;
+            for (int j = 0; j < 6; j++) {
+                y += h * a[5][j] * k[j];
+            }
+            y = std::min(std::max(y, -1.), 1.);
+            k[0] = k[6];
+            result.num_steps++;
+        }
+        const double factor = error > 0 ? 0.9 * std::pow(tolerance / error, 0.2) : 5;
+        h *= std::min(5., std::max(0.2, factor));
+    }
+    result.mass_spread = y;
+    result.time = t;
+    result.currents = model.get_rates(y);
+    return result;
+}
@@ -0,0 +1,80 @@
+#ifndef TERRIER_MEAN_FIELD_H
+#define TERRIER_MEAN_FIELD_H
+
+#include <vector>
+#include "simulation.h"
+
+/**
+ * Mean-field kinetics of the two-urn system, as a fast companion to the billiard.
+ * Particles leave an urn through a channel of width w at the effusion rate n w / (pi A), with n the number of
+ * particles in the urn and A its area (as in `threshold_function` in plot_data.py). Through the central channel,
+ * they only pass if the gate on their side holds fewer particles than its capacity. The gate occupancy is taken to be
+ * Poisson distributed, with as mean the number of inbound particles in half the channel at the density of the urn,
+ * lambda = n w L / (4 A) (as in `J_prime`). The back channel has no gate.
+ *
+ * All rates use the time unit of the billiard, where particles move with unit speed.
+ */
+struct MeanFieldModel {
+    int num_particles = 1000;
+    double bridge_width = 0.3;
+    double bridge_length = 1;
+    double circle_radius = 1;
+    int left_gate_capacity = 3;
+    int right_gate_capacity = 3;
+    double second_width = 0;
+
+    /**
+     * Take the parameters of a simulation that has been set up.
+     */
+    static MeanFieldModel from_simulation(const Simulation &simulation);
+
+    /**
+     * @return Area of a chamber, without the circular segments cut off by the channels
+     */
+    double get_chamber_area() const;
+
+    /**
+     * @param n Number of particles in the urn
+     * @param capacity Capacity of the gate on the side of the urn
+     * @return Probability that the gate admits a particle
+     */
+    double get_pass_probability(double n, int capacity) const;
+
+    /**
+     * Rates at which particles cross from one urn to the other, in the order of `Simulation::current_counters`:
+     * left to right through the central and the back channel, right to left through the central and the back channel.
+     * @param mass_spread Mass spread, see `Simulation::get_mass_spread`
+     * @return Four rates
+     */
+    std::vector<double> get_rates(double mass_spread) const;
+
+    /**
+     * @param mass_spread Mass spread
+     * @return Time derivative of the mass spread
+     */
+    double get_derivative(double mass_spread) const;
+};
+
+struct MeanFieldResult {
+    double mass_spread = 0;
+    // Rates at the final mass spread, see `MeanFieldModel::get_rates`
+    std::vector<double> currents = std::vector<double>(4, 0);
+    double time = 0;
+    unsigned long num_steps = 0;
+    // Whether the integration stopped because the mass spread became stationary
+    bool stationary = false;
+};
+
+/**
+ * Integrate the mean-field mass spread with the adaptive Dormand-Prince (RK45) scheme.
+ * @param model Model
+ * @param initial_mass_spread Mass spread at time zero
+ * @param max_time Time at which the integration stops
+ * @param tolerance Absolute error allowed per step
+ * @param stop_when_stationary Stop as soon as the derivative drops below `tolerance`
+ * @return Final state
+ */
+MeanFieldResult solve_mean_field(const MeanFieldModel &model, double initial_mass_spread, double max_time = 1E6,
+                                 double tolerance = 1E-10, bool stop_when_stationary = true);
+
+#endif //TERRIER_MEAN_FIELD_H
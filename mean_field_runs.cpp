@@ -0,0 +1,44 @@
+#include <iostream>
+#include "experiment.h"
+#include "mean_field.h"
+#include <string>
+
+/**
+ * This file contains an executable that predicts the points of one or more sweep files with the mean-field model
+ * (see mean_field.h), in the output format of `sweep`. Each point takes microseconds, so this serves as a pre-screen
+ * of a sweep, and the predicted mass spread as an initial guess for the stochastic runs.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        throw std::invalid_argument("Please provide (in order) (1) output file, (2) one or more sweep (.in) files");
+    }
+    std::ofstream output(argv[1]);
+    unsigned long num_points = 0;
+    for (int i = 2; i < argc; i++) {
+        for (const ExperimentSpec &spec: ExperimentSpec::read_sweep_file(argv[i])) {
+            ExperimentResult result;
+            // The sweeps use flat gates and take the distance as the channel length
+            MeanFieldModel model;
+            model.num_particles = spec.num_particles;
+            model.bridge_width = spec.channel_width;
+            model.bridge_length = spec.channel_length;
+            model.circle_radius = spec.urn_radius;
+            model.left_gate_capacity = spec.threshold;
+            model.right_gate_capacity = spec.threshold;
+            model.second_width = spec.second_width;
+            if (spec.channel_width / 2 >= spec.urn_radius or spec.second_width / 2 >= spec.urn_radius) {
+                result.valid = false;
+            } else {
+                const MeanFieldResult prediction = solve_mean_field(model, 1 - 2 * spec.left_ratio);
+                result.mass_spread = prediction.mass_spread;
+                result.currents = prediction.currents;
+                result.time = prediction.time;
+            }
+            output << result.to_line(spec) << std::endl;
+            num_points++;
+        }
+    }
+    printf("Predicted %lu points\n", num_points);
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "observers.h"
+#include "simulation.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+StateObserver::StateObserver(unsigned long num_particles, double dt)
+        : num_particles(num_particles), dt(dt), next_sample(0), times(num_particles), x_pos(num_particles),
+          y_pos(num_particles), directions(num_particles) {
+}
+
+void StateObserver::observe(const EventRecord &record) {
+    if (record.kind != EventRecord::INITIAL) {
+        // All particles are known up to the time of this record
+        while (next_sample <= record.time) {
+            sample(next_sample);
+            next_sample += dt;
+        }
+    } else {
+        next_sample = record.time;
+    }
+    times.at(record.particle) = record.time;
+    x_pos[record.particle] = record.x;
+    y_pos[record.particle] = record.y;
+    directions[record.particle] = record.direction;
+    in_left = record.in_left;
+    if (record.kind == EventRecord::ABSORPTION) {
+        // The slot is free until a source injects a particle in it
+        x_pos[record.particle] = std::numeric_limits<double>::quiet_NaN();
+        y_pos[record.particle] = std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+void StateObserver::get_position_at(unsigned long particle, double t, double &x, double &y) const {
+    x = x_pos[particle] + (t - times[particle]) * std::cos(directions[particle]);
+    y = y_pos[particle] + (t - times[particle]) * std::sin(directions[particle]);
+}
+
+DensityObserver::DensityObserver(unsigned long num_particles, double dt, double x_min, double x_max, double y_min,
+                                 double y_max, unsigned long num_x, unsigned long num_y)
+        : StateObserver(num_particles, dt), x_min(x_min), x_max(x_max), y_min(y_min), y_max(y_max), num_x(num_x),
+          num_y(num_y), counts(num_x * num_y) {
+}
+
+void DensityObserver::sample(double t) {
+    for (unsigned long particle = 0; particle < num_particles; particle++) {
+        double x, y;
+        get_position_at(particle, t, x, y);
+        const auto i = (long) std::floor((x - x_min) / (x_max - x_min) * num_x);
+        const auto j = (long) std::floor((y - y_min) / (y_max - y_min) * num_y);
+        if (i >= 0 and i < (long) num_x and j >= 0 and j < (long) num_y) {
+            counts[j * num_x + i]++;
+        }
+    }
+    num_samples++;
+}
+
+std::vector<double> DensityObserver::get_density() const {
+    std::vector<double> density(counts.size());
+    for (unsigned long cell = 0; cell < counts.size(); cell++) {
+        density[cell] = num_samples > 0 ? (double) counts[cell] / num_samples : 0;
+    }
+    return density;
+}
+
+unsigned long DensityObserver::get_num_samples() const {
+    return num_samples;
+}
+
+void DensityObserver::write(const std::string &filename) const {
+    const std::vector<double> density = get_density();
+    std::ofstream file(filename);
+    for (unsigned long j = 0; j < num_y; j++) {
+        for (unsigned long i = 0; i < num_x; i++) {
+            file << density[j * num_x + i] << (i + 1 < num_x ? " " : "\n");
+        }
+    }
+}
+
+MassSpreadObserver::MassSpreadObserver(unsigned long num_particles, unsigned long interval)
+        : num_particles(num_particles), interval(interval) {
+}
+
+void MassSpreadObserver::observe(const EventRecord &record) {
+    const double mass_spread = (num_particles - 2. * record.in_left) / num_particles;
+    if (record.kind == EventRecord::INITIAL) {
+        if (record.particle == 0) {
+            series.push_back(mass_spread);
+        }
+    } else if (record.kind == EventRecord::COLLISION and ++num_collisions % interval == 0) {
+        series.push_back(mass_spread);
+    }
+}
+
+const std::vector<double> &MassSpreadObserver::get_series() const {
+    return series;
+}
+
+ObserverPipeline::Channel::Channel(std::size_t capacity, std::shared_ptr<Observer> observer)
+        : ring(capacity), observer(std::move(observer)) {
+}
+
+void *ObserverPipeline::Channel::operator new(std::size_t size) {
+    void *pointer;
+    if (posix_memalign(&pointer, alignof(Channel), size) != 0) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void ObserverPipeline::Channel::operator delete(void *pointer) {
+    free(pointer);
+}
+
+ObserverPipeline::ObserverPipeline(std::size_t ring_capacity) : ring_capacity(ring_capacity) {
+}
+
+ObserverPipeline::~ObserverPipeline() {
+    stop();
+}
+
+void ObserverPipeline::add(std::shared_ptr<Observer> observer) {
+    if (running) {
+        throw std::logic_error("Observers can only be added before the pipeline starts");
+    }
+    channels.emplace_back(new Channel(ring_capacity, std::move(observer)));
+}
+
+void ObserverPipeline::start() {
+    running = true;
+    for (const std::unique_ptr<Channel> &channel: channels) {
+        Channel &current = *channel;
+        channel->thread = std::thread([this, &current]() {
+            consume(current);
+        });
+    }
+}
+
+void ObserverPipeline::consume(Channel &channel) {
+    const std::size_t BATCH_SIZE = 256;
+    EventRecord records[BATCH_SIZE];
+    unsigned idle_rounds = 0;
+    while (true) {
+        const std::size_t count = channel.ring.pop(records, BATCH_SIZE);
+        for (std::size_t i = 0; i < count; i++) {
+            channel.observer->observe(records[i]);
+        }
+        if (count > 0) {
+            idle_rounds = 0;
+        } else if (not running and channel.ring.empty()) {
+            break;
+        } else if (++idle_rounds > 64) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    channel.observer->finish();
+}
+
+void ObserverPipeline::publish_state(const Simulation &simulation) {
+    std::vector<double> x(simulation.num_particles), y(simulation.num_particles), directions(simulation.num_particles);
+    simulation.snapshot(simulation.time, x.data(), y.data(), directions.data());
+    for (int particle = 0; particle < simulation.num_particles; particle++) {
+        publish({simulation.time, x[particle], y[particle], directions[particle], (uint32_t) particle,
+                 (uint32_t) simulation.in_left, EventRecord::INITIAL});
+    }
+}
+
+void ObserverPipeline::stop() {
+    if (not running) {
+        return;
+    }
+    running = false;
+    for (const std::unique_ptr<Channel> &channel: channels) {
+        channel->thread.join();
+    }
+}
+
+unsigned long ObserverPipeline::get_full_waits() const {
+    return full_waits;
+}
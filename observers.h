@@ -0,0 +1,273 @@
+#ifndef TERRIER_OBSERVERS_H
+#define TERRIER_OBSERVERS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Simulation;
+
+/**
+ * Compact record of the state of one particle right after an event. Particles fly in a straight line between
+ * their records, so an observer that keeps the last record of each particle knows all positions up to the time
+ * of the latest record it received.
+ */
+struct EventRecord {
+    enum Kind : uint32_t {
+        // Particles of an open system enter at a source and leave at a sink, see `Simulation::add_source`
+        INITIAL = 0, COLLISION = 1, RETRACTION = 2, INJECTION = 3, ABSORPTION = 4
+    };
+    double time;
+    double x;
+    double y;
+    double direction;
+    uint32_t particle;
+    uint32_t in_left;
+    uint32_t kind;
+};
+
+/**
+ * Lock-free ring buffer for exactly one producer thread and one consumer thread.
+ * The capacity is rounded up to a power of two.
+ */
+template<typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    /**
+     * Add an item, unless the ring is full. Producer only.
+     * @return true if the item was added
+     */
+    bool try_push(const T &item) {
+        const std::size_t current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (current_tail - cached_head > mask) {
+                return false;
+            }
+        }
+        buffer[current_tail & mask] = item;
+        tail.store(current_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Take up to `max_items` items. Consumer only.
+     * @return Number of items written to `items`
+     */
+    std::size_t pop(T *items, std::size_t max_items) {
+        const std::size_t current_head = head.load(std::memory_order_relaxed);
+        if (cached_tail == current_head) {
+            cached_tail = tail.load(std::memory_order_acquire);
+        }
+        const std::size_t count = std::min(max_items, cached_tail - current_head);
+        for (std::size_t i = 0; i < count; i++) {
+            items[i] = buffer[(current_head + i) & mask];
+        }
+        head.store(current_head + count, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> buffer;
+    std::size_t mask;
+    // Indices only grow; the producer owns `tail` and the consumer `head`. Each side caches the other's index.
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    alignas(64) std::size_t cached_head = 0;
+    alignas(64) std::size_t cached_tail = 0;
+};
+
+/**
+ * Measurement that runs on its own thread, fed with the event records of a simulation in time order.
+ */
+class Observer {
+public:
+    virtual ~Observer() = default;
+
+    virtual void observe(const EventRecord &record) = 0;
+
+    /**
+     * Called on the observer thread after the last record.
+     */
+    virtual void finish() {
+    }
+};
+
+/**
+ * Observer that keeps track of the position of all particles and takes a sample every `dt` time units.
+ * Observes the initial state of the simulation, so attach it before `ObserverPipeline::publish_state`.
+ */
+class StateObserver : public Observer {
+public:
+    StateObserver(unsigned long num_particles, double dt);
+
+    void observe(const EventRecord &record) override;
+
+    /**
+     * Position of a particle at a time between its last record and its next one.
+     */
+    void get_position_at(unsigned long particle, double t, double &x, double &y) const;
+
+protected:
+    /**
+     * Take a sample at time `t`; all positions are known up to this time.
+     */
+    virtual void sample(double t) = 0;
+
+    const unsigned long num_particles;
+    const double dt;
+    double next_sample;
+    unsigned long in_left = 0;
+    std::vector<double> times;
+    std::vector<double> x_pos;
+    std::vector<double> y_pos;
+    std::vector<double> directions;
+};
+
+/**
+ * Time-averaged particle density on a rectangular grid.
+ */
+class DensityObserver : public StateObserver {
+public:
+    DensityObserver(unsigned long num_particles, double dt, double x_min, double x_max, double y_min, double y_max,
+                    unsigned long num_x, unsigned long num_y);
+
+    /**
+     * @return Average number of particles per cell, row by row from `y_min`
+     */
+    std::vector<double> get_density() const;
+
+    unsigned long get_num_samples() const;
+
+    /**
+     * Write the average density as `num_y` lines of `num_x` numbers.
+     */
+    void write(const std::string &filename) const;
+
+protected:
+    void sample(double t) override;
+
+private:
+    const double x_min, x_max, y_min, y_max;
+    const unsigned long num_x, num_y;
+    std::vector<unsigned long> counts;
+    unsigned long num_samples = 0;
+};
+
+/**
+ * Mass spread after every `interval`-th collision, starting with the initial state.
+ */
+class MassSpreadObserver : public Observer {
+public:
+    MassSpreadObserver(unsigned long num_particles, unsigned long interval);
+
+    void observe(const EventRecord &record) override;
+
+    const std::vector<double> &get_series() const;
+
+private:
+    const unsigned long num_particles;
+    const unsigned long interval;
+    unsigned long num_collisions = 0;
+    std::vector<double> series;
+};
+
+/**
+ * Hands the event records of a simulation to observer threads, through one ring per observer.
+ * The simulation thread only blocks when a ring is full.
+ *
+ *     ObserverPipeline pipeline;
+ *     pipeline.add(observer);
+ *     pipeline.start();
+ *     simulation.observers = &pipeline;
+ *     pipeline.publish_state(simulation);
+ *     ... simulation.update(0) ...
+ *     pipeline.stop();
+ *
+ * Observers assume straight flights between records, so do not combine with `Simulation::park_trapped_orbits`.
+ */
+class ObserverPipeline {
+public:
+    explicit ObserverPipeline(std::size_t ring_capacity = 1u << 16);
+
+    ~ObserverPipeline();
+
+    /**
+     * Attach an observer. Only before `start`.
+     */
+    void add(std::shared_ptr<Observer> observer);
+
+    /**
+     * Start one thread per observer.
+     */
+    void start();
+
+    /**
+     * Publish a record to all observers. Simulation thread only.
+     */
+    void publish(const EventRecord &record) {
+        for (const std::unique_ptr<Channel> &channel: channels) {
+            if (not channel->ring.try_push(record)) {
+                full_waits++;
+                while (not channel->ring.try_push(record)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    /**
+     * Publish the current state of every particle, as records of kind `INITIAL`.
+     */
+    void publish_state(const Simulation &simulation);
+
+    /**
+     * Let the observers process all remaining records, call their `finish` and join the threads.
+     */
+    void stop();
+
+    /**
+     * @return Number of records for which the simulation thread had to wait on a full ring
+     */
+    unsigned long get_full_waits() const;
+
+private:
+    struct Channel {
+        Channel(std::size_t capacity, std::shared_ptr<Observer> observer);
+
+        // The ring indices are cache-line aligned, which plain `new` does not honour before C++17
+        static void *operator new(std::size_t size);
+
+        static void operator delete(void *pointer);
+
+        SpscRing<EventRecord> ring;
+        std::shared_ptr<Observer> observer;
+        std::thread thread;
+    };
+
+    void consume(Channel &channel);
+
+    const std::size_t ring_capacity;
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::atomic<bool> running{false};
+    unsigned long full_waits = 0;
+};
+
+#endif //TERRIER_OBSERVERS_H
@@ -0,0 +1,98 @@
+#include "occupancy.h"
+
+static const char MAGIC[4] = {'P', 'O', 'C', 'C'};
+static const uint32_t VERSION = 1;
+
+template<typename T>
+static void write_value(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+static void read_value(std::ifstream &file, T &value) {
+    if (not file.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+        throw std::invalid_argument("Occupancy file ends prematurely");
+    }
+}
+
+std::string OccupancySummary::to_line() const {
+    std::ostringstream s;
+    s << duration << "," << left_fractions.mean() << "," << std::sqrt(left_fractions.variance()) << ","
+      << min_left_fraction << "," << max_left_fraction << "," << crossings.mean() << "," << num_without_crossings;
+    return s.str();
+}
+
+Occupancy Occupancy::from_simulation(const Simulation &simulation, double t) {
+    Occupancy occupancy;
+    std::vector<double> left_times;
+    occupancy.duration = simulation.get_occupancy(t, left_times, occupancy.crossings);
+    occupancy.left_fractions.resize(left_times.size());
+    for (unsigned long particle = 0; particle < left_times.size(); particle++) {
+        occupancy.left_fractions[particle] = occupancy.duration > 0 ? left_times[particle] / occupancy.duration : 0;
+    }
+    return occupancy;
+}
+
+void Occupancy::write(const std::string &filename) const {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (not file) {
+        throw std::invalid_argument("Can not open occupancy file " + filename);
+    }
+    file.write(MAGIC, sizeof(MAGIC));
+    write_value(file, VERSION);
+    write_value(file, (uint32_t) left_fractions.size());
+    write_value(file, duration);
+    for (double fraction: left_fractions) {
+        write_value(file, (float) fraction);
+    }
+    for (unsigned long count: crossings) {
+        write_value(file, (uint32_t) std::min(count, (unsigned long) std::numeric_limits<uint32_t>::max()));
+    }
+}
+
+Occupancy Occupancy::read(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (not file) {
+        throw std::invalid_argument("Can not open occupancy file " + filename);
+    }
+    char magic[4];
+    uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    read_value(file, version);
+    if (not std::equal(magic, magic + 4, MAGIC) or version != VERSION) {
+        throw std::invalid_argument("Not an occupancy file: " + filename);
+    }
+    uint32_t count;
+    read_value(file, count);
+    Occupancy occupancy;
+    read_value(file, occupancy.duration);
+    occupancy.left_fractions.resize(count);
+    occupancy.crossings.resize(count);
+    for (double &fraction: occupancy.left_fractions) {
+        float value;
+        read_value(file, value);
+        fraction = value;
+    }
+    for (unsigned long &crossing: occupancy.crossings) {
+        uint32_t value;
+        read_value(file, value);
+        crossing = value;
+    }
+    return occupancy;
+}
+
+OccupancySummary Occupancy::summarize() const {
+    OccupancySummary summary;
+    summary.duration = duration;
+    if (left_fractions.empty()) {
+        return summary;
+    }
+    summary.min_left_fraction = *std::min_element(left_fractions.begin(), left_fractions.end());
+    summary.max_left_fraction = *std::max_element(left_fractions.begin(), left_fractions.end());
+    for (unsigned long particle = 0; particle < left_fractions.size(); particle++) {
+        summary.left_fractions.add(left_fractions[particle]);
+        summary.crossings.add(crossings[particle]);
+        summary.num_without_crossings += crossings[particle] == 0;
+    }
+    return summary;
+}
@@ -0,0 +1,69 @@
+#ifndef TERRIER_OCCUPANCY_H
+#define TERRIER_OCCUPANCY_H
+
+#include <string>
+#include <vector>
+#include "replicas.h"
+#include "simulation.h"
+
+/**
+ * Spread of the per-particle occupancy over the particles.
+ * In an ergodic system every particle spends about the same fraction of time on the left, and changes sides
+ * regularly; a particle on a regular orbit stays on one side and never crosses.
+ */
+struct OccupancySummary {
+    // Length of the tracked interval
+    double duration = 0;
+    // Over the particles: fraction of time on the left, and number of side changes
+    RunningStatistics left_fractions;
+    RunningStatistics crossings;
+    double min_left_fraction = 0;
+    double max_left_fraction = 0;
+    unsigned long num_without_crossings = 0;
+
+    /**
+     * @return duration, mean left fraction, its standard deviation over the particles, minimum, maximum,
+     * mean number of crossings and number of particles without crossings, comma separated
+     */
+    std::string to_line() const;
+};
+
+/**
+ * End-of-run dump of the occupancy accumulators of a simulation, see `Simulation::track_occupancy`.
+ *
+ *     simulation.track_occupancy = true;
+ *     simulation.start(0.5);
+ *     ...
+ *     Occupancy occupancy = Occupancy::from_simulation(simulation, simulation.time);
+ *     occupancy.write("occupancy.dat");
+ *     printf("%s\n", occupancy.summarize().to_line().c_str());
+ */
+struct Occupancy {
+    double duration = 0;
+    // Per particle id
+    std::vector<double> left_fractions;
+    std::vector<unsigned long> crossings;
+
+    /**
+     * @param simulation Simulation that tracks occupancy
+     * @param t Time between the current time and the next event
+     * @return Occupancy from the start of the tracking up to `t`
+     */
+    static Occupancy from_simulation(const Simulation &simulation, double t);
+
+    /**
+     * Write a compact binary file: "POCC", version and number of particles as uint32, the duration as double,
+     * then the left fractions as float32 and the crossings as uint32 (saturated), all little endian.
+     * @param filename Name of the file, overwritten if it exists
+     */
+    void write(const std::string &filename) const;
+
+    /**
+     * Read a file written by `write`. The fractions have float precision.
+     */
+    static Occupancy read(const std::string &filename);
+
+    OccupancySummary summarize() const;
+};
+
+#endif //TERRIER_OCCUPANCY_H
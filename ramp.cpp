@@ -0,0 +1,87 @@
+#include "ramp.h"
+
+std::string RampPoint::to_line() const {
+    std::ostringstream s;
+    s << value << "," << mass_spread;
+    for (double current: currents) {
+        s << "," << current;
+    }
+    s << "," << num_collisions << "," << time;
+    return s.str();
+}
+
+ParameterRamp::ParameterRamp(Parameter parameter, double start, double end, unsigned long num_steps)
+        : parameter(parameter), start(start), end(end), num_steps(num_steps) {
+    if (num_steps == 0) {
+        throw std::invalid_argument("A ramp needs at least one step");
+    }
+}
+
+ParameterRamp::Parameter ParameterRamp::parse_parameter(const std::string &name) {
+    if (name == "threshold") {
+        return GATE_CAPACITY;
+    } else if (name == "first_width") {
+        return BRIDGE_WIDTH;
+    } else if (name == "second_width") {
+        return SECOND_WIDTH;
+    }
+    throw std::invalid_argument("Unknown ramp parameter " + name + ", choose threshold, first_width or second_width");
+}
+
+unsigned long ParameterRamp::apply(Simulation &simulation, Parameter parameter, double value) {
+    switch (parameter) {
+        case GATE_CAPACITY: {
+            const auto capacity = (int) std::lround(value);
+            simulation.set_gate_capacity(simulation.LEFT, capacity);
+            simulation.set_gate_capacity(simulation.RIGHT, capacity);
+            return 0;
+        }
+        case BRIDGE_WIDTH:
+            return simulation.set_bridge_width(value);
+        default:
+            return simulation.set_second_width(value);
+    }
+}
+
+std::vector<double> ParameterRamp::get_values() const {
+    std::vector<double> values;
+    for (unsigned long step = 0; step < num_steps; step++) {
+        values.push_back(num_steps > 1 ? start + (end - start) * step / (num_steps - 1) : start);
+    }
+    if (round_trip) {
+        for (unsigned long step = num_steps - 1; step > 0; step--) {
+            values.push_back(values[step - 1]);
+        }
+    }
+    return values;
+}
+
+std::vector<RampPoint> ParameterRamp::run(Simulation &simulation) const {
+    std::vector<RampPoint> points;
+    for (double value: get_values()) {
+        RampPoint point;
+        point.value = value;
+        point.num_predicted = apply(simulation, parameter, value);
+        const unsigned long relaxed = simulation.num_collisions + relaxation_collisions;
+        while (simulation.num_collisions < relaxed) {
+            simulation.update(0);
+        }
+        const std::vector<int> count_offset = simulation.current_counters;
+        const double time_offset = simulation.time;
+        const unsigned long measured = simulation.num_collisions + measurement_collisions;
+        const double weight = 1. / (double) measurement_collisions;
+        while (simulation.num_collisions < measured) {
+            simulation.update(0);
+            point.mass_spread += weight * simulation.get_mass_spread();
+        }
+        const double duration = simulation.time - time_offset;
+        for (unsigned int i = 0; i < 4; i++) {
+            point.currents.at(i) =
+                    duration > 0 ? (simulation.current_counters.at(i) - count_offset.at(i)) / duration : 0;
+        }
+        point.num_collisions = simulation.num_collisions;
+        point.time = simulation.time;
+        points.push_back(point);
+    }
+    return points;
+}
@@ -0,0 +1,90 @@
+#ifndef TERRIER_RAMP_H
+#define TERRIER_RAMP_H
+
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+/**
+ * Observables measured at one value of a ramped parameter.
+ */
+struct RampPoint {
+    double value = 0;
+    // Average mass spread over the measurement
+    double mass_spread = 0;
+    // Average currents over the measurement, see `Simulation::current_counters`
+    std::vector<double> currents = std::vector<double>(4, 0);
+    // Collisions and time at the end of the measurement
+    unsigned long num_collisions = 0;
+    double time = 0;
+    // Particles that had to be predicted again when the parameter changed
+    unsigned long num_predicted = 0;
+
+    /**
+     * @return value, mass spread, the four currents, collisions and time, comma separated
+     */
+    std::string to_line() const;
+};
+
+/**
+ * Quasi-static protocol: a parameter is changed in small steps during a single run, and after each step
+ * the observables are measured at the new value. Ramping up and back down again traces hysteresis,
+ * in a fraction of the collisions a separate run per value would take.
+ *
+ *     ParameterRamp ramp(ParameterRamp::GATE_CAPACITY, 1, 25, 25);
+ *     ramp.round_trip = true;
+ *     std::vector<RampPoint> points = ramp.run(simulation);
+ */
+class ParameterRamp {
+public:
+    enum Parameter {
+        // Capacity of both gates, rounded to the nearest integer
+        GATE_CAPACITY,
+        BRIDGE_WIDTH,
+        SECOND_WIDTH
+    };
+
+    /**
+     * @param parameter Parameter to ramp
+     * @param start First value
+     * @param end Last value
+     * @param num_steps Number of values, including both ends
+     */
+    ParameterRamp(Parameter parameter, double start, double end, unsigned long num_steps);
+
+    /**
+     * Parse the name of a parameter, as in the parameter files: `threshold`, `first_width` or `second_width`.
+     */
+    static Parameter parse_parameter(const std::string &name);
+
+    /**
+     * Set a parameter of a running simulation.
+     * @return Number of particles whose next impact was predicted again
+     */
+    static unsigned long apply(Simulation &simulation, Parameter parameter, double value);
+
+    /**
+     * @return The values in the order they are visited
+     */
+    std::vector<double> get_values() const;
+
+    /**
+     * Run the protocol on a started simulation.
+     * @param simulation Simulation
+     * @return Observables per value, in the order of `get_values`
+     */
+    std::vector<RampPoint> run(Simulation &simulation) const;
+
+    const Parameter parameter;
+    const double start;
+    const double end;
+    const unsigned long num_steps;
+    // Collisions after each change that are not measured
+    unsigned long relaxation_collisions = 0;
+    // Collisions over which the observables are averaged at each value
+    unsigned long measurement_collisions = 100000;
+    // Whether to ramp back from `end` to `start` afterwards
+    bool round_trip = false;
+};
+
+#endif //TERRIER_RAMP_H
@@ -0,0 +1,41 @@
+#include <iostream>
+#include "ramp.h"
+#include "experiment.h"
+#include <string>
+
+/**
+ * This file contains an executable that ramps one parameter of the double channel system during a single run,
+ * and writes the mass spread and currents at every value. A round trip traces hysteresis.
+ * The system is described by a line in the format of the double channel sweep files; its transient time
+ * is run before the ramp starts and its final time is ignored. Without a line, the defaults of
+ * `params_double_channel.json` are used.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 8) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) output file, (2) parameter (threshold/first_width/second_width),"
+                " (3) start value, (4) end value, (5) number of values, (6) relaxation collisions per value,"
+                " (7) measured collisions per value, and optionally (8) round trip (0/1),"
+                " (9) a double channel sweep line");
+    }
+    const std::string output = argv[1];
+    ParameterRamp ramp(ParameterRamp::parse_parameter(argv[2]), std::stod(argv[3]), std::stod(argv[4]),
+                       std::stoul(argv[5]));
+    ramp.relaxation_collisions = std::stoul(argv[6]);
+    ramp.measurement_collisions = std::stoul(argv[7]);
+    ramp.round_trip = argc > 8 and std::stoi(argv[8]) != 0;
+    const std::string line = argc > 9 ? argv[9] : "1 0.3 10 1 1 0.02 1000 0.25 1000000 0 ramp";
+    const ExperimentSpec spec = ExperimentSpec::from_line(line);
+    Simulation simulation = spec.make_simulation();
+    simulation.start(spec.left_ratio);
+    while (simulation.num_collisions < spec.M_t) {
+        simulation.update(0);
+    }
+    std::ofstream file(output);
+    for (const RampPoint &point: ramp.run(simulation)) {
+        file << point.to_line() << std::endl;
+        printf("%s\n", point.to_line().c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include "renderer.h"
+#include <string>
+
+/**
+ * This file contains an executable that renders a trajectory file into image frames.
+ * Both binary trajectories (see trajectory.h) and the text output of `Simulation::write_positions_to_file` are read.
+ * The frames can be stitched into an animation with any external tool, e.g.
+ * `ffmpeg -i frames/frame-%05d.png animation.mp4`
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) trajectory file, (2) output prefix, and optionally (3) width,"
+                " (4) height, (5) format (png/ppm), (6) mode (auto/particles/density), (7) number of threads");
+    }
+    const std::string trajectory_file = argv[1];
+    const std::string prefix = argv[2];
+    const unsigned width = argc > 3 ? std::stoi(argv[3]) : 1000;
+    const unsigned height = argc > 4 ? std::stoi(argv[4]) : 500;
+    const std::string format = argc > 5 ? argv[5] : "png";
+    const std::string mode = argc > 6 ? argv[6] : "auto";
+    const unsigned num_threads = argc > 7 ? std::stoi(argv[7]) : 0;
+    TrajectoryReader reader(trajectory_file);
+    Renderer renderer(reader.header, width, height, num_threads);
+    if (mode == "particles") {
+        renderer.mode = Renderer::PARTICLES;
+    } else if (mode == "density") {
+        renderer.mode = Renderer::DENSITY;
+    }
+    TrajectoryFrame frame;
+    unsigned long frame_number = 0;
+    while (reader.read_frame(frame)) {
+        Image image = renderer.render(frame);
+        char filename[32];
+        snprintf(filename, sizeof(filename), "-%05lu.", frame_number++);
+        if (format == "ppm") {
+            image.write_ppm(prefix + filename + format);
+        } else {
+            image.write_png(prefix + filename + format);
+        }
+    }
+    printf("Rendered %lu frames with %u threads\n", frame_number, renderer.num_threads);
+    return 0;
+}
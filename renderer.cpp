@@ -0,0 +1,284 @@
+#include "renderer.h"
+#include <array>
+#include <thread>
+#include <functional>
+
+/**
+ * Run `work(begin, end, thread)` on `num_threads` threads, splitting [0, n) into contiguous chunks.
+ */
+static void parallel_for(unsigned long n, unsigned num_threads,
+                         const std::function<void(unsigned long, unsigned long, unsigned)> &work) {
+    num_threads = std::max(1u, std::min<unsigned>(num_threads, (unsigned) std::max(1ul, n)));
+    if (num_threads == 1) {
+        work(0, n, 0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    const unsigned long chunk = (n + num_threads - 1) / num_threads;
+    for (unsigned thread = 0; thread < num_threads; thread++) {
+        const unsigned long begin = std::min(n, thread * chunk);
+        const unsigned long end = std::min(n, begin + chunk);
+        threads.emplace_back(work, begin, end, thread);
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+Image::Image(unsigned width, unsigned height) : width(width), height(height), pixels(3ul * width * height, 0) {
+}
+
+void Image::set_pixel(unsigned x, unsigned y, uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t *pixel = &pixels[3ul * (y * (unsigned long) width + x)];
+    pixel[0] = r;
+    pixel[1] = g;
+    pixel[2] = b;
+}
+
+void Image::write_ppm(const std::string &filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+}
+
+static uint32_t crc32(const uint8_t *data, std::size_t length, uint32_t crc = 0) {
+    // Function-local statics are initialised once, also when several threads write frames at the same time
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (std::size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void append_big_endian(std::vector<uint8_t> &buffer, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        buffer.push_back((uint8_t) (value >> shift));
+    }
+}
+
+static void write_png_chunk(std::ofstream &file, const char *type, const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> chunk(type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    std::vector<uint8_t> length;
+    append_big_endian(length, (uint32_t) data.size());
+    std::vector<uint8_t> crc;
+    append_big_endian(crc, crc32(chunk.data(), chunk.size()));
+    file.write(reinterpret_cast<const char *>(length.data()), 4);
+    file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+    file.write(reinterpret_cast<const char *>(crc.data()), 4);
+}
+
+void Image::write_png(const std::string &filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), 8);
+    std::vector<uint8_t> ihdr;
+    append_big_endian(ihdr, width);
+    append_big_endian(ihdr, height);
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8 bit depth, truecolour, deflate, no filter, no interlace
+    write_png_chunk(file, "IHDR", ihdr);
+    // Raw scanlines, each preceded by filter type 0
+    std::vector<uint8_t> raw;
+    raw.reserve((3ul * width + 1) * height);
+    for (unsigned y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels.begin() + 3ul * width * y, pixels.begin() + 3ul * width * (y + 1));
+    }
+    // zlib stream with stored blocks
+    std::vector<uint8_t> idat = {0x78, 0x01};
+    const std::size_t max_block = 65535;
+    for (std::size_t start = 0; start < raw.size(); start += max_block) {
+        const std::size_t length = std::min(max_block, raw.size() - start);
+        idat.push_back(start + length >= raw.size() ? 1 : 0);
+        idat.push_back((uint8_t) (length & 0xFF));
+        idat.push_back((uint8_t) (length >> 8));
+        idat.push_back((uint8_t) (~length & 0xFF));
+        idat.push_back((uint8_t) ((~length >> 8) & 0xFF));
+        idat.insert(idat.end(), raw.begin() + start, raw.begin() + start + length);
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte: raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    append_big_endian(idat, (b << 16) | a);
+    write_png_chunk(file, "IDAT", idat);
+    write_png_chunk(file, "IEND", {});
+}
+
+Renderer::Renderer(const TrajectoryHeader &header, unsigned width, unsigned height, unsigned num_threads)
+        : num_threads(num_threads), background(width, height) {
+    if (this->num_threads == 0) {
+        this->num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Fit the box, with a small margin, in the image while keeping the aspect ratio
+    const double margin = 1.05;
+    scale = std::min(width / (2 * margin * header.box_x_radius), height / (2 * margin * header.box_y_radius));
+    x_offset = width / 2.;
+    y_offset = height / 2.;
+    const Simulation geometry = header.make_geometry();
+    // Inside of the domain is white, the outside grey and the boundary black
+    std::vector<uint8_t> inside((unsigned long) width * height);
+    parallel_for(height, this->num_threads, [&](unsigned long begin, unsigned long end, unsigned) {
+        for (unsigned long row = begin; row < end; row++) {
+            const double y = (y_offset - row - 0.5) / scale;
+            for (unsigned column = 0; column < width; column++) {
+                const double x = (column + 0.5 - x_offset) / scale;
+                inside[row * width + column] = geometry.is_in_domain(x, y);
+            }
+        }
+    });
+    parallel_for(height, this->num_threads, [&](unsigned long begin, unsigned long end, unsigned) {
+        for (unsigned long row = begin; row < end; row++) {
+            for (unsigned column = 0; column < width; column++) {
+                const unsigned long index = row * width + column;
+                if (not inside[index]) {
+                    background.set_pixel(column, row, 190, 190, 190);
+                    continue;
+                }
+                bool boundary = row == 0 or row == height - 1 or column == 0 or column == width - 1;
+                boundary = boundary or not inside[index - 1] or not inside[index + 1] or
+                           not inside[index - width] or not inside[index + width];
+                if (boundary) {
+                    background.set_pixel(column, row, 0, 0, 0);
+                } else {
+                    background.set_pixel(column, row, 255, 255, 255);
+                }
+            }
+        }
+    });
+}
+
+double Renderer::to_pixel_x(double x) const {
+    return x_offset + x * scale;
+}
+
+double Renderer::to_pixel_y(double y) const {
+    return y_offset - y * scale;
+}
+
+Image Renderer::render(const TrajectoryFrame &frame) const {
+    Image image = background;
+    if (mode == DENSITY or (mode == AUTO and frame.size() > density_threshold)) {
+        draw_density(frame, image);
+    } else {
+        draw_particles(frame, image);
+    }
+    return image;
+}
+
+Image Renderer::render(const Simulation &simulation, double t) const {
+    return render(TrajectoryFrame::from_simulation(simulation, t));
+}
+
+void Renderer::draw_particles(const TrajectoryFrame &frame, Image &image) const {
+    /**
+     * Each thread owns a band of rows, so no two threads write the same pixel.
+     * Particles are coloured by their direction of motion.
+     */
+    const double r = particle_radius;
+    parallel_for(image.height, num_threads, [&](unsigned long begin, unsigned long end, unsigned) {
+        for (unsigned long particle = 0; particle < frame.size(); particle++) {
+            const double cx = to_pixel_x(frame.x[particle]);
+            const double cy = to_pixel_y(frame.y[particle]);
+            if (cy + r < begin or cy - r >= end) {
+                continue;
+            }
+            const double hue = std::fmod(std::fmod(frame.directions[particle], 2 * PI) + 2 * PI, 2 * PI) / (PI / 3);
+            const double fraction = hue - std::floor(hue);
+            const auto up = (uint8_t) (220 * fraction);
+            const auto down = (uint8_t) (220 * (1 - fraction));
+            uint8_t colours[6][3] = {{220, up,   0},
+                                     {down, 220, 0},
+                                     {0,    220, up},
+                                     {0,    down, 220},
+                                     {up,   0,   220},
+                                     {220,  0,   down}};
+            const uint8_t *colour = colours[std::min(5, (int) hue)];
+            const long y_start = std::max((long) begin, (long) std::floor(cy - r));
+            const long y_end = std::min((long) end - 1, (long) std::ceil(cy + r));
+            const long x_start = std::max(0l, (long) std::floor(cx - r));
+            const long x_end = std::min((long) image.width - 1, (long) std::ceil(cx + r));
+            for (long py = y_start; py <= y_end; py++) {
+                for (long px = x_start; px <= x_end; px++) {
+                    if ((px + 0.5 - cx) * (px + 0.5 - cx) + (py + 0.5 - cy) * (py + 0.5 - cy) <= r * r) {
+                        image.set_pixel(px, py, colour[0], colour[1], colour[2]);
+                    }
+                }
+            }
+        }
+    });
+}
+
+void Renderer::draw_density(const TrajectoryFrame &frame, Image &image) const {
+    /**
+     * Every thread splats its share of the particles bilinearly into a private density buffer.
+     * The buffers are then reduced row-wise in parallel and mapped logarithmically onto the background.
+     */
+    const unsigned long num_pixels = (unsigned long) image.width * image.height;
+    std::vector<std::vector<float>> buffers(num_threads);
+    parallel_for(frame.size(), num_threads, [&](unsigned long begin, unsigned long end, unsigned thread) {
+        std::vector<float> &density = buffers[thread];
+        density.assign(num_pixels, 0);
+        for (unsigned long particle = begin; particle < end; particle++) {
+            const double fx = to_pixel_x(frame.x[particle]) - 0.5;
+            const double fy = to_pixel_y(frame.y[particle]) - 0.5;
+            const long x0 = (long) std::floor(fx);
+            const long y0 = (long) std::floor(fy);
+            const double wx = fx - x0;
+            const double wy = fy - y0;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    const long x = x0 + dx;
+                    const long y = y0 + dy;
+                    if (x < 0 or y < 0 or x >= (long) image.width or y >= (long) image.height) {
+                        continue;
+                    }
+                    density[y * image.width + x] += (float) ((dx ? wx : 1 - wx) * (dy ? wy : 1 - wy));
+                }
+            }
+        }
+    });
+    std::vector<float> &total = buffers[0];
+    total.resize(num_pixels, 0);
+    parallel_for(image.height, num_threads, [&](unsigned long begin, unsigned long end, unsigned) {
+        for (unsigned thread = 1; thread < buffers.size(); thread++) {
+            if (buffers[thread].empty()) {
+                continue;
+            }
+            for (unsigned long index = begin * image.width; index < end * image.width; index++) {
+                total[index] += buffers[thread][index];
+            }
+        }
+    });
+    const float max_density = *std::max_element(total.begin(), total.end());
+    if (max_density <= 0) {
+        return;
+    }
+    const double log_max = std::log1p(max_density);
+    parallel_for(image.height, num_threads, [&](unsigned long begin, unsigned long end, unsigned) {
+        for (unsigned long index = begin * image.width; index < end * image.width; index++) {
+            if (total[index] <= 0) {
+                continue;
+            }
+            const double alpha = std::log1p(total[index]) / log_max;
+            uint8_t *pixel = &image.pixels[3 * index];
+            // Blend towards a dark blue for high densities
+            const uint8_t target[3] = {20, 40, 140};
+            for (int channel = 0; channel < 3; channel++) {
+                pixel[channel] = (uint8_t) (pixel[channel] * (1 - alpha) + target[channel] * alpha);
+            }
+        }
+    });
+}
@@ -0,0 +1,94 @@
+#ifndef TERRIER_RENDERER_H
+#define TERRIER_RENDERER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "trajectory.h"
+
+/**
+ * RGB image with 8 bits per channel, stored row by row from the top.
+ */
+class Image {
+public:
+    Image(unsigned width, unsigned height);
+
+    void set_pixel(unsigned x, unsigned y, uint8_t r, uint8_t g, uint8_t b);
+
+    /**
+     * Write the image as a binary PPM (P6) file.
+     * @param filename Name of the file
+     */
+    void write_ppm(const std::string &filename) const;
+
+    /**
+     * Write the image as a PNG file. The encoder is self-contained and uses stored (uncompressed) deflate blocks,
+     * so no external libraries are required. Convert the frames afterwards if file size matters.
+     * @param filename Name of the file
+     */
+    void write_png(const std::string &filename) const;
+
+    unsigned width;
+    unsigned height;
+    std::vector<uint8_t> pixels;
+};
+
+/**
+ * Headless renderer for the two-urn geometry and the particles in it.
+ * The geometry is rasterized once; each frame then either draws every particle as a small disk,
+ * or for large systems splats the particles onto a density map.
+ * Both the background and the frames are computed with multiple threads.
+ */
+class Renderer {
+public:
+    enum Mode {
+        AUTO, PARTICLES, DENSITY
+    };
+
+    /**
+     * Create a renderer for a given geometry
+     * @param header Geometry of the system, e.g. from `TrajectoryHeader::from_simulation` or a trajectory file
+     * @param width Width of the images in pixels
+     * @param height Height of the images in pixels
+     * @param num_threads Number of threads to render with. Zero means all available cores.
+     */
+    Renderer(const TrajectoryHeader &header, unsigned width, unsigned height, unsigned num_threads = 0);
+
+    /**
+     * Render a single frame.
+     * @param frame Particle positions and directions
+     * @return The rendered image
+     */
+    Image render(const TrajectoryFrame &frame) const;
+
+    /**
+     * Render the current state of a simulation. Positions are interpolated at time `t`.
+     * @param simulation Running simulation
+     * @param t Time between the current time and the next impact of the simulation
+     * @return The rendered image
+     */
+    Image render(const Simulation &simulation, double t) const;
+
+    Mode mode = AUTO;
+    // In AUTO mode, frames with more particles than this are rendered as a density map
+    unsigned long density_threshold = 5000;
+    // Radius of a particle disk in pixels
+    double particle_radius = 2;
+    unsigned num_threads;
+
+private:
+    void draw_particles(const TrajectoryFrame &frame, Image &image) const;
+
+    void draw_density(const TrajectoryFrame &frame, Image &image) const;
+
+    double to_pixel_x(double x) const;
+
+    double to_pixel_y(double y) const;
+
+    Image background;
+    double scale;
+    double x_offset;
+    double y_offset;
+};
+
+#endif //TERRIER_RENDERER_H
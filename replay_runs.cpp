@@ -0,0 +1,59 @@
+#include <iostream>
+#include "checkpoint.h"
+#include "trajectory.h"
+#include <string>
+
+/**
+ * This file contains an executable that re-simulates a time window of an earlier run with full trajectory output.
+ * The run must have kept a `CheckpointRing` and written it to file. The latest checkpoint before the window is
+ * restored, the simulation is fast-forwarded to the start of the window, and from there a frame is written
+ * every `dt` until the end of the window. The binary trajectory can be rendered with the `render` executable.
+ * With `quantized` as codec, the frames are stored with `QuantizedDeltaCodec`, about an order of magnitude smaller.
+ * A filter (see `TrajectoryFilter::parse`, e.g. `gates` or `tagged:3,14`) restricts the frames to the particles
+ * of interest.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 5) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) checkpoint file, (2) start time, (3) end time, (4) time between frames,"
+                " and optionally (5) trajectory file, (6) codec (raw/quantized) and (7) filter");
+    }
+    const std::string checkpoint_file = argv[1];
+    const double t_start = std::stod(argv[2]);
+    const double t_end = std::stod(argv[3]);
+    const double dt = std::stod(argv[4]);
+    const std::string trajectory_file = argc > 5 ? argv[5] : "replay.trj";
+    const std::string codec = argc > 6 ? argv[6] : "raw";
+    if (codec != "raw" and codec != "quantized") {
+        throw std::invalid_argument("Unknown codec " + codec + ", choose raw or quantized");
+    }
+    const TrajectoryFilter filter = TrajectoryFilter::parse(argc > 7 ? argv[7] : "all");
+    if (dt <= 0 or t_end < t_start) {
+        throw std::invalid_argument("Please provide a positive time between frames and a non-empty window");
+    }
+    CheckpointRing checkpoints(checkpoint_file);
+    const SimulationState *state = checkpoints.find(t_start);
+    if (state == nullptr) {
+        throw std::invalid_argument("No checkpoint at or before the start of the window");
+    }
+    Simulation simulation = checkpoints.make_simulation();
+    simulation.restore_state(*state);
+    printf("Restored checkpoint at time %.2f (%lu collisions)\n", simulation.time, simulation.num_collisions);
+    TrajectoryHeader header = TrajectoryHeader::from_simulation(simulation);
+    if (codec == "quantized") {
+        header.codec = TrajectoryHeader::QUANTIZED_DELTA;
+    }
+    header.indexed = filter.selection != TrajectoryFilter::ALL;
+    TrajectoryWriter writer(trajectory_file, header);
+    for (unsigned long frame = 0; t_start + frame * dt <= t_end; frame++) {
+        const double t = t_start + frame * dt;
+        while (simulation.get_next_event_time() < t) {
+            simulation.update(0);
+        }
+        writer.write_frame(simulation, t, filter);
+    }
+    printf("Wrote %lu frames between %.2f and %.2f to %s\n", writer.frames_written, t_start, t_end,
+           trajectory_file.c_str());
+    return 0;
+}
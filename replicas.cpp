@@ -0,0 +1,206 @@
+#include "replicas.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+void RunningStatistics::add(double value) {
+    n++;
+    const double delta = value - running_mean;
+    running_mean += delta / n;
+    sum_of_squares += delta * (value - running_mean);
+}
+
+void RunningStatistics::merge(const RunningStatistics &other) {
+    if (other.n == 0) {
+        return;
+    }
+    const unsigned long combined = n + other.n;
+    const double delta = other.running_mean - running_mean;
+    running_mean += delta * other.n / combined;
+    sum_of_squares += other.sum_of_squares + delta * delta * n * other.n / combined;
+    n = combined;
+}
+
+unsigned long RunningStatistics::count() const {
+    return n;
+}
+
+double RunningStatistics::mean() const {
+    return running_mean;
+}
+
+double RunningStatistics::variance() const {
+    return n > 1 ? sum_of_squares / (n - 1) : 0;
+}
+
+double RunningStatistics::standard_error() const {
+    return n > 1 ? std::sqrt(variance() / n) : std::numeric_limits<double>::infinity();
+}
+
+QuantileSketch::QuantileSketch(double relative_accuracy) : relative_accuracy(relative_accuracy) {
+    if (relative_accuracy <= 0 or relative_accuracy >= 1) {
+        throw std::invalid_argument("Relative accuracy should be between 0 and 1");
+    }
+    log_gamma = std::log((1 + relative_accuracy) / (1 - relative_accuracy));
+}
+
+int QuantileSketch::bucket(double magnitude) const {
+    return (int) std::ceil(std::log(magnitude) / log_gamma);
+}
+
+double QuantileSketch::value(int bucket) const {
+    // Midpoint of (gamma^(i-1), gamma^i] in the relative sense
+    const double gamma = std::exp(log_gamma);
+    return 2 * std::exp(bucket * log_gamma) / (gamma + 1);
+}
+
+void QuantileSketch::add_to(std::vector<unsigned long> &counts, int &offset, int index, unsigned long amount) {
+    if (counts.empty()) {
+        offset = index;
+    } else if (index < offset) {
+        counts.insert(counts.begin(), (unsigned long) (offset - index), 0);
+        offset = index;
+    }
+    if (index - offset >= (int) counts.size()) {
+        counts.resize(index - offset + 1);
+    }
+    counts[index - offset] += amount;
+}
+
+void QuantileSketch::add(double value) {
+    if (value > 0) {
+        add_to(positive, positive_offset, bucket(value), 1);
+    } else if (value < 0) {
+        add_to(negative, negative_offset, bucket(-value), 1);
+    } else {
+        zero_count++;
+    }
+    total++;
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+    if (other.log_gamma != log_gamma) {
+        throw std::invalid_argument("Only sketches with the same accuracy can be merged");
+    }
+    for (unsigned long i = 0; i < other.positive.size(); i++) {
+        if (other.positive[i] > 0) {
+            add_to(positive, positive_offset, other.positive_offset + (int) i, other.positive[i]);
+        }
+    }
+    for (unsigned long i = 0; i < other.negative.size(); i++) {
+        if (other.negative[i] > 0) {
+            add_to(negative, negative_offset, other.negative_offset + (int) i, other.negative[i]);
+        }
+    }
+    zero_count += other.zero_count;
+    total += other.total;
+}
+
+double QuantileSketch::quantile(double q) const {
+    if (total == 0) {
+        return 0;
+    }
+    const double rank = std::min(std::max(q, 0.), 1.) * (total - 1);
+    unsigned long seen = 0;
+    // From the most negative value up
+    for (unsigned long i = negative.size(); i > 0; i--) {
+        seen += negative[i - 1];
+        if (seen > rank) {
+            return -value(negative_offset + (int) i - 1);
+        }
+    }
+    seen += zero_count;
+    if (seen > rank) {
+        return 0;
+    }
+    for (unsigned long i = 0; i < positive.size(); i++) {
+        seen += positive[i];
+        if (seen > rank) {
+            return value(positive_offset + (int) i);
+        }
+    }
+    return value(positive_offset + (int) positive.size() - 1);
+}
+
+unsigned long QuantileSketch::count() const {
+    return total;
+}
+
+ReplicaRunner::ReplicaRunner(unsigned num_threads)
+        : num_threads(num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+bool ReplicaRunner::is_precise(const RunningStatistics &statistics) const {
+    const double error = statistics.standard_error();
+    return (absolute_precision > 0 and error <= absolute_precision) or
+           (relative_precision > 0 and error <= relative_precision * std::fabs(statistics.mean()));
+}
+
+ReplicaResult ReplicaRunner::run(const std::function<void(unsigned long, std::vector<double> &)> &replica,
+                                 unsigned num_observables) const {
+    ReplicaResult result;
+    result.statistics.resize(num_observables);
+    result.sketches.assign(num_observables, QuantileSketch(relative_accuracy));
+    std::mutex mutex;
+    // Observables of replicas that finished before an earlier one
+    std::map<unsigned long, std::vector<double>> pending;
+    std::atomic<unsigned long> next_replica{0};
+    std::atomic<bool> done{max_replicas == 0};
+    std::exception_ptr failure;
+    auto work = [&]() {
+        std::vector<double> observables;
+        while (not done) {
+            const unsigned long r = next_replica++;
+            if (r >= max_replicas) {
+                return;
+            }
+            observables.assign(num_observables, 0);
+            try {
+                replica(r, observables);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failure = std::current_exception();
+                done = true;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (done) {
+                return;
+            }
+            pending.emplace(r, observables);
+            while (not done and not pending.empty() and pending.begin()->first == result.num_replicas) {
+                const std::vector<double> &values = pending.begin()->second;
+                for (unsigned i = 0; i < num_observables; i++) {
+                    result.statistics[i].add(values[i]);
+                    result.sketches[i].add(values[i]);
+                }
+                pending.erase(pending.begin());
+                result.num_replicas++;
+                if (num_observables > 0 and result.num_replicas >= min_replicas and
+                    is_precise(result.statistics[0])) {
+                    result.converged = true;
+                    done = true;
+                } else if (result.num_replicas == max_replicas) {
+                    done = true;
+                }
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned thread = 0; thread < num_threads; thread++) {
+        threads.emplace_back(work);
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    return result;
+}
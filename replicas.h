@@ -0,0 +1,137 @@
+#ifndef TERRIER_REPLICAS_H
+#define TERRIER_REPLICAS_H
+
+#include <functional>
+#include <vector>
+
+/**
+ * Mean and variance of a stream of values, with Welford's update.
+ */
+class RunningStatistics {
+public:
+    void add(double value);
+
+    /**
+     * Combine with the statistics of another stream.
+     */
+    void merge(const RunningStatistics &other);
+
+    unsigned long count() const;
+
+    double mean() const;
+
+    /**
+     * @return Sample variance, zero for less than two values
+     */
+    double variance() const;
+
+    /**
+     * @return Standard error of the mean
+     */
+    double standard_error() const;
+
+private:
+    unsigned long n = 0;
+    double running_mean = 0;
+    double sum_of_squares = 0;
+};
+
+/**
+ * Quantiles of a stream of values in constant memory, as in DDSketch: values are counted in logarithmic buckets,
+ * so every quantile is returned with a relative error of at most `relative_accuracy`.
+ */
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double relative_accuracy = 0.01);
+
+    void add(double value);
+
+    /**
+     * Combine with a sketch of another stream, with the same accuracy.
+     */
+    void merge(const QuantileSketch &other);
+
+    /**
+     * @param q Quantile between 0 and 1
+     * @return Estimate of the quantile, zero for an empty sketch
+     */
+    double quantile(double q) const;
+
+    unsigned long count() const;
+
+private:
+    int bucket(double magnitude) const;
+
+    double value(int bucket) const;
+
+    static void add_to(std::vector<unsigned long> &counts, int &offset, int index, unsigned long amount);
+
+    double relative_accuracy;
+    double log_gamma;
+    // Bucket counts of positive values and of the magnitudes of negative values; entry i is bucket i + offset
+    std::vector<unsigned long> positive;
+    std::vector<unsigned long> negative;
+    int positive_offset = 0;
+    int negative_offset = 0;
+    unsigned long zero_count = 0;
+    unsigned long total = 0;
+};
+
+/**
+ * Reduced observables of a set of replicas.
+ */
+struct ReplicaResult {
+    unsigned long num_replicas = 0;
+    // Whether the requested precision was reached before `max_replicas`
+    bool converged = false;
+    // Statistics and quantile sketch of every observable
+    std::vector<RunningStatistics> statistics;
+    std::vector<QuantileSketch> sketches;
+};
+
+/**
+ * Runs independent replicas of an experiment on a pool of threads and reduces their observables as they come in.
+ * Results are reduced in replica order, so a run is reproducible if replica `r` only depends on `r`
+ * (e.g. by seeding its simulation with `seed + r`), also when it stops early.
+ *
+ *     ReplicaRunner runner;
+ *     runner.relative_precision = 0.01;
+ *     ReplicaResult result = runner.run([](unsigned long replica, std::vector<double> &observables) {
+ *         ... run a simulation ...
+ *         observables[0] = simulation.time;
+ *     });
+ */
+class ReplicaRunner {
+public:
+    /**
+     * @param num_threads Number of threads, zero for one per hardware thread
+     */
+    explicit ReplicaRunner(unsigned num_threads = 0);
+
+    const unsigned num_threads;
+    unsigned long max_replicas = 1000;
+    // Replicas that are always run, before the precision is checked
+    unsigned long min_replicas = 10;
+    /**
+     * Stop as soon as the standard error of the mean of the first observable is below `absolute_precision`
+     * or below `relative_precision` times the magnitude of the mean. Zero disables a criterion.
+     */
+    double relative_precision = 0;
+    double absolute_precision = 0;
+    // Relative accuracy of the quantile sketches
+    double relative_accuracy = 0.01;
+
+    /**
+     * Run replicas until the precision is reached or `max_replicas` have run.
+     * @param replica Runs replica number `r` and writes its observables. Called concurrently from several threads.
+     * @param num_observables Number of observables per replica
+     * @return Reduced observables
+     */
+    ReplicaResult run(const std::function<void(unsigned long, std::vector<double> &)> &replica,
+                      unsigned num_observables = 1) const;
+
+private:
+    bool is_precise(const RunningStatistics &statistics) const;
+};
+
+#endif //TERRIER_REPLICAS_H
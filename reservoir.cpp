@@ -0,0 +1,146 @@
+#include <chrono>
+#include "reservoir.h"
+#include "correlator.h"
+
+ReservoirModel ReservoirModel::analytic(const Simulation &simulation) {
+    ReservoirModel model;
+    const double area = PI * simulation.circle_radius * simulation.circle_radius;
+    // Arc lengths of the mouths on the rim of the chamber
+    const double central_width = 2 * simulation.circle_radius * simulation.mouth_angle;
+    const double back_width = simulation.second_width > 0 ? 2 * simulation.circle_radius * simulation.second_mouth_angle
+                                                          : 0;
+    for (unsigned long side: {simulation.LEFT, simulation.RIGHT}) {
+        model.mean_durations[side] = PI * area / (central_width + back_width);
+        model.back_probabilities[side] = back_width / (central_width + back_width);
+    }
+    return model;
+}
+
+ReservoirModel ReservoirModel::calibrate(Simulation simulation, unsigned long num_visits, unsigned long seed,
+                                         double horizon) {
+    ReservoirModel model = analytic(simulation);
+    model.calibrating = true;
+    model.max_visits = num_visits;
+    simulation.reservoirs = &model;
+    simulation.seed(seed);
+    simulation.start(0.5);
+    while (model.num_started < num_visits) {
+        simulation.update(0.0);
+    }
+    // Waiting for every visit would take long, since the longest of many visits in a circular chamber is very long
+    const double end_time = simulation.time * (1 + horizon);
+    while (model.get_num_censored() > 0 and simulation.time < end_time) {
+        simulation.update(0.0);
+    }
+    model.calibrating = false;
+    return model;
+}
+
+unsigned long ReservoirModel::get_num_censored() const {
+    unsigned long num_recorded = 0;
+    for (const auto &side: returns) {
+        num_recorded += side[0].size() + side[1].size();
+    }
+    return num_started - num_recorded;
+}
+
+double ReservoirModel::get_mean_duration(unsigned long side) const {
+    const std::size_t num_recorded = returns[side][0].size() + returns[side][1].size();
+    if (num_recorded == 0) {
+        return mean_durations[side];
+    }
+    double total = 0;
+    for (const std::vector<Return> &recorded: returns[side]) {
+        for (const Return &visit: recorded) {
+            total += visit.duration;
+        }
+    }
+    return total / num_recorded;
+}
+
+const std::vector<ReservoirModel::Return> &ReservoirModel::get_returns(unsigned long side, bool back_entry) const {
+    return returns[side][back_entry];
+}
+
+std::string ReservoirComparison::to_line() const {
+    std::ostringstream s;
+    s << mode << "," << mass_spread << "," << mass_spread_error;
+    for (double current: currents) {
+        s << "," << current;
+    }
+    for (double error: current_errors) {
+        s << "," << error;
+    }
+    s << "," << num_events << "," << seconds << "," << calibration_seconds;
+    return s.str();
+}
+
+/**
+ * Sample a started simulation from `start_time` until `end_time` or `end_collisions`, whichever comes first,
+ * and fill in the observables of a comparison.
+ */
+static void measure(Simulation &simulation, double start_time, double end_time, unsigned long end_collisions,
+                    double dt, ReservoirComparison &comparison) {
+    while (simulation.time < start_time) {
+        simulation.update(0.0);
+    }
+    const auto clock_start = std::chrono::steady_clock::now();
+    const unsigned long collision_offset = simulation.num_collisions;
+    TimeCorrelations correlations(dt);
+    correlations.record(simulation);
+    // The correlations sample between events, so they are fed after every event, as in correlation_runs.cpp
+    while (simulation.time < end_time and simulation.num_collisions < end_collisions) {
+        simulation.update(0.0);
+        correlations.record(simulation);
+    }
+    comparison.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+    comparison.num_events = simulation.num_collisions - collision_offset;
+    comparison.mass_spread = correlations.get_mass_spread();
+    comparison.mass_spread_error = correlations.get_mass_spread_error();
+    for (unsigned i = 0; i < 4; i++) {
+        const MultiTauCorrelator &current = correlations.get_correlator(TimeCorrelations::CURRENT + i);
+        comparison.currents[i] = current.mean();
+        comparison.current_errors[i] = current.get_standard_error();
+    }
+}
+
+std::vector<ReservoirComparison> compare_reservoirs(const ExperimentSpec &spec, unsigned long num_calibration_returns,
+                                                    double dt, unsigned long seed) {
+    if (spec.M_t == 0 or spec.M_f <= spec.M_t) {
+        throw std::invalid_argument("A reservoir comparison needs a transient and a measurement");
+    }
+    std::vector<ReservoirComparison> comparisons(3);
+    comparisons[0].mode = "exact";
+    comparisons[1].mode = "analytic";
+    comparisons[2].mode = "calibrated";
+
+    // The exact run sets the window of simulated time
+    Simulation exact = spec.make_simulation();
+    exact.seed(seed);
+    exact.start(spec.left_ratio);
+    while (exact.num_collisions < spec.M_t) {
+        exact.update(0.0);
+    }
+    const double start_time = exact.time;
+    const unsigned long no_limit = std::numeric_limits<unsigned long>::max();
+    measure(exact, start_time, std::numeric_limits<double>::infinity(), spec.M_f, dt, comparisons[0]);
+    const double end_time = exact.time;
+
+    ReservoirModel analytic = ReservoirModel::analytic(exact);
+    Simulation sampled = spec.make_simulation();
+    sampled.reservoirs = &analytic;
+    sampled.seed(seed);
+    sampled.start(spec.left_ratio);
+    measure(sampled, start_time, end_time, no_limit, dt, comparisons[1]);
+
+    const auto clock_start = std::chrono::steady_clock::now();
+    ReservoirModel calibrated = ReservoirModel::calibrate(spec.make_simulation(), num_calibration_returns, seed + 1);
+    comparisons[2].calibration_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+    Simulation replayed = spec.make_simulation();
+    replayed.reservoirs = &calibrated;
+    replayed.seed(seed);
+    replayed.start(spec.left_ratio);
+    measure(replayed, start_time, end_time, no_limit, dt, comparisons[2]);
+    return comparisons;
+}
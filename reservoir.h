@@ -0,0 +1,169 @@
+#ifndef TERRIER_RESERVOIR_H
+#define TERRIER_RESERVOIR_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include "experiment.h"
+#include "simulation.h"
+
+/**
+ * Distribution of the visits of particles to a chamber, for the stochastic reservoirs of `Simulation::reservoirs`.
+ * A visit starts at the first bounce off the chamber wall and ends when the particle leaves the chamber through
+ * the mouth of the central or the back channel.
+ *
+ * The analytic model assumes that the chamber is ergodic: the visits last an exponential time with the mean return
+ * time of Kac's lemma, pi A / W for a chamber of area A with mouths of total width W at unit speed. A particle
+ * returns through a mouth with a probability proportional to its width, at a uniform place, with a cosine
+ * distribution of directions around the normal of the mouth.
+ * A calibrated model replays the visits of a short exact run instead, with their joint distribution of durations,
+ * mouths, places and directions, given the mouth the particle entered through: a channel collimates the particles
+ * it lets in, so many cross the chamber in a few bounces. Circular chambers are far from ergodic: a particle that
+ * enters almost along a diameter precesses slowly and stays long, so the durations have a heavy tail that the
+ * analytic model misses.
+ */
+class ReservoirModel {
+public:
+    struct Return {
+        // Time from the first wall bounce to the return
+        double duration = 0;
+        // Whether the particle entered through the back channel, and whether it returns through it
+        bool back_entry = false;
+        bool back = false;
+        // Place across the mouth, from -1 to 1 times half its width
+        double offset = 0;
+        // Direction relative to the normal of the mouth into the channel, between -pi / 2 and pi / 2
+        double angle = 0;
+    };
+
+    /**
+     * @param simulation Simulation that has been set up
+     * @return Model of an ergodic chamber of the simulation
+     */
+    static ReservoirModel analytic(const Simulation &simulation);
+
+    /**
+     * Record the visits of an exact run. The run starts with half of the particles on either side; their first
+     * visits are skipped, since they did not enter through a mouth. Once `num_visits` visits have started, the run
+     * continues until they have all ended, or for `horizon` times the time it took to start them. Visits still going
+     * on by then are censored: they are dropped, which shortens the tail a little.
+     * A side without visits falls back to the analytic model.
+     * @param simulation Simulation that has been set up; it is copied, and reseeded with `seed`
+     * @param num_visits Number of visits to record
+     * @param seed Seed of the run
+     * @param horizon Length of the run after the last visit started, relative to the time it took to start them
+     * @return Calibrated model
+     */
+    static ReservoirModel calibrate(Simulation simulation, unsigned long num_visits, unsigned long seed = 0,
+                                    double horizon = 10);
+
+    /**
+     * Draw a visit to a chamber. Inline, since the engine calls it on every wall bounce.
+     * @param side LEFT or RIGHT
+     * @param back_entry Whether the particle entered through the back channel
+     * @param u Four uniform numbers in [0, 1)
+     * @return Return of the particle
+     */
+    Return sample(unsigned long side, bool back_entry, const double *u) const {
+        const std::vector<Return> &recorded = returns[side][back_entry];
+        if (not recorded.empty()) {
+            return recorded[std::min((std::size_t) (u[0] * recorded.size()), recorded.size() - 1)];
+        }
+        Return visit;
+        visit.back_entry = back_entry;
+        visit.duration = -mean_durations[side] * std::log(1 - u[0]);
+        visit.back = u[1] < back_probabilities[side];
+        visit.offset = 2 * u[2] - 1;
+        visit.angle = std::asin(2 * u[3] - 1);
+        return visit;
+    }
+
+    /**
+     * Called by the engine when a visit starts while `calibrating` is set.
+     * @return Whether the visit is to be recorded
+     */
+    bool start_visit() {
+        if (num_started >= max_visits) {
+            return false;
+        }
+        num_started++;
+        return true;
+    }
+
+    /**
+     * Add a visit recorded by the engine while `calibrating` is set.
+     */
+    void add_return(unsigned long side, const Return &visit) {
+        returns[side][visit.back_entry].push_back(visit);
+    }
+
+    /**
+     * @return Number of visits of the calibration run that were still going on at its horizon
+     */
+    unsigned long get_num_censored() const;
+
+    /**
+     * @param side LEFT or RIGHT
+     * @return Mean duration of a visit, over both mouths
+     */
+    double get_mean_duration(unsigned long side) const;
+
+    /**
+     * @param side LEFT or RIGHT
+     * @param back_entry Whether the visits entered through the back channel
+     * @return Recorded visits, empty for the analytic model
+     */
+    const std::vector<Return> &get_returns(unsigned long side, bool back_entry) const;
+
+    // While set, a simulation with this model runs the exact billiard and records the visits with `add_return`
+    bool calibrating = false;
+
+private:
+    double mean_durations[2] = {0, 0};
+    double back_probabilities[2] = {0, 0};
+    // Recorded visits per side and mouth of entry
+    std::vector<Return> returns[2][2];
+    unsigned long max_visits = 0;
+    unsigned long num_started = 0;
+};
+
+/**
+ * Observables of a sweep point in one reservoir mode, see `compare_reservoirs`.
+ */
+struct ReservoirComparison {
+    // exact, analytic or calibrated
+    std::string mode;
+    // Time average of the mass spread and its standard error, see `TimeCorrelations`
+    double mass_spread = 0;
+    double mass_spread_error = 0;
+    // Average currents (see `Simulation::current_counters`) and their standard errors
+    std::vector<double> currents = std::vector<double>(4, 0);
+    std::vector<double> current_errors = std::vector<double>(4, 0);
+    // Events processed during the measurement, and the wall-clock time they took
+    unsigned long num_events = 0;
+    double seconds = 0;
+    // Wall-clock time of the calibration run
+    double calibration_seconds = 0;
+
+    /**
+     * @return mode, mass spread, its error, the four currents, their errors, events, seconds and calibration
+     * seconds, comma separated
+     */
+    std::string to_line() const;
+};
+
+/**
+ * Measure a sweep point with the exact billiard, with analytic reservoirs and with calibrated reservoirs.
+ * Reservoirs process far fewer events per unit of time, so all modes are measured over the same window of
+ * simulated time: from the time the exact run takes `M_t` collisions to the time it takes `M_f` collisions.
+ * The observables are sampled every `dt`, so their errors account for the correlation in time.
+ * @param spec Sweep point
+ * @param num_calibration_returns Number of visits recorded for the calibrated model
+ * @param dt Time between two samples
+ * @param seed Seed of the runs
+ * @return Exact, analytic and calibrated results, in that order
+ */
+std::vector<ReservoirComparison> compare_reservoirs(const ExperimentSpec &spec, unsigned long num_calibration_returns,
+                                                    double dt = 0.1, unsigned long seed = 0);
+
+#endif //TERRIER_RESERVOIR_H
@@ -0,0 +1,32 @@
+#include <iostream>
+#include "reservoir.h"
+#include <string>
+
+/**
+ * This file contains an executable that measures how well stochastic reservoirs (see `ReservoirModel`) reproduce
+ * the exact billiard for a sweep point. It runs the point exactly, with analytic reservoirs and with reservoirs
+ * calibrated from a short exact run, over the same window of simulated time (see `compare_reservoirs`).
+ * Every output line holds one mode, see `ReservoirComparison::to_line`.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) output file, (2) a sweep line, and optionally (3) the number of visits"
+                " to calibrate with, (4) the time between two samples and (5) the seed");
+    }
+    const std::vector<ReservoirComparison> comparisons =
+            compare_reservoirs(ExperimentSpec::from_line(argv[2]), argc > 3 ? std::stoul(argv[3]) : 100000,
+                               argc > 4 ? std::stod(argv[4]) : 0.1, argc > 5 ? std::stoul(argv[5]) : 0);
+    std::ofstream file(argv[1]);
+    const ReservoirComparison &exact = comparisons.front();
+    for (const ReservoirComparison &comparison: comparisons) {
+        file << comparison.to_line() << std::endl;
+        const double deviation = comparison.mass_spread - exact.mass_spread;
+        const double error = std::hypot(comparison.mass_spread_error, exact.mass_spread_error);
+        printf("%s: mass spread %.4f +/- %.4f (%.1f sigma from exact), %lu events in %.2f s\n",
+               comparison.mode.c_str(), comparison.mass_spread, comparison.mass_spread_error,
+               error > 0 ? deviation / error : 0., comparison.num_events, comparison.seconds);
+    }
+    return 0;
+}
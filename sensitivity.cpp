@@ -0,0 +1,120 @@
+#include "sensitivity.h"
+#include "replicas.h"
+
+std::string Sensitivity::to_line() const {
+    std::ostringstream s;
+    s << parameter << "," << lower << "," << upper << "," << mass_spread << "," << mass_spread_error << ","
+      << independent_error;
+    for (double current: currents) {
+        s << "," << current;
+    }
+    for (double error: current_errors) {
+        s << "," << error;
+    }
+    return s.str();
+}
+
+/**
+ * Measure a started simulation over consecutive windows of simulated time.
+ * @return Per observable (mass spread, then the four currents) its average in every window
+ */
+static std::vector<std::vector<double>> measure(Simulation &simulation, double start_time, double batch_time,
+                                                unsigned long num_batches) {
+    std::vector<std::vector<double>> series(5, std::vector<double>(num_batches, 0));
+    while (simulation.time < start_time) {
+        simulation.update(0.0);
+    }
+    for (unsigned long batch = 0; batch < num_batches; batch++) {
+        const double end_time = start_time + (batch + 1) * batch_time;
+        const std::vector<int> count_offset = simulation.current_counters;
+        double mass_spread = 0;
+        unsigned long num_events = 0;
+        while (simulation.time < end_time) {
+            simulation.update(0.0);
+            mass_spread += simulation.get_mass_spread();
+            num_events++;
+        }
+        series[0][batch] = num_events > 0 ? mass_spread / num_events : simulation.get_mass_spread();
+        for (unsigned int i = 0; i < 4; i++) {
+            series[i + 1][batch] = (simulation.current_counters.at(i) - count_offset.at(i)) / batch_time;
+        }
+    }
+    return series;
+}
+
+SensitivityAnalysis::SensitivityAnalysis(const ExperimentSpec &spec, unsigned long seed) : spec(spec), seed(seed) {
+}
+
+std::vector<Sensitivity> SensitivityAnalysis::run() const {
+    if (spec.M_t == 0 or spec.M_f <= spec.M_t or num_batches < 2) {
+        throw std::invalid_argument("Sensitivities need a transient, a measurement and at least two batches");
+    }
+    auto start = [this](const ExperimentSpec &point) {
+        Simulation simulation = point.make_simulation();
+        simulation.use_common_random_numbers(seed);
+        simulation.start(point.left_ratio);
+        return simulation;
+    };
+    Simulation base = start(spec);
+    while (base.num_collisions < spec.M_t) {
+        base.update(0.0);
+    }
+    const double start_time = base.time;
+    const double batch_time = start_time / spec.M_t * (spec.M_f - spec.M_t) / num_batches;
+    const std::vector<std::vector<double>> base_series = measure(base, start_time, batch_time, num_batches);
+
+    std::vector<Sensitivity> sensitivities;
+    const std::vector<std::string> parameters = {"channel_width", "channel_length", "threshold"};
+    for (const std::string &parameter: parameters) {
+        ExperimentSpec lower_spec = spec;
+        ExperimentSpec upper_spec = spec;
+        Sensitivity sensitivity;
+        sensitivity.parameter = parameter;
+        if (parameter == "channel_width") {
+            lower_spec.channel_width *= 1 - relative_step;
+            upper_spec.channel_width *= 1 + relative_step;
+            sensitivity.lower = lower_spec.channel_width;
+            sensitivity.upper = upper_spec.channel_width;
+        } else if (parameter == "channel_length") {
+            lower_spec.channel_length *= 1 - relative_step;
+            upper_spec.channel_length *= 1 + relative_step;
+            sensitivity.lower = lower_spec.channel_length;
+            sensitivity.upper = upper_spec.channel_length;
+        } else {
+            // A gate that admits nothing is a different system, so take a one-sided difference at a threshold of 1
+            lower_spec.threshold = std::max(1, spec.threshold - 1);
+            upper_spec.threshold = spec.threshold + 1;
+            sensitivity.lower = lower_spec.threshold;
+            sensitivity.upper = upper_spec.threshold;
+        }
+        std::vector<std::vector<double>> lower_series = base_series;
+        if (parameter != "threshold" or lower_spec.threshold != spec.threshold) {
+            Simulation lower = start(lower_spec);
+            lower_series = measure(lower, start_time, batch_time, num_batches);
+        }
+        Simulation upper = start(upper_spec);
+        const std::vector<std::vector<double>> upper_series = measure(upper, start_time, batch_time, num_batches);
+        const double step = sensitivity.upper - sensitivity.lower;
+        for (unsigned int observable = 0; observable < 5; observable++) {
+            RunningStatistics differences;
+            RunningStatistics lower_statistics;
+            RunningStatistics upper_statistics;
+            for (unsigned long batch = 0; batch < num_batches; batch++) {
+                differences.add((upper_series[observable][batch] - lower_series[observable][batch]) / step);
+                lower_statistics.add(lower_series[observable][batch]);
+                upper_statistics.add(upper_series[observable][batch]);
+            }
+            if (observable == 0) {
+                sensitivity.mass_spread = differences.mean();
+                sensitivity.mass_spread_error = differences.standard_error();
+                sensitivity.independent_error = std::sqrt(std::pow(lower_statistics.standard_error(), 2) +
+                                                          std::pow(upper_statistics.standard_error(), 2)) / step;
+            } else {
+                sensitivity.currents.at(observable - 1) = differences.mean();
+                sensitivity.current_errors.at(observable - 1) = differences.standard_error();
+            }
+        }
+        sensitivities.push_back(sensitivity);
+    }
+    return sensitivities;
+}
@@ -0,0 +1,64 @@
+#ifndef TERRIER_SENSITIVITY_H
+#define TERRIER_SENSITIVITY_H
+
+#include <string>
+#include <vector>
+#include "experiment.h"
+
+/**
+ * Finite-difference derivative of the observables of a sweep point with respect to one parameter.
+ */
+struct Sensitivity {
+    std::string parameter;
+    // Values of the parameter in the two runs that are differenced
+    double lower = 0;
+    double upper = 0;
+    // Derivative of the average mass spread and its standard error over the batches
+    double mass_spread = 0;
+    double mass_spread_error = 0;
+    // Standard error the same derivative would have with independent runs, from the variances of the two runs
+    double independent_error = 0;
+    // Derivatives of the average currents (see `Simulation::current_counters`) and their standard errors
+    std::vector<double> currents = std::vector<double>(4, 0);
+    std::vector<double> current_errors = std::vector<double>(4, 0);
+
+    /**
+     * @return parameter, lower and upper value, mass spread derivative, its error, its independent error,
+     * the four current derivatives and their errors, comma separated
+     */
+    std::string to_line() const;
+};
+
+/**
+ * Derivatives of the mass spread and the currents with respect to the channel width, the channel length
+ * and the threshold, from runs that use common random numbers (see `Simulation::use_common_random_numbers`).
+ * The runs on both sides of a difference start from the same configuration and draw the same retraction angles,
+ * so most of their noise cancels in the difference.
+ *
+ * The base point runs `M_t` collisions of transient. All runs are then measured over the same `num_batches`
+ * windows of simulated time, which together last about as long as `M_f - M_t` collisions of the base point.
+ * The differences per window give the derivatives and their standard errors.
+ * The widths and lengths are perturbed by `relative_step` on both sides, the threshold by one.
+ */
+class SensitivityAnalysis {
+public:
+    /**
+     * @param spec Base point
+     * @param seed Seed of the common random numbers
+     */
+    explicit SensitivityAnalysis(const ExperimentSpec &spec, unsigned long seed = 0);
+
+    const ExperimentSpec spec;
+    const unsigned long seed;
+    double relative_step = 0.05;
+    unsigned long num_batches = 20;
+
+    /**
+     * Run the base point and the perturbed points one after the other.
+     * Throws `std::invalid_argument` if the base point has no transient or a perturbed geometry is not valid.
+     * @return Sensitivities to the channel width, channel length and threshold, in that order
+     */
+    std::vector<Sensitivity> run() const;
+};
+
+#endif //TERRIER_SENSITIVITY_H
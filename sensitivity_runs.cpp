@@ -0,0 +1,32 @@
+#include <iostream>
+#include "sensitivity.h"
+#include <string>
+
+/**
+ * This file contains an executable that estimates the derivatives of the mass spread and the currents of a
+ * sweep point with respect to the channel width, the channel length and the threshold, from runs that share
+ * their random numbers (see `SensitivityAnalysis`). Every output line holds one parameter, see `Sensitivity::to_line`.
+ * The error that independent runs of the same length would give is reported next to the actual error.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) output file, (2) a sweep line, and optionally (3) the relative step,"
+                " (4) the number of batches and (5) the seed");
+    }
+    SensitivityAnalysis analysis(ExperimentSpec::from_line(argv[2]), argc > 5 ? std::stoul(argv[5]) : 0);
+    if (argc > 3) {
+        analysis.relative_step = std::stod(argv[3]);
+    }
+    if (argc > 4) {
+        analysis.num_batches = std::stoul(argv[4]);
+    }
+    std::ofstream file(argv[1]);
+    for (const Sensitivity &sensitivity: analysis.run()) {
+        file << sensitivity.to_line() << std::endl;
+        printf("d/d %s: mass spread %.4f +/- %.4f (independent runs: +/- %.4f)\n", sensitivity.parameter.c_str(),
+               sensitivity.mass_spread, sensitivity.mass_spread_error, sensitivity.independent_error);
+    }
+    return 0;
+}
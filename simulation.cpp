@@ -3,8 +3,10 @@
 //
 
 #include "simulation.h"
+#include "observers.h"
+#include "checkpoint.h"
+#include "reservoir.h"
 
-const double PI = 3.14159265358979324;
 const double EPS = 1E-14;
 #define px x_pos[particle]
 #define py y_pos[particle]
@@ -14,6 +16,18 @@ int sgn(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
+/**
+ * Reorder the values of a per-particle array: the value at `order[i]` moves to `i`.
+ */
+template<typename T>
+static void permute_values(std::vector<T> &values, const std::vector<unsigned long> &order) {
+    std::vector<T> permuted(values.size());
+    for (unsigned long i = 0; i < order.size(); i++) {
+        permuted[i] = values[order[i]];
+    }
+    values.swap(permuted);
+}
+
 Simulation::Simulation(int num_particles, double bridge_width, double circle_radius, double circle_distance,
                        int left_gate_capacity, int right_gate_capacity, bool random_dir, bool flat_gate)
         : num_particles(num_particles), circle_radius(circle_radius), circle_distance(circle_distance),
@@ -27,7 +41,6 @@ Simulation::Simulation(int num_particles, double bridge_width, double circle_rad
 
 void Simulation::setup() {
     next_impact_times.resize(num_particles);
-    sorted_indices.resize(num_particles);
     impact_times.resize(num_particles);
     x_pos.resize(num_particles);
     y_pos.resize(num_particles);
@@ -35,27 +48,165 @@ void Simulation::setup() {
     next_y_pos.resize(num_particles);
     directions.resize(num_particles);
     next_directions.resize(num_particles);
+    orbit_chords.resize(num_particles);
+    orbit_rotations.resize(num_particles);
+    particle_ids.resize(num_particles);
+    particle_indices.resize(num_particles);
+    std::iota(particle_ids.begin(), particle_ids.end(), 0);
+    std::iota(particle_indices.begin(), particle_indices.end(), 0);
+    species.resize(num_particles);
     gate_arrays.emplace_back(std::vector<bool>(num_particles));
     gate_arrays.emplace_back(std::vector<bool>(num_particles));
     gate_contents.push_back(currently_in_left_gate);
     gate_contents.push_back(currently_in_right_gate);
     gate_capacities.push_back(left_gate_capacity);
     gate_capacities.push_back(right_gate_capacity);
+    species_gate_capacities.assign(2, std::vector<int>(1, std::numeric_limits<int>::max()));
     couple_bridge();
     left_center_x = -circle_distance / 2 - circle_radius;
     right_center_x = circle_distance / 2 + circle_radius;
     max_path = circle_distance + bridge_width + circle_radius * 4 + second_length; // Upper bound for the longest path
 }
 
+void Simulation::seed(unsigned long seed) {
+    rng = std::make_shared<std::mt19937>(seed);
+}
+
+void Simulation::use_common_random_numbers(unsigned long seed) {
+    common_random_numbers = true;
+    common_seed = seed;
+    common_draws.assign(2 * num_particles, 0);
+}
+
+double Simulation::draw_uniform(const unsigned long &particle, unsigned stream) {
+    if (not common_random_numbers) {
+        return (*unif_real)(*rng);
+    }
+    // SplitMix64 finaliser of the key, a counter-based generator that needs no state besides the counter.
+    // The streams belong to the particle id, so renumbering does not change the draws
+    const unsigned long id = particle_ids[particle];
+    uint64_t z = common_seed * 0x9E3779B97F4A7C15ull + (2 * id + stream) * 0xBF58476D1CE4E5B9ull +
+                 common_draws[2 * id + stream]++ * 0x94D049BB133111EBull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z = z ^ (z >> 31);
+    return (double) (z >> 11) / 9007199254740992.;
+}
+
+void Simulation::save_state(SimulationState &state) const {
+    state.time = time;
+    state.num_collisions = num_collisions;
+    state.in_left = in_left;
+    state.current_counters = current_counters;
+    state.gate_capacities = gate_capacities;
+    state.gate_contents = gate_contents;
+    state.x_pos = x_pos;
+    state.y_pos = y_pos;
+    state.directions = directions;
+    state.impact_times = impact_times;
+    state.next_x_pos = next_x_pos;
+    state.next_y_pos = next_y_pos;
+    state.next_directions = next_directions;
+    state.next_impact_times = next_impact_times;
+    state.orbit_chords = orbit_chords;
+    state.orbit_rotations = orbit_rotations;
+    state.num_parked = num_parked;
+    state.parked_collision_rate = parked_collision_rate;
+    state.parked_collision_credit = parked_collision_credit;
+    std::ostringstream rng_state;
+    rng_state << *rng;
+    state.rng_state = rng_state.str();
+    state.common_random_numbers = common_random_numbers;
+    state.common_seed = common_seed;
+    state.common_draws = common_draws;
+    state.particle_ids = particle_ids;
+    state.species = species;
+    state.species_gate_capacities = species_gate_capacities;
+    state.species_in_left = species_in_left;
+    state.species_current_counters = species_current_counters;
+    state.wall_segments = wall_segments;
+    state.free_slots = free_slots;
+    state.num_lost_injections = num_lost_injections;
+}
+
+void Simulation::restore_state(const SimulationState &state) {
+    if (state.x_pos.size() != (unsigned long) num_particles or state.gate_contents.size() != 2) {
+        throw std::invalid_argument("Saved state does not match this simulation");
+    }
+    time = state.time;
+    last_written_time = state.time;
+    num_collisions = state.num_collisions;
+    in_left = state.in_left;
+    current_counters = state.current_counters;
+    gate_capacities = state.gate_capacities;
+    gate_contents = state.gate_contents;
+    x_pos = state.x_pos;
+    y_pos = state.y_pos;
+    directions = state.directions;
+    impact_times = state.impact_times;
+    next_x_pos = state.next_x_pos;
+    next_y_pos = state.next_y_pos;
+    next_directions = state.next_directions;
+    next_impact_times = state.next_impact_times;
+    orbit_chords = state.orbit_chords;
+    orbit_rotations = state.orbit_rotations;
+    num_parked = state.num_parked;
+    parked_collision_rate = state.parked_collision_rate;
+    parked_collision_credit = state.parked_collision_credit;
+    for (unsigned long direction: {LEFT, RIGHT}) {
+        std::fill(gate_arrays[direction].begin(), gate_arrays[direction].end(), false);
+        for (unsigned long particle: gate_contents[direction]) {
+            gate_arrays[direction][particle] = true;
+        }
+    }
+    rng = std::make_shared<std::mt19937>();
+    std::istringstream rng_state(state.rng_state);
+    rng_state >> *rng;
+    common_random_numbers = state.common_random_numbers;
+    common_seed = state.common_seed;
+    common_draws = state.common_draws;
+    if (state.particle_ids.size() == (unsigned long) num_particles) {
+        particle_ids = state.particle_ids;
+    } else {
+        std::iota(particle_ids.begin(), particle_ids.end(), 0);
+    }
+    index_particle_ids();
+    last_renumbering = num_collisions;
+    reset_occupancy();
+    if (state.species.size() == (unsigned long) num_particles) {
+        species = state.species;
+        species_gate_capacities = state.species_gate_capacities;
+        species_in_left = state.species_in_left;
+        species_current_counters = state.species_current_counters;
+        num_species = std::max(1ul, species_in_left.size());
+    }
+    wall_segments = state.wall_segments;
+    free_slots = state.free_slots;
+    num_lost_injections = state.num_lost_injections;
+    has_sinks = std::any_of(wall_segments.begin(), wall_segments.end(),
+                            [](const WallSegment &segment) { return not segment.is_source; });
+    // Particles with equal times may come out in a different order than in the original queue,
+    // which only matters for parked particles, whose times are all infinite
+    event_queue = EventQueue(queue_type);
+    event_queue.build(next_impact_times);
+}
+
 void Simulation::reset_particle(const unsigned long &particle, const unsigned long &direction) {
     px = 0;
     py = 0;
     while (not is_in_circle(px, py, direction) or is_in_gate(px, py, direction) or
            is_in_bridge(px, py) or is_in_second_bridge(px, py)) {
-        px = ((*unif_real)(*rng) - 0.5) * box_x_radius * 2;
-        py = ((*unif_real)(*rng) - 0.5) * box_y_radius * 2;
+        if (common_random_numbers) {
+            // Sample around the center of the chamber, so the place in the chamber does not depend on the channels
+            const double center_x = direction == LEFT ? left_center_x : right_center_x;
+            px = center_x + (draw_uniform(particle, 0) - 0.5) * circle_radius * 2;
+            py = (draw_uniform(particle, 0) - 0.5) * circle_radius * 2;
+        } else {
+            px = (draw_uniform(particle, 0) - 0.5) * box_x_radius * 2;
+            py = (draw_uniform(particle, 0) - 0.5) * box_y_radius * 2;
+        }
     }
-    directions.at(particle) = ((*unif_real)(*rng) - 0.5) * 2 * PI;
+    directions.at(particle) = (draw_uniform(particle, 0) - 0.5) * 2 * PI;
 }
 
 void Simulation::start(double left_ratio) {
@@ -68,35 +219,114 @@ void Simulation::start(double left_ratio) {
     if (left_ratio * num_particles < 0 or left_ratio * num_particles > num_particles) {
         throw std::domain_error("Please choose ratio between 0 and 1");
     }
-    const auto num_left_particles = (unsigned long) (left_ratio * num_particles);
+    if (is_open() and (park_trapped_orbits or track_occupancy)) {
+        throw std::logic_error("Open systems support neither parked orbits nor occupancy tracking");
+    }
+    if (reservoirs and (park_trapped_orbits or is_open())) {
+        throw std::logic_error("Stochastic reservoirs are available neither with parked orbits nor in open systems");
+    }
+    if (is_open() and initial_particles > (unsigned long) num_particles) {
+        throw std::invalid_argument("An open system can not start with more particles than it has slots");
+    }
+    // Clear what is left of an earlier run, so a simulation that has been set up can be started again
+    num_collisions = 0;
+    truncated = false;
+    std::fill(impact_times.begin(), impact_times.end(), 0);
+    for (unsigned long direction: {LEFT, RIGHT}) {
+        gate_contents[direction].clear();
+        std::fill(gate_arrays[direction].begin(), gate_arrays[direction].end(), false);
+    }
+    std::fill(orbit_chords.begin(), orbit_chords.end(), 0);
+    std::fill(common_draws.begin(), common_draws.end(), 0);
+    if (is_renumbered) {
+        // Species belong to the particle ids, which become the indices again
+        permute_values(species, particle_indices);
+    }
+    std::iota(particle_ids.begin(), particle_ids.end(), 0);
+    std::iota(particle_indices.begin(), particle_indices.end(), 0);
+    is_renumbered = false;
+    last_renumbering = 0;
+    reset_occupancy();
+    if (reservoirs and reservoirs->calibrating) {
+        // The first visits did not start at a mouth, so they are not recorded
+        reservoir_entry_times.assign(num_particles, -std::numeric_limits<double>::infinity());
+        reservoir_back_entries.assign(num_particles, 0);
+    } else {
+        reservoir_entry_times.clear();
+        reservoir_back_entries.clear();
+    }
+    const unsigned long num_initial_particles = is_open() ? initial_particles : num_particles;
+    const auto num_left_particles = (unsigned long) (left_ratio * num_initial_particles);
+    species_in_left.assign(num_species > 1 ? num_species : 0, 0);
+    species_current_counters.assign(species_in_left.size() * 4, 0);
     for (unsigned long particle = 0; particle < num_left_particles; particle++) {
         reset_particle(particle, LEFT);
         compute_next_impact(particle);
-        in_left++;
+        count_side_change(particle, true);
     }
-    for (unsigned long particle = num_left_particles; particle < num_particles; particle++) {
+    for (unsigned long particle = num_left_particles; particle < num_initial_particles; particle++) {
         reset_particle(particle, RIGHT);
         compute_next_impact(particle);
     }
+    // Injections take the free slot at the back, so the lowest slots fill first
+    free_slots.clear();
+    for (unsigned long particle = num_particles; particle-- > num_initial_particles;) {
+        free_slot(particle);
+        free_slots.push_back(particle);
+    }
+    num_lost_injections = 0;
+    for (WallSegment &segment: wall_segments) {
+        segment.count = 0;
+        if (segment.is_source) {
+            segment.next_time = time - std::log(1 - (*unif_real)(*rng)) / segment.rate;
+        }
+    }
     current_counters.resize(4);
     std::fill(current_counters.begin(), current_counters.end(), 0);
-    sort_indices();
+    num_parked = 0;
+    parked_collision_rate = 0;
+    parked_collision_credit = 0;
+    event_queue = EventQueue(queue_type);
+    event_queue.build(next_impact_times);
 }
 
 void Simulation::update(double write_dt) {
+    check_renumbering();
     // Find next event: the first particle that has a new impact
     // If we really need more optimization, this is where to get it.
-    unsigned long particle = sorted_indices[0];
+    unsigned long particle = event_queue.top();
     double next_impact = next_impact_times[particle];
-    num_collisions++;
+    const long source = wall_segments.empty() ? -1 : get_next_source();
+    const bool injecting = source >= 0 and wall_segments[source].next_time < next_impact;
+    if (std::isinf(next_impact) and not injecting) {
+        throw std::domain_error("All particles are parked on trapped orbits or have left the system");
+    }
     // Write a time slice, if desired
     if (write_dt > 0) {
-        while (next_impact > last_written_time + write_dt) {
+        const double next_event = injecting ? wall_segments[source].next_time : next_impact;
+        while (next_event > last_written_time + write_dt) {
             write_positions_to_file(last_written_time + write_dt);
             last_written_time += write_dt;
         }
         printf("Writing position at %.2f\n", last_written_time);
     }
+    if (injecting) {
+        inject(source);
+        return;
+    }
+    if (num_parked > 0) {
+        parked_collision_credit += parked_collision_rate * (next_impact - time);
+        const double credited = std::floor(parked_collision_credit);
+        num_collisions += (unsigned long) credited;
+        parked_collision_credit -= credited;
+    }
+    if (orbit_chords[particle] > 0) {
+        // Waking up from a fast-forward: count all the bounces that were skipped
+        num_collisions += std::lround((next_impact - impact_times[particle]) / orbit_chords[particle]);
+        orbit_chords[particle] = 0;
+    } else {
+        num_collisions++;
+    }
     count_first_gate_crossing(particle);
     // Check if the particle requires boundary conditions
     check_boundary_condition(particle);
@@ -109,15 +339,27 @@ void Simulation::update(double write_dt) {
     }
     // Process the location of the particle
     if (px > 0 and next_x_pos[particle] <= 0) {
-        in_left++;
+        count_side_change(particle, true);
+        record_crossing(particle, px, directions[particle], impact_times[particle], true);
     } else if (px <= 0 and next_x_pos[particle] > 0) {
-        in_left--;
+        count_side_change(particle, false);
+        record_crossing(particle, px, directions[particle], impact_times[particle], false);
     }
+    const double start_x = px;
+    const double start_y = py;
+    const double start_direction = directions[particle];
+    const double start_time = impact_times[particle];
     px = next_x_pos[particle];
     py = next_y_pos[particle];
     directions[particle] = next_directions[particle];
     impact_times[particle] = next_impact;
     time = next_impact;
+    if (has_sinks and check_absorption(particle)) {
+        return;
+    }
+    if (reservoirs and reservoirs->calibrating) {
+        record_reservoir_return(particle, start_x, start_y, start_direction, start_time);
+    }
     // Check if the particle activates the threshold
     for (unsigned long direction = 0; direction < 2; direction++) {
         if (is_in_gate(px, py, direction) and is_going_in(particle)) {
@@ -127,61 +369,664 @@ void Simulation::update(double write_dt) {
         }
     }
 
+    publish_event(particle, EventRecord::COLLISION);
     // Find out when this particle collides next
+    if (reservoirs and not reservoirs->calibrating and is_on_chamber_wall(px, py)) {
+        send_to_reservoir(particle, start_x);
+    } else {
+        compute_next_impact(particle);
+    }
+    if (park_trapped_orbits) {
+        check_trapped_orbit(particle);
+    }
+    event_queue.update(particle, next_impact_times, true);
+}
+
+void Simulation::check_trapped_orbit(const unsigned long &particle) {
+    /**
+     * The chord of the current bounce determines the orbit: the bounce points rotate by the angle between this bounce
+     * point and the next. A chord can only leave the circular part of the chamber if one of its end points lies
+     * on a mouth, so we step through the bounce points until one does.
+     */
+    const double center_x = px > 0 ? right_center_x : left_center_x;
+    const double radius = std::hypot(px - center_x, py);
+    const double next_radius = std::hypot(next_x_pos[particle] - center_x, next_y_pos[particle]);
+    if (std::fabs(radius - circle_radius) > 1E-9 or std::fabs(next_radius - circle_radius) > 1E-9) {
+        return;
+    }
+    const double start_angle = std::atan2(py, px - center_x);
+    const double rotation = std::remainder(std::atan2(next_y_pos[particle], next_x_pos[particle] - center_x)
+                                           - start_angle, 2 * PI);
+    const double chord = next_impact_times[particle] - impact_times[particle];
+    unsigned long escape = 2;
+    while (escape <= trap_horizon and not is_in_mouth(start_angle + escape * rotation, center_x)) {
+        escape++;
+    }
+    if (escape > trap_horizon) {
+        next_impact_times[particle] = std::numeric_limits<double>::infinity();
+        num_parked++;
+        parked_collision_rate += 1 / chord;
+    } else if (escape > 2) {
+        // Move on to the last bounce before the escape
+        const unsigned long bounces = escape - 1;
+        const double angle = start_angle + bounces * rotation;
+        next_x_pos[particle] = center_x + next_radius * std::cos(angle);
+        next_y_pos[particle] = next_radius * std::sin(angle);
+        next_directions[particle] = std::fmod(directions[particle] + bounces * rotation, 2 * PI);
+        next_impact_times[particle] = impact_times[particle] + bounces * chord;
+    } else {
+        return;
+    }
+    orbit_chords[particle] = chord;
+    orbit_rotations[particle] = rotation;
+}
+
+bool Simulation::is_in_mouth(double angle, double center_x) const {
+    // Measured from the direction of the bridge; a small margin makes sure we wake up early rather than late
+    const double margin = 1E-9;
+    const double relative_angle = std::fabs(std::remainder(angle - (center_x < 0 ? 0 : PI), 2 * PI));
+    return relative_angle < mouth_angle + margin or
+           (second_width > 0 and relative_angle > PI - second_mouth_angle - margin);
+}
+
+void Simulation::reschedule_particle(const unsigned long &particle) {
+    impact_times[particle] = time;
     compute_next_impact(particle);
-    reindex_particle(particle, true);
+    event_queue.update(particle, next_impact_times);
 }
 
-void Simulation::sort_indices() {
-    std::iota(sorted_indices.begin(), sorted_indices.end(), 0);
-    std::sort(sorted_indices.begin(), sorted_indices.end(), [this](size_t i1, size_t i2) {
-        return next_impact_times[i1] < next_impact_times[i2];
-    });
+void Simulation::publish_event(const unsigned long &particle, uint32_t kind) const {
+    if (observers) {
+        observers->publish({time, px, py, directions[particle], (uint32_t) particle_ids[particle], (uint32_t) in_left,
+                            kind});
+    }
+}
+
+unsigned long Simulation::get_num_parked() const {
+    return num_parked;
+}
+
+int Simulation::get_num_resets() const {
+    return reset_counter;
+}
+
+bool Simulation::is_independent_event(const unsigned long &particle) const {
+    const double &next_x = next_x_pos[particle];
+    const double &next_y = next_y_pos[particle];
+    if (gate_arrays[LEFT][particle] or gate_arrays[RIGHT][particle] or orbit_chords[particle] > 0) {
+        return false;
+    }
+    if (second_width > 0 and std::fabs(next_x) > box_x_radius) {
+        return false;
+    }
+    if (not is_in_domain(next_x, next_y)) {
+        return false;
+    }
+    if ((has_sinks and find_sink(next_x, next_y) >= 0) or (reservoirs and is_on_chamber_wall(next_x, next_y))) {
+        return false;
+    }
+    const bool going_in = next_x * cos(next_directions[particle]) <= 0;
+    return not(going_in and (is_in_gate(next_x, next_y, LEFT) or is_in_gate(next_x, next_y, RIGHT)));
 }
 
-unsigned long Simulation::find_index(const unsigned long &particle) const {
-    auto it = std::find(sorted_indices.begin(), sorted_indices.end(), particle);
-    if (it != sorted_indices.end()) {
-        return std::distance(sorted_indices.begin(), it);
+unsigned long Simulation::update_window(unsigned long max_events, std::vector<unsigned long> *in_left_trace) {
+    /**
+     * Events of different particles that stay clear of the gates commute, except for their order in time:
+     * in the serial order, a particle whose new event precedes a later event in the window would be processed again
+     * first. So we move and re-predict the whole independent prefix, commit it up to the first event that comes
+     * after a new prediction, and put the remaining particles back as they were.
+     */
+    const int STATE_SIZE = 8;
+    unsigned long processed = 0;
+    while (processed < max_events) {
+        check_renumbering();
+        if (park_trapped_orbits or (reservoirs and reservoirs->calibrating)) {
+            update(0);
+            processed++;
+            if (in_left_trace) {
+                in_left_trace->push_back(in_left);
+            }
+            continue;
+        }
+        event_queue.get_front(std::min(window_size, max_events - processed), next_impact_times, window);
+        const long source = wall_segments.empty() ? -1 : get_next_source();
+        if (source >= 0) {
+            // Events after the next injection wait for it
+            while (not window.empty() and next_impact_times[window.back()] >= wall_segments[source].next_time) {
+                window.pop_back();
+            }
+        }
+        unsigned long independent = 0;
+        while (independent < window.size() and is_independent_event(window[independent])) {
+            independent++;
+        }
+        if (independent == 0) {
+            update(0);
+            processed++;
+            if (in_left_trace) {
+                in_left_trace->push_back(in_left);
+            }
+            continue;
+        }
+        window_state.resize(independent * STATE_SIZE);
+        for (unsigned long i = 0; i < independent; i++) {
+            const unsigned long &particle = window[i];
+            double *state = &window_state[i * STATE_SIZE];
+            state[0] = px;
+            state[1] = py;
+            state[2] = directions[particle];
+            state[3] = impact_times[particle];
+            state[4] = next_x_pos[particle];
+            state[5] = next_y_pos[particle];
+            state[6] = next_directions[particle];
+            state[7] = next_impact_times[particle];
+            px = next_x_pos[particle];
+            py = next_y_pos[particle];
+            directions[particle] = next_directions[particle];
+            impact_times[particle] = next_impact_times[particle];
+        }
+        // A prediction that needs a reset stops the window there: the reset draws random numbers and is counted,
+        // which can not be undone, so it is left to `update` in the serial order
+        speculating = true;
+        unsigned long predicted = 0;
+        while (predicted < independent) {
+            compute_next_impact(window[predicted]);
+            if (speculation_failed) {
+                break;
+            }
+            predicted++;
+        }
+        speculating = false;
+        speculation_failed = false;
+        unsigned long committed = 0;
+        double earliest_prediction = std::numeric_limits<double>::infinity();
+        while (committed < predicted and window_state[committed * STATE_SIZE + 7] < earliest_prediction) {
+            earliest_prediction = std::min(earliest_prediction, next_impact_times[window[committed]]);
+            committed++;
+        }
+        for (unsigned long i = committed; i < independent; i++) {
+            const unsigned long &particle = window[i];
+            const double *state = &window_state[i * STATE_SIZE];
+            px = state[0];
+            py = state[1];
+            directions[particle] = state[2];
+            impact_times[particle] = state[3];
+            next_x_pos[particle] = state[4];
+            next_y_pos[particle] = state[5];
+            next_directions[particle] = state[6];
+            next_impact_times[particle] = state[7];
+        }
+        if (committed == 0) {
+            update(0);
+            processed++;
+            if (in_left_trace) {
+                in_left_trace->push_back(in_left);
+            }
+            continue;
+        }
+        window_times.resize(committed);
+        for (unsigned long i = 0; i < committed; i++) {
+            window_times[i] = next_impact_times[window[i]];
+            next_impact_times[window[i]] = window_state[i * STATE_SIZE + 7];
+        }
+        for (unsigned long i = 0; i < committed; i++) {
+            const double old_x = window_state[i * STATE_SIZE];
+            const double new_x = x_pos[window[i]];
+            if (old_x <= 0 and new_x > 0) {
+                count_crossing(window[i], FROM_LEFT_TO_RIGHT_INNER);
+                count_side_change(window[i], false);
+                record_crossing(window[i], old_x, window_state[i * STATE_SIZE + 2], window_state[i * STATE_SIZE + 3],
+                                false);
+            } else if (old_x > 0 and new_x <= 0) {
+                count_crossing(window[i], FROM_RIGHT_TO_LEFT_INNER);
+                count_side_change(window[i], true);
+                record_crossing(window[i], old_x, window_state[i * STATE_SIZE + 2], window_state[i * STATE_SIZE + 3],
+                                true);
+            }
+            if (in_left_trace) {
+                in_left_trace->push_back(in_left);
+            }
+            if (observers) {
+                time = window_state[i * STATE_SIZE + 7];
+                publish_event(window[i], EventRecord::COLLISION);
+            }
+        }
+        num_collisions += committed;
+        time = window_state[(committed - 1) * STATE_SIZE + 7];
+        event_queue.update_front(window.data(), window_times.data(), committed, next_impact_times);
+        processed += committed;
+    }
+    return processed;
+}
+
+void Simulation::set_gate_capacity(const unsigned long &direction, int capacity) {
+    if (capacity < 0) {
+        throw std::invalid_argument("Gate capacity should not be negative");
+    }
+    gate_capacities.at(direction) = capacity;
+    if (direction == LEFT) {
+        left_gate_capacity = capacity;
     } else {
-        // Throw error if sorting goes wrong. Sorting does not go wrong.
-        printf("Lost particle %lu with position (%.7f,%.7f) running on time %.2f (%.5e), %lu sorts present\n", particle,
-               px, py,
-               next_impact_times[particle], next_impact_times[particle] - time, sorted_indices.size());
-        std::ofstream file;
-        file.open("sorted_indices.txt");
-        for (unsigned long index:sorted_indices) {
-            file << index << std::endl;
+        right_gate_capacity = capacity;
+    }
+}
+
+void Simulation::set_species(const std::vector<unsigned> &particle_species) {
+    if (particle_species.size() != (unsigned long) num_particles) {
+        throw std::invalid_argument("Every particle needs a species");
+    }
+    const unsigned max_species = *std::max_element(particle_species.begin(), particle_species.end());
+    if (max_species > std::numeric_limits<uint8_t>::max()) {
+        throw std::invalid_argument("There can be at most 256 species");
+    }
+    num_species = max_species + 1;
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        species[particle] = (uint8_t) particle_species[particle_ids[particle]];
+    }
+    for (std::vector<int> &capacities: species_gate_capacities) {
+        capacities.resize(num_species, std::numeric_limits<int>::max());
+    }
+    species_in_left.assign(num_species > 1 ? num_species : 0, 0);
+    species_current_counters.assign(species_in_left.size() * 4, 0);
+    if (num_species > 1) {
+        for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+            species_in_left[species[particle]] += px <= 0;
         }
-        file.close();
-        throw std::invalid_argument("Particle not found. Sorting mechanism fails");
     }
 }
 
-void Simulation::insert_index(const unsigned long &particle) {
-    const double &impact_time = next_impact_times[particle];
-    unsigned long l = 0;
-    unsigned long r = num_particles - 1;
-    while (l < r) {
-        unsigned long m = (l + r) / 2;
-        double m_time = next_impact_times[sorted_indices[m]];
-        if (m_time < impact_time) {
-            l = m + 1;
-        } else {
-            r = m;
+void Simulation::set_species_gate_capacity(const unsigned long &direction, unsigned species_index, int capacity) {
+    if (capacity < 0 or species_index >= num_species) {
+        throw std::invalid_argument("Species gate capacity should not be negative, and the species should exist");
+    }
+    species_gate_capacities.at(direction)[species_index] = capacity;
+}
+
+unsigned Simulation::get_num_species() const {
+    return num_species;
+}
+
+unsigned Simulation::get_species(const unsigned long &particle) const {
+    return species[particle];
+}
+
+void Simulation::add_source(const unsigned long &side, double angle, double half_width, double rate) {
+    if (rate <= 0) {
+        throw std::invalid_argument("A source needs a positive rate");
+    }
+    WallSegment segment;
+    segment.side = side;
+    segment.angle = angle;
+    segment.half_width = half_width;
+    segment.is_source = true;
+    segment.rate = rate;
+    add_wall_segment(segment);
+}
+
+void Simulation::add_sink(const unsigned long &side, double angle, double half_width) {
+    WallSegment segment;
+    segment.side = side;
+    segment.angle = angle;
+    segment.half_width = half_width;
+    add_wall_segment(segment);
+}
+
+void Simulation::add_wall_segment(const WallSegment &segment) {
+    if (gate_arrays.empty()) {
+        throw std::logic_error("Sources and sinks are added after `setup`, when the mouths of the channels are known");
+    }
+    if (segment.side != LEFT and segment.side != RIGHT) {
+        throw std::invalid_argument("A wall segment lies in the LEFT or the RIGHT chamber");
+    }
+    if (segment.half_width <= 0 or segment.half_width >= PI) {
+        throw std::invalid_argument("A wall segment should subtend an angle between 0 and 2 pi");
+    }
+    // The central channel leaves the left chamber at angle 0 and the right chamber at pi, the back channel opposite
+    const double offset = std::fabs(std::remainder(segment.angle - (segment.side == LEFT ? 0 : PI), 2 * PI));
+    if (offset - segment.half_width < mouth_angle or
+        (second_width > 0 and PI - offset - segment.half_width < second_mouth_angle)) {
+        throw std::invalid_argument("A wall segment may not overlap the mouth of a channel");
+    }
+    wall_segments.push_back(segment);
+    has_sinks = has_sinks or not segment.is_source;
+}
+
+bool Simulation::is_open() const {
+    return not wall_segments.empty();
+}
+
+bool Simulation::is_active(const unsigned long &particle) const {
+    return not std::isnan(px);
+}
+
+unsigned long Simulation::get_num_active() const {
+    return num_particles - free_slots.size();
+}
+
+long Simulation::get_next_source() const {
+    long next = -1;
+    for (unsigned long i = 0; i < wall_segments.size(); i++) {
+        if (wall_segments[i].is_source and (next < 0 or wall_segments[i].next_time < wall_segments[next].next_time)) {
+            next = (long) i;
+        }
+    }
+    return next;
+}
+
+void Simulation::inject(unsigned long source) {
+    WallSegment &segment = wall_segments[source];
+    time = segment.next_time;
+    segment.next_time = time - std::log(1 - (*unif_real)(*rng)) / segment.rate;
+    if (free_slots.empty()) {
+        num_lost_injections++;
+        return;
+    }
+    const unsigned long particle = free_slots.back();
+    free_slots.pop_back();
+    const double center_x = segment.side == LEFT ? left_center_x : right_center_x;
+    const double angle = segment.angle + (2 * draw_uniform(particle, 0) - 1) * segment.half_width;
+    // Just inside the wall, so the wall itself is not the next impact
+    px = center_x + circle_radius * (1 - 1E-12) * std::cos(angle);
+    py = circle_radius * (1 - 1E-12) * std::sin(angle);
+    // Cosine distribution around the inward normal
+    directions[particle] = std::remainder(angle + PI + std::asin(2 * draw_uniform(particle, 0) - 1), 2 * PI);
+    impact_times[particle] = time;
+    orbit_chords[particle] = 0;
+    compute_next_impact(particle);
+    if (px <= 0) {
+        count_side_change(particle, true);
+    }
+    segment.count++;
+    event_queue.update(particle, next_impact_times);
+    publish_event(particle, EventRecord::INJECTION);
+}
+
+bool Simulation::check_absorption(const unsigned long &particle) {
+    const long sink = find_sink(px, py);
+    if (sink < 0) {
+        return false;
+    }
+    wall_segments[sink].count++;
+    for (unsigned long direction: {LEFT, RIGHT}) {
+        check_gate_departure(particle, direction);
+    }
+    if (px <= 0) {
+        // Leaves the left chamber
+        count_side_change(particle, false);
+    }
+    publish_event(particle, EventRecord::ABSORPTION);
+    free_slot(particle);
+    free_slots.push_back(particle);
+    event_queue.update(particle, next_impact_times, true);
+    return true;
+}
+
+long Simulation::find_sink(double x, double y) const {
+    if (not is_on_chamber_wall(x, y)) {
+        return -1;
+    }
+    const unsigned long side = x <= 0 ? LEFT : RIGHT;
+    const double center_x = side == LEFT ? left_center_x : right_center_x;
+    for (unsigned long i = 0; i < wall_segments.size(); i++) {
+        const WallSegment &segment = wall_segments[i];
+        if (not segment.is_source and segment.side == side and
+            std::fabs(std::remainder(std::atan2(y, x - center_x) - segment.angle, 2 * PI)) <= segment.half_width) {
+            return (long) i;
+        }
+    }
+    return -1;
+}
+
+bool Simulation::is_on_chamber_wall(double x, double y) const {
+    const double center_x = x <= 0 ? left_center_x : right_center_x;
+    // Impacts on the wall lie just inside it
+    return std::fabs(std::hypot(x - center_x, y) - circle_radius) <= 1E-9 * circle_radius and
+           not is_in_bridge(x, y) and not is_in_second_bridge(x, y);
+}
+
+void Simulation::send_to_reservoir(const unsigned long &particle, double start_x) {
+    const unsigned long side = px <= 0 ? LEFT : RIGHT;
+    const double center_x = side == LEFT ? left_center_x : right_center_x;
+    double uniforms[4];
+    for (double &uniform: uniforms) {
+        uniform = draw_uniform(particle, 1);
+    }
+    // The back channel lies beyond the center of the chamber
+    const bool back_entry = (start_x - center_x) * center_x > 0;
+    const ReservoirModel::Return visit = reservoirs->sample(side, back_entry, uniforms);
+    // The central channel leaves the left chamber towards positive x, the back channel towards negative x
+    const double facing = (side == LEFT) != visit.back ? 1 : -1;
+    // Keep clear of the corners of the mouth, where the next impact is ill-defined
+    const double y = visit.offset * (1 - 1E-9) * (visit.back ? second_width : bridge_width) / 2;
+    if (gate_is_flat and not visit.back) {
+        // Just before the plane of the gate, so the gate admits or reflects the particle as after an exact flight
+        next_x_pos[particle] = -facing * bridge_length / 2 * (1 + 1E-12);
+    } else {
+        // Just past the rim into a hollow gate, or just inside the rim of the back channel
+        const double rim = std::sqrt(circle_radius * circle_radius - y * y);
+        next_x_pos[particle] = center_x + facing * rim * (visit.back ? 1 - 1E-12 : 1 + 1E-12);
+    }
+    next_y_pos[particle] = y;
+    next_directions[particle] = (facing > 0 ? 0 : PI) + visit.angle;
+    next_impact_times[particle] = time + visit.duration;
+}
+
+void Simulation::record_reservoir_return(const unsigned long &particle, double x, double y, double direction,
+                                         double start_time) {
+    double &entry_time = reservoir_entry_times[particle];
+    if (std::isnan(entry_time)) {
+        if (is_on_chamber_wall(px, py) and reservoirs->start_visit()) {
+            entry_time = time;
+            const double center_x = px <= 0 ? left_center_x : right_center_x;
+            reservoir_back_entries[particle] = (x - center_x) * center_x > 0;
+        }
+        return;
+    }
+    // The last flight started in the chamber. It returns if it leaves the chamber before it ends
+    const unsigned long side = x <= 0 ? LEFT : RIGHT;
+    const double center_x = side == LEFT ? left_center_x : right_center_x;
+    const double dx = std::cos(direction);
+    const double dy = std::sin(direction);
+    const double b = (x - center_x) * dx + y * dy;
+    const double c = (x - center_x) * (x - center_x) + y * y - circle_radius * circle_radius;
+    if (std::isinf(entry_time) and c > 0) {
+        // A particle that started in a channel
+        entry_time = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    double exit = -b + std::sqrt(std::max(0., b * b - c));
+    double reach = time - start_time;
+    // Towards the central channel
+    const double facing = side == LEFT ? 1 : -1;
+    if (gate_is_flat and dx * facing > 0) {
+        // The central mouth is the plane of the gate, inside the rim. Flights out of the chamber end on it, up to
+        // rounding, whether the gate then admits the particle or reflects it
+        const double to_plane = (-facing * bridge_length / 2 - x) / dx;
+        if (to_plane > 0 and to_plane < exit and std::fabs(y + to_plane * dy) <= bridge_width / 2) {
+            exit = to_plane;
+            reach += 1E-9 * circle_radius;
+        }
+    }
+    const double exit_x = x + exit * dx;
+    const double exit_y = y + exit * dy;
+    const bool back = (exit_x - center_x) * center_x > 0;
+    const double half_width = (back ? second_width : bridge_width) / 2;
+    // A bounce off the wall may lie a rounding error outside the rim, away from the mouths
+    if (exit >= reach or std::fabs(exit_y) > half_width) {
+        return;
+    }
+    if (std::isinf(entry_time)) {
+        entry_time = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    ReservoirModel::Return visit;
+    visit.back_entry = reservoir_back_entries[particle];
+    visit.duration = start_time + exit - entry_time;
+    visit.back = back;
+    visit.offset = exit_y / half_width;
+    visit.angle = std::remainder(direction - (exit_x > center_x ? 0 : PI), 2 * PI);
+    reservoirs->add_return(side, visit);
+    entry_time = std::numeric_limits<double>::quiet_NaN();
+}
+
+void Simulation::free_slot(const unsigned long &particle) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    px = nan;
+    py = nan;
+    next_x_pos[particle] = nan;
+    next_y_pos[particle] = nan;
+    impact_times[particle] = time;
+    next_impact_times[particle] = std::numeric_limits<double>::infinity();
+}
+
+unsigned long Simulation::set_bridge_width(double width) {
+    return change_channel_width(width, false);
+}
+
+unsigned long Simulation::set_second_width(double width) {
+    return change_channel_width(width, true);
+}
+
+/**
+ * Check whether the segment from (x0, y0) to (x1, y1) meets an axis-aligned box, by clipping it (Liang-Barsky).
+ */
+static bool segment_meets_box(double x0, double y0, double x1, double y1, double x_min, double x_max, double y_min,
+                              double y_max) {
+    double t_min = 0;
+    double t_max = 1;
+    const double deltas[2] = {x1 - x0, y1 - y0};
+    const double starts[2] = {x0, y0};
+    const double lows[2] = {x_min, y_min};
+    const double highs[2] = {x_max, y_max};
+    for (int axis = 0; axis < 2; axis++) {
+        if (deltas[axis] == 0) {
+            if (starts[axis] < lows[axis] or starts[axis] > highs[axis]) {
+                return false;
+            }
+            continue;
+        }
+        double t1 = (lows[axis] - starts[axis]) / deltas[axis];
+        double t2 = (highs[axis] - starts[axis]) / deltas[axis];
+        if (t1 > t2) {
+            std::swap(t1, t2);
+        }
+        t_min = std::max(t_min, t1);
+        t_max = std::min(t_max, t2);
+        if (t_min > t_max) {
+            return false;
         }
     }
-    sorted_indices.insert(sorted_indices.begin() + l, particle);
+    return true;
 }
 
-void Simulation::reindex_particle(const unsigned long &particle, bool was_minimum) {
-    if (was_minimum) {
-        sorted_indices.erase(sorted_indices.begin());
+unsigned long Simulation::change_channel_width(double width, bool second) {
+    if (park_trapped_orbits) {
+        throw std::logic_error("Channel widths can not change while trapped orbits are parked");
+    }
+    if (width <= 0 or width / 2 >= circle_radius) {
+        throw std::invalid_argument("Channel width should be positive and smaller than the chamber diameter");
+    }
+    if (second and second_width == 0) {
+        throw std::invalid_argument("There is no back channel to change");
+    }
+    const double margin = 1E-9;
+    const double old_width = second ? second_width : bridge_width;
+    const double old_length = bridge_length;
+    const double old_box_x_radius = box_x_radius;
+    double chamber_shift = 0;
+    if (second) {
+        if (distance_as_channel_length) {
+            // As in `couple_bridge`: the inner ends of the back channel meet the rims, and the box follows them
+            const double second_discrepancy =
+                    2 * circle_radius - 2 * std::sqrt(std::pow(circle_radius, 2) - std::pow(width, 2) / 4);
+            if (second_length - second_discrepancy <= 0) {
+                throw std::invalid_argument("Second bridge length smaller than zero for this width");
+            }
+            box_x_radius = circle_distance / 2 + 2 * circle_radius + (second_length - second_discrepancy) / 2;
+        }
+        second_width = width;
+        second_mouth_angle = std::asin(width / (2 * circle_radius));
     } else {
-        unsigned long old_index = find_index(particle);
-        sorted_indices.erase(sorted_indices.begin() + old_index);
+        const double discrepancy =
+                2 * circle_radius - 2 * std::sqrt(std::pow(circle_radius, 2) - std::pow(width, 2) / 4);
+        if (distance_as_channel_length) {
+            // As in `couple_bridge`: the channel keeps its length, and the chambers, with everything beyond them,
+            // move so that their rims meet its ends
+            if (bridge_length - discrepancy <= 0) {
+                throw std::invalid_argument("Bridge length smaller than zero for this width");
+            }
+            chamber_shift = (bridge_length - discrepancy - circle_distance) / 2;
+            circle_distance = bridge_length - discrepancy;
+            left_center_x -= chamber_shift;
+            right_center_x += chamber_shift;
+            box_x_radius += chamber_shift;
+        } else {
+            bridge_length = circle_distance + discrepancy;
+        }
+        bridge_width = width;
+        mouth_angle = std::asin(width / (2 * circle_radius));
+    }
+    max_path = std::max(max_path, circle_distance + bridge_width + circle_radius * 4 + second_length);
+    // The domain only changes in a band along the walls of the channel, between the old and the new wall
+    double y_low = std::min(old_width, width) / 2 - margin;
+    const double y_high = std::max(old_width, width) / 2 + margin;
+    double x_low = 0;
+    double x_high = std::max(old_length, bridge_length) / 2 + margin;
+    if (second) {
+        x_low = right_center_x;
+        x_high = std::max(old_box_x_radius, box_x_radius) + margin;
+        if (box_x_radius != old_box_x_radius) {
+            // The whole back channel moves with its ends, including the flights through the periodic boundary
+            y_low = -y_high;
+        }
+    }
+    unsigned long num_predicted = 0;
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        double x, y;
+        get_position_at(particle, time, x, y);
+        const double x_end = next_x_pos[particle];
+        const double y_end = next_y_pos[particle];
+        // Moving chambers change the predictions of all particles
+        bool affected = chamber_shift != 0;
+        for (double side: {-1., 1.}) {
+            affected = affected or
+                       segment_meets_box(side * x, y, side * x_end, y_end, x_low, x_high, y_low, y_high) or
+                       segment_meets_box(side * x, y, side * x_end, y_end, x_low, x_high, -y_high, -y_low);
+            if (gate_is_flat and not second) {
+                // The flat gate sits at the end of the channel, which moves with the width
+                affected = affected or segment_meets_box(
+                        side * x, y, side * x_end, y_end, std::min(old_length, bridge_length) / 2 - margin,
+                        std::max(old_length, bridge_length) / 2 + margin, -circle_radius, circle_radius);
+            }
+        }
+        if (not affected) {
+            continue;
+        }
+        if (std::fabs(x) > bridge_length / 2 or std::fabs(y) > old_width / 2) {
+            // Outside the central channel, the domain moves along with its chamber
+            x += sgn(x) * chamber_shift;
+        }
+        if (std::fabs(x) > box_x_radius - margin) {
+            // Caught beyond a periodic boundary that moved inwards: push it back into the channel
+            x = sgn(x) * (box_x_radius - margin);
+        }
+        if (not is_in_domain(x, y)) {
+            // Caught by a wall that moved inwards: push it along and let it bounce off
+            y = sgn(y) * (width / 2 - margin);
+            if (std::sin(directions[particle]) * y > 0) {
+                directions[particle] = -directions[particle];
+            }
+        }
+        px = x;
+        py = y;
+        reschedule_particle(particle);
+        num_predicted++;
     }
-    insert_index(particle);
+    return num_predicted;
+}
+
+double Simulation::get_next_event_time() const {
+    return next_impact_times[event_queue.top()];
 }
 
 bool Simulation::is_in_gate(double x, double y, const unsigned long &direction) const {
@@ -199,7 +1044,8 @@ bool Simulation::is_going_in(const unsigned long &particle) const {
 void Simulation::check_gate_admission(const unsigned long &particle, const unsigned long &direction) {
     if (not gate_arrays[direction][particle]) {
         // Not yet in gate, check admission
-        if (gate_contents[direction].size() >= gate_capacities[direction]) {
+        if (gate_contents[direction].size() >= gate_capacities[direction] or
+            (num_species > 1 and is_species_gate_full(particle, direction))) {
             explode_gate(particle, direction);
         } else {
             gate_contents[direction].push_back(particle);
@@ -218,11 +1064,28 @@ void Simulation::check_gate_departure(const unsigned long &particle, const unsig
     }
 }
 
+bool Simulation::is_species_gate_full(const unsigned long &particle, const unsigned long &direction) const {
+    const uint8_t &kind = species[particle];
+    const long count = std::count_if(gate_contents[direction].begin(), gate_contents[direction].end(),
+                                     [this, &kind](unsigned long other) { return species[other] == kind; });
+    return count >= species_gate_capacities[direction][kind];
+}
+
 void Simulation::explode_gate(const unsigned long &exp_particle, const unsigned long &direction) {
     do {
         directions[exp_particle] = get_retraction_angle(exp_particle);
     } while (not is_in_domain(next_x_pos[exp_particle], next_y_pos[exp_particle]));
-    for (unsigned long particle: gate_contents[direction]) {
+    // If the species of the particle caused the explosion, the other species may stay
+    const bool selective = selective_explosions and num_species > 1 and
+                           gate_contents[direction].size() < (unsigned long) gate_capacities[direction];
+    std::vector<unsigned long> &contents = gate_contents[direction];
+    unsigned long kept = 0;
+    for (unsigned long i = 0; i < contents.size(); i++) {
+        const unsigned long particle = contents[i];
+        if (selective and species[particle] != species[exp_particle]) {
+            contents[kept++] = particle;
+            continue;
+        }
         double x, y;
         get_current_position(particle, x, y);
         if (not is_in_domain(x, y)) {
@@ -237,9 +1100,10 @@ void Simulation::explode_gate(const unsigned long &exp_particle, const unsigned
         impact_times[particle] = time;
         compute_next_impact(particle);
         gate_arrays[direction][particle] = false; // Attention, only in the one-way blocking case.
-        reindex_particle(particle, false);
+        event_queue.update(particle, next_impact_times);
+        publish_event(particle, EventRecord::RETRACTION);
     }
-    gate_contents[direction].clear(); // Attention, only in the one-way blocking case.
+    contents.resize(kept); // Attention, only in the one-way blocking case.
 
 }
 
@@ -247,20 +1111,57 @@ void Simulation::check_boundary_condition(const unsigned long &particle) {
     if (second_width > 0) {
         if (next_x_pos[particle] < -box_x_radius) {
             next_x_pos[particle] += 2 * box_x_radius;
-            current_counters[FROM_LEFT_TO_RIGHT_OUTER]++;
+            count_crossing(particle, FROM_LEFT_TO_RIGHT_OUTER);
         } else if (next_x_pos[particle] > box_x_radius) {
             next_x_pos[particle] -= 2 * box_x_radius;
-            current_counters[FROM_RIGHT_TO_LEFT_OUTER]++;
+            count_crossing(particle, FROM_RIGHT_TO_LEFT_OUTER);
         }
     }
 }
 
 void Simulation::count_first_gate_crossing(const unsigned long &particle) {
     if (px <= 0 and next_x_pos[particle] > 0) {
-        current_counters[FROM_LEFT_TO_RIGHT_INNER]++;
+        count_crossing(particle, FROM_LEFT_TO_RIGHT_INNER);
     } else if (px > 0 and next_x_pos[particle] <= 0) {
-        current_counters[FROM_RIGHT_TO_LEFT_INNER]++;
+        count_crossing(particle, FROM_RIGHT_TO_LEFT_INNER);
+    }
+}
+
+void Simulation::count_crossing(const unsigned long &particle, int counter) {
+    current_counters[counter]++;
+    if (num_species > 1) {
+        species_current_counters[4 * species[particle] + counter]++;
+    }
+}
+
+void Simulation::count_side_change(const unsigned long &particle, bool to_left) {
+    if (to_left) {
+        in_left++;
+    } else {
+        in_left--;
+    }
+    if (num_species > 1) {
+        species_in_left[species[particle]] += to_left ? 1 : -1;
+    }
+}
+
+void Simulation::set_deadline(double seconds) {
+    has_deadline = seconds > 0;
+    deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long) (seconds * 1E6));
+    deadline_check_counter = 0;
+}
+
+bool Simulation::has_budget_left() {
+    if (truncated) {
+        return false;
+    }
+    if (event_budget > 0 and num_collisions >= event_budget) {
+        truncated = true;
+    } else if (has_deadline and ++deadline_check_counter >= DEADLINE_CHECK_INTERVAL) {
+        deadline_check_counter = 0;
+        truncated = std::chrono::steady_clock::now() >= deadline;
     }
+    return not truncated;
 }
 
 void Simulation::print_status() const {
@@ -272,9 +1173,10 @@ void Simulation::print_status() const {
                next_x_pos[particle],
                next_y_pos[particle], next_impact_times[particle], next_directions[particle] / PI);
     }
-    printf("Particles left: %d, particles right: %d\n", (int) in_left, (int) (num_particles - in_left));
+    printf("Particles left: %d, particles right: %d\n", (int) in_left, (int) (get_num_active() - in_left));
     printf("Particles in left gate: %d\t in right gate %d\n", (int) currently_in_left_gate.size(),
            (int) currently_in_right_gate.size());
+    printf("Particles parked on trapped orbits: %lu\n", num_parked);
 }
 
 void Simulation::write_positions_to_file(double time) const {
@@ -282,28 +1184,43 @@ void Simulation::write_positions_to_file(double time) const {
     std::ofstream file;
     if (time == 0) {
         file.open(filename, std::ofstream::out | std::ofstream::trunc);
-        file
-                << "num_particles\tcircle_radius\tcircle_distance\tbridge_width\tbridge_length\tsecond_width\tsecond_length\n";
+        file << "num_particles\tcircle_radius\tcircle_distance\tbridge_width\tbridge_length\tsecond_width"
+             << "\tsecond_length" << (output_filter or is_open() ? "\tindexed\n" : "\n");
         file << num_particles << " " << circle_radius << " " << circle_distance << " "
-             << bridge_width << " " << bridge_length << " " << second_width << " " << second_length << std::endl;
+             << bridge_width << " " << bridge_length << " " << second_width << " " << second_length
+             << (output_filter or is_open() ? " 1" : "") << std::endl;
         file.close();
     }
     file.open(filename, std::ios_base::app);
     file << time << std::endl;
-    for (unsigned long particle = 0; particle < num_particles; particle++) {
-        file << px + (next_x_pos[particle] - px) * (impact_times[particle] - time) /
-                     (impact_times[particle] - next_impact_times[particle]) << " ";
+    std::vector<double> x(num_particles), y(num_particles), angles(num_particles);
+    snapshot(time, x.data(), y.data(), angles.data());
+    std::vector<unsigned long> selected;
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        // The free slots of an open system are left out
+        if (is_active(particle_indices[particle]) and
+            (not output_filter or output_filter(particle, x[particle], y[particle]))) {
+            selected.push_back(particle);
+        }
+    }
+    for (unsigned long particle: selected) {
+        file << x[particle] << " ";
     }
     file << std::endl;
-    for (unsigned long particle = 0; particle < num_particles; particle++) {
-        file << py + (next_y_pos[particle] - py) * (impact_times[particle] - time) /
-                     (impact_times[particle] - next_impact_times[particle]) << " ";
+    for (unsigned long particle: selected) {
+        file << y[particle] << " ";
     }
     file << std::endl;
-    for (unsigned long particle = 0; particle < num_particles; particle++) {
-        file << directions[particle] << " ";
+    for (unsigned long particle: selected) {
+        file << angles[particle] << " ";
     }
     file << std::endl;
+    if (output_filter or is_open()) {
+        for (unsigned long particle: selected) {
+            file << particle << " ";
+        }
+        file << std::endl;
+    }
     file.close();
 }
 
@@ -316,7 +1233,8 @@ void Simulation::write_bounce_map_to_file(const unsigned long &particle) const {
 }
 
 double Simulation::get_mass_spread() const {
-    return (num_particles - 2. * in_left) / num_particles;
+    const auto num_active = (double) get_num_active();
+    return num_active > 0 ? (num_active - 2. * in_left) / num_active : 0;
 }
 
 void Simulation::finish() {
@@ -333,6 +1251,8 @@ void Simulation::couple_bridge() {
      */
     // This is always a positive number
     box_y_radius = circle_radius;
+    mouth_angle = std::asin(std::min(1., bridge_width / (2 * circle_radius)));
+    second_mouth_angle = std::asin(std::min(1., second_width / (2 * circle_radius)));
     const double discrepancy =
             2 * circle_radius - 2 * std::sqrt(std::pow(circle_radius, 2) - std::pow(bridge_width, 2) / 4);
     if (distance_as_channel_length) {
@@ -463,6 +1383,10 @@ void Simulation::compute_next_impact(const unsigned long &particle) {
         next_angle = directions[particle];
     }
     if (next_time == max_path) {
+        if (speculating) {
+            speculation_failed = true;
+            return;
+        }
         reset_counter++;
         printf("Next time = maxpath =%.2f\nParticle has to be reset (%dth time)\n", next_time, reset_counter);
         printf("Position (%.4f, %.4f) at t=%.2f (%lu collisions), angle %.2f pi\n", px, py, impact_times[particle],
@@ -475,7 +1399,7 @@ void Simulation::compute_next_impact(const unsigned long &particle) {
     } else {
         next_x_pos[particle] = px + next_time * cos(directions[particle]);
         next_y_pos[particle] = py + next_time * sin(directions[particle]);
-        next_impact_times[particle] = time + next_time;
+        next_impact_times[particle] = impact_times[particle] + next_time;
         next_directions[particle] = next_angle;
     }
 }
@@ -484,17 +1408,247 @@ void Simulation::get_current_position(const unsigned long &particle, double &x,
     /**
      * Interpolate position at the current time. Returns in referenced variables
      */
-    if (impact_times[particle] == next_impact_times[particle]) {
+    get_position_at(particle, time, x, y);
+}
+
+void Simulation::get_position_at(const unsigned long &particle, double t, double &x, double &y) const {
+    if (orbit_chords[particle] > 0) {
+        // Follow the orbit analytically: complete chords first, then the part of the current chord
+        const double center_x = px > 0 ? right_center_x : left_center_x;
+        const double chords = std::floor((t - impact_times[particle]) / orbit_chords[particle]);
+        const double remainder = t - impact_times[particle] - chords * orbit_chords[particle];
+        const double angle = std::atan2(py, px - center_x) + chords * orbit_rotations[particle];
+        const double direction = directions[particle] + chords * orbit_rotations[particle];
+        const double radius = std::hypot(px - center_x, py);
+        x = center_x + radius * std::cos(angle) + remainder * std::cos(direction);
+        y = radius * std::sin(angle) + remainder * std::sin(direction);
+    } else if (impact_times[particle] == next_impact_times[particle]) {
         x = px;
         y = py;
     } else {
-        x = px + (next_x_pos[particle] - px) * (impact_times[particle] - time) /
+        x = px + (next_x_pos[particle] - px) * (impact_times[particle] - t) /
                  (impact_times[particle] - next_impact_times[particle]);
-        y = py + (next_y_pos[particle] - py) * (impact_times[particle] - time) /
+        y = py + (next_y_pos[particle] - py) * (impact_times[particle] - t) /
                  (impact_times[particle] - next_impact_times[particle]);
     }
 }
 
+double Simulation::get_direction_at(const unsigned long &particle, double t) const {
+    if (orbit_chords[particle] > 0) {
+        const double chords = std::floor((t - impact_times[particle]) / orbit_chords[particle]);
+        return std::fmod(directions[particle] + chords * orbit_rotations[particle], 2 * PI);
+    }
+    return directions[particle];
+}
+
+/**
+ * Interpolate linearly between the last and the next impact of particles `first` to `last`, without branches,
+ * so the loop vectorises. A particle without a flight (zero duration) stays where it is,
+ * as does a parked particle (infinite duration).
+ */
+static void interpolate_positions(unsigned long first, unsigned long last, double t,
+                                  const double *__restrict x_from, const double *__restrict y_from,
+                                  const double *__restrict x_to, const double *__restrict y_to,
+                                  const double *__restrict start, const double *__restrict end,
+                                  double *__restrict x, double *__restrict y) {
+    for (unsigned long particle = first; particle < last; particle++) {
+        // Same operations as `get_position_at`, so both give identical positions
+        const double duration = start[particle] - end[particle];
+        // 1 for a particle in flight, 0 otherwise; a comparison here would keep the loop from vectorising
+        const double moving = 0.5 - std::copysign(0.5, duration);
+        const double elapsed = (start[particle] - t) * moving;
+        const double denominator = duration - (1. - moving);
+        x[particle] = x_from[particle] + (x_to[particle] - x_from[particle]) * elapsed / denominator;
+        y[particle] = y_from[particle] + (y_to[particle] - y_from[particle]) * elapsed / denominator;
+    }
+}
+
+void Simulation::snapshot(double t, double *x, double *y, double *directions_out, unsigned num_threads) const {
+    auto fill = [&](unsigned long first, unsigned long last) {
+        interpolate_positions(first, last, t, x_pos.data(), y_pos.data(), next_x_pos.data(), next_y_pos.data(),
+                              impact_times.data(), next_impact_times.data(), x, y);
+        if (directions_out) {
+            std::copy(directions.begin() + first, directions.begin() + last, directions_out + first);
+        }
+        // Particles that follow an orbit are not on a straight line
+        for (unsigned long particle = first; particle < last; particle++) {
+            if (orbit_chords[particle] > 0) {
+                get_position_at(particle, t, x[particle], y[particle]);
+                if (directions_out) {
+                    directions_out[particle] = get_direction_at(particle, t);
+                }
+            }
+        }
+    };
+    // Starting a thread only pays off for a large enough share of the particles
+    const auto size = (unsigned long) num_particles;
+    num_threads = std::max(1u, std::min(num_threads, (unsigned) (size / SNAPSHOT_CHUNK) + 1));
+    const unsigned long chunk = (size + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (unsigned thread = 1; thread < num_threads; thread++) {
+        threads.emplace_back(fill, std::min(thread * chunk, size), std::min((thread + 1) * chunk, size));
+    }
+    fill(0, std::min(chunk, size));
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    if (is_renumbered) {
+        // Interpolating in index order keeps the reads sequential; put the results in id order afterwards
+        std::vector<double> values(size);
+        for (double *output: {x, y, directions_out}) {
+            if (not output) {
+                continue;
+            }
+            std::copy(output, output + size, values.begin());
+            for (unsigned long particle = 0; particle < size; particle++) {
+                output[particle_ids[particle]] = values[particle];
+            }
+        }
+    }
+}
+
+void Simulation::renumber() {
+    std::vector<unsigned long> order(num_particles);
+    std::vector<unsigned> regions(num_particles);
+    std::iota(order.begin(), order.end(), 0);
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        regions[particle] = not is_active(particle) ? 3 : is_in_circle(px, py, LEFT) ? 0 :
+                                                           is_in_circle(px, py, RIGHT) ? 2 : 1;
+    }
+    std::stable_sort(order.begin(), order.end(), [this, &regions](unsigned long p1, unsigned long p2) {
+        return regions[p1] < regions[p2] or
+               (regions[p1] == regions[p2] and next_impact_times[p1] < next_impact_times[p2]);
+    });
+    permute(order);
+}
+
+void Simulation::permute(const std::vector<unsigned long> &order) {
+    if (order.size() != (unsigned long) num_particles) {
+        throw std::invalid_argument("A renumbering needs a new place for every particle");
+    }
+    std::vector<unsigned long> new_indices(num_particles);
+    for (unsigned long i = 0; i < (unsigned long) num_particles; i++) {
+        new_indices[order[i]] = i;
+    }
+    for (std::vector<double> *values: {&next_impact_times, &impact_times, &next_x_pos, &next_y_pos, &x_pos, &y_pos,
+                                       &directions, &next_directions, &orbit_chords, &orbit_rotations}) {
+        permute_values(*values, order);
+    }
+    permute_values(particle_ids, order);
+    permute_values(species, order);
+    if (not reservoir_entry_times.empty()) {
+        permute_values(reservoir_entry_times, order);
+        permute_values(reservoir_back_entries, order);
+    }
+    if (not occupancy_since.empty()) {
+        permute_values(occupancy_left_times, order);
+        permute_values(occupancy_since, order);
+        permute_values(occupancy_crossings, order);
+    }
+    for (unsigned long direction: {LEFT, RIGHT}) {
+        permute_values(gate_arrays[direction], order);
+        // The order of the gate contents is kept: an explosion retracts them in that order
+        for (unsigned long &particle: gate_contents[direction]) {
+            particle = new_indices[particle];
+        }
+    }
+    for (unsigned long &particle: free_slots) {
+        particle = new_indices[particle];
+    }
+    index_particle_ids();
+    event_queue.relabel(new_indices);
+    last_renumbering = num_collisions;
+}
+
+void Simulation::index_particle_ids() {
+    is_renumbered = false;
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        particle_indices[particle_ids[particle]] = particle;
+        is_renumbered = is_renumbered or particle_ids[particle] != particle;
+    }
+}
+
+void Simulation::check_renumbering() {
+    if (renumber_interval > 0 and num_collisions - last_renumbering >= renumber_interval) {
+        renumber();
+    }
+}
+
+void Simulation::reset_occupancy() {
+    occupancy_start = time;
+    if (track_occupancy) {
+        occupancy_left_times.assign(num_particles, 0);
+        occupancy_since.assign(num_particles, time);
+        occupancy_crossings.assign(num_particles, 0);
+    } else {
+        occupancy_left_times.clear();
+        occupancy_since.clear();
+        occupancy_crossings.clear();
+    }
+}
+
+double Simulation::get_crossing_time(double x, double direction, double start_time) const {
+    const double dx = std::cos(direction);
+    if (x * dx <= 0) {
+        // Heading for the center line
+        return start_time - x / dx;
+    } else if (second_width > 0) {
+        // Heading for the end of the back channel, where it comes back on the other side
+        return start_time + (sgn(dx) * box_x_radius - x) / dx;
+    }
+    return std::numeric_limits<double>::infinity();
+}
+
+void Simulation::record_crossing(const unsigned long &particle, double x, double direction, double start_time,
+                                 bool to_left) {
+    if (occupancy_since.empty()) {
+        return;
+    }
+    const double crossing_time = std::min(get_crossing_time(x, direction, start_time), next_impact_times[particle]);
+    if (not to_left) {
+        occupancy_left_times[particle] += crossing_time - occupancy_since[particle];
+    }
+    occupancy_since[particle] = crossing_time;
+    occupancy_crossings[particle]++;
+}
+
+double Simulation::get_occupancy(double t, std::vector<double> &left_times,
+                                 std::vector<unsigned long> &crossings) const {
+    if (occupancy_since.empty()) {
+        throw std::logic_error("Occupancy is only tracked when `track_occupancy` is set before `start`");
+    }
+    left_times.resize(num_particles);
+    crossings.resize(num_particles);
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        const unsigned long &id = particle_ids[particle];
+        double left_time = occupancy_left_times[particle];
+        unsigned long num_crossings = occupancy_crossings[particle];
+        bool is_left = px <= 0;
+        double since = occupancy_since[particle];
+        // A flight that is under way may already have crossed
+        if (orbit_chords[particle] == 0 and impact_times[particle] < next_impact_times[particle]) {
+            const double crossing_time = get_crossing_time(px, directions[particle], impact_times[particle]);
+            if (crossing_time <= t and crossing_time < next_impact_times[particle]) {
+                left_time += is_left ? crossing_time - since : 0;
+                since = crossing_time;
+                is_left = not is_left;
+                num_crossings++;
+            }
+        }
+        left_times[id] = left_time + (is_left ? t - since : 0);
+        crossings[id] = num_crossings;
+    }
+    return t - occupancy_start;
+}
+
+unsigned long Simulation::get_particle_id(const unsigned long &particle) const {
+    return particle_ids[particle];
+}
+
+unsigned long Simulation::get_particle_index(const unsigned long &id) const {
+    return particle_indices[id];
+}
+
 double Simulation::time_to_hit_bridge(const unsigned long &particle, double &normal_angle) const {
     /**
      * Check if we hit the bottom line, and check if we hit the top line, and return a float.
@@ -619,10 +1773,10 @@ double Simulation::get_reflection_angle(double angle_in, double normal_angle) co
     return fmod(2 * normal_angle - angle_in + PI, 2 * PI);
 }
 
-double Simulation::get_retraction_angle(const unsigned long &particle) const {
+double Simulation::get_retraction_angle(const unsigned long &particle) {
     if (explosion_direction_is_random) {
         int side = sgn(px);
-        return ((*unif_real)(*rng) - 0.5) * PI + PI / 2 * (1 - sgn(side));
+        return (draw_uniform(particle, 1) - 0.5) * PI + PI / 2 * (1 - sgn(side));
     } else {
         if (cos(directions[particle]) * x_pos[particle] < 0) {
             return -directions[particle] + PI; // This might be cause for radical particle bug
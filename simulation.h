@@ -16,6 +16,37 @@
 #include <sstream>
 #include <unistd.h>
 #include <numeric>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <functional>
+#include "constants.h"
+#include "event_queue.h"
+
+class ObserverPipeline;
+
+class ReservoirModel;
+
+struct SimulationState;
+
+/**
+ * Arc of a chamber wall where particles enter (a source) or leave (a sink) an open system,
+ * see `Simulation::add_source` and `Simulation::add_sink`.
+ */
+struct WallSegment {
+    // LEFT or RIGHT chamber
+    unsigned long side = 0;
+    // Angle of the middle of the arc as seen from the center of the chamber, and half the angle the arc subtends
+    double angle = 0;
+    double half_width = 0;
+    bool is_source = false;
+    // Injections per unit of time of a source
+    double rate = 0;
+    // Time of the next injection of a source
+    double next_time = 0;
+    // Number of particles that entered or left through the segment since `start`
+    unsigned long count = 0;
+};
 
 class Simulation {
 public:
@@ -56,6 +87,12 @@ public:
     const int FROM_RIGHT_TO_LEFT_INNER = 2;
     const int FROM_RIGHT_TO_LEFT_OUTER = 3;
     unsigned long in_left;
+    /**
+     * With more than one species (see `set_species`), `in_left` and `current_counters` per species.
+     * The counters of species s are at 4 s + FROM_LEFT_TO_RIGHT_INNER and so on.
+     */
+    std::vector<unsigned long> species_in_left;
+    std::vector<int> species_current_counters;
     unsigned long num_collisions = 0;
     // Other parameters
     double circle_radius;
@@ -77,6 +114,54 @@ public:
     bool gate_is_flat;
     bool distance_as_channel_length = false;
     unsigned long expected_collisions = 0;
+    /**
+     * Limits of a run. If the number of collisions exceeds `event_budget` (when nonzero), or the wall clock passes
+     * the deadline set with `set_deadline`, `has_budget_left` returns false and the run is flagged as `truncated`.
+     * Event loops should check `has_budget_left` alongside their own stopping criterion.
+     */
+    unsigned long event_budget = 0;
+    bool truncated = false;
+    /**
+     * Implementation of the event queue, see `EventQueue`. The sorted vector is fastest for the usual system sizes;
+     * the binary heap scales better for large systems. Takes effect on the next call to `start`.
+     */
+    EventQueue::Type queue_type = EventQueue::SORTED_VECTOR;
+    /**
+     * In a circular chamber, the bounce points of a particle rotate by a fixed angle per bounce. If none of the next
+     * bounce points lands on a mouth (see `mouth_angle`), the particle is fast-forwarded to its last bounce before it
+     * escapes. If it does not escape within `trap_horizon` bounces, it is parked outside the event queue.
+     * Skipped bounces still count towards `num_collisions`: those of fast-forwarded particles when they wake up,
+     * those of parked particles at their bounce rate.
+     */
+    bool park_trapped_orbits = false;
+    unsigned long trap_horizon = 100000;
+    /**
+     * Every `renumber_interval` events (when nonzero), the particles are renumbered with `renumber`, so that particles
+     * that collide close together in time also lie close together in memory. Pays off for large systems,
+     * with an interval of a few times the number of particles. The events themselves do not change.
+     */
+    unsigned long renumber_interval = 0;
+    /**
+     * Keep per-particle occupancy accumulators, to see whether single particles are ergodic: the time each particle
+     * spends on the left (x <= 0) and how often it changes sides, through the channel or the back channel.
+     * The time of a side change is computed from the flight that crosses, so the times are exact.
+     * Takes effect on the next `start`; see `get_occupancy`.
+     */
+    bool track_occupancy = false;
+    /**
+     * Open system: with sources or sinks (see `add_source` and `add_sink`), particles enter and leave the chambers,
+     * and `num_particles` is the number of slots rather than the number of particles. `start` puts
+     * `initial_particles` particles in the chambers; the other slots are free. A source injects into a free slot,
+     * and a particle that hits a sink frees its slot, so the arrays and the event queue keep their size.
+     * An injected particle takes the id (and the species) of its slot. Injections that find no free slot are lost,
+     * and counted in `num_lost_injections`.
+     */
+    unsigned long initial_particles = 0;
+    unsigned long num_lost_injections = 0;
+    std::vector<WallSegment> wall_segments;
+    // Half the angle subtended by the mouth of the bridge (and of the back channel) as seen from the chamber center
+    double mouth_angle = 0;
+    double second_mouth_angle = 0;
 
     // There is a (geometrical) difference between the distance between the urns and the length of the channel
     // if the gate is flat. While the former is nicer from a modelling point of view,
@@ -91,6 +176,7 @@ public:
 
     /**
      * Start the simulation. Initialize particles and times, and compute the next (first) impact.
+     * May be called again to start a new run with the same parameters, reusing the allocated data.
      * @param left_ratio ratio of particles that should be initiated on the left side.
      */
     void start(double left_ratio);
@@ -212,6 +298,141 @@ public:
     std::vector<std::vector<unsigned long>> gate_contents;
     std::vector<std::vector<bool>> gate_arrays;
 
+    /**
+     * Recompute the next impact of a particle whose position or direction has been changed from outside,
+     * as of the current time, and restore the order of the event queue.
+     * @param particle Particle index
+     */
+    void reschedule_particle(const unsigned long &particle);
+
+    /**
+     * Change the capacity of a gate during a run. A gate that holds more particles than its new capacity
+     * keeps them, and explodes on the next admission.
+     * @param direction LEFT or RIGHT
+     * @param capacity New capacity
+     */
+    void set_gate_capacity(const unsigned long &direction, int capacity);
+
+    /**
+     * Split the particles into species, to study sorting by the gates. Without a call, all particles are species 0.
+     * Can be called after `setup`, also during a run; the per-species counters then start at zero.
+     * @param particle_species Species of every particle id, below 256
+     */
+    void set_species(const std::vector<unsigned> &particle_species);
+
+    /**
+     * Limit the number of particles of one species in a gate, on top of the capacity of the gate.
+     * A particle that arrives at a gate holding that many particles of its species explodes the gate.
+     * Unlimited by default.
+     * @param direction LEFT or RIGHT
+     * @param species_index Species
+     * @param capacity Maximum number of particles of the species in the gate
+     */
+    void set_species_gate_capacity(const unsigned long &direction, unsigned species_index, int capacity);
+
+    /**
+     * If set, an explosion caused by the capacity of a species only retracts the particles of that species;
+     * the others stay in the gate. An explosion caused by the capacity of the gate retracts all of them.
+     */
+    bool selective_explosions = false;
+
+    unsigned get_num_species() const;
+
+    /**
+     * @param particle Particle index
+     * @return Species of the particle
+     */
+    unsigned get_species(const unsigned long &particle) const;
+
+    /**
+     * Inject particles through an arc of a chamber wall, at the times of a Poisson process. They enter at a uniform
+     * point of the arc, with a cosine distribution of directions around the inward normal, as particles from
+     * a reservoir behind the wall would. Call after `setup` and before `start`.
+     * Not available with `park_trapped_orbits` or `track_occupancy`.
+     * @param side LEFT or RIGHT
+     * @param angle Middle of the arc, as seen from the center of the chamber; 0 faces the positive x-axis
+     * @param half_width Half the angle the arc subtends; the arc may not overlap the mouth of a channel
+     * @param rate Mean number of injections per unit of time
+     */
+    void add_source(const unsigned long &side, double angle, double half_width, double rate);
+
+    /**
+     * Absorb the particles that hit an arc of a chamber wall, see `add_source`.
+     * @param side LEFT or RIGHT
+     * @param angle Middle of the arc, as seen from the center of the chamber
+     * @param half_width Half the angle the arc subtends; the arc may not overlap the mouth of a channel
+     */
+    void add_sink(const unsigned long &side, double angle, double half_width);
+
+    /**
+     * @return Whether there are sources or sinks
+     */
+    bool is_open() const;
+
+    /**
+     * @param particle Particle index
+     * @return Whether the slot holds a particle; always true for a closed system
+     */
+    bool is_active(const unsigned long &particle) const;
+
+    /**
+     * @return Number of particles in the system, `num_particles` for a closed system
+     */
+    unsigned long get_num_active() const;
+
+    /**
+     * Change the width of the central channel during a run. Particles in the part of the channel that disappears are
+     * pushed along with the wall.
+     * Without `distance_as_channel_length`, the chambers stay in place and the length of the channel follows from the
+     * width; only particles whose flight to their next impact passes the part of the domain that changes are
+     * predicted again. With it, the channel keeps its length as after `setup`, so the system matches the one set up
+     * with the new width: the chambers, with the back channel, move so that their rims meet the ends of the channel,
+     * the particles outside the channel move along with them, and all particles are predicted again.
+     * Not available with `park_trapped_orbits`.
+     * @param width New width
+     * @return Number of particles whose next impact was predicted again
+     */
+    unsigned long set_bridge_width(double width);
+
+    /**
+     * Change the width of the back channel during a run, see `set_bridge_width`. The back channel must exist.
+     * With `distance_as_channel_length`, its inner ends meet the rims for the new width as after `setup`, which moves
+     * the periodic boundary; particles beyond it are pushed back into the channel.
+     * @param width New width, positive
+     * @return Number of particles whose next impact was predicted again
+     */
+    unsigned long set_second_width(double width);
+
+    /**
+     * Reseed the random number generator, for reproducible runs. Call before `start`.
+     * Copies made before reseeding keep sharing the old generator.
+     * @param seed Seed
+     */
+    void seed(unsigned long seed);
+
+    /**
+     * Draw the initial positions and retraction angles of every particle from a stream of its own, keyed by `seed`,
+     * the particle and the number of draws it made so far, instead of from the shared generator.
+     * Simulations with slightly different parameters and the same seed then share their random numbers:
+     * a particle starts in the same place (unless that place is outside the domain of one of them) and retracts
+     * in the same directions, also when the order of the events has changed. Call before `start`.
+     * @param seed Seed of the streams
+     */
+    void use_common_random_numbers(unsigned long seed);
+
+    /**
+     * Copy the dynamic state of the simulation, see `SimulationState`. Reuses the memory of `state`.
+     * @param state Output
+     */
+    void save_state(SimulationState &state) const;
+
+    /**
+     * Continue from a saved state. The simulation must have been set up with the same parameters.
+     * The simulation gets its own random number generator in the saved state.
+     * @param state State saved with `save_state`
+     */
+    void restore_state(const SimulationState &state);
+
     /**
      * Compute the current position of a particle, based on the `time` variable
      * Interpolates on the assumption that the particle has no collision from its last update until this time
@@ -222,6 +443,81 @@ public:
      */
     void get_current_position(const unsigned long &particle, double &x, double &y) const;
 
+    /**
+     * Compute the position of a particle at time `t`, which should lie between its last and its next impact.
+     * @param particle Particle index
+     * @param t Time at which the position is interpolated
+     * @param x output variable for x position
+     * @param y output variable for y position
+     */
+    void get_position_at(const unsigned long &particle, double t, double &x, double &y) const;
+
+    /**
+     * Direction of a particle at time `t`, which should lie between its last and its next impact.
+     * @param particle Particle index
+     * @param t Time
+     * @return Direction angle
+     */
+    double get_direction_at(const unsigned long &particle, double t) const;
+
+    /**
+     * Positions and directions of all particles at time `t`, which should lie between the current time and the next
+     * impact of every particle, in order of particle id. Gives the same result as `get_position_at` and
+     * `get_direction_at` for every particle, but interpolates in a loop the compiler can vectorise,
+     * split over several threads.
+     * Does not change the simulation, so observers, renderers and exporters can call it between updates.
+     * The free slots of an open system get NaN positions.
+     * @param t Time at which the positions are interpolated
+     * @param x Output buffer for `num_particles` x positions
+     * @param y Output buffer for `num_particles` y positions
+     * @param directions Output buffer for `num_particles` directions, or nullptr if they are not needed
+     * @param num_threads Number of threads; with 1, everything runs on the calling thread
+     */
+    void snapshot(double t, double *x, double *y, double *directions = nullptr, unsigned num_threads = 1) const;
+
+    /**
+     * Renumber the particles by chamber (left, channels, right, then the free slots of an open system) and,
+     * within a chamber, by next impact time. All per-particle data, the gate contents and the event queue are
+     * permuted along, so the run continues with exactly the same events. Particle indices change; particle ids
+     * (see `get_particle_id`) do not.
+     */
+    void renumber();
+
+    /**
+     * Particles keep their id when they are renumbered; ids are assigned by `start` and equal the indices until the
+     * first renumbering. Everything the simulation hands out (observer records, `snapshot`, the output files)
+     * is ordered by id; the per-particle arrays and the methods that take a particle are indexed by index.
+     * @param particle Particle index
+     * @return Id of the particle
+     */
+    unsigned long get_particle_id(const unsigned long &particle) const;
+
+    /**
+     * @param id Particle id
+     * @return Current index of the particle
+     */
+    unsigned long get_particle_index(const unsigned long &id) const;
+
+    /**
+     * Read the occupancy accumulators (see `track_occupancy`), including the side changes of flights that cross
+     * before `t`. Accumulators start at `start`, or at the restored time after `restore_state`.
+     * @param t Time between the current time and the next event
+     * @param left_times Output, per particle id the time spent on the left
+     * @param crossings Output, per particle id the number of side changes
+     * @return Time since the accumulators started
+     */
+    double get_occupancy(double t, std::vector<double> &left_times, std::vector<unsigned long> &crossings) const;
+
+    /**
+     * @return Number of particles that are parked on trapped orbits
+     */
+    unsigned long get_num_parked() const;
+
+    /**
+     * @return Number of times a particle had no next impact and was reset, which should not happen
+     */
+    int get_num_resets() const;
+
 
     /**
      * (Re)set the particle to some initial position. We also use this method if we lose a particle due to tricky
@@ -299,6 +595,63 @@ public:
      */
     void update(double write_dt);
 
+    /**
+     * Process up to `max_events` events, with the same result as calling `update(0)` that many times.
+     * The earliest `window_size` events are inspected at once. The longest prefix of them that does not touch
+     * gate state or the boundaries is moved and re-predicted together, and committed as far as the serial order
+     * allows: an event is only committed if it precedes all new predictions of the events before it.
+     * Gate-related events, and events whose new prediction needs a reset, are processed one by one with `update`.
+     * With `park_trapped_orbits` set, all events are processed one by one.
+     * @param max_events Maximum number of events to process
+     * @param in_left_trace If given, the value of `in_left` after each processed event is appended to it
+     * @return Number of events processed
+     */
+    unsigned long update_window(unsigned long max_events, std::vector<unsigned long> *in_left_trace = nullptr);
+
+    // Number of events inspected at once by `update_window`
+    unsigned long window_size = 64;
+
+    /**
+     * If set, every event is published to these observers (see `ObserverPipeline`), which run on their own threads.
+     */
+    ObserverPipeline *observers = nullptr;
+
+    /**
+     * If set, the chambers are stochastic reservoirs: a particle that bounces off a chamber wall is taken out of the
+     * billiard and comes back at the mouth of a channel after a time, at a place and in a direction drawn from
+     * this model (see `ReservoirModel`). Its flight to the mouth is a single event. The channels, the gates and the
+     * back channel stay exact. Positions of particles in a reservoir are interpolated along a chord of the chamber
+     * and have no meaning beyond the side they are on. Not saved with the state, and not available with
+     * `park_trapped_orbits` or in an open system.
+     */
+    ReservoirModel *reservoirs = nullptr;
+
+    /**
+     * If set, `write_positions_to_file` only writes the particles for which it returns true, given the particle id and
+     * its position, followed by a line with their indices (see `TrajectoryFilter` for the usual selections).
+     * Set it before the first frame is written, since the header records that the frames are indexed.
+     */
+    std::function<bool(unsigned long, double, double)> output_filter;
+
+    /**
+     * Time of the next event in the simulation. All positions can be interpolated up to this time.
+     * @return Time of the next impact
+     */
+    double get_next_event_time() const;
+
+    /**
+     * Set a wall-clock deadline for this run.
+     * @param seconds Number of seconds from now after which the run should stop. Non-positive values remove it.
+     */
+    void set_deadline(double seconds);
+
+    /**
+     * Check whether the run is still within its event budget and deadline.
+     * The budget is checked on every call, the clock only every `DEADLINE_CHECK_INTERVAL` calls to keep it cheap.
+     * @return false if a limit has been exceeded (and sets `truncated`), true otherwise
+     */
+    bool has_budget_left();
+
     /**
      * Print the current status of the simulation to stdout
      */
@@ -317,7 +670,7 @@ public:
     void write_bounce_map_to_file(const unsigned long &particle) const;
 
     /**
-     * Compute the mass spread in the chamber.
+     * Compute the mass spread in the chamber, over the particles that are in the system.
      * The mass spread is defined as the number of particles in the right urn minus the number of particles in the left urn
      * divided by the total number of particles. This means that an qqual distribution of mass yields 0, while
      * the right urn full and the left empty yields a mass spread of one.
@@ -339,7 +692,7 @@ public:
      * @param particle Particle index
      * @return angle of the particle after exploding the gate
      */
-    double get_retraction_angle(const unsigned long &particle) const;
+    double get_retraction_angle(const unsigned long &particle);
 
     /**
      * Finish up simulation (write results, optional post-processing)
@@ -354,37 +707,224 @@ private:
     void couple_bridge();
 
     /**
-     * Sort the indices of the particles with respect to the next collision.
-     * By using sorted indices, we speed op the simulation 4-5x.
+     * Fast-forward or park a particle that has just bounced off a chamber wall and will bounce off it again,
+     * see `park_trapped_orbits`.
+     * @param particle Particle index
      */
-    void sort_indices();
+    void check_trapped_orbit(const unsigned long &particle);
 
     /**
-     * Find the index of a particle in a sorted array.
-     * This method uses binary search.
-     * @param particle Particle index
-     * @return Index of the particle where it fits.
+     * Change the width of one of the channels, see `set_bridge_width`.
+     * @param width New width
+     * @param second Whether to change the back channel instead of the central one
+     * @return Number of particles whose next impact was predicted again
+     */
+    unsigned long change_channel_width(double width, bool second);
+
+    /**
+     * Check whether a bounce point lies on the mouth of a channel.
+     * @param angle Angle of the bounce point with respect to the center of the chamber
+     * @param center_x x-coordinate of the chamber center
+     * @return true if a chord ending in this point leaves the circular part of the chamber
      */
-    unsigned long find_index(const unsigned long &particle) const;
+    bool is_in_mouth(double angle, double center_x) const;
 
     /**
-     * Updates the position of a particle in the sorted index list, based on its new collision time.
+     * Check whether processing the next event of a particle only affects the particle itself:
+     * no gate admission or departure, no periodic boundary and no recovery of a lost particle.
      * @param particle Particle index
-     * @param was_minimum If the particle was at the base of the list, no need to search its old position.
+     * @return true if the event can be processed in a batch
      */
-    void reindex_particle(const unsigned long &particle, bool was_minimum);
+    bool is_independent_event(const unsigned long &particle) const;
 
     /**
-     * Insert a particle in the list where it belongs, submethod.
-     * @param particle
+     * Publish the state of a particle to the observers, if any.
+     * @param particle Particle index
+     * @param kind Kind of event, see `EventRecord`
      */
-    void insert_index(const unsigned long &particle);
+    void publish_event(const unsigned long &particle, uint32_t kind) const;
 
     std::shared_ptr<std::random_device> rd;
     std::shared_ptr<std::mt19937> rng;
     std::shared_ptr<std::uniform_real_distribution<double>> unif_real;
+    // Streams of `use_common_random_numbers`: number of draws of the particle with id p for its position at 2p,
+    // for its retractions at 2p + 1
+    bool common_random_numbers = false;
+    unsigned long common_seed = 0;
+    std::vector<unsigned long> common_draws;
+
+    /**
+     * Draw a uniform number in [0, 1), from the given stream of a particle if common random numbers are used
+     * and from the shared generator otherwise.
+     * @param particle Particle index
+     * @param stream 0 for positions, 1 for retractions
+     */
+    double draw_uniform(const unsigned long &particle, unsigned stream);
+
+    /**
+     * Renumber the particles: the particle at index `order[i]` gets index `i`. Every per-particle array and everything
+     * that refers to particles by index is permuted here, so new per-particle state must be added here as well.
+     * @param order Permutation of the particle indices
+     */
+    void permute(const std::vector<unsigned long> &order);
+
+    /**
+     * Recompute `particle_indices` from `particle_ids`.
+     */
+    void index_particle_ids();
+
+    /**
+     * Call `renumber` if `renumber_interval` events have passed since the last renumbering.
+     */
+    void check_renumbering();
+
+    /**
+     * Count a crossing of a particle in `current_counters`, and in `species_current_counters` if there are species.
+     * @param particle Particle index
+     * @param counter FROM_LEFT_TO_RIGHT_INNER, ...
+     */
+    void count_crossing(const unsigned long &particle, int counter);
+
+    /**
+     * Track a particle that changes sides in `in_left`, and in `species_in_left` if there are species.
+     * @param particle Particle index
+     * @param to_left Whether it moves to the left
+     */
+    void count_side_change(const unsigned long &particle, bool to_left);
+
+    /**
+     * @return Whether a gate holds as many particles of the species of `particle` as the species may have in it
+     */
+    bool is_species_gate_full(const unsigned long &particle, const unsigned long &direction) const;
+
+    /**
+     * Time at which a flight crosses to the other side, through the center line or through the back channel.
+     * @param x Position where the flight starts
+     * @param direction Direction of the flight
+     * @param start_time Time the flight starts
+     * @return Crossing time, infinite if the flight heads outwards and there is no back channel
+     */
+    double get_crossing_time(double x, double direction, double start_time) const;
+
+    /**
+     * Add a side change to the occupancy accumulators, if they are kept.
+     * @param particle Particle index
+     * @param x Position where the crossing flight started
+     * @param direction Direction of the crossing flight
+     * @param start_time Time the crossing flight started
+     * @param to_left Whether the particle moved to the left
+     */
+    void record_crossing(const unsigned long &particle, double x, double direction, double start_time, bool to_left);
+
+    /**
+     * Add a source or a sink, see `add_source`.
+     */
+    void add_wall_segment(const WallSegment &segment);
+
+    /**
+     * @return Index in `wall_segments` of the source with the earliest injection, -1 if there are no sources
+     */
+    long get_next_source() const;
+
+    /**
+     * Put a particle in a free slot at a source, and draw the time of the next injection of the source.
+     * @param source Index in `wall_segments`
+     */
+    void inject(unsigned long source);
+
+    /**
+     * Remove a particle that has just hit a wall if it hit a sink, and free its slot.
+     * @param particle Particle index
+     * @return Whether the particle was absorbed
+     */
+    bool check_absorption(const unsigned long &particle);
+
+    /**
+     * @return Index in `wall_segments` of the sink that contains the point, -1 if the point is not on a sink
+     */
+    long find_sink(double x, double y) const;
+
+    /**
+     * Take a particle out of the system: no position, no next impact.
+     * @param particle Particle index
+     */
+    void free_slot(const unsigned long &particle);
+
+    /**
+     * @return Whether the point lies on the wall of a chamber, outside the mouths of the channels
+     */
+    bool is_on_chamber_wall(double x, double y) const;
+
+    /**
+     * Send a particle that has just bounced off a chamber wall into its reservoir: its next event is the return
+     * at a mouth drawn from `reservoirs`.
+     * @param particle Particle index
+     * @param start_x Position where its last flight started, which tells the mouth it entered through
+     */
+    void send_to_reservoir(const unsigned long &particle, double start_x);
+
+    /**
+     * While `reservoirs` is calibrated: start the visit of a particle that has just bounced off a chamber wall,
+     * or end it when its last flight left the chamber, and add the return to the model. Visits are started while
+     * `ReservoirModel::start_visit` lets them.
+     * @param particle Particle index, after its event
+     * @param x Position where the last flight started
+     * @param y Position where the last flight started
+     * @param direction Direction of the last flight
+     * @param start_time Time the last flight started
+     */
+    void record_reservoir_return(const unsigned long &particle, double x, double y, double direction,
+                                 double start_time);
+
+    /**
+     * Start the occupancy accumulators at the current time if `track_occupancy` is set, drop them otherwise.
+     */
+    void reset_occupancy();
     int reset_counter = 0;
-    std::vector<unsigned long> sorted_indices;
+    EventQueue event_queue;
+    static const unsigned DEADLINE_CHECK_INTERVAL = 1024;
+    unsigned deadline_check_counter = 0;
+    // Minimum number of particles per thread in `snapshot`
+    static const unsigned long SNAPSHOT_CHUNK = 1ul << 14;
+    bool has_deadline = false;
+    std::chrono::steady_clock::time_point deadline;
+    // Chord length and rotation angle of the orbit a particle is fast-forwarded or parked on, zero otherwise
+    std::vector<double> orbit_chords;
+    std::vector<double> orbit_rotations;
+    unsigned long num_parked = 0;
+    double parked_collision_rate = 0;
+    double parked_collision_credit = 0;
+    // Id of every particle index and index of every id, see `renumber`
+    std::vector<unsigned long> particle_ids;
+    std::vector<unsigned long> particle_indices;
+    bool is_renumbered = false;
+    // Species of every particle index, see `set_species`
+    std::vector<uint8_t> species;
+    unsigned num_species = 1;
+    // Capacity per gate and species
+    std::vector<std::vector<int>> species_gate_capacities;
+    // Occupancy accumulators per particle index: time on the left up to the last side change, time of the last
+    // side change, number of side changes. Empty if they are not kept
+    std::vector<double> occupancy_left_times;
+    std::vector<double> occupancy_since;
+    std::vector<unsigned long> occupancy_crossings;
+    double occupancy_start = 0;
+    // Time of the first wall bounce of every particle in a reservoir, NaN outside, minus infinity during the visit
+    // a particle starts in; only kept while calibrating
+    std::vector<double> reservoir_entry_times;
+    // Whether every particle in a reservoir entered it through the back channel; only kept while calibrating
+    std::vector<uint8_t> reservoir_back_entries;
+    // Free slots of an open system; injections take the last one
+    std::vector<unsigned long> free_slots;
+    bool has_sinks = false;
+    unsigned long last_renumbering = 0;
+    // Buffers for `update_window`
+    std::vector<unsigned long> window;
+    // Set while `update_window` predicts ahead of the serial order, which leaves resets to `update`
+    bool speculating = false;
+    bool speculation_failed = false;
+    std::vector<double> window_state;
+    std::vector<double> window_times;
 };
 
 
@@ -0,0 +1,320 @@
+#include "simulation3d.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+// Distance (in time) by which events are stepped inside walls and across gate planes
+const double EPS = 1E-12;
+// Roots closer than this are the surface the particle currently sits on
+const double ROOT_EPS = 1E-10;
+
+/**
+ * Keep root `t` if it is valid, positive and earlier than the best so far. Written with selects only,
+ * so that loops calling it remain vectorizable.
+ */
+static inline void select_root(double t, bool valid, int code, double &best, int &surface) {
+    const bool better = valid & (t > ROOT_EPS) & (t < best);
+    best = better ? t : best;
+    surface = better ? code : surface;
+}
+
+Simulation3D::Simulation3D(int num_particles, double bridge_width, double sphere_radius, double sphere_distance,
+                           int left_gate_capacity, int right_gate_capacity, bool random_dir)
+        : num_particles(num_particles), left_gate_capacity(left_gate_capacity),
+          right_gate_capacity(right_gate_capacity), sphere_radius(sphere_radius), sphere_distance(sphere_distance),
+          bridge_width(bridge_width), explosion_direction_is_random(random_dir) {
+    rd = std::make_shared<std::random_device>();
+    rng = std::make_shared<std::mt19937>((*rd)());
+    unif_real = std::make_shared<std::uniform_real_distribution<double>>(0, 1);
+    bridge_length = 0;
+}
+
+void Simulation3D::setup() {
+    for (std::vector<double> *values: {&x_pos, &y_pos, &z_pos, &x_dirs, &y_dirs, &z_dirs, &next_x_pos, &next_y_pos,
+                                       &next_z_pos, &next_x_dirs, &next_y_dirs, &next_z_dirs, &impact_times,
+                                       &next_impact_times}) {
+        values->resize(num_particles);
+    }
+    gate_arrays.emplace_back(std::vector<bool>(num_particles));
+    gate_arrays.emplace_back(std::vector<bool>(num_particles));
+    gate_contents.resize(2);
+    gate_capacities.push_back(left_gate_capacity);
+    gate_capacities.push_back(right_gate_capacity);
+    couple_bridge();
+    left_center_x = -sphere_distance / 2 - sphere_radius;
+    right_center_x = sphere_distance / 2 + sphere_radius;
+    max_path = sphere_distance + bridge_width + sphere_radius * 4; // Upper bound for the longest path
+}
+
+void Simulation3D::couple_bridge() {
+    /**
+     * The cylinder meets each sphere in a circle that lies slightly behind the point of the sphere closest to the
+     * middle, exactly as the bridge lines meet the circles in two dimensions.
+     */
+    if (bridge_width >= 2 * sphere_radius) {
+        throw std::invalid_argument("Channel wider than the chambers");
+    }
+    const double discrepancy =
+            2 * sphere_radius - 2 * std::sqrt(std::pow(sphere_radius, 2) - std::pow(bridge_width, 2) / 4);
+    if (distance_as_channel_length) {
+        bridge_length = sphere_distance;
+        sphere_distance = bridge_length - discrepancy;
+        if (sphere_distance <= 0) {
+            throw std::invalid_argument("Bridge length smaller than zero for this configuration");
+        }
+    } else {
+        bridge_length = sphere_distance + discrepancy;
+    }
+}
+
+void Simulation3D::random_direction(double &vx, double &vy, double &vz) const {
+    const double cos_theta = 2 * (*unif_real)(*rng) - 1;
+    const double sin_theta = std::sqrt(1 - cos_theta * cos_theta);
+    const double phi = 2 * PI * (*unif_real)(*rng);
+    vx = cos_theta;
+    vy = sin_theta * std::cos(phi);
+    vz = sin_theta * std::sin(phi);
+}
+
+void Simulation3D::reset_particle(const unsigned long &particle, const unsigned long &direction) {
+    const double center_x = direction == LEFT ? left_center_x : right_center_x;
+    double x, y, z;
+    do {
+        x = center_x + ((*unif_real)(*rng) - 0.5) * 2 * sphere_radius;
+        y = ((*unif_real)(*rng) - 0.5) * 2 * sphere_radius;
+        z = ((*unif_real)(*rng) - 0.5) * 2 * sphere_radius;
+    } while (not is_in_sphere(x, y, z, direction) or std::fabs(x) <= bridge_length / 2);
+    x_pos[particle] = x;
+    y_pos[particle] = y;
+    z_pos[particle] = z;
+    random_direction(x_dirs[particle], y_dirs[particle], z_dirs[particle]);
+}
+
+void Simulation3D::start(double left_ratio) {
+    time = 0;
+    in_left = 0;
+    if (left_ratio < 0 or left_ratio > 1) {
+        throw std::domain_error("Please choose ratio between 0 and 1");
+    }
+    const auto num_left_particles = (unsigned long) (left_ratio * num_particles);
+    for (unsigned long particle = 0; particle < (unsigned long) num_particles; particle++) {
+        reset_particle(particle, particle < num_left_particles ? LEFT : RIGHT);
+        impact_times[particle] = 0;
+    }
+    in_left = num_left_particles;
+    compute_next_impacts(0, (unsigned long) num_particles);
+    current_counters.assign(4, 0);
+    event_queue = EventQueue(queue_type);
+    event_queue.build(next_impact_times);
+}
+
+void Simulation3D::predict_block(unsigned long n, const double *x, const double *y, const double *z,
+                                 const double *vx, const double *vy, const double *vz, double *times,
+                                 int *surfaces) const {
+    const double radius_2 = sphere_radius * sphere_radius;
+    const double bridge_radius_2 = bridge_width * bridge_width / 4;
+    const double half_length = bridge_length / 2;
+    const double centers[2] = {left_center_x, right_center_x};
+    const double planes[3] = {-half_length, 0, half_length};
+    for (unsigned long i = 0; i < n; i++) {
+        double best = max_path;
+        int surface = NO_SURFACE;
+        // Spheres: both roots count, unless the hit point lies in the mouth of the channel
+        for (int side = 0; side < 2; side++) {
+            const double dx = x[i] - centers[side];
+            const double b = dx * vx[i] + y[i] * vy[i] + z[i] * vz[i];
+            const double c = dx * dx + y[i] * y[i] + z[i] * z[i] - radius_2;
+            const double discriminant = b * b - c;
+            const double root = std::sqrt(std::fmax(discriminant, 0.));
+            for (double t: {-b - root, -b + root}) {
+                const double hx = dx + t * vx[i];
+                const double hy = y[i] + t * vy[i];
+                const double hz = z[i] + t * vz[i];
+                const bool in_mouth = (hy * hy + hz * hz < bridge_radius_2) & (hx * centers[side] < 0);
+                select_root(t, (discriminant >= 0) & not in_mouth, side, best, surface);
+            }
+        }
+        // Cylinder: only the part between the spheres is wall
+        const double a = vy[i] * vy[i] + vz[i] * vz[i];
+        const double b = y[i] * vy[i] + z[i] * vz[i];
+        const double c = y[i] * y[i] + z[i] * z[i] - bridge_radius_2;
+        const double discriminant = b * b - a * c;
+        const double root = std::sqrt(std::fmax(discriminant, 0.));
+        for (double t: {(-b - root) / a, (-b + root) / a}) {
+            const double hx = x[i] + t * vx[i];
+            select_root(t, (discriminant >= 0) & (std::fabs(hx) <= half_length), CYLINDER, best, surface);
+        }
+        // Gate planes and the middle of the channel
+        for (double plane: planes) {
+            select_root((plane - x[i]) / vx[i], true, PLANE, best, surface);
+        }
+        times[i] = best;
+        surfaces[i] = surface;
+    }
+}
+
+void Simulation3D::compute_next_impacts(unsigned long begin, unsigned long end) {
+    const unsigned long n = end - begin;
+    scratch_times.resize(n);
+    scratch_surfaces.resize(n);
+    predict_block(n, &x_pos[begin], &y_pos[begin], &z_pos[begin], &x_dirs[begin], &y_dirs[begin], &z_dirs[begin],
+                  scratch_times.data(), scratch_surfaces.data());
+    for (unsigned long i = 0; i < n; i++) {
+        finish_prediction(begin + i, scratch_times[i], scratch_surfaces[i]);
+    }
+}
+
+void Simulation3D::finish_prediction(const unsigned long &particle, double travel_time, int surface) {
+    while (surface == NO_SURFACE) {
+        // Round-off can let a particle slip through a wall. Has no effect on macroscopic behaviour.
+        reset_counter++;
+        printf("Particle %lu lost at (%.4f, %.4f, %.4f), has to be reset (%dth time)\n", particle, x_pos[particle],
+               y_pos[particle], z_pos[particle], reset_counter);
+        reset_particle(particle, x_pos[particle] > 0 ? RIGHT : LEFT);
+        predict_block(1, &x_pos[particle], &y_pos[particle], &z_pos[particle], &x_dirs[particle], &y_dirs[particle],
+                      &z_dirs[particle], &travel_time, &surface);
+    }
+    const double vx = x_dirs[particle];
+    const double vy = y_dirs[particle];
+    const double vz = z_dirs[particle];
+    // Walls are hit just before the surface, planes are crossed just beyond it
+    const double step = surface == PLANE ? travel_time + EPS : travel_time - EPS;
+    next_x_pos[particle] = x_pos[particle] + step * vx;
+    next_y_pos[particle] = y_pos[particle] + step * vy;
+    next_z_pos[particle] = z_pos[particle] + step * vz;
+    next_impact_times[particle] = impact_times[particle] + step;
+    double nx = 0, ny = 0, nz = 0;
+    if (surface == LEFT_SPHERE or surface == RIGHT_SPHERE) {
+        nx = x_pos[particle] + travel_time * vx - (surface == LEFT_SPHERE ? left_center_x : right_center_x);
+    }
+    if (surface != PLANE) {
+        ny = y_pos[particle] + travel_time * vy;
+        nz = z_pos[particle] + travel_time * vz;
+        const double norm = std::sqrt(nx * nx + ny * ny + nz * nz);
+        nx /= norm;
+        ny /= norm;
+        nz /= norm;
+    }
+    const double dot = vx * nx + vy * ny + vz * nz;
+    const double rx = vx - 2 * dot * nx;
+    const double ry = vy - 2 * dot * ny;
+    const double rz = vz - 2 * dot * nz;
+    // Renormalise, otherwise round-off in the directions grows with every reflection
+    const double speed = std::sqrt(rx * rx + ry * ry + rz * rz);
+    next_x_dirs[particle] = rx / speed;
+    next_y_dirs[particle] = ry / speed;
+    next_z_dirs[particle] = rz / speed;
+}
+
+void Simulation3D::update() {
+    const unsigned long particle = event_queue.top();
+    const double next_impact = next_impact_times[particle];
+    num_collisions++;
+    if (x_pos[particle] <= 0 and next_x_pos[particle] > 0) {
+        current_counters[FROM_LEFT_TO_RIGHT_INNER]++;
+        in_left--;
+    } else if (x_pos[particle] > 0 and next_x_pos[particle] <= 0) {
+        current_counters[FROM_RIGHT_TO_LEFT_INNER]++;
+        in_left++;
+    }
+    x_pos[particle] = next_x_pos[particle];
+    y_pos[particle] = next_y_pos[particle];
+    z_pos[particle] = next_z_pos[particle];
+    x_dirs[particle] = next_x_dirs[particle];
+    y_dirs[particle] = next_y_dirs[particle];
+    z_dirs[particle] = next_z_dirs[particle];
+    impact_times[particle] = next_impact;
+    time = next_impact;
+    for (unsigned long direction = 0; direction < 2; direction++) {
+        if (is_in_gate(x_pos[particle], direction) and is_going_in(particle)) {
+            check_gate_admission(particle, direction);
+        } else {
+            check_gate_departure(particle, direction);
+        }
+    }
+    compute_next_impacts(particle, particle + 1);
+    event_queue.update(particle, next_impact_times, true);
+}
+
+void Simulation3D::check_gate_admission(const unsigned long &particle, const unsigned long &direction) {
+    if (not gate_arrays[direction][particle]) {
+        if (gate_contents[direction].size() >= (unsigned long) gate_capacities[direction]) {
+            explode_gate(particle, direction);
+        } else {
+            gate_contents[direction].push_back(particle);
+            gate_arrays[direction][particle] = true;
+        }
+    }
+}
+
+void Simulation3D::check_gate_departure(const unsigned long &particle, const unsigned long &direction) {
+    if (gate_arrays[direction][particle]) {
+        gate_contents[direction].erase(std::remove(gate_contents[direction].begin(),
+                                                   gate_contents[direction].end(), particle),
+                                       gate_contents[direction].end());
+        gate_arrays[direction][particle] = false;
+    }
+}
+
+void Simulation3D::explode_gate(const unsigned long &exp_particle, const unsigned long &direction) {
+    set_retraction_direction(exp_particle);
+    for (unsigned long particle: gate_contents[direction]) {
+        get_position_at(particle, time, x_pos[particle], y_pos[particle], z_pos[particle]);
+        impact_times[particle] = time;
+        set_retraction_direction(particle);
+        compute_next_impacts(particle, particle + 1);
+        gate_arrays[direction][particle] = false;
+        event_queue.update(particle, next_impact_times);
+    }
+    gate_contents[direction].clear();
+}
+
+void Simulation3D::set_retraction_direction(const unsigned long &particle) {
+    if (explosion_direction_is_random) {
+        random_direction(x_dirs[particle], y_dirs[particle], z_dirs[particle]);
+        x_dirs[particle] = x_pos[particle] > 0 ? std::fabs(x_dirs[particle]) : -std::fabs(x_dirs[particle]);
+    } else if (x_dirs[particle] * x_pos[particle] < 0) {
+        x_dirs[particle] = -x_dirs[particle];
+    }
+}
+
+bool Simulation3D::is_in_sphere(double x, double y, double z, const unsigned long &side) const {
+    const double dx = x - (side == LEFT ? left_center_x : right_center_x);
+    return dx * dx + y * y + z * z <= sphere_radius * sphere_radius;
+}
+
+bool Simulation3D::is_in_bridge(double x, double y, double z) const {
+    return std::fabs(x) <= bridge_length / 2 and y * y + z * z <= bridge_width * bridge_width / 4;
+}
+
+bool Simulation3D::is_in_domain(double x, double y, double z) const {
+    return is_in_sphere(x, y, z, LEFT) or is_in_sphere(x, y, z, RIGHT) or is_in_bridge(x, y, z);
+}
+
+bool Simulation3D::is_in_gate(double x, const unsigned long &direction) const {
+    return ((int) direction * 2 - 1) * x >= 0 and std::fabs(x) <= bridge_length / 2;
+}
+
+bool Simulation3D::is_going_in(const unsigned long &particle) const {
+    return x_pos[particle] * x_dirs[particle] <= 0;
+}
+
+void Simulation3D::get_position_at(const unsigned long &particle, double t, double &x, double &y, double &z) const {
+    const double dt = t - impact_times[particle];
+    x = x_pos[particle] + dt * x_dirs[particle];
+    y = y_pos[particle] + dt * y_dirs[particle];
+    z = z_pos[particle] + dt * z_dirs[particle];
+}
+
+double Simulation3D::get_next_event_time() const {
+    return next_impact_times[event_queue.top()];
+}
+
+double Simulation3D::get_mass_spread() const {
+    return (num_particles - 2. * in_left) / num_particles;
+}
+
+int Simulation3D::get_num_resets() const {
+    return reset_counter;
+}
@@ -0,0 +1,186 @@
+#ifndef TERRIER_SIMULATION3D_H
+#define TERRIER_SIMULATION3D_H
+
+#include <random>
+#include <memory>
+#include <vector>
+#include "constants.h"
+#include "event_queue.h"
+
+/**
+ * Three-dimensional variant of the two-urn model: two spherical chambers connected by a cylindrical channel
+ * along the x-axis. The gate semantics are those of the two-dimensional `Simulation` with a flat gate:
+ * each half of the channel admits at most its capacity of particles moving inwards, and the next particle explodes
+ * the gate, sending all of its contents back.
+ *
+ * Particles move with unit speed; their direction is stored as a unit vector, so reflections need no trigonometry.
+ * Because comparable densities need far larger systems than in 2D, the engine uses the binary heap event queue.
+ * Impacts are predicted with a branch-free kernel over the structure-of-arrays particle data, but only `start` gives it
+ * a large batch: the event loop re-predicts one particle at a time, so it runs scalar like the 2D engine.
+ */
+class Simulation3D {
+public:
+    /**
+     * Create a new three-dimensional simulation. Parameters may be changed until `setup` is called.
+     * @param num_particles Number of particles
+     * @param bridge_width Diameter of the cylindrical channel
+     * @param sphere_radius Radius of the chambers
+     * @param sphere_distance Distance between the chambers
+     * OR length of the channel, based on `distance_as_channel_length`
+     * @param left_gate_capacity Maximum number of particles allowed to enter the left half of the channel
+     * @param right_gate_capacity Maximum number of particles allowed to enter the right half of the channel
+     * @param random_dir Whether bouncing back should happen randomly
+     */
+    Simulation3D(int num_particles, double bridge_width, double sphere_radius = 1., double sphere_distance = 0.5,
+                 int left_gate_capacity = 3, int right_gate_capacity = 3, bool random_dir = false);
+
+    const int num_particles;
+    int left_gate_capacity;
+    int right_gate_capacity;
+    /**
+     * Number of crossings of the middle of the channel, indexed like in `Simulation`.
+     * There is no back channel, so the outer counters stay zero.
+     */
+    std::vector<int> current_counters;
+    const int FROM_LEFT_TO_RIGHT_INNER = 0;
+    const int FROM_LEFT_TO_RIGHT_OUTER = 1;
+    const int FROM_RIGHT_TO_LEFT_INNER = 2;
+    const int FROM_RIGHT_TO_LEFT_OUTER = 3;
+    unsigned long in_left;
+    unsigned long num_collisions = 0;
+    double sphere_radius;
+    double sphere_distance;
+    double bridge_width;
+    // Computed quantities
+    double left_center_x;
+    double right_center_x;
+    double bridge_length;
+    double max_path;
+    const unsigned long LEFT = 0;
+    const unsigned long RIGHT = 1;
+    bool explosion_direction_is_random;
+    bool distance_as_channel_length = false;
+    EventQueue::Type queue_type = EventQueue::BINARY_HEAP;
+
+    /**
+     * Compute the derived geometry and allocate the particle data. Run only once per simulation.
+     */
+    void setup();
+
+    /**
+     * Place the particles uniformly in the chambers, with isotropic directions, and predict all first impacts.
+     * @param left_ratio ratio of particles that should be initiated on the left side.
+     */
+    void start(double left_ratio);
+
+    /**
+     * Process the next event in the simulation.
+     */
+    void update();
+
+    bool is_in_domain(double x, double y, double z) const;
+
+    bool is_in_sphere(double x, double y, double z, const unsigned long &side) const;
+
+    bool is_in_bridge(double x, double y, double z) const;
+
+    /**
+     * Check if the point is in the gate on side `direction`: the half of the channel between the middle and the
+     * plane where the channel meets the sphere. The gate is flat, so only `x` matters.
+     */
+    bool is_in_gate(double x, const unsigned long &direction) const;
+
+    bool is_going_in(const unsigned long &particle) const;
+
+    /**
+     * Compute the position of a particle at time `t`, which should lie between its last and its next impact.
+     */
+    void get_position_at(const unsigned long &particle, double t, double &x, double &y, double &z) const;
+
+    double get_next_event_time() const;
+
+    /**
+     * See `Simulation::get_mass_spread`.
+     * @return mass spread as a double between -1 and 1.
+     */
+    double get_mass_spread() const;
+
+    /**
+     * @return Number of particles that were lost to round-off and had to be placed back in their chamber.
+     */
+    int get_num_resets() const;
+
+    /**
+     * Compute the time until each ray leaves the domain or crosses one of the gate planes.
+     * Branch-free over the batch, so that the compiler can vectorize it. `start` predicts all particles in one batch;
+     * in the event loop every event and every retraction re-predicts a single particle, a batch of one.
+     * @param n Number of rays
+     * @param x,y,z Start positions
+     * @param vx,vy,vz Unit directions
+     * @param times Output: travel time until the event, `max_path` if no event is found
+     * @param surfaces Output: surface hit, one of `Surface`
+     */
+    void predict_block(unsigned long n, const double *x, const double *y, const double *z, const double *vx,
+                       const double *vy, const double *vz, double *times, int *surfaces) const;
+
+    enum Surface {
+        LEFT_SPHERE = 0, RIGHT_SPHERE = 1, CYLINDER = 2, PLANE = 3, NO_SURFACE = 4
+    };
+
+    double time;
+    std::vector<double> x_pos;
+    std::vector<double> y_pos;
+    std::vector<double> z_pos;
+    std::vector<double> x_dirs;
+    std::vector<double> y_dirs;
+    std::vector<double> z_dirs;
+    std::vector<double> next_x_pos;
+    std::vector<double> next_y_pos;
+    std::vector<double> next_z_pos;
+    std::vector<double> next_x_dirs;
+    std::vector<double> next_y_dirs;
+    std::vector<double> next_z_dirs;
+    std::vector<double> impact_times;
+    std::vector<double> next_impact_times;
+    std::vector<int> gate_capacities;
+    std::vector<std::vector<unsigned long>> gate_contents;
+    std::vector<std::vector<bool>> gate_arrays;
+
+private:
+    /**
+     * Compute the length of the channel from the distance between the spheres, or vice versa.
+     */
+    void couple_bridge();
+
+    /**
+     * Predict the next impact of the particles in the index range [begin, end).
+     */
+    void compute_next_impacts(unsigned long begin, unsigned long end);
+
+    /**
+     * Turn a predicted travel time and surface into the next position, direction and time of a particle.
+     */
+    void finish_prediction(const unsigned long &particle, double travel_time, int surface);
+
+    void reset_particle(const unsigned long &particle, const unsigned long &direction);
+
+    void random_direction(double &vx, double &vy, double &vz) const;
+
+    void set_retraction_direction(const unsigned long &particle);
+
+    void check_gate_admission(const unsigned long &particle, const unsigned long &direction);
+
+    void check_gate_departure(const unsigned long &particle, const unsigned long &direction);
+
+    void explode_gate(const unsigned long &particle, const unsigned long &direction);
+
+    std::shared_ptr<std::random_device> rd;
+    std::shared_ptr<std::mt19937> rng;
+    std::shared_ptr<std::uniform_real_distribution<double>> unif_real;
+    EventQueue event_queue;
+    int reset_counter = 0;
+    std::vector<double> scratch_times;
+    std::vector<int> scratch_surfaces;
+};
+
+#endif //TERRIER_SIMULATION3D_H
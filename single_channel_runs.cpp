@@ -1,6 +1,7 @@
 #include <iostream>
 #include <memory>
 #include "simulation.h"
+#include "experiment.h"
 #include <string>
 
 /**
@@ -21,38 +22,29 @@
  * @param urn_radius Radius of the chamber
  * @param threshold Number of particles that can at the same time in the channel
  * @param num_particles Number of particles in the system
- * @param id File identifier to write auxiliary results to.
+ * @param backend Backend to run with, see `select_backend`. If null, the backend is selected for this run.
  * @return Average mass spread
  */
 
 double
 get_mass_spread(unsigned long M_t, unsigned long M_f, double channel_length, double channel_width, double urn_radius,
-                int threshold, int num_particles) {
-    double chi = 0; // mass spread
-    Simulation sim = Simulation(num_particles, channel_width, urn_radius, channel_length, threshold, threshold);
-    sim.gate_is_flat = true;
-    sim.distance_as_channel_length = true;
-    sim.expected_collisions = M_f;
-
-    std::ostringstream s;
-    const double left_ratio = 0.75;
-    try {
-        sim.setup();
-    } catch (const std::invalid_argument &ex) {
-        printf("Not running for bridge width %.2f and radius %.2f, returning 0\n", channel_width, urn_radius);
-        return 0;
-    }
-    sim.start(left_ratio);
-    while (sim.num_collisions < M_t) {
-        sim.update(0.0);
-    }
-    const double weight = 1. / (double) (M_f - M_t);
-    while (sim.num_collisions < M_f) {
-        sim.update(0.0);
-        chi += weight * sim.get_mass_spread();
+                int threshold, int num_particles, const Backend *backend = nullptr) {
+    ExperimentSpec spec;
+    spec.single_channel = true;
+    spec.channel_length = channel_length;
+    spec.channel_width = channel_width;
+    spec.urn_radius = urn_radius;
+    spec.threshold = threshold;
+    spec.num_particles = num_particles;
+    spec.left_ratio = 0.75;
+    spec.M_t = M_t;
+    spec.M_f = M_f;
+    if (backend) {
+        spec.backend = *backend;
+    } else {
+        spec.auto_backend = true;
     }
-    chi = std::fabs(chi);
-    return chi;
+    return std::fabs(run_experiment(spec).mass_spread);
 }
 
 /**
@@ -226,13 +218,27 @@ void average_mass_spread_for(int argc, char *argv[]) {
     const int M_f = std::stoi(argv[7]);
     const std::string file_id = argv[8];
     const std::string sim_id = argv[9];
+    // The backend only depends on the point, so all runs share one calibration
+    ExperimentSpec spec;
+    spec.channel_length = channel_length;
+    spec.channel_width = channel_width;
+    spec.urn_radius = urn_radius;
+    spec.threshold = threshold;
+    spec.num_particles = num_particles;
+    spec.M_f = M_f;
+    Backend backend;
+    try {
+        backend = select_backend(spec);
+    } catch (const std::invalid_argument &ex) {
+        // Invalid geometry, which the runs report themselves
+    }
     double av_chi = 0;
     for (unsigned int i = 0; i < num_runs; i++) {
-        av_chi += get_mass_spread(M_t, M_f, channel_length, channel_width, urn_radius, threshold, num_particles) /
-                  num_runs;
+        av_chi += get_mass_spread(M_t, M_f, channel_length, channel_width, urn_radius, threshold, num_particles,
+                                  &backend) / num_runs;
     }
     std::ostringstream s;
-    s << sim_id << "," << av_chi << std::endl;
+    s << sim_id << "," << av_chi << "," << backend.name() << std::endl;
     std::ofstream result_file(file_id + ".out", std::ios::app);
     result_file << s.str();
     result_file.close();
@@ -0,0 +1,235 @@
+#include <mpi.h>
+#include <iostream>
+#include "experiment.h"
+#include "telemetry.h"
+#include <string>
+
+/**
+ * This file contains an executable that distributes a parameter sweep over MPI ranks.
+ * It replaces the xargs-based batch scripts when more than one machine is available,
+ * but works just as well on a single host:
+ *
+ *     mpirun -np 4 ./sweep_mpi results.out double_channel_data/params_1000.in
+ *
+ * Rank 0 reads the sweep files (as created by `create_single_channel_batch.py` and `create_double_channel_batch.py`)
+ * and hands out the points one by one to the workers that ask for work, so fast and slow points balance out.
+ * The workers run the points with the in-process engine and send back the results,
+ * which rank 0 writes as one output file in the order of the input.
+ * Workers report their progress to rank 0 every `PROGRESS_INTERVAL` collisions; rank 0 keeps the statistics file
+ * given with `--stats` up to date (and serves it on localhost with `--port`), see telemetry.h.
+ * With `--budget` and `--deadline` every point is capped in number of collisions and wall-clock seconds.
+ * As in sweep_runs.cpp, `--backend` gives the backend of every point, by name or `auto` (the default) to let the
+ * workers time the backends on each point and keep the fastest; the output records the backend of every point.
+ */
+
+const int TAG_READY = 1;
+const int TAG_RESULT = 2;
+const int TAG_WORK = 3;
+const int TAG_STOP = 4;
+const int TAG_PROGRESS = 5;
+// Index, validity, mass spread, four currents, number of collisions, time, truncation,
+// and the backend: queue type, window size, renumber interval, measured speed
+const int RESULT_SIZE = 14;
+
+void pack_result(unsigned long index, const ExperimentResult &result, double *buffer) {
+    buffer[0] = index;
+    buffer[1] = result.valid;
+    buffer[2] = result.mass_spread;
+    for (unsigned int i = 0; i < 4; i++) {
+        buffer[3 + i] = result.currents.at(i);
+    }
+    buffer[7] = result.num_collisions;
+    buffer[8] = result.time;
+    buffer[9] = result.truncated;
+    buffer[10] = result.backend.queue_type;
+    buffer[11] = result.backend.window_size;
+    buffer[12] = result.backend.renumber_interval;
+    buffer[13] = result.backend.events_per_second;
+}
+
+unsigned long unpack_result(const double *buffer, ExperimentResult &result) {
+    result.valid = buffer[1] != 0;
+    result.mass_spread = buffer[2];
+    for (unsigned int i = 0; i < 4; i++) {
+        result.currents.at(i) = buffer[3 + i];
+    }
+    result.num_collisions = (unsigned long) buffer[7];
+    result.time = buffer[8];
+    result.truncated = buffer[9] != 0;
+    result.backend.queue_type = (EventQueue::Type) buffer[10];
+    result.backend.window_size = (unsigned long) buffer[11];
+    result.backend.renumber_interval = (unsigned long) buffer[12];
+    result.backend.events_per_second = buffer[13];
+    return (unsigned long) buffer[0];
+}
+
+/**
+ * Read the sweep files on rank 0 and broadcast their contents to all ranks,
+ * so the input files need not be on a shared file system.
+ * If rank 0 can not read a file, all ranks throw `std::invalid_argument`.
+ */
+std::vector<ExperimentSpec> broadcast_specs(int rank, const std::vector<std::string> &files) {
+    std::string contents;
+    std::string missing;
+    if (rank == 0) {
+        std::ostringstream s;
+        for (const std::string &filename: files) {
+            std::ifstream file(filename);
+            if (not file) {
+                missing = filename;
+                break;
+            }
+            s << file.rdbuf() << "\n";
+        }
+        contents = s.str();
+    }
+    // The other ranks would wait for the contents forever if rank 0 threw on its own
+    int failed = not missing.empty();
+    MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (failed) {
+        throw std::invalid_argument(rank == 0 ? "Can not open sweep file " + missing : "Rank 0 failed to read");
+    }
+    unsigned long length = contents.size();
+    MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    contents.resize(length);
+    MPI_Bcast(&contents[0], (int) length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    std::istringstream stream(contents);
+    return ExperimentSpec::read_sweep(stream);
+}
+
+void dispatch(const std::vector<ExperimentSpec> &specs, int num_ranks, std::vector<ExperimentResult> &results,
+              SweepTelemetry &telemetry) {
+    unsigned long next = 0;
+    int active_workers = num_ranks - 1;
+    double buffer[RESULT_SIZE];
+    MPI_Status status;
+    while (active_workers > 0) {
+        MPI_Recv(buffer, RESULT_SIZE, MPI_DOUBLE, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        const unsigned worker = status.MPI_SOURCE - 1;
+        if (status.MPI_TAG == TAG_PROGRESS) {
+            telemetry.report_events(worker, (unsigned long) buffer[0]);
+            continue;
+        }
+        if (status.MPI_TAG == TAG_RESULT) {
+            const unsigned long index = unpack_result(buffer, results.at((unsigned long) buffer[0]));
+            telemetry.finish_point(worker, results.at(index).num_collisions);
+            printf("Finished point %lu/%lu on rank %d\n", index + 1, specs.size(), status.MPI_SOURCE);
+        }
+        if (next < specs.size()) {
+            MPI_Send(&next, 1, MPI_UNSIGNED_LONG, status.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
+            telemetry.start_point(worker, next);
+            next++;
+        } else {
+            MPI_Send(&next, 1, MPI_UNSIGNED_LONG, status.MPI_SOURCE, TAG_STOP, MPI_COMM_WORLD);
+            active_workers--;
+        }
+    }
+}
+
+void work(const std::vector<ExperimentSpec> &specs) {
+    double buffer[RESULT_SIZE] = {0};
+    MPI_Send(buffer, RESULT_SIZE, MPI_DOUBLE, 0, TAG_READY, MPI_COMM_WORLD);
+    while (true) {
+        unsigned long index;
+        MPI_Status status;
+        MPI_Recv(&index, 1, MPI_UNSIGNED_LONG, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        if (status.MPI_TAG == TAG_STOP) {
+            break;
+        }
+        const ExperimentResult result = run_experiment(specs.at(index), [](unsigned long events) {
+            double progress[RESULT_SIZE] = {(double) events};
+            MPI_Send(progress, RESULT_SIZE, MPI_DOUBLE, 0, TAG_PROGRESS, MPI_COMM_WORLD);
+        });
+        pack_result(index, result, buffer);
+        MPI_Send(buffer, RESULT_SIZE, MPI_DOUBLE, 0, TAG_RESULT, MPI_COMM_WORLD);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, num_ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+    std::vector<std::string> files;
+    std::string stats_file = "sweep_stats.json";
+    int port = 0;
+    unsigned long event_budget = 0;
+    double time_limit = 0;
+    std::string backend = "auto";
+    for (int i = 2; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument == "--stats" and i + 1 < argc) {
+            stats_file = argv[++i];
+        } else if (argument == "--port" and i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (argument == "--budget" and i + 1 < argc) {
+            event_budget = (unsigned long) std::stod(argv[++i]);
+        } else if (argument == "--deadline" and i + 1 < argc) {
+            time_limit = std::stod(argv[++i]);
+        } else if (argument == "--backend" and i + 1 < argc) {
+            backend = argv[++i];
+        } else {
+            files.push_back(argument);
+        }
+    }
+    if (argc < 3 or files.empty()) {
+        if (rank == 0) {
+            std::cout << "Please provide (in order) (1) output file, (2) one or more sweep (.in) files, and optionally "
+                         "--stats <file>, --port <port>, --budget <events>, --deadline <seconds> "
+                         "and --backend <name or auto>" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    std::vector<ExperimentSpec> specs;
+    try {
+        specs = broadcast_specs(rank, files);
+        for (ExperimentSpec &spec: specs) {
+            spec.event_budget = event_budget;
+            spec.time_limit = time_limit;
+            spec.auto_backend = backend == "auto";
+            if (not spec.auto_backend) {
+                spec.backend = Backend::from_name(backend);
+            }
+        }
+    } catch (const std::invalid_argument &error) {
+        // Every rank gets here, as the sweep and the options are the same on all of them
+        if (rank == 0) {
+            std::cout << error.what() << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    std::vector<ExperimentResult> results(specs.size());
+    if (rank == 0) {
+        std::vector<unsigned long> expected_events;
+        for (const ExperimentSpec &spec: specs) {
+            expected_events.push_back(spec.M_f);
+        }
+        SweepTelemetry telemetry((unsigned) std::max(1, num_ranks - 1), expected_events);
+        telemetry.start_reporting(stats_file, port);
+        if (num_ranks == 1) {
+            for (unsigned long i = 0; i < specs.size(); i++) {
+                telemetry.start_point(0, i);
+                results.at(i) = run_experiment(specs.at(i), [&telemetry](unsigned long events) {
+                    telemetry.report_events(0, events);
+                });
+                telemetry.finish_point(0, results.at(i).num_collisions);
+            }
+        } else {
+            dispatch(specs, num_ranks, results, telemetry);
+        }
+        telemetry.stop_reporting();
+    } else {
+        work(specs);
+    }
+    if (rank == 0) {
+        std::ofstream result_file(argv[1]);
+        for (unsigned long i = 0; i < specs.size(); i++) {
+            result_file << results.at(i).to_line(specs.at(i)) << std::endl;
+        }
+        printf("Wrote %lu points to %s\n", specs.size(), argv[1]);
+    }
+    MPI_Finalize();
+    return 0;
+}
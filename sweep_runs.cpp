@@ -0,0 +1,159 @@
+#include <iostream>
+#include <mutex>
+#include "adaptive_sweep.h"
+#include "experiment.h"
+#include "telemetry.h"
+#include <string>
+
+/**
+ * This file contains an executable that runs the points of one or more sweep files on a pool of threads,
+ * as a single-machine alternative to the xargs-based batch scripts:
+ *
+ *     ./sweep params_1000.out double_channel_data/params_1000.in --stats sweep_stats.json --port 8080
+ *
+ * While it runs, the throughput of each thread, the number of points done and remaining, the predicted time of
+ * arrival and the memory use are written to the stats file and, if a port is given, served on localhost.
+ * With `--budget` and `--deadline` every point is capped in number of collisions and wall-clock seconds;
+ * points that hit a cap report their partial averages with the truncation flag set.
+ *
+ * With `--adaptive <collisions>` the final times of the points are ignored. Instead, the given total of collisions
+ * is spread over the points where the mass spread is noisiest (see `AdaptiveSweep`), in batches of `--batch`
+ * collisions over `--rounds` rounds. Every output line then ends with the standard error of the mass spread
+ * and the number of collisions spent on the point.
+ *
+ * Every point runs with the backend given by `--backend`: `auto` (the default) times the backends on the point first
+ * and keeps the fastest (see `select_backend`), a name from the output of an earlier sweep reruns it in the same way.
+ * With `--seed <number>` the points are seeded with consecutive seeds from it, so that a sweep can be repeated exactly.
+ */
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> files;
+    std::string stats_file = "sweep_stats.json";
+    int port = 0;
+    unsigned long event_budget = 0;
+    double time_limit = 0;
+    unsigned long adaptive_budget = 0;
+    unsigned long batch_size = 10000;
+    unsigned long num_rounds = 10;
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string backend = "auto";
+    unsigned long seed = 0;
+    for (int i = 2; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument == "--threads" and i + 1 < argc) {
+            num_threads = std::stoi(argv[++i]);
+        } else if (argument == "--stats" and i + 1 < argc) {
+            stats_file = argv[++i];
+        } else if (argument == "--port" and i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (argument == "--budget" and i + 1 < argc) {
+            event_budget = (unsigned long) std::stod(argv[++i]);
+        } else if (argument == "--deadline" and i + 1 < argc) {
+            time_limit = std::stod(argv[++i]);
+        } else if (argument == "--adaptive" and i + 1 < argc) {
+            adaptive_budget = (unsigned long) std::stod(argv[++i]);
+        } else if (argument == "--batch" and i + 1 < argc) {
+            batch_size = (unsigned long) std::stod(argv[++i]);
+        } else if (argument == "--rounds" and i + 1 < argc) {
+            num_rounds = std::stoul(argv[++i]);
+        } else if (argument == "--backend" and i + 1 < argc) {
+            backend = argv[++i];
+        } else if (argument == "--seed" and i + 1 < argc) {
+            seed = std::stoul(argv[++i]);
+        } else {
+            files.push_back(argument);
+        }
+    }
+    if (argc < 3 or files.empty()) {
+        throw std::invalid_argument(
+                "Please provide (in order) (1) output file, (2) one or more sweep (.in) files, and optionally "
+                "--threads <number>, --stats <file>, --port <port>, --budget <events>, --deadline <seconds>, "
+                "--adaptive <total events>, --batch <events>, --rounds <number>, --backend <name or auto> "
+                "and --seed <number>");
+    }
+    std::vector<ExperimentSpec> specs;
+    for (const std::string &file: files) {
+        const std::vector<ExperimentSpec> file_specs = ExperimentSpec::read_sweep_file(file);
+        specs.insert(specs.end(), file_specs.begin(), file_specs.end());
+    }
+    if (seed > 0) {
+        for (unsigned long i = 0; i < specs.size(); i++) {
+            specs[i].seed = seed + i;
+        }
+    }
+    if (adaptive_budget > 0) {
+        AdaptiveSweep sweep(specs, adaptive_budget, batch_size, seed);
+        sweep.num_rounds = num_rounds;
+        sweep.num_threads = num_threads;
+        sweep.run([&sweep, num_rounds](unsigned long round) {
+            // Points with fewer than two batches have no standard error yet, so they are counted instead
+            double worst = 0;
+            unsigned long num_unmeasured = 0;
+            for (const SweepPoint &point: sweep.get_points()) {
+                if (not point.is_valid()) {
+                    continue;
+                }
+                if (point.get_num_batches() < 2) {
+                    num_unmeasured++;
+                } else {
+                    worst = std::max(worst, point.get_standard_error());
+                }
+            }
+            printf("Round %lu/%lu: %lu collisions, largest standard error %.2e, %lu points with fewer than two "
+                   "batches\n", round + 1, num_rounds, sweep.get_num_collisions(), worst, num_unmeasured);
+        });
+        std::ofstream result_file(argv[1]);
+        for (unsigned long i = 0; i < specs.size(); i++) {
+            result_file << sweep.to_line(i) << std::endl;
+        }
+        printf("Wrote %lu points to %s\n", specs.size(), argv[1]);
+        return 0;
+    }
+    for (ExperimentSpec &spec: specs) {
+        spec.event_budget = event_budget;
+        spec.time_limit = time_limit;
+        spec.auto_backend = backend == "auto";
+        if (not spec.auto_backend) {
+            spec.backend = Backend::from_name(backend);
+        }
+    }
+    std::vector<unsigned long> expected_events;
+    for (const ExperimentSpec &spec: specs) {
+        expected_events.push_back(spec.M_f);
+    }
+    std::vector<ExperimentResult> results(specs.size());
+    SweepTelemetry telemetry(num_threads, expected_events);
+    telemetry.start_reporting(stats_file, port);
+    std::mutex queue_mutex;
+    unsigned long next = 0;
+    std::vector<std::thread> threads;
+    for (unsigned worker = 0; worker < num_threads; worker++) {
+        threads.emplace_back([&, worker]() {
+            while (true) {
+                unsigned long index;
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    if (next >= specs.size()) {
+                        return;
+                    }
+                    index = next++;
+                }
+                telemetry.start_point(worker, index);
+                results.at(index) = run_experiment(specs.at(index), [&telemetry, worker](unsigned long events) {
+                    telemetry.report_events(worker, events);
+                });
+                telemetry.finish_point(worker, results.at(index).num_collisions);
+            }
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    telemetry.stop_reporting();
+    std::ofstream result_file(argv[1]);
+    for (unsigned long i = 0; i < specs.size(); i++) {
+        result_file << results.at(i).to_line(specs.at(i)) << std::endl;
+    }
+    printf("Wrote %lu points to %s\n", specs.size(), argv[1]);
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "telemetry.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned long get_resident_memory() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::stoul(line.substr(6));
+        }
+    }
+    struct rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        // Peak instead of current memory, in kilobytes on Linux
+        return (unsigned long) usage.ru_maxrss;
+    }
+    return 0;
+}
+
+SweepTelemetry::SweepTelemetry(unsigned num_workers, const std::vector<unsigned long> &expected_events)
+        : workers(new WorkerProgress[num_workers]), num_workers(num_workers), expected_events(expected_events) {
+    for (unsigned long events: expected_events) {
+        total_expected_events += events;
+    }
+    start_time = std::chrono::steady_clock::now();
+    last_statistics_time = start_time;
+}
+
+SweepTelemetry::~SweepTelemetry() {
+    stop_reporting();
+}
+
+void SweepTelemetry::start_point(unsigned worker, unsigned long point) {
+    workers[worker].current_events = 0;
+    workers[worker].point_start = seconds_since(start_time);
+    workers[worker].point = (long) point;
+}
+
+void SweepTelemetry::report_events(unsigned worker, unsigned long events) {
+    workers[worker].current_events.store(events, std::memory_order_relaxed);
+}
+
+void SweepTelemetry::finish_point(unsigned worker, unsigned long events) {
+    WorkerProgress &progress = workers[worker];
+    const long point = progress.point;
+    if (point >= 0) {
+        finished_expected_events += expected_events.at((unsigned long) point);
+    }
+    progress.completed_events += events;
+    progress.current_events = 0;
+    progress.point = -1;
+    progress.points_done++;
+    points_done++;
+}
+
+unsigned long SweepTelemetry::get_points_done() const {
+    return points_done;
+}
+
+std::string SweepTelemetry::get_statistics() {
+    /**
+     * The throughput of a worker is measured over the last interval and smoothed exponentially,
+     * so that a slow point shows up within a few intervals without making the prediction jumpy.
+     */
+    const double now = seconds_since(start_time);
+    const double dt = std::max(1E-9, seconds_since(last_statistics_time));
+    last_statistics_time = std::chrono::steady_clock::now();
+    const double smoothing = 0.5;
+    double total_rate = 0;
+    unsigned long done_events = 0;
+    unsigned long in_progress_expected = 0;
+    std::ostringstream workers_json;
+    for (unsigned worker = 0; worker < num_workers; worker++) {
+        WorkerProgress &progress = workers[worker];
+        const long point = progress.point;
+        const unsigned long current = progress.current_events;
+        const unsigned long events = progress.completed_events + current;
+        const double rate = (events - std::min(events, progress.last_events)) / dt;
+        progress.events_per_second = progress.last_events == 0 and progress.events_per_second == 0 ? rate :
+                                     smoothing * rate + (1 - smoothing) * progress.events_per_second;
+        progress.last_events = events;
+        total_rate += progress.events_per_second;
+        done_events += events;
+        if (point >= 0) {
+            in_progress_expected += std::max(expected_events.at((unsigned long) point), current) - current;
+        }
+        workers_json << (worker ? "," : "") << "\n    {\"worker\": " << worker
+                     << ", \"point\": " << point
+                     << ", \"point_events\": " << current
+                     << ", \"point_seconds\": " << (point >= 0 ? now - progress.point_start : 0)
+                     << ", \"events_per_second\": " << progress.events_per_second
+                     << ", \"points_done\": " << progress.points_done << "}";
+    }
+    const unsigned long finished = points_done;
+    // Events that are still to come: the points not started yet plus the rest of the points in progress
+    unsigned long started_expected = finished_expected_events;
+    for (unsigned worker = 0; worker < num_workers; worker++) {
+        const long point = workers[worker].point;
+        if (point >= 0) {
+            started_expected += expected_events.at((unsigned long) point);
+        }
+    }
+    const unsigned long remaining_events =
+            total_expected_events - std::min(total_expected_events, started_expected) + in_progress_expected;
+    const double average_rate = now > 0 ? done_events / now : 0;
+    const double rate = total_rate > 0 ? total_rate : average_rate;
+    const double eta = rate > 0 ? remaining_events / rate : -1;
+    std::ostringstream s;
+    s << "{\n  \"elapsed_seconds\": " << now
+      << ",\n  \"points_done\": " << finished
+      << ",\n  \"points_remaining\": " << expected_events.size() - finished
+      << ",\n  \"events_done\": " << done_events
+      << ",\n  \"events_remaining\": " << remaining_events
+      << ",\n  \"events_per_second\": " << rate
+      << ",\n  \"average_events_per_second\": " << average_rate
+      << ",\n  \"eta_seconds\": " << eta
+      << ",\n  \"resident_memory_kb\": " << get_resident_memory()
+      << ",\n  \"workers\": [" << workers_json.str() << "\n  ]\n}\n";
+    return s.str();
+}
+
+static int open_local_server(int port) {
+    const int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        throw std::runtime_error("Can not create telemetry socket");
+    }
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t) port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server, (sockaddr *) &address, sizeof(address)) != 0 or listen(server, 8) != 0) {
+        close(server);
+        throw std::runtime_error("Can not listen on telemetry port " + std::to_string(port));
+    }
+    return server;
+}
+
+void SweepTelemetry::start_reporting(const std::string &stats_file, int port, double interval) {
+    if (reporting) {
+        return;
+    }
+    int server = -1;
+    if (port > 0) {
+        // Opened here rather than in the reporter thread, where an exception would terminate the program
+        try {
+            server = open_local_server(port);
+        } catch (const std::runtime_error &error) {
+            std::cerr << "Warning: " << error.what() << ", continuing without HTTP statistics" << std::endl;
+        }
+    }
+    reporting = true;
+    reporter = std::thread(&SweepTelemetry::report_loop, this, stats_file, server, interval);
+}
+
+void SweepTelemetry::stop_reporting() {
+    if (reporting) {
+        reporting = false;
+        reporter.join();
+    }
+}
+
+static void serve_statistics(int server, const std::string &statistics) {
+    const int client = accept(server, nullptr, nullptr);
+    if (client < 0) {
+        return;
+    }
+    // The request itself is not interpreted; every path returns the statistics
+    pollfd request{client, POLLIN, 0};
+    char buffer[1024];
+    if (poll(&request, 1, 100) > 0) {
+        recv(client, buffer, sizeof(buffer), 0);
+    }
+    std::ostringstream response;
+    response << "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << statistics.size()
+             << "\r\nConnection: close\r\n\r\n" << statistics;
+    const std::string text = response.str();
+    send(client, text.data(), text.size(), MSG_NOSIGNAL);
+    close(client);
+}
+
+void SweepTelemetry::report_loop(const std::string &stats_file, int server, double interval) {
+    std::string statistics = get_statistics();
+    auto next_update = std::chrono::steady_clock::now();
+    bool last_round = false;
+    while (not last_round) {
+        last_round = not reporting;
+        if (std::chrono::steady_clock::now() >= next_update or last_round) {
+            statistics = get_statistics();
+            if (not stats_file.empty()) {
+                // Write and rename, so readers never see a half-written file
+                const std::string temporary = stats_file + ".tmp";
+                std::ofstream(temporary) << statistics;
+                std::rename(temporary.c_str(), stats_file.c_str());
+            }
+            next_update += std::chrono::microseconds((long) (interval * 1E6));
+        }
+        const int wait = 50; // ms, bounds the delay of stopping
+        if (server >= 0) {
+            pollfd listener{server, POLLIN, 0};
+            if (poll(&listener, 1, wait) > 0) {
+                serve_statistics(server, statistics);
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+        }
+    }
+    if (server >= 0) {
+        close(server);
+    }
+}
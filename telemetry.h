@@ -0,0 +1,90 @@
+#ifndef TERRIER_TELEMETRY_H
+#define TERRIER_TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Live progress information of a sweep.
+ * Workers report the points they start and finish and, every now and then, the number of events of their
+ * current point. A reporter thread periodically turns this into a JSON document with per-worker throughput,
+ * the number of points done and remaining, a predicted time of arrival and the memory use of the process.
+ * The document is written to a stats file and, optionally, served over HTTP on localhost.
+ *
+ * Reporting from the workers only touches atomics, so it is safe (and cheap) to call from any thread.
+ */
+class SweepTelemetry {
+public:
+    /**
+     * @param num_workers Number of workers that run points
+     * @param expected_events Expected number of events (collisions) of each point, in sweep order
+     */
+    SweepTelemetry(unsigned num_workers, const std::vector<unsigned long> &expected_events);
+
+    ~SweepTelemetry();
+
+    void start_point(unsigned worker, unsigned long point);
+
+    /**
+     * Report the number of events processed so far in the current point of a worker
+     */
+    void report_events(unsigned worker, unsigned long events);
+
+    void finish_point(unsigned worker, unsigned long events);
+
+    /**
+     * Start the reporter thread.
+     * @param stats_file File that is rewritten with the JSON statistics every interval. Empty for none.
+     * @param port If nonzero, serve the statistics on http://127.0.0.1:port/. If the port can not be opened, a
+     * warning is printed and only the file is written.
+     * @param interval Seconds between updates
+     */
+    void start_reporting(const std::string &stats_file, int port = 0, double interval = 1);
+
+    /**
+     * Stop the reporter thread, after writing the final statistics.
+     */
+    void stop_reporting();
+
+    /**
+     * Compute the statistics as a JSON document. Throughput is measured since the previous call.
+     */
+    std::string get_statistics();
+
+    unsigned long get_points_done() const;
+
+private:
+    struct WorkerProgress {
+        std::atomic<long> point{-1};
+        std::atomic<unsigned long> current_events{0};
+        std::atomic<unsigned long> completed_events{0};
+        std::atomic<unsigned long> points_done{0};
+        std::atomic<double> point_start{0};
+        unsigned long last_events = 0;
+        double events_per_second = 0;
+    };
+
+    void report_loop(const std::string &stats_file, int server, double interval);
+
+    std::unique_ptr<WorkerProgress[]> workers;
+    unsigned num_workers;
+    std::vector<unsigned long> expected_events;
+    unsigned long total_expected_events = 0;
+    std::atomic<unsigned long> points_done{0};
+    std::atomic<unsigned long> finished_expected_events{0};
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point last_statistics_time;
+    std::thread reporter;
+    std::atomic<bool> reporting{false};
+};
+
+/**
+ * Resident memory of this process, in kilobytes. Zero if it can not be determined.
+ */
+unsigned long get_resident_memory();
+
+#endif //TERRIER_TELEMETRY_H
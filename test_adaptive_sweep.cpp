@@ -0,0 +1,58 @@
+#include <boost/test/unit_test.hpp>
+#include "adaptive_sweep.h"
+
+BOOST_AUTO_TEST_SUITE(test_adaptive_sweep)
+
+    BOOST_AUTO_TEST_CASE(test_allocation_follows_variance) {
+        const std::vector<double> variances = {1, 4, 0, 1};
+        const std::vector<unsigned long> num_batches = {4, 4, 4, 8};
+        const std::vector<unsigned long> allocation = AdaptiveSweep::allocate(variances, num_batches, 30);
+        unsigned long total = 0;
+        for (unsigned long batches: allocation) {
+            total += batches;
+        }
+        BOOST_CHECK_EQUAL(total, 30);
+        BOOST_CHECK_GT(allocation[1], allocation[0]);
+        BOOST_CHECK_EQUAL(allocation[2], 0);
+        // Equal variances end up with (nearly) equal numbers of batches
+        BOOST_CHECK_LE(std::labs((long) (allocation[0] + 4) - (long) (allocation[3] + 8)), 1);
+        BOOST_CHECK_THROW(AdaptiveSweep::allocate({1}, {1, 2}, 3), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_continued_point_matches_single_run) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 5000 a");
+        SweepPoint continued(spec, 500, 3);
+        continued.advance(2);
+        continued.advance(3);
+        SweepPoint single(spec, 500, 3);
+        single.advance(5);
+        BOOST_CHECK_EQUAL(continued.get_num_collisions(), 1000 + 5 * 500);
+        BOOST_CHECK_EQUAL(continued.get_num_batches(), 5);
+        BOOST_CHECK_EQUAL(continued.get_result().mass_spread, single.get_result().mass_spread);
+        BOOST_CHECK_EQUAL(continued.get_standard_error(), single.get_standard_error());
+        BOOST_CHECK(continued.get_result().currents == single.get_result().currents);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_sweep_spends_budget) {
+        std::vector<ExperimentSpec> specs;
+        specs.push_back(ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 5000 a"));
+        specs.push_back(ExperimentSpec::from_line("1 0.3 10 1 1 0.02 200 0.75 1000 5000 a"));
+        specs.push_back(ExperimentSpec::from_line("1 2.5 3 1 1 0.1 200 0.75 1000 5000 a"));
+        AdaptiveSweep sweep(specs, 40000, 500);
+        sweep.num_threads = 2;
+        sweep.num_rounds = 3;
+        unsigned long rounds = 0;
+        sweep.run([&rounds](unsigned long) { rounds++; });
+        BOOST_CHECK_EQUAL(rounds, 3);
+        BOOST_CHECK_LE(sweep.get_num_collisions(), 40000);
+        BOOST_CHECK_GT(sweep.get_num_collisions(), 40000 - 500);
+        BOOST_CHECK(not sweep.get_points()[2].is_valid());
+        BOOST_CHECK_EQUAL(sweep.get_points()[2].get_num_collisions(), 0);
+        for (unsigned long i = 0; i < 2; i++) {
+            BOOST_CHECK(std::isfinite(sweep.get_points()[i].get_standard_error()));
+            BOOST_CHECK_LE(std::fabs(sweep.get_points()[i].get_result().mass_spread), 1);
+        }
+        BOOST_CHECK_THROW(AdaptiveSweep(specs, 1000, 500).run(), std::invalid_argument);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
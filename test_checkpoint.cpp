@@ -0,0 +1,106 @@
+#include <boost/test/unit_test.hpp>
+#include "checkpoint.h"
+#include <cstdio>
+
+BOOST_AUTO_TEST_SUITE(test_checkpoint)
+
+    Simulation get_seeded_sim(bool random_dir) {
+        auto sim = Simulation(200, 0.3, 1, 0.5, 3, 3, random_dir, true);
+        sim.distance_as_channel_length = true;
+        sim.seed(7);
+        sim.setup();
+        sim.start(0.75);
+        return sim;
+    }
+
+    BOOST_AUTO_TEST_CASE(test_ring_finds_latest_earlier_checkpoint) {
+        auto sim = get_seeded_sim(false);
+        CheckpointRing checkpoints(4, 1);
+        BOOST_CHECK(checkpoints.find(0) == nullptr);
+        while (sim.time < 10) {
+            sim.update(0);
+            checkpoints.record(sim);
+        }
+        BOOST_CHECK_EQUAL(checkpoints.size(), 4);
+        const SimulationState *last = checkpoints.find(sim.time);
+        BOOST_REQUIRE(last != nullptr);
+        BOOST_CHECK_GE(last->time, 8);
+        BOOST_CHECK_LE(last->time, sim.time);
+        // Older checkpoints have been overwritten
+        BOOST_CHECK(checkpoints.find(5) == nullptr);
+        const SimulationState *earlier = checkpoints.find(last->time - 1E-9);
+        BOOST_REQUIRE(earlier != nullptr);
+        BOOST_CHECK_LT(earlier->time, last->time);
+        BOOST_CHECK_GE(last->time - earlier->time, 1);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_replay_matches_original_run) {
+        // Random retractions make the run depend on the generator state
+        auto sim = get_seeded_sim(true);
+        CheckpointRing checkpoints(8, 2);
+        while (sim.time < 10) {
+            sim.update(0);
+            checkpoints.record(sim);
+        }
+        const std::string filename = "test_checkpoints.chk";
+        checkpoints.write(filename, sim);
+        while (sim.time < 15) {
+            sim.update(0);
+        }
+        CheckpointRing read(filename);
+        BOOST_CHECK_EQUAL(read.size(), checkpoints.size());
+        const SimulationState *state = read.find(7);
+        BOOST_REQUIRE(state != nullptr);
+        Simulation replay = read.make_simulation();
+        replay.restore_state(*state);
+        BOOST_CHECK_EQUAL(replay.bridge_length, sim.bridge_length);
+        BOOST_CHECK_EQUAL(replay.circle_distance, sim.circle_distance);
+        while (replay.num_collisions < sim.num_collisions) {
+            replay.update(0);
+        }
+        BOOST_CHECK_EQUAL(replay.time, sim.time);
+        BOOST_CHECK_EQUAL(replay.in_left, sim.in_left);
+        BOOST_CHECK(replay.x_pos == sim.x_pos);
+        BOOST_CHECK(replay.directions == sim.directions);
+        BOOST_CHECK(replay.current_counters == sim.current_counters);
+        std::remove(filename.c_str());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_replay_with_species_matches_original_run) {
+        // Selective explosions retract only part of a gate, so the replay only matches if they are restored
+        auto sim = get_seeded_sim(true);
+        std::vector<unsigned> species(200);
+        for (unsigned long particle = 0; particle < 200; particle++) {
+            species[particle] = particle % 2;
+        }
+        sim.set_species(species);
+        sim.set_species_gate_capacity(sim.LEFT, 1, 1);
+        sim.set_species_gate_capacity(sim.RIGHT, 1, 1);
+        sim.selective_explosions = true;
+        CheckpointRing checkpoints(8, 2);
+        while (sim.time < 10) {
+            sim.update(0);
+            checkpoints.record(sim);
+        }
+        const std::string filename = "test_species_checkpoints.chk";
+        checkpoints.write(filename, sim);
+        while (sim.time < 15) {
+            sim.update(0);
+        }
+        CheckpointRing read(filename);
+        const SimulationState *state = read.find(7);
+        BOOST_REQUIRE(state != nullptr);
+        Simulation replay = read.make_simulation();
+        BOOST_CHECK(replay.selective_explosions);
+        replay.restore_state(*state);
+        while (replay.num_collisions < sim.num_collisions) {
+            replay.update(0);
+        }
+        BOOST_CHECK_EQUAL(replay.time, sim.time);
+        BOOST_CHECK(replay.x_pos == sim.x_pos);
+        BOOST_CHECK(replay.species_in_left == sim.species_in_left);
+        BOOST_CHECK(replay.species_current_counters == sim.species_current_counters);
+        std::remove(filename.c_str());
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
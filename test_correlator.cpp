@@ -0,0 +1,92 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <random>
+#include "correlator.h"
+
+BOOST_AUTO_TEST_SUITE(test_correlator)
+
+    BOOST_AUTO_TEST_CASE(test_autoregressive_series) {
+        // x_{n+1} = a x_n + noise has correlation a^k and an integrated time of (1 + a) / (2 (1 - a))
+        const double a = 0.9;
+        std::mt19937_64 generator(3);
+        std::normal_distribution<double> noise(0, 1);
+        MultiTauCorrelator correlator;
+        double x = 0;
+        const unsigned long num_samples = 1 << 20;
+        for (unsigned long i = 0; i < num_samples; i++) {
+            x = a * x + noise(generator);
+            correlator.add(5 + x);
+        }
+        BOOST_CHECK_EQUAL(correlator.get_num_samples(), num_samples);
+        BOOST_CHECK_SMALL(correlator.mean() - 5, 0.1);
+        BOOST_CHECK_CLOSE(correlator.variance(), 1 / (1 - a * a), 5);
+        const std::vector<unsigned long> lags = correlator.get_lags();
+        const std::vector<double> correlation = correlator.get_correlation();
+        BOOST_REQUIRE_EQUAL(lags.size(), correlation.size());
+        BOOST_CHECK_EQUAL(lags.front(), 0);
+        BOOST_CHECK_CLOSE(correlation.front(), 1, 1E-9);
+        for (unsigned long i = 1; i < lags.size(); i++) {
+            BOOST_REQUIRE_GT(lags[i], lags[i - 1]);
+            if (lags[i] <= 30) {
+                // Lags beyond the first level are correlations of averages, which are a bit smoother
+                BOOST_CHECK_SMALL(correlation[i] - std::pow(a, lags[i]), lags[i] < 16 ? 0.02 : 0.06);
+            }
+        }
+        // Levels grow logarithmically: 16 lags on the first level, 8 on every next one
+        BOOST_CHECK_LE(lags.size(), 16 + 8 * 20);
+        BOOST_CHECK_GE(lags.back(), num_samples / 16);
+        BOOST_CHECK_CLOSE(correlator.get_integrated_time(), (1 + a) / (2 * (1 - a)), 10);
+        BOOST_CHECK_CLOSE(correlator.get_standard_error(),
+                          std::sqrt(correlator.variance() * (1 + a) / (1 - a) / num_samples), 10);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_uncorrelated_series) {
+        std::mt19937_64 generator(5);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        MultiTauCorrelator correlator(8);
+        for (unsigned long i = 0; i < 100000; i++) {
+            correlator.add(uniform(generator));
+        }
+        const std::vector<double> correlation = correlator.get_correlation();
+        for (unsigned long i = 1; i < correlation.size() and i < 8; i++) {
+            BOOST_CHECK_SMALL(correlation[i], 0.02);
+        }
+        BOOST_CHECK_SMALL(correlator.get_integrated_time() - 0.5, 0.1);
+        BOOST_CHECK_THROW(MultiTauCorrelator(7), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_time_correlations_of_simulation) {
+        Simulation sim(200, 0.3, 1, 0.5, 5, 5, false, true);
+        sim.setup();
+        sim.seed(11);
+        sim.start(0.5);
+        // Correlations assume a stationary series, so skip the relaxation
+        while (sim.time < 100) {
+            sim.update(0);
+        }
+        TimeCorrelations correlations(0.05);
+        correlations.record(sim);
+        const double start_time = sim.time;
+        std::vector<int> start_counters = sim.current_counters;
+        while (sim.time < start_time + 200) {
+            sim.update(0);
+            correlations.record(sim);
+        }
+        const MultiTauCorrelator &in_left = correlations.get_correlator(TimeCorrelations::IN_LEFT);
+        BOOST_CHECK_SMALL(double(in_left.get_num_samples()) - 200 / 0.05, 2.);
+        BOOST_CHECK_CLOSE(in_left.get_correlation().front(), 1, 1E-9);
+        // in_left changes by one particle at a time, so it is strongly correlated between samples
+        BOOST_CHECK_GT(in_left.get_correlation().at(1), 0.5);
+        BOOST_CHECK_GT(correlations.get_integrated_time(TimeCorrelations::IN_LEFT), 10 * correlations.dt);
+        BOOST_CHECK_GT(correlations.get_mass_spread_error(), 0);
+        BOOST_CHECK_LT(std::abs(correlations.get_mass_spread()), 1);
+        for (unsigned i = 0; i < 4; i++) {
+            // The sampled currents add up to the crossings up to the last sample
+            const MultiTauCorrelator &current = correlations.get_correlator(TimeCorrelations::CURRENT + i);
+            const double crossings = current.mean() * current.get_num_samples() * correlations.dt;
+            BOOST_CHECK_SMALL(crossings - (sim.current_counters[i] - start_counters[i]), 30.);
+        }
+        BOOST_CHECK_THROW(correlations.get_correlator(TimeCorrelations::NUM_SIGNALS), std::out_of_range);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+#include <boost/test/unit_test.hpp>
+#include "daemon.h"
+#include <unistd.h>
+
+BOOST_AUTO_TEST_SUITE(test_daemon)
+
+    DaemonJob get_cool_down_job(unsigned long id) {
+        DaemonJob job;
+        job.id = id;
+        job.num_particles = 50;
+        job.left_gate_capacity = 3;
+        job.right_gate_capacity = 0;
+        job.left_ratio = 0;
+        job.max_collisions = 10;
+        job.max_time = 1E5;
+        job.seed = id + 1;
+        return job;
+    }
+
+    BOOST_AUTO_TEST_CASE(test_job_line_round_trip) {
+        DaemonJob job = get_cool_down_job(4);
+        job.bridge_width = 0.123456789;
+        job.flat_gate = true;
+        const DaemonJob read = DaemonJob::from_line(job.to_line());
+        BOOST_CHECK_EQUAL(read.to_line(), job.to_line());
+        BOOST_CHECK(read.has_same_geometry(job));
+        BOOST_CHECK_THROW(DaemonJob::from_line("1 2 3"), std::invalid_argument);
+        DaemonResult result;
+        result.id = 4;
+        result.error = "Bridge width too large";
+        BOOST_CHECK_EQUAL(DaemonResult::from_line(result.to_line()).error, result.error);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_warm_simulation_matches_fresh_one) {
+        std::unique_ptr<Simulation> warm;
+        DaemonJob last_job;
+        run_daemon_job(get_cool_down_job(1), warm, last_job);
+        const Simulation *first = warm.get();
+        const DaemonResult reused = run_daemon_job(get_cool_down_job(2), warm, last_job);
+        BOOST_CHECK_EQUAL(warm.get(), first);
+        std::unique_ptr<Simulation> cold;
+        const DaemonResult fresh = run_daemon_job(get_cool_down_job(2), cold, last_job);
+        BOOST_CHECK(reused.error.empty());
+        BOOST_CHECK_EQUAL(reused.time, fresh.time);
+        BOOST_CHECK_EQUAL(reused.in_left, fresh.in_left);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_daemon_serves_jobs) {
+        const std::string socket_path = "test_daemon.sock";
+        SimulationDaemon daemon(socket_path, 2);
+        daemon.start();
+        std::vector<DaemonJob> jobs;
+        for (unsigned long id = 0; id < 40; id++) {
+            jobs.push_back(get_cool_down_job(id));
+        }
+        DaemonJob invalid = get_cool_down_job(40);
+        invalid.bridge_width = 3;
+        jobs.push_back(invalid);
+        std::vector<DaemonResult> results;
+        {
+            DaemonClient client(socket_path);
+            results = client.run(jobs);
+        }
+        BOOST_REQUIRE_EQUAL(results.size(), jobs.size());
+        for (unsigned long id = 0; id < 40; id++) {
+            std::unique_ptr<Simulation> simulation;
+            DaemonJob last_job;
+            const DaemonResult expected = run_daemon_job(jobs[id], simulation, last_job);
+            BOOST_CHECK_EQUAL(results[id].id, id);
+            BOOST_CHECK(results[id].error.empty());
+            BOOST_CHECK_EQUAL(results[id].num_collisions, 10);
+            BOOST_CHECK_EQUAL(results[id].time, expected.time);
+        }
+        BOOST_CHECK(not results.back().error.empty());
+        // Warm workers only create a simulation for a new geometry
+        BOOST_CHECK_LE(daemon.get_simulations_created(), 4);
+        daemon.stop();
+        BOOST_CHECK_EQUAL(daemon.get_jobs_done(), jobs.size());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_closed_connections_are_reaped) {
+        const std::string socket_path = "test_daemon_reap.sock";
+        SimulationDaemon daemon(socket_path, 1);
+        daemon.start();
+        for (unsigned long id = 0; id < 20; id++) {
+            DaemonClient client(socket_path);
+            BOOST_CHECK_EQUAL(client.run({get_cool_down_job(id)}).size(), 1);
+        }
+        // Give the readers time to notice the closed connections; the next accept joins them
+        usleep(200000);
+        {
+            DaemonClient client(socket_path);
+            BOOST_CHECK_EQUAL(client.run({get_cool_down_job(20)}).size(), 1);
+            BOOST_CHECK_LE(daemon.get_num_readers(), 2);
+        }
+        daemon.stop();
+        BOOST_CHECK_EQUAL(daemon.get_num_readers(), 0);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
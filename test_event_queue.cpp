@@ -0,0 +1,56 @@
+#include <boost/test/unit_test.hpp>
+#include "event_queue.h"
+#include "simulation.h"
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_event_queue)
+
+    void check_queue_order(EventQueue::Type type) {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> unif(0, 1);
+        std::vector<double> times(500);
+        for (double &t: times) {
+            t = unif(rng);
+        }
+        EventQueue queue(type);
+        queue.build(times);
+        BOOST_CHECK_EQUAL(queue.size(), times.size());
+        double now = 0;
+        for (int step = 0; step < 5000; step++) {
+            const unsigned long top = queue.top();
+            BOOST_REQUIRE(times[top] == *std::min_element(times.begin(), times.end()));
+            BOOST_REQUIRE(times[top] >= now);
+            now = times[top];
+            times[top] = now + unif(rng);
+            queue.update(top, times, true);
+            // Move an arbitrary particle as well, as a gate explosion would
+            const auto other = (unsigned long) (unif(rng) * times.size());
+            times[other] = now + unif(rng);
+            queue.update(other, times);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_sorted_vector_order) {
+        check_queue_order(EventQueue::SORTED_VECTOR);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_binary_heap_order) {
+        check_queue_order(EventQueue::BINARY_HEAP);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_simulation_on_heap) {
+        Simulation sim(200, 0.2, 1, 0.5, 2, 2, false, true);
+        sim.queue_type = EventQueue::BINARY_HEAP;
+        sim.setup();
+        sim.start(0.75);
+        double last_time = 0;
+        for (int step = 0; step < 20000; step++) {
+            sim.update(0);
+            BOOST_REQUIRE(sim.time >= last_time);
+            last_time = sim.time;
+        }
+        BOOST_CHECK(std::fabs(sim.get_mass_spread()) <= 1);
+        BOOST_CHECK(sim.get_next_event_time() >= sim.time);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
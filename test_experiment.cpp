@@ -0,0 +1,123 @@
+#include <boost/test/unit_test.hpp>
+#include "experiment.h"
+
+BOOST_AUTO_TEST_SUITE(test_experiment)
+
+    BOOST_AUTO_TEST_CASE(test_parse_double_channel_line) {
+        auto spec = ExperimentSpec::from_line(
+                "1.0000 0.3000 10.0000 1.0000 1.0000 0.0200 1000.0000 0.5000 95000000.0000 100000000.0000 "
+                "double_channel_data/params_1000");
+        BOOST_CHECK(not spec.single_channel);
+        BOOST_CHECK_EQUAL(spec.threshold, 10);
+        BOOST_CHECK_EQUAL(spec.num_particles, 1000);
+        BOOST_CHECK_CLOSE(spec.second_width, 0.02, 1E-9);
+        BOOST_CHECK_EQUAL(spec.M_t, 95000000ul);
+        BOOST_CHECK_EQUAL(spec.M_f, 100000000ul);
+        BOOST_CHECK_EQUAL(spec.identifier, "double_channel_data/params_1000");
+        BOOST_CHECK_EQUAL(spec.tokens.size(), 10);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_parse_single_channel_line) {
+        auto spec = ExperimentSpec::from_line("0.5000 0.3000 1.0000 4 1000 1000 2000 single_channel_data/explorer");
+        BOOST_CHECK(spec.single_channel);
+        BOOST_CHECK_CLOSE(spec.urn_radius, 1, 1E-9);
+        BOOST_CHECK_EQUAL(spec.M_f, 2000ul);
+        BOOST_CHECK_THROW(ExperimentSpec::from_line("1 2 3"), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_read_sweep) {
+        std::istringstream sweep("# comment\n"
+                                 "0.5 0.3 1 4 100 100 200 a\n"
+                                 "\n"
+                                 "0.5 0.3 1 4 100 100 300 a\n");
+        auto specs = ExperimentSpec::read_sweep(sweep);
+        BOOST_CHECK_EQUAL(specs.size(), 2);
+        BOOST_CHECK_EQUAL(specs.at(1).M_f, 300ul);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_run_experiment) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 5000 a");
+        auto result = run_experiment(spec);
+        BOOST_CHECK(result.valid);
+        BOOST_CHECK_EQUAL(result.num_collisions, 5000ul);
+        BOOST_CHECK(std::fabs(result.mass_spread) <= 1);
+        BOOST_CHECK(result.time > 0);
+        // Channel wider than the urn cannot be set up
+        auto invalid = ExperimentSpec::from_line("1 2.5 3 1 1 0.1 200 0.75 1000 5000 a");
+        BOOST_CHECK(not run_experiment(invalid).valid);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_truncated_experiment) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 50000 a");
+        spec.event_budget = 3000;
+        auto result = run_experiment(spec);
+        BOOST_CHECK(result.truncated);
+        BOOST_CHECK_EQUAL(result.num_collisions, 3000ul);
+        BOOST_CHECK(std::fabs(result.mass_spread) <= 1);
+        BOOST_CHECK_EQUAL(result.to_line(spec).substr(result.to_line(spec).size() - 2), ",1");
+    }
+
+    BOOST_AUTO_TEST_CASE(test_backend_names) {
+        Backend backend;
+        BOOST_CHECK_EQUAL(backend.name(), "sorted_vector/serial");
+        backend.queue_type = EventQueue::BINARY_HEAP;
+        backend.window_size = 64;
+        backend.renumber_interval = 4000;
+        BOOST_CHECK_EQUAL(backend.name(), "binary_heap/window64/renumber4000");
+        const Backend read = Backend::from_name(backend.name());
+        BOOST_CHECK(read.queue_type == EventQueue::BINARY_HEAP);
+        BOOST_CHECK_EQUAL(read.window_size, 64ul);
+        BOOST_CHECK_EQUAL(read.renumber_interval, 4000ul);
+        BOOST_CHECK_EQUAL(Backend::from_name("sorted_vector/window256").name(), "sorted_vector/window256");
+        for (const char *name: {"", "heap/serial", "sorted_vector", "sorted_vector/window", "binary_heap/serial/64",
+                                "binary_heap/serial/renumber-1"}) {
+            BOOST_CHECK_THROW(Backend::from_name(name), std::invalid_argument);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_backends_agree) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 20000 a");
+        for (unsigned long seed: {7ul, 19ul, 31ul}) {
+            spec.seed = seed;
+            spec.backend = Backend();
+            const ExperimentResult serial = run_experiment(spec);
+            BOOST_CHECK_EQUAL(serial.backend.name(), "sorted_vector/serial");
+            for (const char *name: {"binary_heap/serial", "sorted_vector/window64",
+                                    "binary_heap/window64/renumber800"}) {
+                spec.backend = Backend::from_name(name);
+                const ExperimentResult result = run_experiment(spec);
+                BOOST_CHECK_EQUAL(result.backend.name(), name);
+                BOOST_CHECK_EQUAL(result.num_collisions, serial.num_collisions);
+                BOOST_CHECK_EQUAL(result.time, serial.time);
+                BOOST_CHECK_EQUAL(result.mass_spread, serial.mass_spread);
+                for (unsigned i = 0; i < 4; i++) {
+                    BOOST_CHECK_EQUAL(result.currents[i], serial.currents[i]);
+                }
+                const std::string line = result.to_line(spec);
+                BOOST_CHECK(line.find("," + std::string(name) + ",0") != std::string::npos);
+            }
+        }
+        // The budget stops a windowed run at the same event
+        spec.event_budget = 3000;
+        spec.backend = Backend::from_name("sorted_vector/window64");
+        const ExperimentResult truncated = run_experiment(spec);
+        BOOST_CHECK(truncated.truncated);
+        BOOST_CHECK_EQUAL(truncated.num_collisions, 3000ul);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_select_backend) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 5000 a");
+        // Too short to calibrate
+        BOOST_CHECK_EQUAL(select_backend(spec).events_per_second, 0);
+        spec.auto_backend = true;
+        BOOST_CHECK_EQUAL(run_experiment(spec).backend.name(), "sorted_vector/serial");
+        spec.M_f = 10000000;
+        const Backend fastest = select_backend(spec);
+        BOOST_CHECK_GT(fastest.events_per_second, 0);
+        // Windows larger than the system and renumbering of a small system are not tried
+        BOOST_CHECK_LE(fastest.window_size, 200ul);
+        BOOST_CHECK_EQUAL(fastest.renumber_interval, 0ul);
+        BOOST_CHECK_EQUAL(Backend::from_name(fastest.name()).name(), fastest.name());
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,59 @@
+#include <boost/test/unit_test.hpp>
+#include "mean_field.h"
+
+BOOST_AUTO_TEST_SUITE(test_mean_field)
+
+    BOOST_AUTO_TEST_CASE(test_area_matches_plot_script) {
+        MeanFieldModel model;
+        model.circle_radius = 1;
+        model.bridge_width = 0.3;
+        const double expected = M_PI - std::asin(0.15) + 0.3 * std::sqrt(4 - 0.09) / 4;
+        BOOST_CHECK_CLOSE(model.get_chamber_area(), expected, 1E-12);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_pass_probability_is_poisson) {
+        MeanFieldModel model;
+        const double lambda = 100 * model.bridge_width * model.bridge_length / (4 * model.get_chamber_area());
+        const double expected = std::exp(-lambda) * (1 + lambda + lambda * lambda / 2);
+        BOOST_CHECK_CLOSE(model.get_pass_probability(100, 3), expected, 1E-10);
+        BOOST_CHECK_EQUAL(model.get_pass_probability(100, 0), 0);
+        // Large occupancies stay finite
+        BOOST_CHECK_GE(model.get_pass_probability(1E6, 1000), 0);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_ungated_decay_is_exponential) {
+        MeanFieldModel model;
+        model.left_gate_capacity = 1000000;
+        model.right_gate_capacity = 1000000;
+        const double rate = 2 * model.bridge_width / (M_PI * model.get_chamber_area());
+        const MeanFieldResult result = solve_mean_field(model, 0.8, 20, 1E-12, false);
+        BOOST_CHECK_EQUAL(result.time, 20);
+        BOOST_CHECK_CLOSE(result.mass_spread, 0.8 * std::exp(-rate * 20), 1E-6);
+        BOOST_CHECK_CLOSE(result.currents[0] - result.currents[2], -result.mass_spread * rate * model.num_particles / 2,
+                          1E-6);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_stationary_states) {
+        MeanFieldModel model;
+        model.num_particles = 1000;
+        model.left_gate_capacity = 3;
+        model.right_gate_capacity = 3;
+        // The symmetric state is stationary
+        const MeanFieldResult symmetric = solve_mean_field(model, 0);
+        BOOST_CHECK(symmetric.stationary);
+        BOOST_CHECK_SMALL(symmetric.mass_spread, 1E-12);
+        // With crowded gates, the system polarises
+        const MeanFieldResult polarised = solve_mean_field(model, 0.1);
+        BOOST_CHECK(polarised.stationary);
+        BOOST_CHECK_GT(polarised.mass_spread, 0.5);
+        BOOST_CHECK_SMALL(model.get_derivative(polarised.mass_spread), 1E-9);
+        const MeanFieldResult mirrored = solve_mean_field(model, -0.1);
+        BOOST_CHECK_CLOSE(mirrored.mass_spread, -polarised.mass_spread, 1E-6);
+        // A wide back channel drains the polarisation
+        model.second_width = 0.3;
+        const MeanFieldResult drained = solve_mean_field(model, 0.1);
+        BOOST_CHECK_LT(drained.mass_spread, polarised.mass_spread);
+        BOOST_CHECK_SMALL(drained.currents[0] + drained.currents[1] - drained.currents[2] - drained.currents[3], 1E-6);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+#include "observers.h"
+#include "simulation.h"
+
+BOOST_AUTO_TEST_SUITE(test_observers)
+
+    BOOST_AUTO_TEST_CASE(test_ring_keeps_order) {
+        SpscRing<unsigned long> ring(16);
+        const unsigned long num_items = 100000;
+        std::thread producer([&ring]() {
+            for (unsigned long item = 0; item < num_items; item++) {
+                while (not ring.try_push(item)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        unsigned long expected = 0;
+        unsigned long items[8];
+        bool in_order = true;
+        while (expected < num_items) {
+            const std::size_t count = ring.pop(items, 8);
+            if (count == 0) {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                in_order = in_order and items[i] == expected++;
+            }
+        }
+        producer.join();
+        BOOST_CHECK(in_order);
+        BOOST_CHECK(ring.empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_mass_spread_series) {
+        Simulation sim(300, 0.2, 1, 0.5, 2, 2, false, true);
+        sim.setup();
+        sim.start(0.75);
+        auto series = std::make_shared<MassSpreadObserver>(sim.num_particles, 100);
+        // A small ring, so that the simulation also has to wait for the observer
+        ObserverPipeline pipeline(64);
+        pipeline.add(series);
+        pipeline.start();
+        sim.observers = &pipeline;
+        pipeline.publish_state(sim);
+        std::vector<double> inline_series;
+        while (sim.num_collisions < 20000) {
+            if (sim.num_collisions % 100 == 0) {
+                inline_series.push_back(sim.get_mass_spread());
+            }
+            sim.update(0);
+        }
+        inline_series.push_back(sim.get_mass_spread());
+        pipeline.stop();
+        BOOST_CHECK(series->get_series() == inline_series);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_density_matches_engine) {
+        Simulation sim(300, 0.2, 1, 0.5, 2, 2, false, true);
+        sim.setup();
+        sim.start(0.75);
+        const double dt = 0.1;
+        const unsigned long num_x = 20, num_y = 10;
+        const double x_max = sim.box_x_radius, y_max = sim.box_y_radius;
+        auto density = std::make_shared<DensityObserver>(sim.num_particles, dt, -x_max, x_max, -y_max, y_max,
+                                                         num_x, num_y);
+        ObserverPipeline pipeline;
+        pipeline.add(density);
+        pipeline.start();
+        sim.observers = &pipeline;
+        pipeline.publish_state(sim);
+        std::vector<double> counts(num_x * num_y);
+        unsigned long num_samples = 0;
+        double next_sample = 0;
+        while (sim.time < 20) {
+            while (next_sample <= sim.get_next_event_time()) {
+                for (int particle = 0; particle < sim.num_particles; particle++) {
+                    double x, y;
+                    sim.get_position_at(particle, next_sample, x, y);
+                    const auto i = (unsigned long) ((x + x_max) / (2 * x_max) * num_x);
+                    const auto j = (unsigned long) ((y + y_max) / (2 * y_max) * num_y);
+                    counts.at(j * num_x + i)++;
+                }
+                num_samples++;
+                next_sample += dt;
+            }
+            sim.update(0);
+        }
+        pipeline.stop();
+        const std::vector<double> observed = density->get_density();
+        // The observer has only seen samples up to the last event, the loop above one beyond
+        BOOST_CHECK(density->get_num_samples() >= num_samples - 1);
+        double total = 0, difference = 0;
+        for (unsigned long cell = 0; cell < counts.size(); cell++) {
+            total += observed[cell];
+            difference += std::fabs(observed[cell] - counts[cell] / num_samples);
+        }
+        BOOST_CHECK_CLOSE(total, sim.num_particles, 1E-6);
+        BOOST_CHECK(difference < 0.01 * sim.num_particles);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
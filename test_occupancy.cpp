@@ -0,0 +1,99 @@
+#include <boost/test/unit_test.hpp>
+#include "occupancy.h"
+
+BOOST_AUTO_TEST_SUITE(test_occupancy)
+
+    BOOST_AUTO_TEST_CASE(test_occupancy_matches_positions) {
+        Simulation sim(200, 0.3, 1, 0.5, 5, 5, false, true);
+        sim.track_occupancy = true;
+        sim.renumber_interval = 3000;
+        sim.setup();
+        sim.seed(7);
+        sim.start(0.5);
+        const double dt = 0.002;
+        std::vector<double> left_times(200, 0);
+        std::vector<unsigned long> crossings(200, 0);
+        std::vector<double> x(200), y(200), previous_x(200);
+        sim.snapshot(0, previous_x.data(), y.data());
+        for (unsigned long step = 1; step <= 10000; step++) {
+            const double t = step * dt;
+            while (sim.get_next_event_time() < t) {
+                if (step % 2) {
+                    sim.update(0);
+                } else {
+                    sim.update_window(1);
+                }
+            }
+            sim.snapshot(t, x.data(), y.data());
+            for (unsigned long particle = 0; particle < 200; particle++) {
+                left_times[particle] += previous_x[particle] <= 0 ? dt : 0;
+                crossings[particle] += (previous_x[particle] <= 0) != (x[particle] <= 0);
+            }
+            previous_x.swap(x);
+        }
+        const Occupancy occupancy = Occupancy::from_simulation(sim, 10000 * dt);
+        BOOST_CHECK_CLOSE(occupancy.duration, 10000 * dt, 1E-9);
+        unsigned long total_crossings = 0;
+        for (unsigned long particle = 0; particle < 200; particle++) {
+            // Each crossing can be off by one sampling interval
+            BOOST_REQUIRE_SMALL(occupancy.left_fractions[particle] * occupancy.duration - left_times[particle],
+                                dt * (crossings[particle] + 1));
+            BOOST_REQUIRE_EQUAL(occupancy.crossings[particle], crossings[particle]);
+            total_crossings += crossings[particle];
+        }
+        BOOST_CHECK_GT(total_crossings, 0);
+        const std::string filename = "test_occupancy.dat";
+        occupancy.write(filename);
+        const Occupancy read = Occupancy::read(filename);
+        BOOST_CHECK(read.crossings == occupancy.crossings);
+        BOOST_CHECK_CLOSE(read.left_fractions.at(17), occupancy.left_fractions.at(17), 1E-4);
+        std::remove(filename.c_str());
+        const OccupancySummary summary = occupancy.summarize();
+        BOOST_CHECK_EQUAL(summary.left_fractions.count(), 200);
+        BOOST_CHECK_CLOSE(summary.crossings.mean(), total_crossings / 200., 1E-9);
+        BOOST_CHECK_LE(summary.min_left_fraction, summary.left_fractions.mean());
+        BOOST_CHECK_GE(summary.max_left_fraction, summary.left_fractions.mean());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_back_channel_crossings) {
+        Simulation sim(100, 0.3, 1, 1, 100, 100, false, true);
+        sim.distance_as_channel_length = true;
+        sim.second_width = 0.3;
+        sim.second_length = 1;
+        sim.track_occupancy = true;
+        sim.setup();
+        sim.seed(3);
+        sim.start(0.5);
+        while (sim.time < 100) {
+            sim.update(0);
+        }
+        const Occupancy occupancy = Occupancy::from_simulation(sim, sim.time);
+        unsigned long total = 0;
+        for (unsigned long crossings: occupancy.crossings) {
+            total += crossings;
+        }
+        // Without gate explosions every side change is counted in the currents once the flight has ended,
+        // while the occupancy also counts flights under way that crossed already
+        unsigned long currents = 0;
+        for (int counter: sim.current_counters) {
+            currents += counter;
+        }
+        BOOST_CHECK_GT(sim.current_counters[sim.FROM_LEFT_TO_RIGHT_OUTER], 0);
+        BOOST_CHECK_GE(total, currents);
+        BOOST_CHECK_LE(total, currents + 100);
+        for (double fraction: occupancy.left_fractions) {
+            BOOST_REQUIRE_GE(fraction, 0);
+            BOOST_REQUIRE_LE(fraction, 1);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_occupancy_needs_tracking) {
+        Simulation sim(10, 0.3);
+        sim.setup();
+        sim.start(0.5);
+        std::vector<double> left_times;
+        std::vector<unsigned long> crossings;
+        BOOST_CHECK_THROW(sim.get_occupancy(sim.time, left_times, crossings), std::logic_error);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,159 @@
+#include <boost/test/unit_test.hpp>
+#include "ramp.h"
+
+BOOST_AUTO_TEST_SUITE(test_ramp)
+
+    Simulation get_double_channel_sim() {
+        auto sim = Simulation(300, 0.3, 1, 1, 3, 3, false, true);
+        sim.distance_as_channel_length = true;
+        sim.second_length = 1;
+        sim.second_width = 0.1;
+        sim.seed(11);
+        sim.setup();
+        sim.start(0.5);
+        while (sim.num_collisions < 5000) {
+            sim.update(0);
+        }
+        return sim;
+    }
+
+    /**
+     * Check that the prediction of every particle matches a prediction from scratch at the current time.
+     */
+    void check_predictions(const Simulation &sim) {
+        Simulation fresh = sim;
+        for (int particle = 0; particle < sim.num_particles; particle++) {
+            double x, y;
+            sim.get_position_at(particle, sim.time, x, y);
+            BOOST_CHECK(sim.is_in_domain(x, y));
+            fresh.x_pos[particle] = x;
+            fresh.y_pos[particle] = y;
+            fresh.impact_times[particle] = sim.time;
+            fresh.compute_next_impact(particle);
+            BOOST_CHECK_CLOSE_FRACTION(fresh.next_impact_times[particle], sim.next_impact_times[particle], 1E-9);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_width_change_repredicts_affected_particles) {
+        // With fixed chambers, the channel gets longer and only the particles near it are predicted again
+        auto fixed = Simulation(300, 0.3, 1, 1, 3, 3, false, true);
+        fixed.seed(11);
+        fixed.setup();
+        fixed.start(0.5);
+        while (fixed.num_collisions < 5000) {
+            fixed.update(0);
+        }
+        const double fixed_length = fixed.bridge_length;
+        const unsigned long fixed_widened = fixed.set_bridge_width(0.35);
+        BOOST_CHECK_GT(fixed_widened, 0);
+        BOOST_CHECK_LT(fixed_widened, fixed.num_particles);
+        BOOST_CHECK_GT(fixed.bridge_length, fixed_length);
+        check_predictions(fixed);
+        auto sim = get_double_channel_sim();
+        const double bridge_length = sim.bridge_length;
+        const unsigned long widened = sim.set_bridge_width(0.35);
+        BOOST_CHECK_EQUAL(widened, sim.num_particles);
+        check_predictions(sim);
+        const unsigned long narrowed = sim.set_bridge_width(0.2);
+        BOOST_CHECK_GT(narrowed, 0);
+        check_predictions(sim);
+        // The channel keeps its length, so the geometry is the one of a run set up with the new width
+        auto fresh = Simulation(300, 0.2, 1, 1, 3, 3, false, true);
+        fresh.distance_as_channel_length = true;
+        fresh.second_length = 1;
+        fresh.second_width = 0.1;
+        fresh.setup();
+        BOOST_CHECK_EQUAL(sim.bridge_length, bridge_length);
+        BOOST_CHECK_CLOSE_FRACTION(sim.circle_distance, fresh.circle_distance, 1E-12);
+        BOOST_CHECK_CLOSE_FRACTION(sim.left_center_x, fresh.left_center_x, 1E-12);
+        BOOST_CHECK_CLOSE_FRACTION(sim.right_center_x, fresh.right_center_x, 1E-12);
+        BOOST_CHECK_CLOSE_FRACTION(sim.box_x_radius, fresh.box_x_radius, 1E-12);
+        auto moved = sim;
+        unsigned long num_outside = 0;
+        while (moved.num_collisions < 100000) {
+            moved.update(0);
+            if (moved.num_collisions % 100 == 0) {
+                for (int particle = 0; particle < moved.num_particles; particle++) {
+                    double x, y;
+                    moved.get_position_at(particle, moved.time, x, y);
+                    num_outside += not moved.is_in_domain(x, y);
+                }
+            }
+        }
+        BOOST_CHECK_EQUAL(num_outside, 0);
+        BOOST_CHECK_EQUAL(moved.get_num_resets(), 0);
+        const unsigned long second = sim.set_second_width(0.15);
+        BOOST_CHECK_GT(second, 0);
+        BOOST_CHECK_LT(second, sim.num_particles);
+        check_predictions(sim);
+        while (sim.num_collisions < 20000) {
+            sim.update(0);
+        }
+        check_predictions(sim);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_back_channel_width_change_keeps_particles_inside) {
+        for (double width: {0.15, 0.05}) {
+            auto sim = get_double_channel_sim();
+            const double box_x_radius = sim.box_x_radius;
+            sim.set_second_width(width);
+            // The inner ends follow the rims, so the periodic boundary moves out for a narrower channel
+            BOOST_CHECK_EQUAL(sim.box_x_radius > box_x_radius, width < 0.1);
+            check_predictions(sim);
+            unsigned long num_outside = 0;
+            while (sim.num_collisions < 100000) {
+                sim.update(0);
+                if (sim.num_collisions % 100 == 0) {
+                    for (int particle = 0; particle < sim.num_particles; particle++) {
+                        double x, y;
+                        sim.get_position_at(particle, sim.time, x, y);
+                        num_outside += not sim.is_in_domain(x, y);
+                    }
+                }
+            }
+            BOOST_CHECK_EQUAL(num_outside, 0);
+            BOOST_CHECK_EQUAL(sim.get_num_resets(), 0);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_invalid_width_is_rejected) {
+        auto sim = get_double_channel_sim();
+        BOOST_CHECK_THROW(sim.set_bridge_width(2.5), std::invalid_argument);
+        BOOST_CHECK_THROW(sim.set_bridge_width(0), std::invalid_argument);
+        BOOST_CHECK_EQUAL(sim.bridge_width, 0.3);
+        auto single = Simulation(10, 0.3);
+        single.setup();
+        single.start(0.5);
+        BOOST_CHECK_THROW(single.set_second_width(0.1), std::invalid_argument);
+        BOOST_CHECK_THROW(ParameterRamp::parse_parameter("radius"), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_round_trip_ramp) {
+        auto sim = get_double_channel_sim();
+        ParameterRamp ramp(ParameterRamp::parse_parameter("threshold"), 1, 5, 5);
+        ramp.round_trip = true;
+        ramp.measurement_collisions = 2000;
+        const std::vector<double> values = ramp.get_values();
+        BOOST_REQUIRE_EQUAL(values.size(), 9);
+        BOOST_CHECK_EQUAL(values[4], 5);
+        BOOST_CHECK_EQUAL(values[8], 1);
+        const std::vector<RampPoint> points = ramp.run(sim);
+        BOOST_REQUIRE_EQUAL(points.size(), values.size());
+        BOOST_CHECK_EQUAL(sim.gate_capacities[sim.LEFT], 1);
+        BOOST_CHECK_EQUAL(points.back().num_collisions, 5000 + 9 * 2000);
+        for (const RampPoint &point: points) {
+            BOOST_CHECK_LE(std::fabs(point.mass_spread), 1);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_width_ramp_keeps_particles_in_domain) {
+        auto sim = get_double_channel_sim();
+        ParameterRamp ramp(ParameterRamp::BRIDGE_WIDTH, 0.3, 0.1, 11);
+        ramp.measurement_collisions = 1000;
+        const std::vector<RampPoint> points = ramp.run(sim);
+        BOOST_CHECK_EQUAL(sim.bridge_width, 0.1);
+        BOOST_CHECK_EQUAL(points.size(), 11);
+        check_predictions(sim);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
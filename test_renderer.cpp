@@ -0,0 +1,285 @@
+#include <boost/test/unit_test.hpp>
+#include "renderer.h"
+#include <cstdio>
+
+BOOST_AUTO_TEST_SUITE(test_renderer)
+
+    Simulation get_started_sim(int num_particles) {
+        auto sim = Simulation(num_particles, 0.2);
+        sim.circle_distance = 0.5;
+        sim.circle_radius = 0.5;
+        sim.gate_is_flat = true;
+        sim.distance_as_channel_length = true;
+        sim.setup();
+        sim.start(0.5);
+        return sim;
+    }
+
+    BOOST_AUTO_TEST_CASE(test_trajectory_round_trip) {
+        auto sim = get_started_sim(50);
+        const std::string filename = "test_trajectory.trj";
+        {
+            TrajectoryWriter writer(filename, TrajectoryHeader::from_simulation(sim));
+            writer.write_frame(sim, 0);
+            while (sim.time < 1) {
+                sim.update(0);
+            }
+            writer.write_frame(sim, sim.time);
+        }
+        TrajectoryReader reader(filename);
+        BOOST_CHECK(reader.is_binary);
+        BOOST_CHECK_EQUAL(reader.header.num_particles, 50);
+        BOOST_CHECK_CLOSE(reader.header.bridge_length, sim.bridge_length, 1E-9);
+        TrajectoryFrame frame;
+        BOOST_CHECK(reader.read_frame(frame));
+        BOOST_CHECK(reader.read_frame(frame));
+        BOOST_CHECK_CLOSE(frame.time, sim.time, 1E-9);
+        double x, y;
+        sim.get_current_position(7, x, y);
+        BOOST_CHECK_EQUAL(frame.x.at(7), x);
+        BOOST_CHECK_EQUAL(frame.y.at(7), y);
+        BOOST_CHECK(not reader.read_frame(frame));
+        std::remove(filename.c_str());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_quantized_trajectory) {
+        auto sim = get_started_sim(1000);
+        TrajectoryHeader header = TrajectoryHeader::from_simulation(sim);
+        const std::string raw_file = "test_raw.trj";
+        const std::string coded_file = "test_quantized.trj";
+        std::vector<TrajectoryFrame> frames;
+        {
+            TrajectoryWriter raw(raw_file, header);
+            header.codec = TrajectoryHeader::QUANTIZED_DELTA;
+            TrajectoryWriter coded(coded_file, header);
+            for (int step = 0; step < 50; step++) {
+                const double t = 0.01 * step;
+                while (sim.get_next_event_time() < t) {
+                    sim.update(0);
+                }
+                frames.push_back(TrajectoryFrame::from_simulation(sim, t));
+                raw.write_frame(frames.back());
+                coded.write_frame(frames.back());
+            }
+        }
+        std::ifstream raw_stream(raw_file, std::ios::binary | std::ios::ate);
+        std::ifstream coded_stream(coded_file, std::ios::binary | std::ios::ate);
+        BOOST_CHECK_LT(coded_stream.tellg() * 5, raw_stream.tellg());
+        TrajectoryReader reader(coded_file);
+        BOOST_CHECK_EQUAL(reader.header.codec, TrajectoryHeader::QUANTIZED_DELTA);
+        const QuantizedDeltaCodec codec(reader.header);
+        TrajectoryFrame frame;
+        for (const TrajectoryFrame &original: frames) {
+            BOOST_REQUIRE(reader.read_frame(frame));
+            BOOST_CHECK_EQUAL(frame.time, original.time);
+            BOOST_REQUIRE_EQUAL(frame.size(), original.size());
+            for (std::size_t particle = 0; particle < frame.size(); particle++) {
+                BOOST_REQUIRE_LE(std::fabs(frame.x[particle] - original.x[particle]), codec.get_position_error());
+                BOOST_REQUIRE_LE(std::fabs(frame.y[particle] - original.y[particle]), codec.get_position_error());
+                const double turn =
+                        std::remainder(frame.directions[particle] - original.directions[particle], 2 * M_PI);
+                BOOST_REQUIRE_LE(std::fabs(turn), codec.get_direction_error() * (1 + 1E-9));
+            }
+        }
+        BOOST_CHECK(not reader.read_frame(frame));
+        std::remove(raw_file.c_str());
+        std::remove(coded_file.c_str());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_filtered_trajectory) {
+        auto sim = get_started_sim(1000);
+        TrajectoryHeader header = TrajectoryHeader::from_simulation(sim);
+        header.indexed = true;
+        header.codec = TrajectoryHeader::QUANTIZED_DELTA;
+        const std::string filename = "test_filtered.trj";
+        const TrajectoryFilter tagged = TrajectoryFilter::parse("tagged:3,14,15,92");
+        const TrajectoryFilter window = TrajectoryFilter::window(sim.left_center_x, sim.box_x_radius, -sim.box_y_radius,
+                                                                 sim.box_y_radius);
+        std::vector<TrajectoryFrame> frames;
+        {
+            TrajectoryWriter writer(filename, header);
+            for (int step = 0; step < 20; step++) {
+                const double t = 0.01 * step;
+                while (sim.get_next_event_time() < t) {
+                    sim.update(0);
+                }
+                frames.push_back(TrajectoryFrame::from_simulation(sim, t));
+                writer.write_frame(sim, t, step % 2 ? tagged : window);
+            }
+        }
+        TrajectoryReader reader(filename);
+        BOOST_CHECK(reader.header.indexed);
+        const QuantizedDeltaCodec codec(reader.header);
+        TrajectoryFrame frame;
+        for (std::size_t step = 0; step < frames.size(); step++) {
+            const TrajectoryFrame &full = frames[step];
+            BOOST_REQUIRE(reader.read_frame(frame));
+            BOOST_REQUIRE_EQUAL(frame.indices.size(), frame.size());
+            if (step % 2) {
+                BOOST_CHECK(frame.indices == std::vector<uint32_t>({3, 14, 15, 92}));
+            } else {
+                BOOST_CHECK_GT(frame.size(), 0);
+                BOOST_CHECK_LT(frame.size(), full.size());
+            }
+            for (std::size_t i = 0; i < frame.size(); i++) {
+                const uint32_t particle = frame.indices[i];
+                BOOST_REQUIRE_LE(std::fabs(frame.x[i] - full.x[particle]), codec.get_position_error());
+                BOOST_REQUIRE_LE(std::fabs(frame.y[i] - full.y[particle]), codec.get_position_error());
+                if (step % 2 == 0) {
+                    BOOST_CHECK_GE(full.x[particle], sim.left_center_x);
+                }
+            }
+        }
+        BOOST_CHECK(not reader.read_frame(frame));
+        std::remove(filename.c_str());
+        BOOST_CHECK_THROW(TrajectoryFilter::parse("tagged:"), std::invalid_argument);
+        BOOST_CHECK_THROW(TrajectoryFilter::parse("window:0,1"), std::invalid_argument);
+        BOOST_CHECK_THROW(TrajectoryFilter::parse("urns"), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_background) {
+        auto sim = get_started_sim(1);
+        Renderer renderer(TrajectoryHeader::from_simulation(sim), 200, 100, 2);
+        TrajectoryFrame empty;
+        Image image = renderer.render(empty);
+        BOOST_CHECK_EQUAL(image.pixels.size(), 200 * 100 * 3);
+        // Corner is outside the domain, the center of the left urn inside
+        BOOST_CHECK_EQUAL(image.pixels[0], 190);
+        const double scale = std::min(200 / (2 * 1.05 * sim.box_x_radius), 100 / (2 * 1.05 * sim.box_y_radius));
+        const auto column = (unsigned) (100 + sim.left_center_x * scale);
+        BOOST_CHECK_EQUAL(image.pixels[3 * (50 * 200 + column)], 255);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_density_matches_particles) {
+        auto sim = get_started_sim(20000);
+        Renderer renderer(TrajectoryHeader::from_simulation(sim), 200, 100, 3);
+        TrajectoryFrame empty;
+        const Image background = renderer.render(empty);
+        renderer.mode = Renderer::DENSITY;
+        const Image density = renderer.render(sim, sim.time);
+        // All particles are in the urns, so the outside of the domain is untouched
+        BOOST_CHECK_EQUAL(density.pixels[0], background.pixels[0]);
+        BOOST_CHECK(density.pixels != background.pixels);
+        Renderer single_thread(TrajectoryHeader::from_simulation(sim), 200, 100, 1);
+        single_thread.mode = Renderer::DENSITY;
+        const Image reference = single_thread.render(sim, sim.time);
+        unsigned long differences = 0;
+        for (unsigned long i = 0; i < reference.pixels.size(); i++) {
+            differences += std::abs(reference.pixels[i] - density.pixels[i]) > 1;
+        }
+        BOOST_CHECK_EQUAL(differences, 0);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_png_output) {
+        Image image(3, 2);
+        image.set_pixel(1, 1, 10, 20, 30);
+        const std::string filename = "test_image.png";
+        image.write_png(filename);
+        std::ifstream file(filename, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        BOOST_CHECK_EQUAL(bytes.at(1), 'P');
+        BOOST_CHECK_EQUAL(std::string(bytes.begin() + 12, bytes.begin() + 16), "IHDR");
+        BOOST_CHECK_EQUAL(std::string(bytes.end() - 8, bytes.end() - 4), "IEND");
+        std::remove(filename.c_str());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_empty_indexed_frame_keeps_history) {
+        auto sim = get_started_sim(5);
+        TrajectoryHeader header = TrajectoryHeader::from_simulation(sim);
+        header.indexed = true;
+        header.codec = TrajectoryHeader::QUANTIZED_DELTA;
+        const std::string filename = "test_empty_frame.trj";
+        std::vector<TrajectoryFrame> frames(3);
+        for (std::size_t step = 0; step < frames.size(); step++) {
+            TrajectoryFrame &frame = frames[step];
+            frame.time = step;
+            if (step != 1) {
+                // An empty selection in between, as for the gates while both are empty
+                frame.indices = {1, 3};
+                frame.x = {0.1 * step - 0.9, 0.6};
+                frame.y = {0.35 - 0.1 * step, -0.4};
+                frame.directions = {1, 2};
+            }
+        }
+        {
+            TrajectoryWriter writer(filename, header);
+            for (const TrajectoryFrame &frame: frames) {
+                writer.write_frame(frame);
+            }
+        }
+        TrajectoryReader reader(filename);
+        const QuantizedDeltaCodec codec(reader.header);
+        TrajectoryFrame frame;
+        for (const TrajectoryFrame &written: frames) {
+            BOOST_REQUIRE(reader.read_frame(frame));
+            BOOST_REQUIRE(frame.indices == written.indices);
+            for (std::size_t i = 0; i < frame.size(); i++) {
+                BOOST_CHECK_LE(std::fabs(frame.x[i] - written.x[i]), codec.get_position_error());
+                BOOST_CHECK_LE(std::fabs(frame.y[i] - written.y[i]), codec.get_position_error());
+            }
+        }
+        std::remove(filename.c_str());
+        // The empty frame does not change how the next one is coded, so other decoders (visualise.py) agree
+        QuantizedDeltaCodec with_empty(header), without_empty(header);
+        std::vector<uint8_t> bytes, expected;
+        for (const TrajectoryFrame &written: frames) {
+            with_empty.encode(written, bytes);
+        }
+        without_empty.encode(frames[0], expected);
+        without_empty.encode(frames[2], expected);
+        BOOST_CHECK(bytes == expected);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_region_filters) {
+        auto sim = Simulation(2000, 0.2);
+        sim.circle_distance = 0.5;
+        sim.circle_radius = 0.5;
+        sim.gate_is_flat = true;
+        sim.distance_as_channel_length = true;
+        sim.second_width = 0.1;
+        sim.second_length = 0.5;
+        sim.setup();
+        sim.start(0.5);
+        while (sim.time < 1) {
+            sim.update(0);
+        }
+        const double t = (sim.time + sim.get_next_event_time()) / 2;
+        const TrajectoryFrame full = TrajectoryFrame::from_simulation(sim, t);
+        for (const char *name: {"gates", "bridge", "second_bridge"}) {
+            const TrajectoryFilter filter = TrajectoryFilter::parse(name);
+            std::vector<uint32_t> expected;
+            for (uint32_t particle = 0; particle < full.size(); particle++) {
+                const double x = full.x[particle];
+                const double y = full.y[particle];
+                bool inside;
+                if (filter.selection == TrajectoryFilter::GATES) {
+                    inside = sim.is_in_gate(x, y, sim.LEFT) or sim.is_in_gate(x, y, sim.RIGHT);
+                } else if (filter.selection == TrajectoryFilter::BRIDGE) {
+                    inside = sim.is_in_bridge(x, y);
+                } else {
+                    inside = sim.is_in_second_bridge(x, y);
+                }
+                if (inside) {
+                    expected.push_back(particle);
+                }
+            }
+            const TrajectoryFrame frame = TrajectoryFrame::from_simulation(sim, t, filter);
+            BOOST_CHECK_GT(expected.size(), 0);
+            BOOST_CHECK_LT(expected.size(), full.size());
+            BOOST_CHECK(frame.indices == expected);
+            for (std::size_t i = 0; i < frame.size(); i++) {
+                BOOST_CHECK_EQUAL(frame.x[i], full.x[frame.indices[i]]);
+                BOOST_CHECK_EQUAL(frame.y[i], full.y[frame.indices[i]]);
+                // The regions themselves: the gates and the bridge lie between the chambers, the second bridge beyond
+                if (filter.selection == TrajectoryFilter::SECOND_BRIDGE) {
+                    BOOST_CHECK_GT(std::fabs(frame.x[i]), sim.right_center_x);
+                    BOOST_CHECK_LE(std::fabs(frame.y[i]), sim.second_width / 2);
+                } else {
+                    BOOST_CHECK_LE(std::fabs(frame.x[i]), sim.bridge_length / 2);
+                    BOOST_CHECK_LE(std::fabs(frame.y[i]), sim.bridge_width / 2);
+                }
+            }
+        }
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+#include "replicas.h"
+#include "simulation.h"
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_replicas)
+
+    BOOST_AUTO_TEST_CASE(test_running_statistics) {
+        RunningStatistics all;
+        RunningStatistics first;
+        RunningStatistics second;
+        std::vector<double> values = {4, 7, 13, 16, 1E9 + 4, 1E9 + 7};
+        double mean = 0;
+        for (unsigned long i = 0; i < values.size(); i++) {
+            all.add(values[i]);
+            (i < 2 ? first : second).add(values[i]);
+            mean += values[i] / values.size();
+        }
+        double variance = 0;
+        for (double value: values) {
+            variance += (value - mean) * (value - mean) / (values.size() - 1);
+        }
+        BOOST_CHECK_CLOSE(all.mean(), mean, 1E-10);
+        BOOST_CHECK_CLOSE(all.variance(), variance, 1E-8);
+        first.merge(second);
+        BOOST_CHECK_EQUAL(first.count(), values.size());
+        BOOST_CHECK_CLOSE(first.mean(), mean, 1E-10);
+        BOOST_CHECK_CLOSE(first.variance(), variance, 1E-8);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_sketch_quantiles) {
+        const double accuracy = 0.01;
+        QuantileSketch sketch(accuracy);
+        QuantileSketch lower(accuracy);
+        QuantileSketch upper(accuracy);
+        std::vector<double> values;
+        for (int i = -1000; i <= 10000; i++) {
+            values.push_back(i);
+        }
+        std::shuffle(values.begin(), values.end(), std::mt19937(3));
+        for (unsigned long i = 0; i < values.size(); i++) {
+            sketch.add(values[i]);
+            (i % 2 ? lower : upper).add(values[i]);
+        }
+        lower.merge(upper);
+        BOOST_CHECK_EQUAL(sketch.count(), values.size());
+        std::sort(values.begin(), values.end());
+        for (double q: {0., 0.01, 0.05, 0.25, 0.5, 0.9, 0.99, 1.}) {
+            const double exact = values[(unsigned long) (q * (values.size() - 1))];
+            BOOST_CHECK_LE(std::fabs(sketch.quantile(q) - exact), accuracy * std::fabs(exact) + 1E-12);
+            BOOST_CHECK_EQUAL(lower.quantile(q), sketch.quantile(q));
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_runner_is_reproducible) {
+        auto replica = [](unsigned long r, std::vector<double> &observables) {
+            Simulation simulation(20, 0.3, 1, 0.5, 3, 0);
+            simulation.seed(r + 1);
+            simulation.setup();
+            simulation.start(0);
+            while (simulation.num_collisions < 10) {
+                simulation.update(0);
+            }
+            observables[0] = simulation.time;
+            observables[1] = simulation.in_left;
+        };
+        ReplicaRunner serial(1);
+        serial.max_replicas = 200;
+        serial.relative_precision = 0.05;
+        ReplicaRunner parallel(3);
+        parallel.max_replicas = 200;
+        parallel.relative_precision = 0.05;
+        const ReplicaResult expected = serial.run(replica, 2);
+        const ReplicaResult result = parallel.run(replica, 2);
+        BOOST_CHECK(expected.converged);
+        BOOST_CHECK_LT(expected.num_replicas, 200);
+        BOOST_CHECK_GE(expected.num_replicas, serial.min_replicas);
+        BOOST_CHECK_EQUAL(result.num_replicas, expected.num_replicas);
+        BOOST_CHECK_EQUAL(result.statistics[0].mean(), expected.statistics[0].mean());
+        BOOST_CHECK_EQUAL(result.statistics[1].mean(), expected.statistics[1].mean());
+        BOOST_CHECK_EQUAL(result.sketches[0].quantile(0.5), expected.sketches[0].quantile(0.5));
+        BOOST_CHECK_LE(result.statistics[0].standard_error(), 0.05 * result.statistics[0].mean());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_runner_without_precision_runs_all) {
+        ReplicaRunner runner(2);
+        runner.max_replicas = 50;
+        const ReplicaResult result = runner.run([](unsigned long r, std::vector<double> &observables) {
+            observables[0] = r;
+        });
+        BOOST_CHECK(not result.converged);
+        BOOST_CHECK_EQUAL(result.num_replicas, 50);
+        BOOST_CHECK_CLOSE(result.statistics[0].mean(), 24.5, 1E-10);
+        BOOST_CHECK_THROW(runner.run([](unsigned long r, std::vector<double> &) {
+            if (r == 7) {
+                throw std::runtime_error("Replica failed");
+            }
+        }), std::runtime_error);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
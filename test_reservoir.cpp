@@ -0,0 +1,110 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include "reservoir.h"
+
+BOOST_AUTO_TEST_SUITE(test_reservoir)
+
+    const char *const SPEC = "1 0.3 3 1 1 0.1 200 0.75 2000 20000 a";
+
+    BOOST_AUTO_TEST_CASE(test_analytic_model) {
+        Simulation sim = ExperimentSpec::from_line(SPEC).make_simulation();
+        const ReservoirModel model = ReservoirModel::analytic(sim);
+        const double width = 2 * sim.circle_radius * (sim.mouth_angle + sim.second_mouth_angle);
+        BOOST_CHECK_CLOSE(model.get_mean_duration(sim.LEFT), PI * PI * sim.circle_radius * sim.circle_radius / width,
+                          1E-9);
+        BOOST_CHECK(model.get_returns(sim.LEFT, false).empty());
+        const double u[4] = {0.5, 0.1, 0.99, 0.01};
+        const ReservoirModel::Return visit = model.sample(sim.RIGHT, true, u);
+        BOOST_CHECK_CLOSE(visit.duration, model.get_mean_duration(sim.RIGHT) * std::log(2), 1E-9);
+        BOOST_CHECK(visit.back_entry);
+        BOOST_CHECK(visit.back);
+        BOOST_CHECK_CLOSE(visit.offset, 0.98, 1E-9);
+        BOOST_CHECK_CLOSE(visit.angle, -std::asin(0.98), 1E-9);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_calibration) {
+        Simulation sim = ExperimentSpec::from_line(SPEC).make_simulation();
+        const ReservoirModel model = ReservoirModel::calibrate(sim, 4000, 1);
+        BOOST_CHECK(not model.calibrating);
+        BOOST_CHECK_EQUAL(sim.num_collisions, 0);
+        unsigned long num_recorded = 0;
+        for (unsigned long side: {sim.LEFT, sim.RIGHT}) {
+            for (bool back_entry: {false, true}) {
+                const std::vector<ReservoirModel::Return> &returns = model.get_returns(side, back_entry);
+                BOOST_CHECK(not returns.empty());
+                num_recorded += returns.size();
+                unsigned long num_back = 0;
+                for (const ReservoirModel::Return &visit: returns) {
+                    BOOST_REQUIRE_EQUAL(visit.back_entry, back_entry);
+                    BOOST_REQUIRE_GT(visit.duration, 0);
+                    BOOST_REQUIRE_LE(std::fabs(visit.offset), 1);
+                    BOOST_REQUIRE_LE(std::fabs(visit.angle), PI / 2);
+                    num_back += visit.back;
+                }
+                BOOST_CHECK_GT(num_back, 0);
+                BOOST_CHECK_LT(num_back, returns.size());
+            }
+        }
+        BOOST_CHECK_EQUAL(num_recorded + model.get_num_censored(), 4000);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_reservoir_run) {
+        const ExperimentSpec spec = ExperimentSpec::from_line(SPEC);
+        const ReservoirModel model = ReservoirModel::calibrate(spec.make_simulation(), 4000, 1);
+        Simulation parked = spec.make_simulation();
+        parked.park_trapped_orbits = true;
+        ReservoirModel analytic = ReservoirModel::analytic(parked);
+        parked.reservoirs = &analytic;
+        BOOST_CHECK_THROW(parked.start(0.5), std::logic_error);
+
+        // Copies share their random number generator, so both runs are made from scratch
+        ReservoirModel serial_model = model;
+        ReservoirModel windowed_model = model;
+        auto make_simulation = [&spec](ReservoirModel *reservoirs) {
+            Simulation sim = spec.make_simulation();
+            sim.reservoirs = reservoirs;
+            sim.seed(5);
+            sim.start(spec.left_ratio);
+            return sim;
+        };
+        Simulation serial = make_simulation(&serial_model);
+        Simulation windowed = make_simulation(&windowed_model);
+        windowed.renumber_interval = 2999;
+        while (serial.time < 200) {
+            serial.update(0);
+        }
+        while (windowed.time < serial.time) {
+            windowed.update_window(1000);
+        }
+        while (serial.time < windowed.time) {
+            serial.update(0);
+        }
+        BOOST_CHECK_EQUAL(windowed.num_collisions, serial.num_collisions);
+        BOOST_CHECK_EQUAL(windowed.in_left, serial.in_left);
+        BOOST_CHECK_EQUAL(windowed.current_counters[0], serial.current_counters[0]);
+        BOOST_CHECK_EQUAL(windowed.current_counters[2], serial.current_counters[2]);
+        BOOST_CHECK_GT(serial.current_counters[0], 0);
+        BOOST_CHECK_GT(serial.current_counters[2], 0);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_compare_reservoirs) {
+        ExperimentSpec spec = ExperimentSpec::from_line(SPEC);
+        const std::vector<ReservoirComparison> comparisons = compare_reservoirs(spec, 2000, 0.1, 2);
+        BOOST_REQUIRE_EQUAL(comparisons.size(), 3);
+        BOOST_CHECK_EQUAL(comparisons[0].mode, "exact");
+        BOOST_CHECK_EQUAL(comparisons[1].mode, "analytic");
+        BOOST_CHECK_EQUAL(comparisons[2].mode, "calibrated");
+        BOOST_CHECK_EQUAL(comparisons[0].num_events, spec.M_f - spec.M_t);
+        for (const ReservoirComparison &comparison: comparisons) {
+            BOOST_CHECK_GT(comparison.mass_spread_error, 0);
+            BOOST_CHECK_GT(comparison.currents[0], 0);
+        }
+        // Reservoirs skip the bounces inside the chambers
+        BOOST_CHECK_LT(comparisons[1].num_events, comparisons[0].num_events);
+        BOOST_CHECK_LT(comparisons[2].num_events, comparisons[0].num_events);
+        BOOST_CHECK_GT(comparisons[2].calibration_seconds, 0);
+        spec.M_t = 0;
+        BOOST_CHECK_THROW(compare_reservoirs(spec, 2000), std::invalid_argument);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
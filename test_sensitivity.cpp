@@ -0,0 +1,49 @@
+#include <boost/test/unit_test.hpp>
+#include "sensitivity.h"
+
+BOOST_AUTO_TEST_SUITE(test_sensitivity)
+
+    BOOST_AUTO_TEST_CASE(test_common_random_numbers) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 1000 5000 a");
+        Simulation base = spec.make_simulation();
+        base.use_common_random_numbers(5);
+        base.start(spec.left_ratio);
+        spec.channel_width = 0.31;
+        Simulation wider = spec.make_simulation();
+        wider.use_common_random_numbers(5);
+        wider.start(spec.left_ratio);
+        unsigned long num_equal = 0;
+        for (int particle = 0; particle < base.num_particles; particle++) {
+            num_equal += base.y_pos[particle] == wider.y_pos[particle] and
+                         base.directions[particle] == wider.directions[particle];
+        }
+        // Only the particles that started near the mouth of the channel differ
+        BOOST_CHECK_GT(num_equal, base.num_particles * 9 / 10);
+        Simulation other = spec.make_simulation();
+        other.use_common_random_numbers(6);
+        other.start(spec.left_ratio);
+        BOOST_CHECK(other.y_pos[0] != wider.y_pos[0]);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_sensitivities) {
+        auto spec = ExperimentSpec::from_line("1 0.3 3 1 1 0.1 200 0.75 2000 20000 a");
+        SensitivityAnalysis analysis(spec, 1);
+        analysis.num_batches = 10;
+        const std::vector<Sensitivity> sensitivities = analysis.run();
+        BOOST_REQUIRE_EQUAL(sensitivities.size(), 3);
+        BOOST_CHECK_EQUAL(sensitivities[0].parameter, "channel_width");
+        BOOST_CHECK_CLOSE(sensitivities[0].upper - sensitivities[0].lower, 0.03, 1E-9);
+        BOOST_CHECK_EQUAL(sensitivities[2].lower, 2);
+        BOOST_CHECK_EQUAL(sensitivities[2].upper, 4);
+        for (const Sensitivity &sensitivity: sensitivities) {
+            BOOST_CHECK(std::isfinite(sensitivity.mass_spread));
+            BOOST_CHECK_GT(sensitivity.mass_spread_error, 0);
+            BOOST_CHECK(std::isfinite(sensitivity.independent_error));
+        }
+        // A small change of the width leaves most trajectories alone, so common random numbers cancel most noise
+        BOOST_CHECK_LT(sensitivities[0].mass_spread_error, sensitivities[0].independent_error);
+        spec.M_t = 0;
+        BOOST_CHECK_THROW(SensitivityAnalysis(spec).run(), std::invalid_argument);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -679,6 +679,39 @@ BOOST_AUTO_TEST_SUITE(test_simulation)
         BOOST_CHECK(sim.is_in_bridge(sim.x_pos.at(0), sim.y_pos.at(0)));
     }
 
+    BOOST_AUTO_TEST_CASE(test_event_budget_and_deadline) {
+        auto sim = get_sim(100);
+        sim.event_budget = 500;
+        sim.setup();
+        sim.start(0.5);
+        while (sim.num_collisions < 10000 and sim.has_budget_left()) {
+            sim.update(0);
+        }
+        BOOST_CHECK_EQUAL(sim.num_collisions, 500);
+        BOOST_CHECK(sim.truncated);
+        auto sim2 = get_sim(100);
+        sim2.setup();
+        sim2.start(0.5);
+        sim2.set_deadline(1E-6);
+        usleep(1000);
+        unsigned long checks = 0;
+        while (sim2.has_budget_left()) {
+            sim2.update(0);
+            checks++;
+        }
+        BOOST_CHECK(sim2.truncated);
+        // The clock is only consulted every so many checks
+        BOOST_CHECK(checks > 0);
+        BOOST_CHECK(checks < 2000);
+        auto sim3 = get_sim(100);
+        sim3.setup();
+        sim3.start(0.5);
+        while (sim3.num_collisions < 2000 and sim3.has_budget_left()) {
+            sim3.update(0);
+        }
+        BOOST_CHECK(not sim3.truncated);
+    }
+
     BOOST_AUTO_TEST_CASE(test_second_bridge) {
         // Test if the upper and lower bound of the bridge function works correctly
         // Todo: Try to identify the error that comes without the extension
@@ -697,4 +730,311 @@ BOOST_AUTO_TEST_SUITE(test_simulation)
     }
 
 
+    Simulation get_orbit_sim(bool park, double y, double direction) {
+        Simulation sim(1, 0.1, 1, 0.5, 1, 1, false, true);
+        sim.park_trapped_orbits = park;
+        sim.setup();
+        sim.start(1);
+        sim.x_pos.at(0) = sim.left_center_x;
+        sim.y_pos.at(0) = y;
+        sim.directions.at(0) = direction;
+        sim.reschedule_particle(0);
+        return sim;
+    }
+
+    BOOST_AUTO_TEST_CASE(test_fast_forward_matches_event_by_event) {
+        auto parked = get_orbit_sim(true, 0.5, 0.3);
+        auto reference = get_orbit_sim(false, 0.5, 0.3);
+        bool skipped = false;
+        for (int step = 0; step < 10; step++) {
+            const unsigned long before = parked.num_collisions;
+            parked.update(0);
+            skipped = skipped or parked.num_collisions > before + 1;
+            while (reference.time < parked.time - 1E-9) {
+                reference.update(0);
+            }
+            BOOST_REQUIRE_EQUAL(reference.num_collisions, parked.num_collisions);
+            BOOST_REQUIRE_EQUAL(reference.in_left, parked.in_left);
+            BOOST_REQUIRE_SMALL(reference.x_pos.at(0) - parked.x_pos.at(0), 1E-6);
+            BOOST_REQUIRE_SMALL(reference.y_pos.at(0) - parked.y_pos.at(0), 1E-6);
+            // Positions in between are followed along the orbit
+            const double t = (parked.time + parked.get_next_event_time()) / 2;
+            while (reference.get_next_event_time() < t) {
+                reference.update(0);
+            }
+            double x1, y1, x2, y2;
+            parked.get_position_at(0, t, x1, y1);
+            reference.get_position_at(0, t, x2, y2);
+            BOOST_REQUIRE_SMALL(x1 - x2, 1E-6);
+            BOOST_REQUIRE_SMALL(y1 - y2, 1E-6);
+        }
+        BOOST_CHECK(skipped);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_snapshot_matches_single_particles) {
+        auto orbit = get_orbit_sim(true, 0.5, 0.3);
+        orbit.update(0);
+        Simulation large(40000, 0.3, 1, 0.5, 3, 3, false, true);
+        large.park_trapped_orbits = true;
+        large.setup();
+        large.start(0.75);
+        while (large.num_collisions < 50000) {
+            large.update(0);
+        }
+        for (Simulation *sim: {&orbit, &large}) {
+            const double t = (sim->time + sim->get_next_event_time()) / 2;
+            std::vector<double> x(sim->num_particles), y(sim->num_particles), directions(sim->num_particles);
+            sim->snapshot(t, x.data(), y.data(), directions.data(), 3);
+            for (int particle = 0; particle < sim->num_particles; particle++) {
+                double x_single, y_single;
+                sim->get_position_at(particle, t, x_single, y_single);
+                BOOST_REQUIRE_EQUAL(x[particle], x_single);
+                BOOST_REQUIRE_EQUAL(y[particle], y_single);
+                BOOST_REQUIRE_EQUAL(directions[particle], sim->get_direction_at(particle, t));
+            }
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_trapped_orbit_is_parked) {
+        // A square orbit whose corners stay away from the mouth, next to a particle bouncing along the x-axis
+        Simulation sim(2, 0.1, 1, 0.5, 1, 1, false, true);
+        sim.park_trapped_orbits = true;
+        sim.setup();
+        sim.start(1);
+        const double corner = std::sqrt(0.5);
+        sim.x_pos.at(0) = sim.left_center_x + corner;
+        sim.y_pos.at(0) = 0;
+        sim.directions.at(0) = M_PI / 2;
+        sim.reschedule_particle(0);
+        sim.x_pos.at(1) = sim.left_center_x;
+        sim.y_pos.at(1) = 0;
+        sim.directions.at(1) = 0;
+        sim.reschedule_particle(1);
+        unsigned long num_updates = 0;
+        while (sim.time < 50) {
+            sim.update(0);
+            num_updates++;
+        }
+        BOOST_CHECK_EQUAL(sim.get_num_parked(), 1);
+        BOOST_CHECK(std::isinf(sim.next_impact_times.at(0)));
+        BOOST_CHECK_EQUAL(sim.in_left, sim.x_pos.at(1) <= 0 ? 2ul : 1ul);
+        // The parked particle keeps bouncing once per chord
+        const auto parked_bounces = (unsigned long) ((sim.time - sim.impact_times.at(0)) / (2 * corner));
+        BOOST_CHECK(sim.num_collisions + 1 >= num_updates + parked_bounces);
+        BOOST_CHECK(sim.num_collisions <= num_updates + parked_bounces + 1);
+        // Halfway the second chord, the particle is at the far side of the chamber
+        double x, y;
+        sim.get_position_at(0, sim.impact_times.at(0) + 3 * corner, x, y);
+        BOOST_CHECK_SMALL(x - (sim.left_center_x - corner), 1E-6);
+        BOOST_CHECK_SMALL(y, 1E-6);
+    }
+
+    void check_window_matches_serial(Simulation &sim) {
+        sim.setup();
+        sim.start(0.75);
+        Simulation serial = sim;
+        std::vector<unsigned long> trace;
+        const unsigned long num_events = 20000;
+        BOOST_CHECK_EQUAL(sim.update_window(num_events, &trace), num_events);
+        BOOST_REQUIRE_EQUAL(trace.size(), num_events);
+        for (unsigned long event = 0; event < num_events; event++) {
+            serial.update(0);
+            BOOST_REQUIRE_EQUAL(serial.in_left, trace[event]);
+        }
+        BOOST_CHECK_EQUAL(serial.num_collisions, sim.num_collisions);
+        BOOST_CHECK_EQUAL(serial.time, sim.time);
+        BOOST_CHECK(serial.current_counters == sim.current_counters);
+        BOOST_CHECK(serial.x_pos == sim.x_pos);
+        BOOST_CHECK(serial.y_pos == sim.y_pos);
+        BOOST_CHECK(serial.directions == sim.directions);
+        BOOST_CHECK(serial.next_impact_times == sim.next_impact_times);
+        BOOST_CHECK(serial.gate_contents == sim.gate_contents);
+        BOOST_CHECK_EQUAL(serial.get_next_event_time(), sim.get_next_event_time());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_window_matches_serial) {
+        Simulation sim(300, 0.2, 1, 0.5, 2, 2, false, true);
+        check_window_matches_serial(sim);
+        Simulation circular(300, 0.2, 1, 0.5, 3, 3, false, false);
+        circular.queue_type = EventQueue::BINARY_HEAP;
+        check_window_matches_serial(circular);
+        Simulation double_channel(300, 0.2, 1, 0.5, 2, 2, false, true);
+        double_channel.second_width = 0.1;
+        double_channel.second_length = 1;
+        check_window_matches_serial(double_channel);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_window_leaves_resets_to_serial_order) {
+        Simulation sim(100, 0.2, 1, 0.5, 2, 2, false, true);
+        // Per-particle streams, so the copy does not share the generator
+        sim.use_common_random_numbers(3);
+        sim.setup();
+        sim.start(0.75);
+        // Long chords now find no impact, so some predictions need a reset
+        sim.max_path = 1.98;
+        Simulation serial = sim;
+        const unsigned long num_events = 2000;
+        sim.update_window(num_events);
+        for (unsigned long event = 0; event < num_events; event++) {
+            serial.update(0);
+        }
+        BOOST_CHECK(serial.get_num_resets() > 0);
+        BOOST_CHECK_EQUAL(serial.get_num_resets(), sim.get_num_resets());
+        BOOST_CHECK_EQUAL(serial.time, sim.time);
+        BOOST_CHECK(serial.x_pos == sim.x_pos);
+        BOOST_CHECK(serial.y_pos == sim.y_pos);
+        BOOST_CHECK(serial.directions == sim.directions);
+        BOOST_CHECK(serial.next_impact_times == sim.next_impact_times);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_renumbering_keeps_events) {
+        for (EventQueue::Type type: {EventQueue::SORTED_VECTOR, EventQueue::BINARY_HEAP}) {
+            Simulation plain(300, 0.2, 1, 0.5, 2, 2, false, true);
+            plain.queue_type = type;
+            plain.setup();
+            plain.seed(11);
+            plain.start(0.7);
+            Simulation renumbered = plain;
+            renumbered.renumber_interval = 997;
+            while (plain.num_collisions < 20000) {
+                plain.update(0);
+                renumbered.update(0);
+            }
+            plain.update_window(5000);
+            renumbered.update_window(5000);
+            BOOST_CHECK_EQUAL(renumbered.num_collisions, plain.num_collisions);
+            BOOST_CHECK_EQUAL(renumbered.in_left, plain.in_left);
+            BOOST_CHECK(renumbered.current_counters == plain.current_counters);
+            std::vector<double> x(300), y(300), directions(300), x_plain(300), y_plain(300), directions_plain(300);
+            renumbered.snapshot(renumbered.time, x.data(), y.data(), directions.data());
+            plain.snapshot(plain.time, x_plain.data(), y_plain.data(), directions_plain.data());
+            BOOST_CHECK(x == x_plain);
+            BOOST_CHECK(y == y_plain);
+            BOOST_CHECK(directions == directions_plain);
+            renumbered.renumber();
+            unsigned long moved = 0;
+            int last_region = 0;
+            for (unsigned long particle = 0; particle < 300; particle++) {
+                const unsigned long id = renumbered.get_particle_id(particle);
+                BOOST_REQUIRE_EQUAL(renumbered.get_particle_index(id), particle);
+                double x_single, y_single;
+                renumbered.get_current_position(particle, x_single, y_single);
+                BOOST_REQUIRE_EQUAL(x_single, x_plain[id]);
+                moved += id != particle;
+                // Left chamber, channel, right chamber
+                const double &px = renumbered.x_pos[particle];
+                const double &py = renumbered.y_pos[particle];
+                const int region = renumbered.is_in_circle(px, py, renumbered.LEFT) ? 0 :
+                                   renumbered.is_in_circle(px, py, renumbered.RIGHT) ? 2 : 1;
+                BOOST_REQUIRE_GE(region, last_region);
+                last_region = region;
+            }
+            BOOST_CHECK_GT(moved, 0);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(test_species_counters) {
+        Simulation sim(400, 0.2, 1, 0.5, 3, 3, false, true);
+        sim.setup();
+        sim.seed(5);
+        std::vector<unsigned> species(400);
+        for (unsigned long particle = 0; particle < 400; particle++) {
+            species[particle] = particle % 3;
+        }
+        sim.set_species(species);
+        // Species 2 may not enter the left gate, so it only goes to the right through the back of the channel
+        sim.set_species_gate_capacity(sim.LEFT, 2, 0);
+        sim.selective_explosions = true;
+        sim.renumber_interval = 5000;
+        sim.start(0.5);
+        BOOST_CHECK_EQUAL(sim.get_num_species(), 3);
+        while (sim.num_collisions < 40000) {
+            sim.update(0);
+        }
+        sim.update_window(10000);
+        unsigned long in_left = 0;
+        std::vector<unsigned long> counted(3, 0);
+        for (unsigned long particle = 0; particle < 400; particle++) {
+            BOOST_REQUIRE_EQUAL(sim.get_species(particle), sim.get_particle_id(particle) % 3);
+            counted[sim.get_species(particle)] += sim.x_pos[particle] <= 0;
+        }
+        BOOST_CHECK(counted == sim.species_in_left);
+        for (unsigned int species_index = 0; species_index < 3; species_index++) {
+            in_left += sim.species_in_left[species_index];
+        }
+        BOOST_CHECK_EQUAL(in_left, sim.in_left);
+        for (unsigned int counter = 0; counter < 4; counter++) {
+            int total = 0;
+            for (unsigned int species_index = 0; species_index < 3; species_index++) {
+                total += sim.species_current_counters[4 * species_index + counter];
+            }
+            BOOST_CHECK_EQUAL(total, sim.current_counters[counter]);
+        }
+        BOOST_CHECK_GT(sim.species_current_counters[sim.FROM_LEFT_TO_RIGHT_INNER], 0);
+        BOOST_CHECK_EQUAL(sim.species_current_counters[4 * 2 + sim.FROM_LEFT_TO_RIGHT_INNER], 0);
+        BOOST_CHECK_THROW(sim.set_species_gate_capacity(sim.LEFT, 3, 1), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_open_system) {
+        Simulation closed(300, 0.3, 1, 0.5, 3, 3, false, true);
+        closed.setup();
+        BOOST_CHECK_THROW(closed.add_sink(closed.LEFT, 0, 0.2), std::invalid_argument);
+        BOOST_CHECK(not closed.is_open());
+        // Particles enter at the far end of the left chamber and leave at the far end of the right one.
+        // Copies share their random number generator, so both runs are made from scratch
+        auto make_open_system = []() {
+            Simulation sim(300, 0.3, 1, 0.5, 3, 3, false, true);
+            sim.setup();
+            sim.add_source(sim.LEFT, PI, 0.5, 10);
+            sim.add_sink(sim.RIGHT, 0, 0.5);
+            sim.initial_particles = 50;
+            sim.seed(3);
+            sim.start(1);
+            return sim;
+        };
+        Simulation plain = make_open_system();
+        BOOST_CHECK(plain.is_open());
+        BOOST_CHECK_EQUAL(plain.get_num_active(), 50);
+        BOOST_CHECK(not plain.is_active(50));
+        Simulation windowed = make_open_system();
+        windowed.renumber_interval = 2999;
+        while (plain.time < 100) {
+            plain.update(0);
+        }
+        while (windowed.time < plain.time) {
+            windowed.update_window(1000);
+        }
+        while (plain.time < windowed.time) {
+            plain.update(0);
+        }
+        BOOST_CHECK_EQUAL(windowed.num_collisions, plain.num_collisions);
+        BOOST_CHECK_EQUAL(windowed.in_left, plain.in_left);
+        BOOST_CHECK_EQUAL(windowed.get_num_active(), plain.get_num_active());
+        const WallSegment &source = plain.wall_segments[0];
+        const WallSegment &sink = plain.wall_segments[1];
+        BOOST_CHECK_EQUAL(plain.get_num_active(), 50 + source.count - sink.count);
+        BOOST_CHECK_GT(sink.count, 0);
+        // A rate of 10 over a time of 100
+        BOOST_CHECK_SMALL(double(source.count + plain.num_lost_injections) - 1000, 150.);
+        std::vector<double> x(300), y(300);
+        std::vector<double> x_windowed(300), y_windowed(300);
+        plain.snapshot(plain.time, x.data(), y.data());
+        windowed.snapshot(windowed.time, x_windowed.data(), y_windowed.data());
+        unsigned long in_left = 0;
+        unsigned long num_active = 0;
+        for (unsigned long id = 0; id < 300; id++) {
+            BOOST_REQUIRE_EQUAL(std::isnan(x[id]), not plain.is_active(id));
+            BOOST_REQUIRE(std::isnan(x[id]) ? std::isnan(x_windowed[id]) : x[id] == x_windowed[id]);
+            if (not std::isnan(x[id])) {
+                BOOST_REQUIRE(plain.is_in_domain(x[id], y[id]));
+                num_active++;
+                in_left += x[id] <= 0;
+            }
+        }
+        BOOST_CHECK_EQUAL(num_active, plain.get_num_active());
+        BOOST_CHECK_EQUAL(in_left, plain.in_left);
+        // The flow from the source to the sink keeps more particles on the left
+        BOOST_CHECK_LT(plain.get_mass_spread(), 0);
+    }
+
 BOOST_AUTO_TEST_SUITE_END();
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include <boost/test/unit_test.hpp>
+#include "simulation3d.h"
+#include <cmath>
+
+BOOST_AUTO_TEST_SUITE(test_simulation3d)
+    double eps = 1E-9;
+
+    Simulation3D get_sim3d(int num_particles) {
+        Simulation3D sim(num_particles, 0.4, 1, 0.5, 2, 2);
+        sim.setup();
+        return sim;
+    }
+
+    BOOST_AUTO_TEST_CASE(test_geometry) {
+        auto sim = get_sim3d(10);
+        BOOST_CHECK_CLOSE(sim.bridge_length, 0.5 + 2 - 2 * std::sqrt(1 - 0.04), eps);
+        BOOST_CHECK(sim.is_in_domain(0, 0.19, 0));
+        BOOST_CHECK(not sim.is_in_domain(0, 0.15, 0.15));
+        BOOST_CHECK(sim.is_in_domain(sim.left_center_x, 0.5, 0.5));
+        BOOST_CHECK(sim.is_in_gate(0.1, sim.RIGHT));
+        BOOST_CHECK(not sim.is_in_gate(0.1, sim.LEFT));
+        Simulation3D channel(10, 0.4, 1, 0.5, 2, 2);
+        channel.distance_as_channel_length = true;
+        channel.setup();
+        BOOST_CHECK_CLOSE(channel.bridge_length, 0.5, eps);
+        Simulation3D too_wide(10, 2.5);
+        BOOST_CHECK_THROW(too_wide.setup(), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_intersection_kernel) {
+        auto sim = get_sim3d(10);
+        const double c = sim.left_center_x;
+        const double x[4] = {c, c, 0, c};
+        const double y[4] = {0, 0, 0, 0.5};
+        const double z[4] = {0, 0, 0, 0};
+        const double vx[4] = {0, 1, 0, -1};
+        const double vy[4] = {1, 0, 0.6, 0};
+        const double vz[4] = {0, 0, 0.8, 0};
+        double times[4];
+        int surfaces[4];
+        sim.predict_block(4, x, y, z, vx, vy, vz, times, surfaces);
+        // Straight up to the sphere wall
+        BOOST_CHECK_CLOSE(times[0], 1, eps);
+        BOOST_CHECK_EQUAL(surfaces[0], Simulation3D::LEFT_SPHERE);
+        // Straight through the mouth to the gate plane
+        BOOST_CHECK_CLOSE(times[1], -sim.bridge_length / 2 - c, eps);
+        BOOST_CHECK_EQUAL(surfaces[1], Simulation3D::PLANE);
+        // From the axis to the cylinder wall
+        BOOST_CHECK_CLOSE(times[2], 0.2, eps);
+        BOOST_CHECK_EQUAL(surfaces[2], Simulation3D::CYLINDER);
+        // Away from the channel, off-axis
+        BOOST_CHECK_CLOSE(times[3], std::sqrt(0.75), eps);
+        BOOST_CHECK_EQUAL(surfaces[3], Simulation3D::LEFT_SPHERE);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_mass_spread) {
+        auto sim = get_sim3d(1000);
+        sim.start(0.25);
+        BOOST_CHECK_CLOSE(sim.get_mass_spread(), 0.5, eps);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_dynamics_stay_in_domain) {
+        for (bool random_dir: {false, true}) {
+            auto sim = get_sim3d(300);
+            sim.explosion_direction_is_random = random_dir;
+            sim.start(0.75);
+            double last_time = 0;
+            for (int step = 0; step < 50000; step++) {
+                sim.update();
+                BOOST_REQUIRE(sim.time >= last_time);
+                last_time = sim.time;
+                BOOST_REQUIRE(sim.gate_contents[sim.LEFT].size() <= 2);
+                BOOST_REQUIRE(sim.gate_contents[sim.RIGHT].size() <= 2);
+            }
+            unsigned long in_left = 0;
+            for (int particle = 0; particle < sim.num_particles; particle++) {
+                double x, y, z;
+                sim.get_position_at(particle, sim.time, x, y, z);
+                const double dx = std::fabs(x) - sim.right_center_x;
+                const bool in_sphere = dx * dx + y * y + z * z <= 1 + 1E-8;
+                BOOST_REQUIRE(in_sphere or sim.is_in_bridge(x, y, z));
+                BOOST_REQUIRE_CLOSE(std::pow(sim.x_dirs[particle], 2) + std::pow(sim.y_dirs[particle], 2) +
+                                    std::pow(sim.z_dirs[particle], 2), 1, 1E-6);
+                in_left += sim.x_pos[particle] <= 0;
+            }
+            BOOST_CHECK_EQUAL(in_left, sim.in_left);
+            BOOST_CHECK(sim.current_counters[sim.FROM_LEFT_TO_RIGHT_INNER] > 0);
+            BOOST_CHECK_EQUAL(sim.get_num_resets(), 0);
+        }
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+#include <boost/test/unit_test.hpp>
+#include "telemetry.h"
+#include <fstream>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+BOOST_AUTO_TEST_SUITE(test_telemetry)
+
+    std::string get_field(const std::string &statistics, const std::string &name) {
+        const std::size_t start = statistics.find("\"" + name + "\": ") + name.size() + 4;
+        return statistics.substr(start, statistics.find_first_of(",\n", start) - start);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_points_and_remaining_events) {
+        SweepTelemetry telemetry(2, {100, 200, 300});
+        telemetry.start_point(0, 0);
+        telemetry.start_point(1, 1);
+        telemetry.report_events(1, 50);
+        telemetry.finish_point(0, 100);
+        const std::string statistics = telemetry.get_statistics();
+        BOOST_CHECK_EQUAL(telemetry.get_points_done(), 1);
+        BOOST_CHECK_EQUAL(get_field(statistics, "points_remaining"), "2");
+        BOOST_CHECK_EQUAL(get_field(statistics, "events_done"), "150");
+        // Point 2 is not started, point 1 has 150 events to go
+        BOOST_CHECK_EQUAL(get_field(statistics, "events_remaining"), "450");
+        BOOST_CHECK(std::stod(get_field(statistics, "events_per_second")) > 0);
+        BOOST_CHECK(std::stod(get_field(statistics, "eta_seconds")) > 0);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_resident_memory) {
+        BOOST_CHECK(get_resident_memory() > 0);
+    }
+
+    BOOST_AUTO_TEST_CASE(test_stats_file_and_endpoint) {
+        const std::string stats_file = "test_sweep_stats.json";
+        const int port = 18000 + getpid() % 1000;
+        SweepTelemetry telemetry(1, {10});
+        telemetry.start_reporting(stats_file, port, 0.05);
+        telemetry.start_point(0, 0);
+        telemetry.finish_point(0, 10);
+        usleep(200000);
+        const int client = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t) port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        BOOST_REQUIRE_EQUAL(connect(client, (sockaddr *) &address, sizeof(address)), 0);
+        const std::string request = "GET / HTTP/1.0\r\n\r\n";
+        send(client, request.data(), request.size(), 0);
+        std::string response;
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, (std::size_t) received);
+        }
+        close(client);
+        BOOST_CHECK(response.find("200 OK") != std::string::npos);
+        BOOST_CHECK_EQUAL(get_field(response, "points_done"), "1");
+        telemetry.stop_reporting();
+        std::ifstream file(stats_file);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        BOOST_CHECK_EQUAL(get_field(contents.str(), "points_remaining"), "0");
+        std::remove(stats_file.c_str());
+    }
+
+    BOOST_AUTO_TEST_CASE(test_busy_port_keeps_stats_file) {
+        const std::string stats_file = "test_sweep_stats_busy.json";
+        const int port = 19000 + getpid() % 1000;
+        // Occupy the port, so the telemetry can not listen on it
+        const int blocker = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t) port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        BOOST_REQUIRE_EQUAL(bind(blocker, (sockaddr *) &address, sizeof(address)), 0);
+        BOOST_REQUIRE_EQUAL(listen(blocker, 1), 0);
+        SweepTelemetry telemetry(1, {10});
+        telemetry.start_reporting(stats_file, port, 0.05);
+        telemetry.start_point(0, 0);
+        telemetry.finish_point(0, 10);
+        telemetry.stop_reporting();
+        close(blocker);
+        std::ifstream file(stats_file);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        BOOST_CHECK_EQUAL(get_field(contents.str(), "points_done"), "1");
+        std::remove(stats_file.c_str());
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,40 @@
+#include <iostream>
+#include <string>
+#include "simulation3d.h"
+
+/**
+ * This file contains an executable for the three-dimensional urn model: two spheres of unit radius connected by a
+ * cylindrical channel. It prints the mass spread averaged from the transient time to the final time,
+ * analogous to the single channel runs:
+ *
+ *     ./three_dimensional <channel_length> <channel_diameter> <threshold> <num_particles> <M_t> <M_f>
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc != 7) {
+        throw std::invalid_argument(
+                "Please provide (in order) channel length, channel diameter, threshold, number of particles, "
+                "transient collisions and final collisions");
+    }
+    const double channel_length = std::stod(argv[1]);
+    const double channel_width = std::stod(argv[2]);
+    const int threshold = std::stoi(argv[3]);
+    const int num_particles = std::stoi(argv[4]);
+    const auto M_t = (unsigned long) std::stod(argv[5]);
+    const auto M_f = (unsigned long) std::stod(argv[6]);
+    Simulation3D sim(num_particles, channel_width, 1, channel_length, threshold, threshold);
+    sim.distance_as_channel_length = true;
+    sim.setup();
+    sim.start(0.75);
+    while (sim.num_collisions < M_t) {
+        sim.update();
+    }
+    const double weight = 1. / (double) (M_f - M_t);
+    double mass_spread = 0;
+    while (sim.num_collisions < M_f) {
+        sim.update();
+        mass_spread += weight * sim.get_mass_spread();
+    }
+    printf("%.4f %.4f %d %d %.4f\n", channel_length, channel_width, threshold, num_particles, mass_spread);
+    return 0;
+}
@@ -0,0 +1,494 @@
+#include "trajectory.h"
+
+static const char MAGIC[4] = {'P', 'T', 'R', 'J'};
+const uint32_t TrajectoryHeader::VERSION;
+const uint32_t TrajectoryHeader::RAW;
+const uint32_t TrajectoryHeader::QUANTIZED_DELTA;
+// Quotients of the Rice code from this value on are escaped, and followed by the 16-bit value
+static const unsigned RICE_ESCAPE = 32;
+
+template<typename T>
+static void write_value(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool read_value(std::ifstream &file, T &value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+TrajectoryHeader TrajectoryHeader::from_simulation(const Simulation &simulation) {
+    TrajectoryHeader header;
+    header.num_particles = (uint32_t) simulation.num_particles;
+    header.circle_radius = simulation.circle_radius;
+    header.circle_distance = simulation.circle_distance;
+    header.bridge_width = simulation.bridge_width;
+    header.bridge_length = simulation.bridge_length;
+    header.second_width = simulation.second_width;
+    header.second_length = simulation.second_length;
+    header.box_x_radius = simulation.box_x_radius;
+    header.box_y_radius = simulation.box_y_radius;
+    header.gate_is_flat = simulation.gate_is_flat;
+    return header;
+}
+
+Simulation TrajectoryHeader::make_geometry() const {
+    Simulation geometry(0, bridge_width, circle_radius, circle_distance);
+    geometry.gate_is_flat = gate_is_flat;
+    geometry.bridge_length = bridge_length;
+    geometry.second_width = second_width;
+    geometry.second_length = second_length;
+    geometry.box_x_radius = box_x_radius;
+    geometry.box_y_radius = box_y_radius;
+    geometry.left_center_x = -circle_distance / 2 - circle_radius;
+    geometry.right_center_x = circle_distance / 2 + circle_radius;
+    return geometry;
+}
+
+TrajectoryFilter TrajectoryFilter::tagged(const std::vector<unsigned long> &particles) {
+    TrajectoryFilter filter;
+    filter.selection = TAGGED;
+    filter.particles = particles;
+    std::sort(filter.particles.begin(), filter.particles.end());
+    return filter;
+}
+
+TrajectoryFilter TrajectoryFilter::region(Selection selection) {
+    if (selection != GATES and selection != BRIDGE and selection != SECOND_BRIDGE) {
+        throw std::invalid_argument("A region filter selects the gates, the bridge or the second bridge");
+    }
+    TrajectoryFilter filter;
+    filter.selection = selection;
+    return filter;
+}
+
+TrajectoryFilter TrajectoryFilter::window(double x_min, double x_max, double y_min, double y_max) {
+    if (x_min > x_max or y_min > y_max) {
+        throw std::invalid_argument("A window filter needs its lower bounds below its upper bounds");
+    }
+    TrajectoryFilter filter;
+    filter.selection = WINDOW;
+    filter.bounds[0] = x_min;
+    filter.bounds[1] = x_max;
+    filter.bounds[2] = y_min;
+    filter.bounds[3] = y_max;
+    return filter;
+}
+
+TrajectoryFilter TrajectoryFilter::parse(const std::string &description) {
+    const std::size_t colon = description.find(':');
+    const std::string name = description.substr(0, colon);
+    std::vector<double> values;
+    if (colon != std::string::npos) {
+        std::istringstream stream(description.substr(colon + 1));
+        std::string value;
+        while (std::getline(stream, value, ',')) {
+            values.push_back(std::stod(value));
+        }
+    }
+    if (name == "all") {
+        return TrajectoryFilter();
+    } else if (name == "gates") {
+        return region(GATES);
+    } else if (name == "bridge") {
+        return region(BRIDGE);
+    } else if (name == "second_bridge") {
+        return region(SECOND_BRIDGE);
+    } else if (name == "tagged" and not values.empty()) {
+        return tagged(std::vector<unsigned long>(values.begin(), values.end()));
+    } else if (name == "window" and values.size() == 4) {
+        return window(values[0], values[1], values[2], values[3]);
+    }
+    throw std::invalid_argument("Unknown trajectory filter " + description + ", choose all, gates, bridge, "
+                                "second_bridge, tagged:<i>,<j>,... or window:<x_min>,<x_max>,<y_min>,<y_max>");
+}
+
+bool TrajectoryFilter::accepts(const Simulation &simulation, unsigned long particle, double x, double y) const {
+    switch (selection) {
+        case ALL:
+            return true;
+        case TAGGED:
+            return std::binary_search(particles.begin(), particles.end(), particle);
+        case GATES:
+            return simulation.is_in_gate(x, y, simulation.LEFT) or simulation.is_in_gate(x, y, simulation.RIGHT);
+        case BRIDGE:
+            return simulation.is_in_bridge(x, y);
+        case SECOND_BRIDGE:
+            return simulation.is_in_second_bridge(x, y);
+        default:
+            return x >= bounds[0] and x <= bounds[1] and y >= bounds[2] and y <= bounds[3];
+    }
+}
+
+TrajectoryFrame TrajectoryFrame::from_simulation(const Simulation &simulation, double t,
+                                                 const TrajectoryFilter &filter) {
+    TrajectoryFrame frame;
+    frame.time = t;
+    frame.x.resize(simulation.num_particles);
+    frame.y.resize(simulation.num_particles);
+    frame.directions.resize(simulation.num_particles);
+    simulation.snapshot(t, frame.x.data(), frame.y.data(), frame.directions.data());
+    if (filter.selection == TrajectoryFilter::ALL) {
+        return frame;
+    }
+    // Compact the selected particles to the front
+    std::size_t kept = 0;
+    for (uint32_t particle = 0; particle < frame.x.size(); particle++) {
+        if (filter.accepts(simulation, particle, frame.x[particle], frame.y[particle])) {
+            frame.x[kept] = frame.x[particle];
+            frame.y[kept] = frame.y[particle];
+            frame.directions[kept] = frame.directions[particle];
+            frame.indices.push_back(particle);
+            kept++;
+        }
+    }
+    frame.x.resize(kept);
+    frame.y.resize(kept);
+    frame.directions.resize(kept);
+    return frame;
+}
+
+std::size_t TrajectoryFrame::size() const {
+    return x.size();
+}
+
+/**
+ * Appends bits to a byte buffer, most significant bit first.
+ */
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t> &bytes) : bytes(bytes) {}
+
+    void write(uint32_t value, unsigned num_bits) {
+        for (unsigned bit = num_bits; bit > 0; bit--) {
+            write_bit((value >> (bit - 1)) & 1u);
+        }
+    }
+
+    void write_bit(unsigned bit) {
+        if (used == 0) {
+            bytes.push_back(0);
+        }
+        bytes.back() |= (uint8_t) (bit << (7 - used));
+        used = (used + 1) % 8;
+    }
+
+private:
+    std::vector<uint8_t> &bytes;
+    unsigned used = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const std::vector<uint8_t> &bytes, std::size_t position) : bytes(bytes), position(8 * position) {}
+
+    uint32_t read(unsigned num_bits) {
+        uint32_t value = 0;
+        for (unsigned bit = 0; bit < num_bits; bit++) {
+            value = (value << 1) | read_bit();
+        }
+        return value;
+    }
+
+    unsigned read_bit() {
+        if (position >= 8 * bytes.size()) {
+            throw std::invalid_argument("Coded trajectory frame ends prematurely");
+        }
+        const unsigned bit = (bytes[position / 8] >> (7 - position % 8)) & 1u;
+        position++;
+        return bit;
+    }
+
+private:
+    const std::vector<uint8_t> &bytes;
+    std::size_t position;
+};
+
+QuantizedDeltaCodec::QuantizedDeltaCodec(const TrajectoryHeader &header)
+        : num_particles(header.num_particles), indexed(header.indexed) {
+    offsets[0] = -header.box_x_radius;
+    offsets[1] = -header.box_y_radius;
+    offsets[2] = 0;
+    steps[0] = 2 * header.box_x_radius / 65535;
+    steps[1] = 2 * header.box_y_radius / 65535;
+    steps[2] = 2 * M_PI / 65536;
+}
+
+uint16_t QuantizedDeltaCodec::quantize(double value, unsigned coordinate) const {
+    const long level = std::lround((value - offsets[coordinate]) / steps[coordinate]);
+    if (coordinate == 2) {
+        // Directions wrap around
+        return (uint16_t) (((level % 65536) + 65536) % 65536);
+    }
+    return (uint16_t) std::min(std::max(level, 0l), 65535l);
+}
+
+double QuantizedDeltaCodec::dequantize(uint16_t value, unsigned coordinate) const {
+    return offsets[coordinate] + value * steps[coordinate];
+}
+
+double QuantizedDeltaCodec::get_position_error() const {
+    return std::max(steps[0], steps[1]) / 2;
+}
+
+double QuantizedDeltaCodec::get_direction_error() const {
+    return steps[2] / 2;
+}
+
+void QuantizedDeltaCodec::encode(const TrajectoryFrame &frame, std::vector<uint8_t> &bytes) {
+    const std::vector<double> *values[3] = {&frame.x, &frame.y, &frame.directions};
+    bytes.assign(3, 0);
+    std::vector<uint16_t> codes[3];
+    for (unsigned coordinate = 0; coordinate < 3; coordinate++) {
+        const std::size_t slots = indexed ? num_particles : frame.size();
+        if (previous[coordinate].size() != slots) {
+            previous[coordinate].assign(slots, 0);
+        }
+        // Differences modulo 2^16, read as signed and zigzagged, so small steps either way give small codes
+        double mean = 0;
+        codes[coordinate].resize(frame.size());
+        for (std::size_t particle = 0; particle < frame.size(); particle++) {
+            const uint16_t level = quantize(values[coordinate]->at(particle), coordinate);
+            uint16_t &last = previous[coordinate].at(frame.indices.empty() ? particle : frame.indices[particle]);
+            const auto delta = (int16_t) (uint16_t) (level - last);
+            codes[coordinate][particle] = (uint16_t) (delta >= 0 ? 2 * delta : -2 * delta - 1);
+            last = level;
+            mean += codes[coordinate][particle];
+        }
+        mean /= std::max((std::size_t) 1, frame.size());
+        // A Rice parameter near the log of the mean code is close to optimal for geometric distributions
+        unsigned k = 0;
+        while (k < 15 and (1u << (k + 1)) <= mean) {
+            k++;
+        }
+        bytes[coordinate] = (uint8_t) k;
+    }
+    BitWriter writer(bytes);
+    for (unsigned coordinate = 0; coordinate < 3; coordinate++) {
+        const unsigned k = bytes[coordinate];
+        for (uint16_t code: codes[coordinate]) {
+            const uint32_t quotient = code >> k;
+            if (quotient >= RICE_ESCAPE) {
+                writer.write(~0u, RICE_ESCAPE);
+                writer.write(code, 16);
+            } else {
+                writer.write((1u << quotient) - 1, quotient);
+                writer.write_bit(0);
+                writer.write(code & ((1u << k) - 1), k);
+            }
+        }
+    }
+}
+
+void QuantizedDeltaCodec::decode(const std::vector<uint8_t> &bytes, uint32_t count, TrajectoryFrame &frame) {
+    if (bytes.size() < 3) {
+        throw std::invalid_argument("Coded trajectory frame ends prematurely");
+    }
+    std::vector<double> *values[3] = {&frame.x, &frame.y, &frame.directions};
+    BitReader reader(bytes, 3);
+    for (unsigned coordinate = 0; coordinate < 3; coordinate++) {
+        const unsigned k = bytes[coordinate];
+        const std::size_t slots = indexed ? num_particles : count;
+        if (previous[coordinate].size() != slots) {
+            previous[coordinate].assign(slots, 0);
+        }
+        values[coordinate]->resize(count);
+        for (uint32_t particle = 0; particle < count; particle++) {
+            uint32_t quotient = 0;
+            while (quotient < RICE_ESCAPE and reader.read_bit()) {
+                quotient++;
+            }
+            const uint32_t code = quotient == RICE_ESCAPE ? reader.read(16) : (quotient << k) | reader.read(k);
+            const auto delta = (uint16_t) (code % 2 == 0 ? (int) code / 2 : -(int) (code + 1) / 2);
+            uint16_t &last = previous[coordinate].at(frame.indices.empty() ? particle : frame.indices[particle]);
+            last = (uint16_t) (last + delta);
+            values[coordinate]->at(particle) = dequantize(last, coordinate);
+        }
+    }
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string &filename, const TrajectoryHeader &header)
+        : header(header), codec(header) {
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (not file) {
+        throw std::invalid_argument("Can not open trajectory file " + filename);
+    }
+    file.write(MAGIC, sizeof(MAGIC));
+    write_value(file, TrajectoryHeader::VERSION);
+    write_value(file, header.codec);
+    write_value(file, header.num_particles);
+    for (double value: {header.circle_radius, header.circle_distance, header.bridge_width, header.bridge_length,
+                        header.second_width, header.second_length, header.box_x_radius, header.box_y_radius}) {
+        write_value(file, value);
+    }
+    write_value(file, (uint8_t) header.gate_is_flat);
+    write_value(file, (uint8_t) header.indexed);
+}
+
+void TrajectoryWriter::write_frame(const TrajectoryFrame &frame) {
+    const auto count = (uint32_t) frame.size();
+    write_value(file, frame.time);
+    write_value(file, count);
+    if (header.indexed) {
+        std::vector<uint32_t> indices = frame.indices;
+        if (indices.empty()) {
+            indices.resize(count);
+            std::iota(indices.begin(), indices.end(), 0);
+        }
+        file.write(reinterpret_cast<const char *>(indices.data()), count * sizeof(uint32_t));
+    } else if (not frame.indices.empty()) {
+        throw std::invalid_argument("Frames with a subset of the particles need an indexed trajectory header");
+    }
+    if (header.codec == TrajectoryHeader::QUANTIZED_DELTA) {
+        codec.encode(frame, buffer);
+        write_value(file, (uint32_t) buffer.size());
+        file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+        frames_written++;
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(frame.x.data()), count * sizeof(double));
+    file.write(reinterpret_cast<const char *>(frame.y.data()), count * sizeof(double));
+    file.write(reinterpret_cast<const char *>(frame.directions.data()), count * sizeof(double));
+    frames_written++;
+}
+
+void TrajectoryWriter::write_frame(const Simulation &simulation, double t) {
+    write_frame(TrajectoryFrame::from_simulation(simulation, t));
+}
+
+void TrajectoryWriter::write_frame(const Simulation &simulation, double t, const TrajectoryFilter &filter) {
+    write_frame(TrajectoryFrame::from_simulation(simulation, t, filter));
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &filename) {
+    file.open(filename, std::ios::binary);
+    if (not file) {
+        throw std::invalid_argument("Can not open trajectory file " + filename);
+    }
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    is_binary = file and std::equal(magic, magic + 4, MAGIC);
+    if (not is_binary) {
+        file.clear();
+        file.seekg(0);
+        read_text_header();
+        return;
+    }
+    uint32_t version;
+    read_value(file, version);
+    // Version 1 files have no indexed flag
+    if (version != 1 and version != TrajectoryHeader::VERSION) {
+        throw std::invalid_argument("Unsupported trajectory version in " + filename);
+    }
+    read_value(file, header.codec);
+    read_value(file, header.num_particles);
+    for (double *value: {&header.circle_radius, &header.circle_distance, &header.bridge_width, &header.bridge_length,
+                         &header.second_width, &header.second_length, &header.box_x_radius, &header.box_y_radius}) {
+        read_value(file, *value);
+    }
+    uint8_t flat;
+    read_value(file, flat);
+    header.gate_is_flat = flat != 0;
+    uint8_t indexed = 0;
+    if (version > 1) {
+        read_value(file, indexed);
+    }
+    header.indexed = indexed != 0;
+    if (header.codec == TrajectoryHeader::QUANTIZED_DELTA) {
+        codec.reset(new QuantizedDeltaCodec(header));
+    } else if (header.codec != TrajectoryHeader::RAW) {
+        throw std::invalid_argument("Unsupported trajectory codec in " + filename);
+    }
+}
+
+void TrajectoryReader::read_text_header() {
+    /**
+     * The text header only holds the parameters written by `Simulation::write_positions_to_file`.
+     * The box size is not part of it, so it is reconstructed assuming the circle distance was taken as channel length,
+     * which is how all runs with a back channel are configured.
+     */
+    std::string names_line, values_line;
+    std::getline(file, names_line);
+    std::getline(file, values_line);
+    std::istringstream values(values_line);
+    double num_particles;
+    values >> num_particles >> header.circle_radius >> header.circle_distance >> header.bridge_width
+           >> header.bridge_length >> header.second_width >> header.second_length;
+    if (not values) {
+        throw std::invalid_argument("Trajectory file has no valid header");
+    }
+    header.num_particles = (uint32_t) num_particles;
+    // Files written with an output filter have an extra column
+    int indexed = 0;
+    header.indexed = values >> indexed and indexed != 0;
+    header.gate_is_flat = true;
+    header.box_y_radius = header.circle_radius;
+    header.box_x_radius = header.circle_distance / 2 + 2 * header.circle_radius;
+    if (header.second_width > 0) {
+        const double second_discrepancy = 2 * header.circle_radius - 2 * std::sqrt(
+                std::pow(header.circle_radius, 2) - std::pow(header.second_width, 2) / 4);
+        header.box_x_radius += (header.second_length - second_discrepancy) / 2;
+    }
+}
+
+bool TrajectoryReader::read_frame(TrajectoryFrame &frame) {
+    if (is_binary) {
+        uint32_t count;
+        if (not read_value(file, frame.time) or not read_value(file, count)) {
+            return false;
+        }
+        frame.indices.resize(header.indexed ? count : 0);
+        if (header.indexed and
+            not file.read(reinterpret_cast<char *>(frame.indices.data()), count * sizeof(uint32_t))) {
+            return false;
+        }
+        if (codec) {
+            uint32_t size;
+            if (not read_value(file, size)) {
+                return false;
+            }
+            buffer.resize(size);
+            if (not file.read(reinterpret_cast<char *>(buffer.data()), size)) {
+                return false;
+            }
+            codec->decode(buffer, count, frame);
+            return true;
+        }
+        frame.x.resize(count);
+        frame.y.resize(count);
+        frame.directions.resize(count);
+        file.read(reinterpret_cast<char *>(frame.x.data()), count * sizeof(double));
+        file.read(reinterpret_cast<char *>(frame.y.data()), count * sizeof(double));
+        file.read(reinterpret_cast<char *>(frame.directions.data()), count * sizeof(double));
+        return static_cast<bool>(file);
+    }
+    std::string line;
+    if (not std::getline(file, line) or line.empty()) {
+        return false;
+    }
+    frame.time = std::stod(line);
+    for (std::vector<double> *values: {&frame.x, &frame.y, &frame.directions}) {
+        values->clear();
+        values->reserve(header.num_particles);
+        if (not std::getline(file, line)) {
+            return false;
+        }
+        std::istringstream stream(line);
+        double value;
+        while (stream >> value) {
+            values->push_back(value);
+        }
+    }
+    frame.indices.clear();
+    if (header.indexed) {
+        if (not std::getline(file, line)) {
+            return false;
+        }
+        std::istringstream stream(line);
+        uint32_t index;
+        while (stream >> index) {
+            frame.indices.push_back(index);
+        }
+    }
+    return true;
+}
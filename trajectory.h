@@ -0,0 +1,243 @@
+#ifndef TERRIER_TRAJECTORY_H
+#define TERRIER_TRAJECTORY_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+/**
+ * Binary trajectory files.
+ * The text format of `Simulation::write_positions_to_file` is easy to read, but grows quickly for large systems
+ * and is slow to parse. A binary trajectory file stores the same information: a header with the geometry,
+ * followed by frames with the interpolated positions and directions of the particles.
+ */
+
+/**
+ * Geometry of the system a trajectory was recorded in.
+ * All values are the computed quantities of a simulation after `Simulation::setup`.
+ */
+struct TrajectoryHeader {
+    static const uint32_t VERSION = 2;
+    static const uint32_t RAW = 0;
+    // 16-bit fixed point, delta-encoded against the previous frame and Rice coded, see `QuantizedDeltaCodec`
+    static const uint32_t QUANTIZED_DELTA = 1;
+    uint32_t codec = RAW;
+    uint32_t num_particles = 0;
+    double circle_radius = 0;
+    double circle_distance = 0;
+    double bridge_width = 0;
+    double bridge_length = 0;
+    double second_width = 0;
+    double second_length = 0;
+    double box_x_radius = 0;
+    double box_y_radius = 0;
+    bool gate_is_flat = false;
+    // Whether every frame lists the indices of its particles, see `TrajectoryFilter`
+    bool indexed = false;
+
+    /**
+     * Copy the geometry of a simulation that has been set up.
+     * @param simulation Simulation
+     * @return Header describing the geometry
+     */
+    static TrajectoryHeader from_simulation(const Simulation &simulation);
+
+    /**
+     * Create a simulation object with this geometry. It is not set up and not started; it only serves
+     * to query the geometry (`is_in_domain`, `is_in_gate`, ...).
+     * @return Simulation without particles
+     */
+    Simulation make_geometry() const;
+};
+
+/**
+ * Selects the particles that go into a trajectory, so that animations of large systems only store what is looked at:
+ * a fixed set of tagged particles, the particles that are in a part of the domain at the time of the frame,
+ * or the particles in a rectangular window.
+ */
+class TrajectoryFilter {
+public:
+    enum Selection {
+        ALL, TAGGED, GATES, BRIDGE, SECOND_BRIDGE, WINDOW
+    };
+
+    // Filter that selects all particles
+    TrajectoryFilter() = default;
+
+    static TrajectoryFilter tagged(const std::vector<unsigned long> &particles);
+
+    /**
+     * @param selection GATES, BRIDGE or SECOND_BRIDGE
+     */
+    static TrajectoryFilter region(Selection selection);
+
+    static TrajectoryFilter window(double x_min, double x_max, double y_min, double y_max);
+
+    /**
+     * Parse a filter from the command line: `all`, `gates`, `bridge`, `second_bridge`,
+     * `tagged:<i>,<j>,...` or `window:<x_min>,<x_max>,<y_min>,<y_max>`.
+     */
+    static TrajectoryFilter parse(const std::string &description);
+
+    /**
+     * @param simulation Simulation the particle belongs to, for the geometry
+     * @param particle Particle index
+     * @param x Position of the particle
+     * @param y Position of the particle
+     * @return Whether the particle goes into the trajectory
+     */
+    bool accepts(const Simulation &simulation, unsigned long particle, double x, double y) const;
+
+    Selection selection = ALL;
+
+private:
+    // Sorted tagged particles
+    std::vector<unsigned long> particles;
+    double bounds[4] = {0, 0, 0, 0};
+};
+
+/**
+ * Positions and directions of the particles at a single point in time.
+ */
+struct TrajectoryFrame {
+    double time = 0;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> directions;
+    // Particle index of every entry; empty if the frame holds all particles in order
+    std::vector<uint32_t> indices;
+
+    /**
+     * Interpolate the positions of the particles in a simulation at time `t`.
+     * @param simulation Running simulation
+     * @param t Time between the current time and the next impact of the simulation
+     * @param filter Particles to include; unless it selects all particles, the frame lists their indices
+     * @return Frame with the selected particles
+     */
+    static TrajectoryFrame from_simulation(const Simulation &simulation, double t,
+                                           const TrajectoryFilter &filter = TrajectoryFilter());
+
+    std::size_t size() const;
+};
+
+/**
+ * Lossy codec for frames: positions are stored as 16-bit fixed point numbers on the bounding box of the system and
+ * directions as 16-bit fractions of a full turn. Every value is stored as the difference with the (quantised)
+ * value in the previous frame, so the errors do not accumulate. Particles move little between two frames, so
+ * the differences are small, and they are Rice coded with a parameter per frame and coordinate.
+ * Differences that are too large for the Rice code (e.g. directions after a bounce) are escaped and stored raw.
+ * A frame with a different number of particles than the previous one is coded against zero.
+ *
+ * A decoded position differs at most half a quantisation step (see `get_position_error`) from the original,
+ * a decoded direction at most `get_direction_error` modulo 2 pi. Decoded directions lie in [0, 2 pi).
+ */
+class QuantizedDeltaCodec {
+public:
+    explicit QuantizedDeltaCodec(const TrajectoryHeader &header);
+
+    /**
+     * Encode a frame, against the previous frame encoded with this codec.
+     * The values of an indexed frame are coded against the last values of the same particles.
+     * @param frame Frame with positions inside the bounding box of the header
+     * @param bytes Output, the coded positions and directions (not the time)
+     */
+    void encode(const TrajectoryFrame &frame, std::vector<uint8_t> &bytes);
+
+    /**
+     * Decode a frame, against the previous frame decoded with this codec.
+     * @param bytes Output of `encode`
+     * @param count Number of particles in the frame
+     * @param frame Output; its time and indices are left alone, and the indices must have been read already
+     */
+    void decode(const std::vector<uint8_t> &bytes, uint32_t count, TrajectoryFrame &frame);
+
+    /**
+     * @return Largest difference between an original and a decoded coordinate
+     */
+    double get_position_error() const;
+
+    /**
+     * @return Largest difference between an original and a decoded direction, modulo 2 pi
+     */
+    double get_direction_error() const;
+
+private:
+    uint16_t quantize(double value, unsigned coordinate) const;
+
+    double dequantize(uint16_t value, unsigned coordinate) const;
+
+    // Offset and step of x, y and direction
+    double offsets[3];
+    double steps[3];
+    // Quantised values of the previous frame per coordinate; per particle for indexed trajectories, so that a
+    // particle that drops out of the selection, even for an empty frame, continues from its last value
+    std::vector<uint16_t> previous[3];
+    const uint32_t num_particles;
+    const bool indexed;
+};
+
+class TrajectoryWriter {
+public:
+    /**
+     * Open a binary trajectory file for writing and write the header.
+     * @param filename Name of the file, overwritten if it exists
+     * @param header Geometry of the system
+     */
+    TrajectoryWriter(const std::string &filename, const TrajectoryHeader &header);
+
+    void write_frame(const TrajectoryFrame &frame);
+
+    /**
+     * Convenience method for writing a frame straight from the engine.
+     * @param simulation Running simulation
+     * @param t Time at which the positions are interpolated
+     */
+    void write_frame(const Simulation &simulation, double t);
+
+    /**
+     * Write the particles of a simulation that pass a filter. The header must be indexed.
+     * @param simulation Running simulation
+     * @param t Time at which the positions are interpolated
+     * @param filter Particles to write
+     */
+    void write_frame(const Simulation &simulation, double t, const TrajectoryFilter &filter);
+
+    unsigned long frames_written = 0;
+
+private:
+    std::ofstream file;
+    TrajectoryHeader header;
+    QuantizedDeltaCodec codec;
+    std::vector<uint8_t> buffer;
+};
+
+class TrajectoryReader {
+public:
+    /**
+     * Open a trajectory file. Both the binary format and the text format of
+     * `Simulation::write_positions_to_file` (results.dat) are understood.
+     * @param filename Name of the file
+     */
+    explicit TrajectoryReader(const std::string &filename);
+
+    /**
+     * Read the next frame.
+     * @param frame output variable
+     * @return false if the end of the file is reached, true otherwise
+     */
+    bool read_frame(TrajectoryFrame &frame);
+
+    TrajectoryHeader header;
+    bool is_binary;
+
+private:
+    void read_text_header();
+
+    std::ifstream file;
+    std::unique_ptr<QuantizedDeltaCodec> codec;
+    std::vector<uint8_t> buffer;
+};
+
+#endif //TERRIER_TRAJECTORY_H
@@ -1,4 +1,6 @@
 #!/usr/bin/env python3
+import struct
+import sys
 import tkinter
 import numpy as np
 import random
@@ -163,9 +165,9 @@ class VisualScene:
         :return: None
         """
         start_pos_array, end_pos_array = self.get_visual_pedestrian_coordinates()
-        for index in range(self.data_reader.num_particles):
+        for index, particle in enumerate(self.data_reader.indices):
             self.canvas.create_oval(start_pos_array[index, 0], start_pos_array[index, 1],
-                                    end_pos_array[index, 0], end_pos_array[index, 1], fill=self.colors[index])
+                                    end_pos_array[index, 0], end_pos_array[index, 1], fill=self.colors[particle])
 
     def get_visual_pedestrian_coordinates(self):
         """
@@ -238,6 +240,7 @@ class DataReader:
         self.num_particles = self.gate_radius = self.circle_radius = 0
         self.circle_distance = self.bridge_width = self.bridge_length = 0
         self.second_width = self.second_length = 0
+        self.indexed = 0
         self.read_parameters()
         self.box_radius = np.array(
             [self.circle_radius * 4 + self.circle_distance + self.second_length * 0.97, self.circle_radius * 2]) / 2
@@ -245,6 +248,7 @@ class DataReader:
         self.times = []
         self.positions = np.zeros((self.num_particles, 2))
         self.directions = np.zeros(self.num_particles)
+        self.indices = np.arange(self.num_particles)
         self.counter = 0
         self.dt = 0.01
         self.time = 0
@@ -267,7 +271,12 @@ class DataReader:
             raw_pos_x = self.file.readline().strip().split(' ')
             raw_pos_y = self.file.readline().strip().split(' ')
             raw_dirs = self.file.readline().strip().split(' ')
-            for i in range(self.num_particles):
+            if self.indexed:
+                # Only the particles that passed the output filter are in the frame
+                self.indices = np.array([int(index) for index in self.file.readline().split()], dtype=int)
+                self.positions = np.zeros((len(self.indices), 2))
+                self.directions = np.zeros(len(self.indices))
+            for i in range(len(self.indices)):
                 self.positions[i, 0] = float(raw_pos_x[i])
                 self.positions[i, 1] = float(raw_pos_y[i])
                 self.directions[i] = float(raw_dirs[i])
@@ -276,7 +285,106 @@ class DataReader:
             self.time = -1
 
 
+class BinaryDataReader:
+    """
+    Reads the binary trajectory files of `TrajectoryWriter` (trajectory.h), both raw and quantized.
+    Offers the same attributes as `DataReader`.
+    """
+    RAW = 0
+    QUANTIZED_DELTA = 1
+    RICE_ESCAPE = 32
+
+    def __init__(self, filename):
+        self.filename = filename
+        self.file = open(self.filename, 'rb')
+        magic, version, self.codec, self.num_particles = struct.unpack('<4sIII', self.file.read(16))
+        if magic != b'PTRJ' or version not in (1, 2) or self.codec not in (self.RAW, self.QUANTIZED_DELTA):
+            print("Cannot read %s: not a supported trajectory file" % filename)
+            exit(1)
+        (self.circle_radius, self.circle_distance, self.bridge_width, self.bridge_length, self.second_width,
+         self.second_length, box_x_radius, box_y_radius) = struct.unpack('<8d', self.file.read(64))
+        self.file.read(1)
+        self.indexed = version > 1 and self.file.read(1) != b'\x00'
+        self.gate_radius = 0
+        self.box_radius = np.array([box_x_radius, box_y_radius])
+        self.size = self.box_radius * 1.1
+        # Quantization of x, y and direction, as in `QuantizedDeltaCodec`
+        self.offsets = np.array([-box_x_radius, -box_y_radius, 0])
+        self.steps = np.array([2 * box_x_radius / 65535, 2 * box_y_radius / 65535, 2 * np.pi / 65536])
+        self.levels = np.zeros((3, self.num_particles), dtype=np.uint16)
+        self.indices = np.arange(self.num_particles)
+        self.times = []
+        self.positions = np.zeros((self.num_particles, 2))
+        self.directions = np.zeros(self.num_particles)
+        self.counter = 0
+        self.dt = 0.01
+        self.time = 0
+
+    def read_line(self):
+        header = self.file.read(12)
+        if len(header) < 12:
+            print("Simulation is done")
+            self.time = -1
+            return
+        self.time, count = struct.unpack('<dI', header)
+        self.times.append(self.time)
+        if self.indexed:
+            self.indices = np.frombuffer(self.file.read(4 * count), dtype='<u4').astype(int)
+        else:
+            self.indices = np.arange(count)
+        if self.codec == self.RAW:
+            values = np.frombuffer(self.file.read(24 * count), dtype='<f8').reshape(3, count)
+        else:
+            size, = struct.unpack('<I', self.file.read(4))
+            values = self.decode(self.file.read(size), count)
+        self.positions = values[:2].T.copy()
+        self.directions = values[2].copy()
+
+    def decode(self, payload, count):
+        """
+        Decode the Rice coded differences of a quantized frame and add them to the last levels of its particles.
+        """
+        slots = self.num_particles if self.indexed else count
+        if self.levels.shape[1] != slots:
+            self.levels = np.zeros((3, slots), dtype=np.uint16)
+        bits = np.unpackbits(np.frombuffer(payload[3:], dtype=np.uint8))
+        position = 0
+        for coordinate in range(3):
+            k = payload[coordinate]
+            codes = np.zeros(count, dtype=np.int64)
+            for particle in range(count):
+                quotient = 0
+                while quotient < self.RICE_ESCAPE and bits[position]:
+                    quotient += 1
+                    position += 1
+                if quotient == self.RICE_ESCAPE:
+                    width, code = 16, 0
+                else:
+                    # Skip the zero that ends the quotient
+                    position += 1
+                    width, code = k, quotient << k
+                remainder = 0
+                for bit in bits[position:position + width]:
+                    remainder = (remainder << 1) | int(bit)
+                position += width
+                codes[particle] = code | remainder
+            deltas = np.where(codes % 2 == 0, codes // 2, -(codes + 1) // 2)
+            self.levels[coordinate, self.indices] = (self.levels[coordinate, self.indices].astype(np.int64) + deltas) % 65536
+        return self.offsets[:, None] + self.levels[:, self.indices] * self.steps[:, None]
+
+
+def open_reader(filename=None):
+    """
+    Open a text (results.dat) or binary trajectory file.
+    """
+    if filename is not None:
+        with open(filename, 'rb') as file:
+            if file.read(4) == b'PTRJ':
+                return BinaryDataReader(filename)
+    return DataReader(filename)
+
+
 if __name__ == '__main__':
-    dr = DataReader()
+    dr = open_reader(sys.argv[1] if len(sys.argv) > 1 else None)
     vs = VisualScene(dr)
     vs.start()